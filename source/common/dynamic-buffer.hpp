@@ -9,9 +9,10 @@
 #define _NOVA_COMMON_DYNAMIC_BUFFER_HEADER_
 
 #include "exception.hpp"
+#include "platform.hpp"
 
-#include <vector>
 #include <cstdint>
+#include <cstring>
 
 namespace Nova {
 
@@ -19,68 +20,283 @@ namespace Nova {
 		class DynamicBufferConstIterator;
 	}
 	
+	/// <summary>
+	/// Growable block of bytes.
+	/// </summary>
+	/// <remarks>
+	/// <para>Small buffers, such as the code of tiny scopes, are stored inside the object; larger ones
+	/// are allocated aligned to InlineCapacity, so the values in them can be loaded directly. Moving a
+	/// buffer takes its storage, and Clear keeps it for the next use.</para>
+	/// <para>A buffer can also be a read-only view of memory owned by someone else, such as the code
+	/// region of a scope manager or a mapped file. Changing a view copies its data first, and copies of
+	/// a view own their data.</para>
+	/// </remarks>
 	class DynamicBuffer {
-		std::vector<std::int8_t> _data;
-
 	public:
 		typedef Internal::DynamicBufferConstIterator ConstIterator;
 
-		inline DynamicBuffer(
+		static const size_t InlineCapacity = 32;
+
+	private:
+		std::int8_t * _data;
+		size_t _size;
+
+		/// <summary>
+		/// Bytes available in the storage, or zero if the buffer is a view.
+		/// </summary>
+		size_t _capacity;
+		NOVA_ALIGN(16) std::int8_t _inline[InlineCapacity];
+
+		inline bool _IsHeap(
+			) const {
+				return _capacity != 0 && _data != _inline;
+			}
+
+		inline void _Release(
+			) {
+				if (_IsHeap())
+					AlignedFree(_data);
+				_data = _inline;
+				_size = 0;
+				_capacity = InlineCapacity;
+			}
+
+		/// <summary>
+		/// Moves the data to owned storage of at least the specified capacity.
+		/// </summary>
+		inline void _Reallocate(
+			size_t capacity
+			) {
+				if (capacity < _size)
+					capacity = _size;
+				std::int8_t * data = capacity <= InlineCapacity
+					? _inline : reinterpret_cast<std::int8_t *>(AlignedAllocate(capacity, InlineCapacity));
+				if (data == _data)
+					return;
+				if (_size != 0)
+					memmove(data, _data, _size);
+				if (_IsHeap())
+					AlignedFree(_data);
+				_data = data;
+				_capacity = data == _inline ? InlineCapacity : capacity;
+			}
+
+		inline void _Detach(
+			) {
+				if (_capacity == 0)
+					_Reallocate(_size);
+			}
+
+		inline void _Grow(
+			size_t size
+			) {
+				if (_capacity == 0 || size > _capacity)
+					_Reallocate(size > _capacity * 2 ? size : _capacity * 2);
+			}
+
+		inline void _Assign(
+			const void * ptr, size_t size
 			) {
+				_size = 0;
+				_Grow(size);
+				if (size != 0)
+					memcpy(_data, ptr, size);
+				_size = size;
+			}
+
+		inline void _Take(
+			DynamicBuffer & other
+			) {
+				if (other._data == other._inline) {
+					memcpy(_inline, other._inline, other._size);
+					_data = _inline;
+					_capacity = InlineCapacity;
+				} else {
+					_data = other._data;
+					_capacity = other._capacity;
+				}
+				_size = other._size;
+				other._data = other._inline;
+				other._size = 0;
+				other._capacity = InlineCapacity;
+			}
+
+	public:
+		inline DynamicBuffer(
+			)
+			: _data(_inline), _size(0), _capacity(InlineCapacity)
+			{
 			}
 
 		inline DynamicBuffer(
 			const DynamicBuffer & other
 			)
-			: _data(other._data)
+			: _data(_inline), _size(0), _capacity(InlineCapacity)
 			{
+				_Assign(other._data, other._size);
 			}
 
 		inline DynamicBuffer(
 			DynamicBuffer && other
 			)
-			: _data(other._data)
+			: _data(_inline), _size(0), _capacity(InlineCapacity)
 			{
+				_Take(other);
+			}
+
+		inline ~DynamicBuffer(
+			) {
+				_Release();
 			}
 
 		inline DynamicBuffer & operator = (
 			const DynamicBuffer & other
 			) {
-				_data = other._data;
+				if (this != &other) {
+					if (_capacity == 0)
+						_Release();
+					_Assign(other._data, other._size);
+				}
 				return * this;
 			}
 
 		inline DynamicBuffer & operator = (
 			DynamicBuffer && other
 			) {
-				_data = other._data;
+				if (this != &other) {
+					_Release();
+					_Take(other);
+				}
 				return * this;
 			}
 
+		/// <summary>
+		/// Creates a view of memory which must outlive the buffer and every buffer it's moved to.
+		/// </summary>
+		static inline DynamicBuffer CreateView(
+			const void * ptr, size_t size
+			) {
+				DynamicBuffer buffer;
+				buffer._data = const_cast<std::int8_t *>(reinterpret_cast<const std::int8_t *>(ptr));
+				buffer._size = size;
+				buffer._capacity = 0;
+				return buffer;
+			}
+
+		inline bool IsView(
+			) const {
+				return _capacity == 0;
+			}
+
 		inline DynamicBuffer & Push(
 			const void * ptr, size_t size
 			) {
-				const std::int8_t * bufferPtr = reinterpret_cast<const std::int8_t *>(ptr);
-				_data.insert(_data.end(), bufferPtr, bufferPtr + size);
+				// The data may come from the buffer itself, whose storage moves when it grows.
+				const std::int8_t * source = reinterpret_cast<const std::int8_t *>(ptr);
+				bool isInside = source >= _data && source < _data + _size;
+				size_t sourceOffset = isInside ? static_cast<size_t>(source - _data) : 0;
+				_Grow(_size + size);
+				if (isInside)
+					source = _data + sourceOffset;
+				if (size != 0)
+					memcpy(_data + _size, source, size);
+				_size += size;
+				return * this;
+			}
+
+		/// <summary>
+		/// Overwrites data already in the buffer, such as a placeholder written before its value was known.
+		/// </summary>
+		inline DynamicBuffer & Write(
+			const void * ptr, size_t offset, size_t size
+			) {
+				if (offset + size > _size)
+					throw RuntimeException("Not enough space to write.");
+				_Detach();
+				memcpy(_data + offset, ptr, size);
 				return * this;
 			}
 
+		/// <summary>
+		/// Changes the size of the buffer, so its contents can be written through GetPointer. New bytes
+		/// are zero.
+		/// </summary>
+		inline DynamicBuffer & Resize(
+			size_t size
+			) {
+				_Grow(size);
+				if (size > _size)
+					memset(_data + _size, 0, size - _size);
+				_size = size;
+				return * this;
+			}
+
+		/// <summary>
+		/// Makes room for the specified number of bytes, so pushing up to them doesn't allocate.
+		/// </summary>
+		inline DynamicBuffer & Reserve(
+			size_t capacity
+			) {
+				if (_capacity == 0 || capacity > _capacity)
+					_Reallocate(capacity);
+				return * this;
+			}
+
+		/// <summary>
+		/// Empties the buffer, keeping its storage. A view becomes an empty buffer.
+		/// </summary>
+		inline DynamicBuffer & Clear(
+			) {
+				if (_capacity == 0)
+					_Release();
+				_size = 0;
+				return * this;
+			}
+
+		inline void * GetPointer(
+			) {
+				_Detach();
+				return _data;
+			}
+
 		inline const void * GetPointer(
 			) const {
-				return &_data[0];
+				return _data;
 			}
 		
 		inline const void * Read(
 			void * outputBuffer, size_t offset, size_t size
 			) const {
-				if (offset + size > GetSize())
+				if (offset + size > _size)
 					throw RuntimeException("Not enough space to read.");
-				return memcpy(outputBuffer, &_data[offset], size);
+				return memcpy(outputBuffer, _data + offset, size);
+			}
+
+		/// <summary>
+		/// Returns a copy of the value at an offset, which doesn't need to be aligned.
+		/// </summary>
+		template <typename _Ty>
+		inline _Ty Load(
+			size_t offset
+			) const {
+				if (offset + sizeof (_Ty) > _size)
+					throw RuntimeException("Not enough space to read.");
+				_Ty value;
+				memcpy(&value, _data + offset, sizeof (_Ty));
+				return value;
 			}
 
 		inline size_t GetSize(
 			) const {
-				return _data.size();
+				return _size;
+			}
+
+		/// <summary>
+		/// Returns the number of bytes the buffer can hold without allocating, or zero for a view.
+		/// </summary>
+		inline size_t GetCapacity(
+			) const {
+				return _capacity;
 			}
 
 		inline ConstIterator GetConstIterator(
@@ -88,15 +304,19 @@ namespace Nova {
 	};
 	
 	namespace Internal {
+		/// <summary>
+		/// Read position in a buffer. Iterators can be assigned, so a reader can move to another buffer
+		/// with the same layout.
+		/// </summary>
 		class DynamicBufferConstIterator {
-			const DynamicBuffer & _source;
+			const DynamicBuffer * _source;
 			size_t _offset;
 
 		public:
 			inline explicit DynamicBufferConstIterator(
 				const DynamicBuffer & source
 				)
-				: _source(source), _offset(0)
+				: _source(&source), _offset(0)
 				{
 				}
 
@@ -107,10 +327,27 @@ namespace Nova {
 				{
 				}
 
+			inline DynamicBufferConstIterator & operator = (
+				const DynamicBufferConstIterator & other
+				) {
+					_source = other._source;
+					_offset = other._offset;
+					return * this;
+				}
+
 			inline void Read(
 				void * outputBuffer, size_t size
 				) const {
-					_source.Read(outputBuffer, _offset, size);
+					_source->Read(outputBuffer, _offset, size);
+				}
+
+			/// <summary>
+			/// Returns a copy of the value at the position, without moving it.
+			/// </summary>
+			template <typename _Ty>
+			inline _Ty Load(
+				) const {
+					return _source->Load<_Ty>(_offset);
 				}
 			
 			inline void Skip(
@@ -119,9 +356,22 @@ namespace Nova {
 					_offset += size;
 				}
 
+			inline void Seek(
+				size_t offset
+				) {
+					if (offset > _source->GetSize())
+						throw RuntimeException("The offset is out of the buffer.");
+					_offset = offset;
+				}
+
 			inline bool HasData(
 				) const {
-					return _offset < _source.GetSize();
+					return _offset < _source->GetSize();
+				}
+
+			inline size_t GetOffset(
+				) const {
+					return _offset;
 				}
 		};
 	}
@@ -0,0 +1,233 @@
+//
+// lz-codec.hpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#ifndef _NOVA_COMMON_LZ_CODEC_HEADER_
+#define _NOVA_COMMON_LZ_CODEC_HEADER_
+
+#include "exception.hpp"
+#include "dynamic-buffer.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace Nova {
+
+	/// <summary>
+	/// Byte-oriented LZ77 codec, tuned for the speed of the decompression rather than for the ratio.
+	/// </summary>
+	/// <remarks>
+	/// <para>The compressed data starts with the decompressed size, as 32-bits, followed by sequences
+	/// of literals and matches. Every sequence starts with a token holding the number of literals in
+	/// its high nibble and the length of the match minus MinMatchLength in the low one, where 15 means
+	/// that the length goes on in the next bytes, 255 at a time. The literals follow, then the
+	/// distance back to the match, as 16-bits little endian. The last sequence can end after its
+	/// literals.</para>
+	/// <para>Decompression checks every length and distance, so corrupted data throws instead of
+	/// reading or writing out of the buffers.</para>
+	/// </remarks>
+	class LzCodec {
+		static const size_t _HashBits = 12;
+		static const size_t _MaxDistance = 0xFFFF;
+		static const size_t _HeaderSize = sizeof (std::uint32_t);
+
+		/// <summary>
+		/// Most bytes a byte of compressed data can decompress to: a length byte adds up to 255 bytes to
+		/// a run, and the rest of the bytes of a sequence add less.
+		/// </summary>
+		static const size_t _MaxExpansion = 255;
+
+		static inline std::uint32_t _Read32(
+			const std::uint8_t * ptr
+			) {
+				std::uint32_t value;
+				memcpy(&value, ptr, sizeof (value));
+				return value;
+			}
+
+		static inline size_t _Hash(
+			std::uint32_t value
+			) {
+				return (value * 2654435761u) >> (32 - _HashBits);
+			}
+
+		static inline void _PushLength(
+			DynamicBuffer & output, size_t length
+			) {
+				std::uint8_t byte = 255;
+				for (; length >= 255; length -= 255)
+					output.Push(&byte, 1);
+				byte = static_cast<std::uint8_t>(length);
+				output.Push(&byte, 1);
+			}
+
+		static inline void _PushSequence(
+			DynamicBuffer & output, const std::uint8_t * literals, size_t literalCount,
+			size_t distance, size_t matchLength
+			) {
+				size_t matchCode = matchLength != 0 ? matchLength - MinMatchLength : 0;
+				std::uint8_t token = static_cast<std::uint8_t>(
+					((literalCount < 15 ? literalCount : 15) << 4) | (matchCode < 15 ? matchCode : 15));
+				output.Push(&token, 1);
+				if (literalCount >= 15)
+					_PushLength(output, literalCount - 15);
+				output.Push(literals, literalCount);
+				if (matchLength == 0)
+					return;
+
+				std::uint8_t distanceBytes[] = {
+					static_cast<std::uint8_t>(distance & 0xFF), static_cast<std::uint8_t>(distance >> 8)
+				};
+				output.Push(distanceBytes, sizeof (distanceBytes));
+				if (matchCode >= 15)
+					_PushLength(output, matchCode - 15);
+			}
+
+		static inline size_t _ReadLength(
+			const std::uint8_t *& input, const std::uint8_t * inputEnd, size_t length
+			) {
+				if (length != 15)
+					return length;
+				std::uint8_t byte;
+				do {
+					if (input == inputEnd)
+						throw RuntimeException("The compressed data is corrupted.");
+					byte = * input++;
+					length += byte;
+				} while (byte == 255);
+				return length;
+			}
+
+	public:
+		static const size_t MinMatchLength = 4;
+
+		/// <summary>
+		/// Compresses a block of data, appending it to the output.
+		/// </summary>
+		static inline void Compress(
+			const void * data, size_t size, DynamicBuffer & output
+			) {
+				if (size > 0xFFFFFFFFu)
+					throw InvalidArgumentException("The data is too large to compress.");
+				std::uint32_t header = static_cast<std::uint32_t>(size);
+				output.Push(&header, sizeof (header));
+
+				const std::uint8_t * input = reinterpret_cast<const std::uint8_t *>(data);
+				// Positions plus one of the last 4 bytes with every hash, so zero is an empty slot.
+				std::vector<std::uint32_t> table(static_cast<size_t>(1) << _HashBits, 0);
+				size_t anchor = 0, position = 0;
+				while (position + MinMatchLength <= size) {
+					std::uint32_t sequence = _Read32(input + position);
+					size_t hash = _Hash(sequence);
+					size_t candidate = table[hash];
+					table[hash] = static_cast<std::uint32_t>(position + 1);
+					if (candidate == 0 || position - (candidate - 1) > _MaxDistance
+						|| _Read32(input + candidate - 1) != sequence) {
+							++position;
+							continue;
+					}
+
+					size_t match = candidate - 1, length = MinMatchLength;
+					while (position + length < size && input[match + length] == input[position + length])
+						++length;
+					_PushSequence(output, input + anchor, position - anchor, position - match, length);
+					position += length;
+					anchor = position;
+				}
+				if (anchor != size)
+					_PushSequence(output, input + anchor, size - anchor, 0, 0);
+			}
+
+		static inline void Compress(
+			const DynamicBuffer & data, DynamicBuffer & output
+			) {
+				Compress(data.GetPointer(), data.GetSize(), output);
+			}
+
+		/// <summary>
+		/// Returns the size of the data once decompressed. The size comes from the data, so it's checked
+		/// against the most the rest of the data could decompress to before anything is allocated for it.
+		/// </summary>
+		static inline size_t GetDecompressedSize(
+			const void * data, size_t size
+			) {
+				if (size < _HeaderSize)
+					throw RuntimeException("The compressed data is corrupted.");
+				size_t decompressedSize = _Read32(reinterpret_cast<const std::uint8_t *>(data));
+				if (decompressedSize / _MaxExpansion > size - _HeaderSize)
+					throw RuntimeException("The compressed data is corrupted.");
+				return decompressedSize;
+			}
+
+		/// <summary>
+		/// Decompresses a block of data to a buffer of GetDecompressedSize bytes.
+		/// </summary>
+		static inline void Decompress(
+			const void * data, size_t size, void * output, size_t outputSize
+			) {
+				if (GetDecompressedSize(data, size) != outputSize)
+					throw InvalidArgumentException("The output doesn't have the size of the decompressed data.");
+
+				const std::uint8_t * input = reinterpret_cast<const std::uint8_t *>(data) + _HeaderSize;
+				const std::uint8_t * inputEnd = reinterpret_cast<const std::uint8_t *>(data) + size;
+				std::uint8_t * outputStart = reinterpret_cast<std::uint8_t *>(output);
+				std::uint8_t * outputPtr = outputStart;
+				std::uint8_t * outputEnd = outputStart + outputSize;
+				while (input != inputEnd) {
+					std::uint8_t token = * input++;
+
+					size_t literalCount = _ReadLength(input, inputEnd, token >> 4);
+					if (literalCount > static_cast<size_t>(inputEnd - input)
+						|| literalCount > static_cast<size_t>(outputEnd - outputPtr))
+							throw RuntimeException("The compressed data is corrupted.");
+					if (literalCount != 0)
+						memcpy(outputPtr, input, literalCount);
+					input += literalCount;
+					outputPtr += literalCount;
+					if (input == inputEnd)
+						break;
+
+					if (inputEnd - input < 2)
+						throw RuntimeException("The compressed data is corrupted.");
+					size_t distance = input[0] | (static_cast<size_t>(input[1]) << 8);
+					input += 2;
+					size_t length = _ReadLength(input, inputEnd, token & 0x0F) + MinMatchLength;
+					if (distance == 0 || distance > static_cast<size_t>(outputPtr - outputStart)
+						|| length > static_cast<size_t>(outputEnd - outputPtr))
+							throw RuntimeException("The compressed data is corrupted.");
+
+					// Matches closer than their length repeat the bytes being written, so they're copied
+					// in chunks which double every time.
+					const std::uint8_t * match = outputPtr - distance;
+					while (length != 0) {
+						size_t chunk = static_cast<size_t>(outputPtr - match);
+						if (chunk > length)
+							chunk = length;
+						memcpy(outputPtr, match, chunk);
+						outputPtr += chunk;
+						length -= chunk;
+					}
+				}
+				if (outputPtr != outputEnd)
+					throw RuntimeException("The compressed data is corrupted.");
+			}
+
+		/// <summary>
+		/// Decompresses a block of data in place of the contents of the output.
+		/// </summary>
+		static inline void Decompress(
+			const DynamicBuffer & data, DynamicBuffer & output
+			) {
+				size_t outputSize = GetDecompressedSize(data.GetPointer(), data.GetSize());
+				output.Resize(outputSize);
+				Decompress(data.GetPointer(), data.GetSize(), outputSize != 0 ? output.GetPointer() : nullptr, outputSize);
+			}
+	};
+
+} // namespace Nova
+
+#endif // !_NOVA_COMMON_LZ_CODEC_HEADER_
\ No newline at end of file
@@ -0,0 +1,147 @@
+//
+// object-arena.hpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#ifndef _NOVA_COMMON_OBJECT_ARENA_HEADER_
+#define _NOVA_COMMON_OBJECT_ARENA_HEADER_
+
+#include "exception.hpp"
+#include "platform.hpp"
+
+#include <cstdint>
+#include <vector>
+#include <new>
+
+namespace Nova {
+
+	/// <summary>
+	/// Allocates objects of a type in blocks, so objects created together are stored contiguously and
+	/// released at once.
+	/// </summary>
+	/// <remarks>
+	/// Objects never move once created. Destroyed objects leave their slot free for the next one, and
+	/// the objects still alive are destroyed with the arena.
+	/// </remarks>
+	template <typename _Ty, size_t _BlockSize = 64>
+	class ObjectArena {
+		std::vector<_Ty *> _blocks;
+		std::vector<bool> _liveSlots;
+		std::vector<size_t> _freeSlots;
+		size_t _count;
+
+		ObjectArena(const ObjectArena &);
+		ObjectArena & operator = (const ObjectArena &);
+
+		inline _Ty * _GetSlot(
+			size_t slot
+			) const {
+				return _blocks[slot / _BlockSize] + slot % _BlockSize;
+			}
+
+		/// <summary>
+		/// Returns a free slot, adding a block if every one is used.
+		/// </summary>
+		inline size_t _AcquireSlot(
+			) {
+				if (!_freeSlots.empty()) {
+					size_t slot = _freeSlots.back();
+					_freeSlots.pop_back();
+					return slot;
+				}
+				if (_liveSlots.size() == _blocks.size() * _BlockSize)
+					_blocks.push_back(reinterpret_cast<_Ty *>(AlignedAllocate(sizeof (_Ty) * _BlockSize, CacheLineSize)));
+				_liveSlots.push_back(false);
+				return _liveSlots.size() - 1;
+			}
+
+		inline size_t _FindSlot(
+			const _Ty * object
+			) const {
+				for (size_t i = 0; i < _blocks.size(); ++i) {
+					if (object >= _blocks[i] && object < _blocks[i] + _BlockSize)
+						return i * _BlockSize + static_cast<size_t>(object - _blocks[i]);
+				}
+				return static_cast<size_t>(-1);
+			}
+
+	public:
+		inline ObjectArena(
+			)
+			: _count(0)
+			{
+			}
+
+		inline ~ObjectArena(
+			) {
+				for (size_t i = 0; i < _liveSlots.size(); ++i) {
+					if (_liveSlots[i])
+						_GetSlot(i)->~_Ty();
+				}
+				for (auto block : _blocks)
+					AlignedFree(block);
+			}
+
+		/// <summary>
+		/// Creates an object passing an argument to its constructor.
+		/// </summary>
+		template <typename _Arg>
+		inline _Ty * Create(
+			const _Arg & argument
+			) {
+				size_t slot = _AcquireSlot();
+				_Ty * object;
+				try {
+					object = new (_GetSlot(slot)) _Ty(argument);
+				} catch (...) {
+					_freeSlots.push_back(slot);
+					throw;
+				}
+				_liveSlots[slot] = true;
+				++_count;
+				return object;
+			}
+
+		/// <summary>
+		/// Destroys an object of the arena, leaving its slot free.
+		/// </summary>
+		inline void Destroy(
+			_Ty * object
+			) {
+				size_t slot = _FindSlot(object);
+				if (slot >= _liveSlots.size() || !_liveSlots[slot])
+					throw InvalidArgumentException("The object doesn't belong to the arena.");
+				object->~_Ty();
+				_liveSlots[slot] = false;
+				_freeSlots.push_back(slot);
+				--_count;
+			}
+
+		/// <summary>
+		/// Returns true if the object is stored in the arena, whether it's alive or not.
+		/// </summary>
+		inline bool Owns(
+			const _Ty * object
+			) const {
+				return _FindSlot(object) < _liveSlots.size();
+			}
+
+		/// <summary>
+		/// Returns the number of objects alive.
+		/// </summary>
+		inline size_t GetCount(
+			) const {
+				return _count;
+			}
+
+		inline size_t GetBlockCount(
+			) const {
+				return _blocks.size();
+			}
+	};
+
+} // namespace Nova
+
+#endif // !_NOVA_COMMON_OBJECT_ARENA_HEADER_
\ No newline at end of file
@@ -0,0 +1,157 @@
+//
+// platform.hpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#ifndef _NOVA_COMMON_PLATFORM_HEADER_
+#define _NOVA_COMMON_PLATFORM_HEADER_
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#if defined(_MSC_VER)
+#	include <malloc.h>
+#	define NOVA_ALIGN(bytes) __declspec(align(bytes))
+#	define NOVA_THREAD_LOCAL __declspec(thread)
+#else
+#	define NOVA_ALIGN(bytes) __attribute__((aligned(bytes)))
+#	define NOVA_THREAD_LOCAL __thread
+#endif
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#	define NOVA_X86
+#	if defined(_MSC_VER)
+#		include <intrin.h>
+#		include <immintrin.h>
+		// MSVC allows the intrinsics of any instruction set without changing the target.
+#		define NOVA_TARGET_SSE2
+#		define NOVA_TARGET_SSE41
+#		define NOVA_TARGET_AVX
+#		define NOVA_TARGET_AVX2
+#	else
+#		include <cpuid.h>
+#		include <immintrin.h>
+#		define NOVA_TARGET_SSE2 __attribute__((target("sse2")))
+#		define NOVA_TARGET_SSE41 __attribute__((target("sse4.1")))
+#		define NOVA_TARGET_AVX __attribute__((target("avx")))
+#		define NOVA_TARGET_AVX2 __attribute__((target("avx2")))
+#	endif
+#endif
+
+namespace Nova {
+
+	/// <summary>
+	/// Size of a cache line in the supported targets. Used to align objects shared by the engine.
+	/// </summary>
+	static const size_t CacheLineSize = 64;
+
+	/// <summary>
+	/// Size of the smallest pages of the supported targets. Used to align the regions holding code.
+	/// </summary>
+	static const size_t PageSize = 4096;
+
+	/// <summary>
+	/// Allocates a block of memory with the specified alignment. It must be released with AlignedFree.
+	/// </summary>
+	inline void * AlignedAllocate(
+		size_t size, size_t alignment
+		) {
+#if defined(_MSC_VER)
+			void * ptr = _aligned_malloc(size, alignment);
+#else
+			void * ptr = nullptr;
+			if (posix_memalign(&ptr, alignment, size) != 0)
+				ptr = nullptr;
+#endif
+			if (ptr == nullptr)
+				throw std::bad_alloc();
+			return ptr;
+		}
+
+	/// <summary>
+	/// Instruction set extensions available in the processor, and enabled by the operating system.
+	/// </summary>
+	struct CpuFeatures {
+		bool Sse2;
+		bool Sse41;
+		bool Avx;
+		bool Avx2;
+	};
+
+	namespace Internal {
+		inline CpuFeatures DetectCpuFeatures(
+			) {
+				CpuFeatures features = { false, false, false, false };
+#if defined(NOVA_X86)
+				unsigned int registers[4] = { 0, 0, 0, 0 };
+				unsigned int maxLeaf;
+#	if defined(_MSC_VER)
+				int info[4];
+				__cpuid(info, 0);
+				maxLeaf = info[0];
+				__cpuid(info, 1);
+				for (int i = 0; i < 4; ++i)
+					registers[i] = info[i];
+#	else
+				maxLeaf = __get_cpuid_max(0, nullptr);
+				__get_cpuid(1, &registers[0], &registers[1], &registers[2], &registers[3]);
+#	endif
+				features.Sse2 = (registers[3] & (1 << 26)) != 0;
+				features.Sse41 = (registers[2] & (1 << 19)) != 0;
+
+				// AVX needs the operating system to save the upper halves of the registers.
+				bool osSavesAvx = false;
+				if ((registers[2] & (1 << 27)) != 0 && (registers[2] & (1 << 28)) != 0) {
+#	if defined(_MSC_VER)
+					unsigned long long xcr0 = _xgetbv(0);
+#	else
+					unsigned int eax, edx;
+					__asm__ volatile ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+					unsigned long long xcr0 = (static_cast<unsigned long long>(edx) << 32) | eax;
+#	endif
+					osSavesAvx = (xcr0 & 6) == 6;
+				}
+				features.Avx = osSavesAvx;
+
+				if (osSavesAvx && maxLeaf >= 7) {
+#	if defined(_MSC_VER)
+					__cpuidex(info, 7, 0);
+					registers[1] = info[1];
+#	else
+					__cpuid_count(7, 0, registers[0], registers[1], registers[2], registers[3]);
+#	endif
+					features.Avx2 = (registers[1] & (1 << 5)) != 0;
+				}
+#endif
+				return features;
+			}
+	}
+
+	/// <summary>
+	/// Returns the instruction set extensions of the processor. They are detected once.
+	/// </summary>
+	inline const CpuFeatures & GetCpuFeatures(
+		) {
+			static const CpuFeatures features = Internal::DetectCpuFeatures();
+			return features;
+		}
+
+	/// <summary>
+	/// Releases a block of memory allocated with AlignedAllocate.
+	/// </summary>
+	inline void AlignedFree(
+		void * ptr
+		) {
+#if defined(_MSC_VER)
+			_aligned_free(ptr);
+#else
+			free(ptr);
+#endif
+		}
+
+} // namespace Nova
+
+#endif // !_NOVA_COMMON_PLATFORM_HEADER_
\ No newline at end of file
@@ -0,0 +1,178 @@
+//
+// shared-memory.hpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#ifndef _NOVA_COMMON_SHARED_MEMORY_HEADER_
+#define _NOVA_COMMON_SHARED_MEMORY_HEADER_
+
+#include "exception.hpp"
+
+#include <cstddef>
+#include <string>
+
+#if defined(_MSC_VER)
+#	ifndef WIN32_LEAN_AND_MEAN
+#		define WIN32_LEAN_AND_MEAN
+#	endif
+#	ifndef NOMINMAX
+#		define NOMINMAX
+#	endif
+#	include <windows.h>
+	// The Windows headers rename GetMessage, which exceptions use.
+#	undef GetMessage
+#else
+#	include <fcntl.h>
+#	include <unistd.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#endif
+
+namespace Nova {
+
+	INHERIT_EXCEPTION(SharedMemoryException, RuntimeException)
+
+	/// <summary>
+	/// Block of memory mapped by several processes, identified by a name.
+	/// </summary>
+	/// <remarks>
+	/// The process which creates the block owns its name: it's removed when the creator unmaps it, and
+	/// the memory is released once every process has unmapped it. Each process may map the block at a
+	/// different address, so the data in it can't hold pointers.
+	/// </remarks>
+	class SharedMemory {
+		std::string _name;
+		void * _data;
+		size_t _size;
+		bool _isOwner;
+#if defined(_MSC_VER)
+		HANDLE _handle;
+#endif
+
+		SharedMemory(const SharedMemory &);
+		SharedMemory & operator = (const SharedMemory &);
+
+		inline void _Map(
+			bool create
+			) {
+#if defined(_MSC_VER)
+				if (create) {
+					unsigned long long size = _size;
+					_handle = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+						static_cast<DWORD>(size >> 32), static_cast<DWORD>(size), _name.c_str());
+					if (_handle != nullptr && GetLastError() == ERROR_ALREADY_EXISTS) {
+						CloseHandle(_handle);
+						_handle = nullptr;
+					}
+				} else {
+					_handle = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, _name.c_str());
+				}
+				if (_handle == nullptr)
+					throw SharedMemoryException("The shared memory can't be " + std::string(create ? "created." : "opened."));
+
+				_data = MapViewOfFile(_handle, FILE_MAP_ALL_ACCESS, 0, 0, create ? _size : 0);
+				if (_data == nullptr) {
+					CloseHandle(_handle);
+					throw SharedMemoryException("The shared memory can't be mapped.");
+				}
+				if (!create) {
+					MEMORY_BASIC_INFORMATION information;
+					VirtualQuery(_data, &information, sizeof information);
+					_size = information.RegionSize;
+				}
+#else
+				std::string path = "/" + _name;
+				int descriptor = create
+					? shm_open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600)
+					: shm_open(path.c_str(), O_RDWR, 0);
+				if (descriptor < 0)
+					throw SharedMemoryException("The shared memory can't be " + std::string(create ? "created." : "opened."));
+
+				struct stat status;
+				if (create ? ftruncate(descriptor, static_cast<off_t>(_size)) != 0 : fstat(descriptor, &status) != 0) {
+					close(descriptor);
+					if (create)
+						shm_unlink(path.c_str());
+					throw SharedMemoryException("The size of the shared memory can't be set.");
+				}
+				if (!create)
+					_size = static_cast<size_t>(status.st_size);
+
+				_data = mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+				close(descriptor);
+				if (_data == MAP_FAILED) {
+					_data = nullptr;
+					if (create)
+						shm_unlink(path.c_str());
+					throw SharedMemoryException("The shared memory can't be mapped.");
+				}
+#endif
+			}
+
+	public:
+		/// <summary>
+		/// Creates a block, which must not exist yet. Its bytes are zero.
+		/// </summary>
+		/// <param name='name'>Name of the block, without slashes.</param>
+		inline SharedMemory(
+			const std::string & name, size_t size
+			)
+			: _name(name), _data(nullptr), _size(size), _isOwner(true)
+			{
+				if (size == 0)
+					throw InvalidArgumentException("The shared memory can't be empty.");
+				_Map(true);
+			}
+
+		/// <summary>
+		/// Maps a block created by another process.
+		/// </summary>
+		inline explicit SharedMemory(
+			const std::string & name
+			)
+			: _name(name), _data(nullptr), _size(0), _isOwner(false)
+			{
+				_Map(false);
+			}
+
+		inline ~SharedMemory(
+			) {
+#if defined(_MSC_VER)
+				UnmapViewOfFile(_data);
+				CloseHandle(_handle);
+#else
+				munmap(_data, _size);
+				if (_isOwner)
+					shm_unlink(("/" + _name).c_str());
+#endif
+			}
+
+		inline void * GetPointer(
+			) const {
+				return _data;
+			}
+
+		/// <summary>
+		/// Returns the size of the block. Blocks opened by name may be rounded up to whole pages.
+		/// </summary>
+		inline size_t GetSize(
+			) const {
+				return _size;
+			}
+
+		inline const std::string & GetName(
+			) const {
+				return _name;
+			}
+
+		inline bool IsOwner(
+			) const {
+				return _isOwner;
+			}
+	};
+
+} // namespace Nova
+
+#endif // !_NOVA_COMMON_SHARED_MEMORY_HEADER_
\ No newline at end of file
@@ -9,15 +9,93 @@
 #define _NOVA_COMMON_TYPE_TRAITS_HEADER_
 
 #include <cstdint>
+#include <cstddef>
 
 namespace Nova {
 
 	typedef std::int8_t * staddr_t;
 	typedef struct refaddr_t_ {} * refaddr_t;
 	typedef struct scoperef_t_ {} * scoperef_t;
+	typedef struct chanref_t_ {} * chanref_t;
+	typedef struct constref_t_ {} * constref_t;
 
 	static const scoperef_t InvalidScope = reinterpret_cast<scoperef_t>(-1);
 
+	/// <summary>
+	/// Vector of values handled as a single value by the engine, so its lanes can be processed
+	/// with SIMD instructions.
+	/// </summary>
+	template <typename _Ty, size_t _Count>
+	struct VectorValue {
+		_Ty Lanes[_Count];
+	};
+
+	typedef VectorValue<std::int32_t, 4> v4i4_t;
+	typedef VectorValue<std::int32_t, 8> v8i4_t;
+	typedef VectorValue<float, 4> v4fs_t;
+	typedef VectorValue<float, 8> v8fs_t;
+	typedef VectorValue<double, 2> v2fd_t;
+	typedef VectorValue<double, 4> v4fd_t;
+
+	/// <summary>
+	/// Types of the values handled by the engine instructions. Vector types are named after the
+	/// number of lanes and the type of every lane.
+	/// </summary>
+	enum class ValueType {
+		i1 = 0, i2, i4, i8, fs, fd, rf,
+		v4i4, v8i4, v4fs, v8fs, v2fd, v4fd
+	};
+
+	inline size_t GetValueTypeSize(
+		ValueType type
+		) {
+			switch (type) {
+			case ValueType::i1: return 1;
+			case ValueType::i2: return 2;
+			case ValueType::i4: return 4;
+			case ValueType::i8: return 8;
+			case ValueType::fs: return 4;
+			case ValueType::fd: return 8;
+			case ValueType::v4i4: return 16;
+			case ValueType::v8i4: return 32;
+			case ValueType::v4fs: return 16;
+			case ValueType::v8fs: return 32;
+			case ValueType::v2fd: return 16;
+			case ValueType::v4fd: return 32;
+			default: return sizeof(refaddr_t);
+			}
+		}
+
+	inline bool IsVectorType(
+		ValueType type
+		) {
+			return type >= ValueType::v4i4 && type <= ValueType::v4fd;
+		}
+
+	/// <summary>
+	/// Returns the type of the lanes of a vector type.
+	/// </summary>
+	inline ValueType GetVectorLaneType(
+		ValueType type
+		) {
+			switch (type) {
+			case ValueType::v4i4:
+			case ValueType::v8i4:
+				return ValueType::i4;
+			case ValueType::v4fs:
+			case ValueType::v8fs:
+				return ValueType::fs;
+			default:
+				return ValueType::fd;
+			}
+		}
+
+	inline size_t GetVectorLaneCount(
+		ValueType type
+		) {
+			return GetValueTypeSize(type) / GetValueTypeSize(GetVectorLaneType(type));
+		}
+
 	template <typename _Ty>
 	struct EngineTypeTraits {
 		static const bool Supported = false;
@@ -26,24 +104,42 @@ namespace Nova {
 	template <>
 	struct EngineTypeTraits<std::int8_t> {
 		static const bool Supported = true;
-		static const size_t Size = 8;
+		static const ValueType Type = ValueType::i1;
+		static const size_t Size = 1;
 	};
 
 	template <>
 	struct EngineTypeTraits<std::int16_t> {
 		static const bool Supported = true;
+		static const ValueType Type = ValueType::i2;
 		static const size_t Size = 2;
 	};
 	
 	template <>
 	struct EngineTypeTraits<std::int32_t> {
 		static const bool Supported = true;
+		static const ValueType Type = ValueType::i4;
 		static const size_t Size = 4;
 	};
 
 	template <>
 	struct EngineTypeTraits<std::int64_t> {
 		static const bool Supported = true;
+		static const ValueType Type = ValueType::i8;
+		static const size_t Size = 8;
+	};
+
+	template <>
+	struct EngineTypeTraits<float> {
+		static const bool Supported = true;
+		static const ValueType Type = ValueType::fs;
+		static const size_t Size = 4;
+	};
+
+	template <>
+	struct EngineTypeTraits<double> {
+		static const bool Supported = true;
+		static const ValueType Type = ValueType::fd;
 		static const size_t Size = 8;
 	};
 
@@ -56,9 +152,52 @@ namespace Nova {
 	template <>
 	struct EngineTypeTraits<refaddr_t> {
 		static const bool Supported = true;
+		static const ValueType Type = ValueType::rf;
 		static const size_t Size = sizeof(refaddr_t);
 	};
 
+	template <>
+	struct EngineTypeTraits<v4i4_t> {
+		static const bool Supported = true;
+		static const ValueType Type = ValueType::v4i4;
+		static const size_t Size = 16;
+	};
+
+	template <>
+	struct EngineTypeTraits<v8i4_t> {
+		static const bool Supported = true;
+		static const ValueType Type = ValueType::v8i4;
+		static const size_t Size = 32;
+	};
+
+	template <>
+	struct EngineTypeTraits<v4fs_t> {
+		static const bool Supported = true;
+		static const ValueType Type = ValueType::v4fs;
+		static const size_t Size = 16;
+	};
+
+	template <>
+	struct EngineTypeTraits<v8fs_t> {
+		static const bool Supported = true;
+		static const ValueType Type = ValueType::v8fs;
+		static const size_t Size = 32;
+	};
+
+	template <>
+	struct EngineTypeTraits<v2fd_t> {
+		static const bool Supported = true;
+		static const ValueType Type = ValueType::v2fd;
+		static const size_t Size = 16;
+	};
+
+	template <>
+	struct EngineTypeTraits<v4fd_t> {
+		static const bool Supported = true;
+		static const ValueType Type = ValueType::v4fd;
+		static const size_t Size = 32;
+	};
+
 } // namespace Nova
 
 #endif // !_NOVA_COMMON_TYPE_TRAITS_HEADER_
\ No newline at end of file
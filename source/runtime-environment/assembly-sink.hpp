@@ -0,0 +1,243 @@
+//
+// assembly-sink.hpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#ifndef _NOVA_RUNTIME_ENVIRONMENT_ASSEMBLY_SINK_HEADER_
+#define _NOVA_RUNTIME_ENVIRONMENT_ASSEMBLY_SINK_HEADER_
+
+#include "assembly.hpp"
+
+#include "..\common\exception.hpp"
+#include "..\common\dynamic-buffer.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+
+namespace Nova {
+
+	/// <summary>
+	/// Output of an AssemblySinkWriter. Offsets count every byte pushed since the sink was created.
+	/// </summary>
+	class IAssemblySink {
+	public:
+		virtual ~IAssemblySink() {}
+
+		virtual void Push(const void * ptr, size_t size) = 0;
+
+		/// <summary>
+		/// Overwrites bytes already pushed, such as the offset of a branch to a label bound later.
+		/// </summary>
+		virtual void Write(const void * ptr, size_t offset, size_t size) = 0;
+		virtual void Read(void * outputBuffer, size_t offset, size_t size) const = 0;
+		virtual size_t GetSize() const = 0;
+	};
+
+	typedef BasicAssemblyWriter<IAssemblySink> AssemblySinkWriter;
+
+	/// <summary>
+	/// Sink appending to a growable buffer.
+	/// </summary>
+	class BufferAssemblySink : public IAssemblySink {
+		DynamicBuffer & _buffer;
+
+		BufferAssemblySink & operator = (const BufferAssemblySink &);
+
+	public:
+		inline explicit BufferAssemblySink(
+			DynamicBuffer & buffer
+			)
+			: _buffer(buffer)
+			{
+			}
+
+		inline void Push(
+			const void * ptr, size_t size
+			) {
+				_buffer.Push(ptr, size);
+			}
+
+		inline void Write(
+			const void * ptr, size_t offset, size_t size
+			) {
+				_buffer.Write(ptr, offset, size);
+			}
+
+		inline void Read(
+			void * outputBuffer, size_t offset, size_t size
+			) const {
+				_buffer.Read(outputBuffer, offset, size);
+			}
+
+		inline size_t GetSize(
+			) const {
+				return _buffer.GetSize();
+			}
+	};
+
+	/// <summary>
+	/// Sink writing to memory allocated by the caller, which never grows.
+	/// </summary>
+	class FixedAssemblySink : public IAssemblySink {
+		std::int8_t * _data;
+		size_t _capacity;
+		size_t _size;
+
+	public:
+		inline FixedAssemblySink(
+			void * data, size_t capacity
+			)
+			: _data(reinterpret_cast<std::int8_t *>(data)), _capacity(capacity), _size(0)
+			{
+			}
+
+		inline void Push(
+			const void * ptr, size_t size
+			) {
+				if (size > _capacity - _size)
+					throw RuntimeException("The assembly doesn't fit in the buffer.");
+				memcpy(_data + _size, ptr, size);
+				_size += size;
+			}
+
+		inline void Write(
+			const void * ptr, size_t offset, size_t size
+			) {
+				if (offset + size > _size)
+					throw RuntimeException("Not enough space to write.");
+				memcpy(_data + offset, ptr, size);
+			}
+
+		inline void Read(
+			void * outputBuffer, size_t offset, size_t size
+			) const {
+				if (offset + size > _size)
+					throw RuntimeException("Not enough space to read.");
+				memcpy(outputBuffer, _data + offset, size);
+			}
+
+		inline size_t GetSize(
+			) const {
+				return _size;
+			}
+
+		inline size_t GetCapacity(
+			) const {
+				return _capacity;
+			}
+	};
+
+	/// <summary>
+	/// Sink writing to a stream, such as a file or a pipe, in blocks.
+	/// </summary>
+	/// <remarks>
+	/// <para>The last bytes pushed are kept in memory until there's a whole block older than the window,
+	/// so the sink never holds more than the window and a block. Branches can only be fixed up while
+	/// they're in the window: labels must be bound within the window of the branches to them.</para>
+	/// <para>Flush must be called once the code is written; bytes still buffered are lost otherwise.
+	/// Streams are expected to be opened in binary mode.</para>
+	/// </remarks>
+	class StreamAssemblySink : public IAssemblySink {
+		std::ostream & _stream;
+		const size_t _windowSize;
+		const size_t _blockSize;
+		DynamicBuffer _buffer;
+
+		/// <summary>
+		/// Offset of the first byte of the buffer, which is the number of bytes already written.
+		/// </summary>
+		size_t _writtenSize;
+
+		StreamAssemblySink & operator = (const StreamAssemblySink &);
+
+		inline void _WriteToStream(
+			size_t size
+			) {
+				if (size == 0)
+					return;
+				std::int8_t * data = reinterpret_cast<std::int8_t *>(_buffer.GetPointer());
+				if (!_stream.write(reinterpret_cast<const char *>(data), static_cast<std::streamsize>(size)))
+					throw RuntimeException("The assembly couldn't be written to the stream.");
+
+				size_t remaining = _buffer.GetSize() - size;
+				memmove(data, data + size, remaining);
+				_buffer.Resize(remaining);
+				_writtenSize += size;
+			}
+
+		inline size_t _GetBufferOffset(
+			size_t offset
+			) const {
+				if (offset < _writtenSize)
+					throw InvalidArgumentException("The offset was already written to the stream.");
+				return offset - _writtenSize;
+			}
+
+	public:
+		static const size_t DefaultWindowSize = 64 * 1024;
+		static const size_t DefaultBlockSize = 64 * 1024;
+
+		/// <param name='windowSize'>Number of the last bytes which can be fixed up.</param>
+		/// <param name='blockSize'>Minimum number of bytes written to the stream at once.</param>
+		inline explicit StreamAssemblySink(
+			std::ostream & stream, size_t windowSize = DefaultWindowSize, size_t blockSize = DefaultBlockSize
+			)
+			: _stream(stream), _windowSize(windowSize), _blockSize(blockSize), _writtenSize(0)
+			{
+				if (blockSize == 0)
+					throw InvalidArgumentException("The blocks of a stream sink can't be empty.");
+				_buffer.Reserve(windowSize + blockSize);
+			}
+
+		inline void Push(
+			const void * ptr, size_t size
+			) {
+				_buffer.Push(ptr, size);
+				if (_buffer.GetSize() >= _windowSize + _blockSize) {
+					size_t flushable = _buffer.GetSize() - _windowSize;
+					_WriteToStream(flushable - flushable % _blockSize);
+				}
+			}
+
+		inline void Write(
+			const void * ptr, size_t offset, size_t size
+			) {
+				_buffer.Write(ptr, _GetBufferOffset(offset), size);
+			}
+
+		inline void Read(
+			void * outputBuffer, size_t offset, size_t size
+			) const {
+				_buffer.Read(outputBuffer, _GetBufferOffset(offset), size);
+			}
+
+		inline size_t GetSize(
+			) const {
+				return _writtenSize + _buffer.GetSize();
+			}
+
+		/// <summary>
+		/// Writes the buffered bytes to the stream and flushes it. They can't be fixed up anymore.
+		/// </summary>
+		inline void Flush(
+			) {
+				_WriteToStream(_buffer.GetSize());
+				if (!_stream.flush())
+					throw RuntimeException("The assembly couldn't be written to the stream.");
+			}
+
+		/// <summary>
+		/// Returns the number of bytes held in memory.
+		/// </summary>
+		inline size_t GetBufferedSize(
+			) const {
+				return _buffer.GetSize();
+			}
+	};
+
+} // namespace Nova
+
+#endif // !_NOVA_RUNTIME_ENVIRONMENT_ASSEMBLY_SINK_HEADER_
\ No newline at end of file
@@ -13,6 +13,10 @@
 #include "instruction-set.hpp"
 
 #include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include <limits>
 
 namespace Nova {
 
@@ -50,13 +54,298 @@ namespace Nova {
 			
 			struct Ret : Base {
 			};
+
+			struct Alloc : Base {
+				Register MId;
+			};
+
+			struct PushRfR : Base {
+				Register MId;
+			};
+
+			struct SetRfR : Base {
+				Register MId;
+			};
+
+			struct MemoryAccess : Base {
+				Register MId;
+				std::int32_t Offset;
+			};
+
+			struct IndexedAccess : Base {
+				Register MId;
+			};
+
+			struct MemoryCopy : Base {
+				Register DestinationMId;
+				Register SourceMId;
+			};
+
+			struct VectorOperation : Base {
+				ValueType Type;
+			};
+
+			struct VectorRegisterAccess : Base {
+				ValueType Type;
+				Register VId;
+			};
+
+			struct VectorShuffle : Base {
+				ValueType Type;
+				std::uint8_t Lanes[8];
+			};
+
+			struct VectorMemoryAccess : Base {
+				ValueType Type;
+				Register MId;
+			};
+
+			struct Compare : Base {
+			};
+
+			struct Branch : Base {
+				std::int32_t Offset;
+			};
+
+			struct DecrementBranch : Base {
+				Register RId;
+				std::int32_t Offset;
+			};
+
+			struct ChannelAccess : Base {
+				chanref_t Channel;
+			};
+
+			struct ChannelMemoryAccess : Base {
+				chanref_t Channel;
+				Register MId;
+			};
+
+			struct ParallelMap : Base {
+				scoperef_t Scope;
+				Register SourceMId;
+				Register DestinationMId;
+			};
+
+			struct SetSpR : Base {
+				Register SpId;
+			};
+
+			struct FrameAccess : Base {
+				Register SpId;
+				std::int32_t Offset;
+			};
+
+			struct StackOperation : Base {
+				ValueType Type;
+			};
+
+			struct StackPick : Base {
+				ValueType Type;
+				std::int32_t Offset;
+			};
+
+			struct StackDrop : Base {
+				std::int32_t Size;
+			};
+
+			struct ConstantAccess : Base {
+				ValueType Type;
+				constref_t Constant;
+			};
+
+			struct ConstantAllocation : Base {
+				Register MId;
+				constref_t Constant;
+			};
 		};
 	};
 
-	class AssemblyWriter {
+	/// <summary>
+	/// Position in the code written by an AssemblyWriter, used as the target of branches. Labels can
+	/// be used before they're bound: the offsets of the branches are fixed up when they are.
+	/// </summary>
+	typedef size_t label_t;
+
+	/// <summary>
+	/// Writes instructions to an output, which is a DynamicBuffer or any type with its Push, Write, Read
+	/// and GetSize methods, such as the sinks of assembly-sink.hpp.
+	/// </summary>
+	template <typename _Output>
+	class BasicAssemblyWriter {
+		struct _Label {
+			const _Output * Output;
+			size_t Offset;
+		};
+
+		/// <summary>
+		/// Branch written before its target label was bound.
+		/// </summary>
+		struct _Fixup {
+			const _Output * Output;
+			size_t InstructionOffset;
+			label_t Label;
+		};
+
+		std::vector<_Label> _labels;
+		std::vector<_Fixup> _fixups;
+
+		static inline std::int32_t _GetBranchOffset(
+			size_t branchEnd, size_t target
+			) {
+				std::int64_t offset = static_cast<std::int64_t>(target) - static_cast<std::int64_t>(branchEnd);
+				if (offset < std::numeric_limits<std::int32_t>::min() || offset > std::numeric_limits<std::int32_t>::max())
+					throw InvalidArgumentException("The branch target is too far.");
+				return static_cast<std::int32_t>(offset);
+			}
+
+		inline _Label & _GetLabel(
+			label_t label
+			) {
+				if (label >= _labels.size())
+					throw InvalidArgumentException("The label doesn't exist.");
+				return _labels[label];
+			}
+
+		/// <summary>
+		/// Returns the offset of a branch to the label, written at the end of the output. If the label
+		/// isn't bound yet, the branch is recorded to be fixed up later and the offset is zero.
+		/// </summary>
+		inline std::int32_t _ResolveBranch(
+			const _Output & output, label_t label, size_t instructionSize
+			) {
+				_Label & target = _GetLabel(label);
+				if (target.Output == nullptr) {
+					_Fixup fixup;
+					fixup.Output = &output;
+					fixup.InstructionOffset = output.GetSize();
+					fixup.Label = label;
+					_fixups.push_back(fixup);
+					return 0;
+				}
+
+				if (target.Output != &output)
+					throw InvalidArgumentException("The label is bound to another buffer.");
+				return _GetBranchOffset(output.GetSize() + instructionSize, target.Offset);
+			}
+
+		inline BasicAssemblyWriter & _Branch(
+			_Output & output, Instruction instruction, label_t label
+			) {
+				Internal::InstructionMemoryStructure::Branch s;
+				s.Instruction = instruction;
+				s.Offset = _ResolveBranch(output, label, sizeof s);
+
+				output.Push(&s, sizeof s);
+				return * this;
+			}
+
+		inline BasicAssemblyWriter & _Compare(
+			_Output & output, Instruction instruction
+			) {
+				Internal::InstructionMemoryStructure::Compare s;
+				s.Instruction = instruction;
+
+				output.Push(&s, sizeof s);
+				return * this;
+			}
+
+		inline BasicAssemblyWriter & _MemoryAccess(
+			_Output & output, Instruction instruction, Register mId, std::int32_t offset
+			) {
+				Internal::InstructionMemoryStructure::MemoryAccess s;
+				s.Instruction = instruction;
+				s.MId = mId;
+				s.Offset = offset;
+
+				output.Push(&s, sizeof s);
+				return * this;
+			}
+
+		inline BasicAssemblyWriter & _IndexedAccess(
+			_Output & output, Instruction instruction, Register mId
+			) {
+				Internal::InstructionMemoryStructure::IndexedAccess s;
+				s.Instruction = instruction;
+				s.MId = mId;
+
+				output.Push(&s, sizeof s);
+				return * this;
+			}
+
+		inline BasicAssemblyWriter & _VectorOperation(
+			_Output & output, Instruction instruction, ValueType type
+			) {
+				Internal::InstructionMemoryStructure::VectorOperation s;
+				s.Instruction = instruction;
+				s.Type = type;
+
+				output.Push(&s, sizeof s);
+				return * this;
+			}
+
+		inline BasicAssemblyWriter & _VectorRegisterAccess(
+			_Output & output, Instruction instruction, ValueType type, Register vId
+			) {
+				Internal::InstructionMemoryStructure::VectorRegisterAccess s;
+				s.Instruction = instruction;
+				s.Type = type;
+				s.VId = vId;
+
+				output.Push(&s, sizeof s);
+				return * this;
+			}
+
+		inline BasicAssemblyWriter & _VectorMemoryAccess(
+			_Output & output, Instruction instruction, ValueType type, Register mId
+			) {
+				Internal::InstructionMemoryStructure::VectorMemoryAccess s;
+				s.Instruction = instruction;
+				s.Type = type;
+				s.MId = mId;
+
+				output.Push(&s, sizeof s);
+				return * this;
+			}
+
+		inline BasicAssemblyWriter & _FrameAccess(
+			_Output & output, Instruction instruction, Register spId, std::int32_t offset
+			) {
+				Internal::InstructionMemoryStructure::FrameAccess s;
+				s.Instruction = instruction;
+				s.SpId = spId;
+				s.Offset = offset;
+
+				output.Push(&s, sizeof s);
+				return * this;
+			}
+
+		inline BasicAssemblyWriter & _StackOperation(
+			_Output & output, Instruction instruction, ValueType type
+			) {
+				Internal::InstructionMemoryStructure::StackOperation s;
+				s.Instruction = instruction;
+				s.Type = type;
+
+				output.Push(&s, sizeof s);
+				return * this;
+			}
+
+		inline BasicAssemblyWriter & _ConstantAccess(
+			_Output & output, Instruction instruction, ValueType type, constref_t constant
+			) {
+				Internal::InstructionMemoryStructure::ConstantAccess s;
+				s.Instruction = instruction;
+				s.Type = type;
+				s.Constant = constant;
+
+				output.Push(&s, sizeof s);
+				return * this;
+			}
+
 	public:
-		inline AssemblyWriter & Nop(
-			DynamicBuffer & output
+		inline BasicAssemblyWriter & Nop(
+			_Output & output
 			) {
 				Internal::InstructionMemoryStructure::Nop s;
 				s.Instruction = Instruction::nop;
@@ -65,8 +354,8 @@ namespace Nova {
 				return * this;
 			}
 
-		inline AssemblyWriter & PushI4C(
-			DynamicBuffer & output, std::int32_t value
+		inline BasicAssemblyWriter & PushI4C(
+			_Output & output, std::int32_t value
 			) {
 				Internal::InstructionMemoryStructure::PushI4C s;
 				s.Instruction = Instruction::push_i4c;
@@ -76,8 +365,8 @@ namespace Nova {
 				return * this;
 			}
 		
-		inline AssemblyWriter & PushI4R(
-			DynamicBuffer & output, Register rId
+		inline BasicAssemblyWriter & PushI4R(
+			_Output & output, Register rId
 			) {
 				Internal::InstructionMemoryStructure::PushI4R s;
 				s.Instruction = Instruction::push_i4r;
@@ -87,8 +376,8 @@ namespace Nova {
 				return * this;
 			}
 		
-		inline AssemblyWriter & SetI4R(
-			DynamicBuffer & output, Register rId
+		inline BasicAssemblyWriter & SetI4R(
+			_Output & output, Register rId
 			) {
 				Internal::InstructionMemoryStructure::SetI4R s;
 				s.Instruction = Instruction::set_i4r;
@@ -98,8 +387,8 @@ namespace Nova {
 				return * this;
 			}
 
-		inline AssemblyWriter & AddI4(
-			DynamicBuffer & output
+		inline BasicAssemblyWriter & AddI4(
+			_Output & output
 			) {
 				Internal::InstructionMemoryStructure::AddI4 s;
 				s.Instruction = Instruction::add_i4;
@@ -108,8 +397,8 @@ namespace Nova {
 				return * this;
 			}
 
-		inline AssemblyWriter & Call(
-			DynamicBuffer & output, const scoperef_t & scope
+		inline BasicAssemblyWriter & Call(
+			_Output & output, const scoperef_t & scope
 			) {
 				Internal::InstructionMemoryStructure::Call s;
 				s.Instruction = Instruction::call;
@@ -119,8 +408,8 @@ namespace Nova {
 				return * this;
 			}
 		
-		inline AssemblyWriter & XCall(
-			DynamicBuffer & output, const scoperef_t & scope
+		inline BasicAssemblyWriter & XCall(
+			_Output & output, const scoperef_t & scope
 			) {
 				Internal::InstructionMemoryStructure::XCall s;
 				s.Instruction = Instruction::xcall;
@@ -130,17 +419,783 @@ namespace Nova {
 				return * this;
 			}
 							
-		inline AssemblyWriter & Ret(
-			DynamicBuffer & output
+		inline BasicAssemblyWriter & Ret(
+			_Output & output
 			) {
 				Internal::InstructionMemoryStructure::Ret s;
 				s.Instruction = Instruction::ret;
 
+				output.Push(&s, sizeof s);
+				return * this;
+			}
+
+		inline BasicAssemblyWriter & Alloc(
+			_Output & output, Register mId
+			) {
+				Internal::InstructionMemoryStructure::Alloc s;
+				s.Instruction = Instruction::alloc;
+				s.MId = mId;
+
+				output.Push(&s, sizeof s);
+				return * this;
+			}
+
+		inline BasicAssemblyWriter & PushRfR(
+			_Output & output, Register mId
+			) {
+				Internal::InstructionMemoryStructure::PushRfR s;
+				s.Instruction = Instruction::push_rfr;
+				s.MId = mId;
+
+				output.Push(&s, sizeof s);
+				return * this;
+			}
+
+		inline BasicAssemblyWriter & SetRfR(
+			_Output & output, Register mId
+			) {
+				Internal::InstructionMemoryStructure::SetRfR s;
+				s.Instruction = Instruction::set_rfr;
+				s.MId = mId;
+
+				output.Push(&s, sizeof s);
+				return * this;
+			}
+
+		inline BasicAssemblyWriter & LdI1M(
+			_Output & output, Register mId, std::int32_t offset
+			) {
+				return _MemoryAccess(output, Instruction::ld_i1m, mId, offset);
+			}
+
+		inline BasicAssemblyWriter & LdI2M(
+			_Output & output, Register mId, std::int32_t offset
+			) {
+				return _MemoryAccess(output, Instruction::ld_i2m, mId, offset);
+			}
+
+		inline BasicAssemblyWriter & LdI4M(
+			_Output & output, Register mId, std::int32_t offset
+			) {
+				return _MemoryAccess(output, Instruction::ld_i4m, mId, offset);
+			}
+
+		inline BasicAssemblyWriter & LdI8M(
+			_Output & output, Register mId, std::int32_t offset
+			) {
+				return _MemoryAccess(output, Instruction::ld_i8m, mId, offset);
+			}
+
+		inline BasicAssemblyWriter & LdFsM(
+			_Output & output, Register mId, std::int32_t offset
+			) {
+				return _MemoryAccess(output, Instruction::ld_fsm, mId, offset);
+			}
+
+		inline BasicAssemblyWriter & LdFdM(
+			_Output & output, Register mId, std::int32_t offset
+			) {
+				return _MemoryAccess(output, Instruction::ld_fdm, mId, offset);
+			}
+
+		inline BasicAssemblyWriter & LdRfM(
+			_Output & output, Register mId, std::int32_t offset
+			) {
+				return _MemoryAccess(output, Instruction::ld_rfm, mId, offset);
+			}
+
+		inline BasicAssemblyWriter & StI1M(
+			_Output & output, Register mId, std::int32_t offset
+			) {
+				return _MemoryAccess(output, Instruction::st_i1m, mId, offset);
+			}
+
+		inline BasicAssemblyWriter & StI2M(
+			_Output & output, Register mId, std::int32_t offset
+			) {
+				return _MemoryAccess(output, Instruction::st_i2m, mId, offset);
+			}
+
+		inline BasicAssemblyWriter & StI4M(
+			_Output & output, Register mId, std::int32_t offset
+			) {
+				return _MemoryAccess(output, Instruction::st_i4m, mId, offset);
+			}
+
+		inline BasicAssemblyWriter & StI8M(
+			_Output & output, Register mId, std::int32_t offset
+			) {
+				return _MemoryAccess(output, Instruction::st_i8m, mId, offset);
+			}
+
+		inline BasicAssemblyWriter & StFsM(
+			_Output & output, Register mId, std::int32_t offset
+			) {
+				return _MemoryAccess(output, Instruction::st_fsm, mId, offset);
+			}
+
+		inline BasicAssemblyWriter & StFdM(
+			_Output & output, Register mId, std::int32_t offset
+			) {
+				return _MemoryAccess(output, Instruction::st_fdm, mId, offset);
+			}
+
+		inline BasicAssemblyWriter & StRfM(
+			_Output & output, Register mId, std::int32_t offset
+			) {
+				return _MemoryAccess(output, Instruction::st_rfm, mId, offset);
+			}
+
+		inline BasicAssemblyWriter & LdxI1M(
+			_Output & output, Register mId
+			) {
+				return _IndexedAccess(output, Instruction::ldx_i1m, mId);
+			}
+
+		inline BasicAssemblyWriter & LdxI2M(
+			_Output & output, Register mId
+			) {
+				return _IndexedAccess(output, Instruction::ldx_i2m, mId);
+			}
+
+		inline BasicAssemblyWriter & LdxI4M(
+			_Output & output, Register mId
+			) {
+				return _IndexedAccess(output, Instruction::ldx_i4m, mId);
+			}
+
+		inline BasicAssemblyWriter & LdxI8M(
+			_Output & output, Register mId
+			) {
+				return _IndexedAccess(output, Instruction::ldx_i8m, mId);
+			}
+
+		inline BasicAssemblyWriter & LdxFsM(
+			_Output & output, Register mId
+			) {
+				return _IndexedAccess(output, Instruction::ldx_fsm, mId);
+			}
+
+		inline BasicAssemblyWriter & LdxFdM(
+			_Output & output, Register mId
+			) {
+				return _IndexedAccess(output, Instruction::ldx_fdm, mId);
+			}
+
+		inline BasicAssemblyWriter & StxI1M(
+			_Output & output, Register mId
+			) {
+				return _IndexedAccess(output, Instruction::stx_i1m, mId);
+			}
+
+		inline BasicAssemblyWriter & StxI2M(
+			_Output & output, Register mId
+			) {
+				return _IndexedAccess(output, Instruction::stx_i2m, mId);
+			}
+
+		inline BasicAssemblyWriter & StxI4M(
+			_Output & output, Register mId
+			) {
+				return _IndexedAccess(output, Instruction::stx_i4m, mId);
+			}
+
+		inline BasicAssemblyWriter & StxI8M(
+			_Output & output, Register mId
+			) {
+				return _IndexedAccess(output, Instruction::stx_i8m, mId);
+			}
+
+		inline BasicAssemblyWriter & StxFsM(
+			_Output & output, Register mId
+			) {
+				return _IndexedAccess(output, Instruction::stx_fsm, mId);
+			}
+
+		inline BasicAssemblyWriter & StxFdM(
+			_Output & output, Register mId
+			) {
+				return _IndexedAccess(output, Instruction::stx_fdm, mId);
+			}
+
+		inline BasicAssemblyWriter & FillI1M(
+			_Output & output, Register mId
+			) {
+				return _IndexedAccess(output, Instruction::fill_i1m, mId);
+			}
+
+		inline BasicAssemblyWriter & FillI2M(
+			_Output & output, Register mId
+			) {
+				return _IndexedAccess(output, Instruction::fill_i2m, mId);
+			}
+
+		inline BasicAssemblyWriter & FillI4M(
+			_Output & output, Register mId
+			) {
+				return _IndexedAccess(output, Instruction::fill_i4m, mId);
+			}
+
+		inline BasicAssemblyWriter & FillI8M(
+			_Output & output, Register mId
+			) {
+				return _IndexedAccess(output, Instruction::fill_i8m, mId);
+			}
+
+		inline BasicAssemblyWriter & FillFsM(
+			_Output & output, Register mId
+			) {
+				return _IndexedAccess(output, Instruction::fill_fsm, mId);
+			}
+
+		inline BasicAssemblyWriter & FillFdM(
+			_Output & output, Register mId
+			) {
+				return _IndexedAccess(output, Instruction::fill_fdm, mId);
+			}
+
+		inline BasicAssemblyWriter & LenM(
+			_Output & output, Register mId
+			) {
+				return _IndexedAccess(output, Instruction::len_m, mId);
+			}
+
+		inline BasicAssemblyWriter & CopyM(
+			_Output & output, Register destinationMId, Register sourceMId
+			) {
+				Internal::InstructionMemoryStructure::MemoryCopy s;
+				s.Instruction = Instruction::copy_m;
+				s.DestinationMId = destinationMId;
+				s.SourceMId = sourceMId;
+
+				output.Push(&s, sizeof s);
+				return * this;
+			}
+
+		inline BasicAssemblyWriter & AddV(
+			_Output & output, ValueType type
+			) {
+				return _VectorOperation(output, Instruction::add_v, type);
+			}
+
+		inline BasicAssemblyWriter & SubV(
+			_Output & output, ValueType type
+			) {
+				return _VectorOperation(output, Instruction::sub_v, type);
+			}
+
+		inline BasicAssemblyWriter & MulV(
+			_Output & output, ValueType type
+			) {
+				return _VectorOperation(output, Instruction::mul_v, type);
+			}
+
+		inline BasicAssemblyWriter & MinV(
+			_Output & output, ValueType type
+			) {
+				return _VectorOperation(output, Instruction::min_v, type);
+			}
+
+		inline BasicAssemblyWriter & MaxV(
+			_Output & output, ValueType type
+			) {
+				return _VectorOperation(output, Instruction::max_v, type);
+			}
+
+		inline BasicAssemblyWriter & CmpEqV(
+			_Output & output, ValueType type
+			) {
+				return _VectorOperation(output, Instruction::cmpeq_v, type);
+			}
+
+		inline BasicAssemblyWriter & CmpLtV(
+			_Output & output, ValueType type
+			) {
+				return _VectorOperation(output, Instruction::cmplt_v, type);
+			}
+
+		inline BasicAssemblyWriter & BlendV(
+			_Output & output, ValueType type
+			) {
+				return _VectorOperation(output, Instruction::blend_v, type);
+			}
+
+		inline BasicAssemblyWriter & SplatV(
+			_Output & output, ValueType type
+			) {
+				return _VectorOperation(output, Instruction::splat_v, type);
+			}
+
+		inline BasicAssemblyWriter & HAddV(
+			_Output & output, ValueType type
+			) {
+				return _VectorOperation(output, Instruction::hadd_v, type);
+			}
+
+		inline BasicAssemblyWriter & HMinV(
+			_Output & output, ValueType type
+			) {
+				return _VectorOperation(output, Instruction::hmin_v, type);
+			}
+
+		inline BasicAssemblyWriter & HMaxV(
+			_Output & output, ValueType type
+			) {
+				return _VectorOperation(output, Instruction::hmax_v, type);
+			}
+
+		inline BasicAssemblyWriter & PushVR(
+			_Output & output, ValueType type, Register vId
+			) {
+				return _VectorRegisterAccess(output, Instruction::push_vr, type, vId);
+			}
+
+		inline BasicAssemblyWriter & SetVR(
+			_Output & output, ValueType type, Register vId
+			) {
+				return _VectorRegisterAccess(output, Instruction::set_vr, type, vId);
+			}
+
+		/// <param name='lanes'>Index of the source lane for every lane of the result.</param>
+		inline BasicAssemblyWriter & ShuffleV(
+			_Output & output, ValueType type, const std::uint8_t * lanes
+			) {
+				Internal::InstructionMemoryStructure::VectorShuffle s;
+				s.Instruction = Instruction::shuffle_v;
+				s.Type = type;
+				memset(s.Lanes, 0, sizeof s.Lanes);
+				memcpy(s.Lanes, lanes, std::min(GetVectorLaneCount(type), sizeof s.Lanes));
+
+				output.Push(&s, sizeof s);
+				return * this;
+			}
+
+		inline BasicAssemblyWriter & LdxVM(
+			_Output & output, ValueType type, Register mId
+			) {
+				return _VectorMemoryAccess(output, Instruction::ldx_vm, type, mId);
+			}
+
+		inline BasicAssemblyWriter & StxVM(
+			_Output & output, ValueType type, Register mId
+			) {
+				return _VectorMemoryAccess(output, Instruction::stx_vm, type, mId);
+			}
+
+		inline BasicAssemblyWriter & CmpEqI4(
+			_Output & output
+			) {
+				return _Compare(output, Instruction::cmpeq_i4);
+			}
+
+		inline BasicAssemblyWriter & CmpNeI4(
+			_Output & output
+			) {
+				return _Compare(output, Instruction::cmpne_i4);
+			}
+
+		inline BasicAssemblyWriter & CmpLtI4(
+			_Output & output
+			) {
+				return _Compare(output, Instruction::cmplt_i4);
+			}
+
+		inline BasicAssemblyWriter & CmpLeI4(
+			_Output & output
+			) {
+				return _Compare(output, Instruction::cmple_i4);
+			}
+
+		inline BasicAssemblyWriter & CmpGtI4(
+			_Output & output
+			) {
+				return _Compare(output, Instruction::cmpgt_i4);
+			}
+
+		inline BasicAssemblyWriter & CmpGeI4(
+			_Output & output
+			) {
+				return _Compare(output, Instruction::cmpge_i4);
+			}
+
+		/// <summary>
+		/// Creates a label, which has to be bound before the code is used.
+		/// </summary>
+		inline label_t CreateLabel(
+			) {
+				_Label label;
+				label.Output = nullptr;
+				label.Offset = 0;
+				_labels.push_back(label);
+				return _labels.size() - 1;
+			}
+
+		/// <summary>
+		/// Binds the label to the end of the output, so it targets the next instruction written, and
+		/// fixes up the branches already written to it.
+		/// </summary>
+		inline BasicAssemblyWriter & BindLabel(
+			_Output & output, label_t label
+			) {
+				_Label & target = _GetLabel(label);
+				if (target.Output != nullptr)
+					throw InvalidArgumentException("The label is already bound.");
+				target.Output = &output;
+				target.Offset = output.GetSize();
+
+				auto end = std::partition(_fixups.begin(), _fixups.end(),
+					[label] (const _Fixup & fixup) {
+						return fixup.Label != label;
+					});
+				for (auto i = end; i != _fixups.end(); ++i) {
+					if (i->Output != &output)
+						throw InvalidArgumentException("The label is bound to another buffer.");
+
+					Internal::InstructionMemoryStructure::Base base;
+					output.Read(&base, i->InstructionOffset, sizeof base);
+					if (base.Instruction == Instruction::djnz_i4r) {
+						Internal::InstructionMemoryStructure::DecrementBranch s;
+						output.Read(&s, i->InstructionOffset, sizeof s);
+						s.Offset = _GetBranchOffset(i->InstructionOffset + sizeof s, target.Offset);
+						output.Write(&s, i->InstructionOffset, sizeof s);
+					} else {
+						Internal::InstructionMemoryStructure::Branch s;
+						output.Read(&s, i->InstructionOffset, sizeof s);
+						s.Offset = _GetBranchOffset(i->InstructionOffset + sizeof s, target.Offset);
+						output.Write(&s, i->InstructionOffset, sizeof s);
+					}
+				}
+				_fixups.erase(end, _fixups.end());
+
+				return * this;
+			}
+
+		/// <summary>
+		/// Returns true if any branch targets a label that isn't bound yet.
+		/// </summary>
+		inline bool HasUnresolvedLabels(
+			) const {
+				return !_fixups.empty();
+			}
+
+		/// <param name='offset'>Offset of the target, relative to the end of the instruction.</param>
+		inline BasicAssemblyWriter & Jmp(
+			_Output & output, std::int32_t offset
+			) {
+				Internal::InstructionMemoryStructure::Branch s;
+				s.Instruction = Instruction::jmp;
+				s.Offset = offset;
+
+				output.Push(&s, sizeof s);
+				return * this;
+			}
+
+		inline BasicAssemblyWriter & Jmp(
+			_Output & output, label_t label
+			) {
+				return _Branch(output, Instruction::jmp, label);
+			}
+
+		inline BasicAssemblyWriter & Jt(
+			_Output & output, label_t label
+			) {
+				return _Branch(output, Instruction::jt, label);
+			}
+
+		inline BasicAssemblyWriter & Jf(
+			_Output & output, label_t label
+			) {
+				return _Branch(output, Instruction::jf, label);
+			}
+
+		inline BasicAssemblyWriter & JeqI4(
+			_Output & output, label_t label
+			) {
+				return _Branch(output, Instruction::jeq_i4, label);
+			}
+
+		inline BasicAssemblyWriter & JneI4(
+			_Output & output, label_t label
+			) {
+				return _Branch(output, Instruction::jne_i4, label);
+			}
+
+		inline BasicAssemblyWriter & JltI4(
+			_Output & output, label_t label
+			) {
+				return _Branch(output, Instruction::jlt_i4, label);
+			}
+
+		inline BasicAssemblyWriter & JleI4(
+			_Output & output, label_t label
+			) {
+				return _Branch(output, Instruction::jle_i4, label);
+			}
+
+		inline BasicAssemblyWriter & JgtI4(
+			_Output & output, label_t label
+			) {
+				return _Branch(output, Instruction::jgt_i4, label);
+			}
+
+		inline BasicAssemblyWriter & JgeI4(
+			_Output & output, label_t label
+			) {
+				return _Branch(output, Instruction::jge_i4, label);
+			}
+
+		/// <summary>
+		/// Writes any of jmp, jt, jf or the j*_i4 instructions.
+		/// </summary>
+		inline BasicAssemblyWriter & Branch(
+			_Output & output, Instruction instruction, label_t label
+			) {
+				if (instruction < Instruction::jmp || instruction > Instruction::jge_i4)
+					throw InvalidArgumentException("The instruction isn't a branch.");
+				return _Branch(output, instruction, label);
+			}
+
+		/// <summary>
+		/// Decrements the r register and branches to the label if it isn't zero.
+		/// </summary>
+		inline BasicAssemblyWriter & DjnzI4R(
+			_Output & output, Register rId, label_t label
+			) {
+				Internal::InstructionMemoryStructure::DecrementBranch s;
+				s.Instruction = Instruction::djnz_i4r;
+				s.RId = rId;
+				s.Offset = _ResolveBranch(output, label, sizeof s);
+
+				output.Push(&s, sizeof s);
+				return * this;
+			}
+
+		inline BasicAssemblyWriter & Send(
+			_Output & output, chanref_t channel
+			) {
+				Internal::InstructionMemoryStructure::ChannelAccess s;
+				s.Instruction = Instruction::send;
+				s.Channel = channel;
+
+				output.Push(&s, sizeof s);
+				return * this;
+			}
+
+		inline BasicAssemblyWriter & Recv(
+			_Output & output, chanref_t channel
+			) {
+				Internal::InstructionMemoryStructure::ChannelAccess s;
+				s.Instruction = Instruction::recv;
+				s.Channel = channel;
+
+				output.Push(&s, sizeof s);
+				return * this;
+			}
+
+		inline BasicAssemblyWriter & SendM(
+			_Output & output, chanref_t channel, Register mId
+			) {
+				Internal::InstructionMemoryStructure::ChannelMemoryAccess s;
+				s.Instruction = Instruction::send_m;
+				s.Channel = channel;
+				s.MId = mId;
+
+				output.Push(&s, sizeof s);
+				return * this;
+			}
+
+		inline BasicAssemblyWriter & RecvM(
+			_Output & output, chanref_t channel, Register mId
+			) {
+				Internal::InstructionMemoryStructure::ChannelMemoryAccess s;
+				s.Instruction = Instruction::recv_m;
+				s.Channel = channel;
+				s.MId = mId;
+
+				output.Push(&s, sizeof s);
+				return * this;
+			}
+
+		/// <summary>
+		/// Maps the scope over the elements of the object in sourceMId, storing the results in the
+		/// object in destinationMId.
+		/// </summary>
+		inline BasicAssemblyWriter & PMap(
+			_Output & output, scoperef_t scope, Register sourceMId, Register destinationMId
+			) {
+				Internal::InstructionMemoryStructure::ParallelMap s;
+				s.Instruction = Instruction::pmap;
+				s.Scope = scope;
+				s.SourceMId = sourceMId;
+				s.DestinationMId = destinationMId;
+
+				output.Push(&s, sizeof s);
+				return * this;
+			}
+
+		/// <summary>
+		/// Sets the stack-frame register to the top of the stack.
+		/// </summary>
+		inline BasicAssemblyWriter & SetSpR(
+			_Output & output, Register spId
+			) {
+				Internal::InstructionMemoryStructure::SetSpR s;
+				s.Instruction = Instruction::set_spr;
+				s.SpId = spId;
+
+				output.Push(&s, sizeof s);
+				return * this;
+			}
+
+		inline BasicAssemblyWriter & LdI1S(
+			_Output & output, Register spId, std::int32_t offset
+			) {
+				return _FrameAccess(output, Instruction::ld_i1s, spId, offset);
+			}
+
+		inline BasicAssemblyWriter & LdI2S(
+			_Output & output, Register spId, std::int32_t offset
+			) {
+				return _FrameAccess(output, Instruction::ld_i2s, spId, offset);
+			}
+
+		inline BasicAssemblyWriter & LdI4S(
+			_Output & output, Register spId, std::int32_t offset
+			) {
+				return _FrameAccess(output, Instruction::ld_i4s, spId, offset);
+			}
+
+		inline BasicAssemblyWriter & LdI8S(
+			_Output & output, Register spId, std::int32_t offset
+			) {
+				return _FrameAccess(output, Instruction::ld_i8s, spId, offset);
+			}
+
+		inline BasicAssemblyWriter & LdFsS(
+			_Output & output, Register spId, std::int32_t offset
+			) {
+				return _FrameAccess(output, Instruction::ld_fss, spId, offset);
+			}
+
+		inline BasicAssemblyWriter & LdFdS(
+			_Output & output, Register spId, std::int32_t offset
+			) {
+				return _FrameAccess(output, Instruction::ld_fds, spId, offset);
+			}
+
+		inline BasicAssemblyWriter & LdRfS(
+			_Output & output, Register spId, std::int32_t offset
+			) {
+				return _FrameAccess(output, Instruction::ld_rfs, spId, offset);
+			}
+
+		inline BasicAssemblyWriter & StI1S(
+			_Output & output, Register spId, std::int32_t offset
+			) {
+				return _FrameAccess(output, Instruction::st_i1s, spId, offset);
+			}
+
+		inline BasicAssemblyWriter & StI2S(
+			_Output & output, Register spId, std::int32_t offset
+			) {
+				return _FrameAccess(output, Instruction::st_i2s, spId, offset);
+			}
+
+		inline BasicAssemblyWriter & StI4S(
+			_Output & output, Register spId, std::int32_t offset
+			) {
+				return _FrameAccess(output, Instruction::st_i4s, spId, offset);
+			}
+
+		inline BasicAssemblyWriter & StI8S(
+			_Output & output, Register spId, std::int32_t offset
+			) {
+				return _FrameAccess(output, Instruction::st_i8s, spId, offset);
+			}
+
+		inline BasicAssemblyWriter & StFsS(
+			_Output & output, Register spId, std::int32_t offset
+			) {
+				return _FrameAccess(output, Instruction::st_fss, spId, offset);
+			}
+
+		inline BasicAssemblyWriter & StFdS(
+			_Output & output, Register spId, std::int32_t offset
+			) {
+				return _FrameAccess(output, Instruction::st_fds, spId, offset);
+			}
+
+		inline BasicAssemblyWriter & StRfS(
+			_Output & output, Register spId, std::int32_t offset
+			) {
+				return _FrameAccess(output, Instruction::st_rfs, spId, offset);
+			}
+
+		inline BasicAssemblyWriter & Dup(
+			_Output & output, ValueType type
+			) {
+				return _StackOperation(output, Instruction::dup, type);
+			}
+
+		inline BasicAssemblyWriter & Swap(
+			_Output & output, ValueType type
+			) {
+				return _StackOperation(output, Instruction::swap, type);
+			}
+
+		/// <param name='offset'>Number of bytes between the end of the value and the top of the stack.</param>
+		inline BasicAssemblyWriter & Pick(
+			_Output & output, ValueType type, std::int32_t offset
+			) {
+				Internal::InstructionMemoryStructure::StackPick s;
+				s.Instruction = Instruction::pick;
+				s.Type = type;
+				s.Offset = offset;
+
+				output.Push(&s, sizeof s);
+				return * this;
+			}
+
+		/// <param name='size'>Number of bytes removed from the top of the stack.</param>
+		inline BasicAssemblyWriter & DropN(
+			_Output & output, std::int32_t size
+			) {
+				Internal::InstructionMemoryStructure::StackDrop s;
+				s.Instruction = Instruction::drop_n;
+				s.Size = size;
+
+				output.Push(&s, sizeof s);
+				return * this;
+			}
+
+		inline BasicAssemblyWriter & LdK(
+			_Output & output, ValueType type, constref_t constant
+			) {
+				return _ConstantAccess(output, Instruction::ld_k, type, constant);
+			}
+
+		/// <param name='type'>Type of the elements of the array constant.</param>
+		inline BasicAssemblyWriter & LdxK(
+			_Output & output, ValueType type, constref_t constant
+			) {
+				return _ConstantAccess(output, Instruction::ldx_k, type, constant);
+			}
+
+		inline BasicAssemblyWriter & AllocK(
+			_Output & output, Register mId, constref_t constant
+			) {
+				Internal::InstructionMemoryStructure::ConstantAllocation s;
+				s.Instruction = Instruction::alloc_k;
+				s.MId = mId;
+				s.Constant = constant;
+
 				output.Push(&s, sizeof s);
 				return * this;
 			}
 	};
 
+	typedef BasicAssemblyWriter<DynamicBuffer> AssemblyWriter;
+
 	class AssemblyReader {
 		inline void _ThrowIfInvalidInstruction(
 			const DynamicBuffer::ConstIterator & bufferIterator, Instruction instruction
@@ -150,45 +1205,200 @@ namespace Nova {
 			}
 
 	public:
+		/// <summary>
+		/// Returns the size of an instruction, or zero if the instruction doesn't exist.
+		/// </summary>
+		/// <remarks>
+		/// The cases only return constants, so compilers lower the switch to a table lookup instead of
+		/// an indirect jump, keeping it off the branch predictor in the interpreter loop.
+		/// </remarks>
+		static inline size_t GetInstructionSize(
+			Instruction instruction
+			) {
+				switch (instruction) {
+				case Instruction::nop:
+					return sizeof Internal::InstructionMemoryStructure::Nop;
+				case Instruction::push_i4c:
+					return sizeof Internal::InstructionMemoryStructure::PushI4C;
+				case Instruction::push_i4r:
+					return sizeof Internal::InstructionMemoryStructure::PushI4R;
+				case Instruction::add_i4:
+					return sizeof Internal::InstructionMemoryStructure::AddI4;
+				case Instruction::set_i4r:
+					return sizeof Internal::InstructionMemoryStructure::SetI4R;
+				case Instruction::call:
+					return sizeof Internal::InstructionMemoryStructure::Call;
+				case Instruction::xcall:
+					return sizeof Internal::InstructionMemoryStructure::XCall;
+				case Instruction::ret:
+					return sizeof Internal::InstructionMemoryStructure::Ret;
+				case Instruction::alloc:
+					return sizeof Internal::InstructionMemoryStructure::Alloc;
+				case Instruction::push_rfr:
+					return sizeof Internal::InstructionMemoryStructure::PushRfR;
+				case Instruction::set_rfr:
+					return sizeof Internal::InstructionMemoryStructure::SetRfR;
+				case Instruction::ld_i1m:
+				case Instruction::ld_i2m:
+				case Instruction::ld_i4m:
+				case Instruction::ld_i8m:
+				case Instruction::ld_fsm:
+				case Instruction::ld_fdm:
+				case Instruction::ld_rfm:
+				case Instruction::st_i1m:
+				case Instruction::st_i2m:
+				case Instruction::st_i4m:
+				case Instruction::st_i8m:
+				case Instruction::st_fsm:
+				case Instruction::st_fdm:
+				case Instruction::st_rfm:
+					return sizeof Internal::InstructionMemoryStructure::MemoryAccess;
+				case Instruction::ldx_i1m:
+				case Instruction::ldx_i2m:
+				case Instruction::ldx_i4m:
+				case Instruction::ldx_i8m:
+				case Instruction::ldx_fsm:
+				case Instruction::ldx_fdm:
+				case Instruction::stx_i1m:
+				case Instruction::stx_i2m:
+				case Instruction::stx_i4m:
+				case Instruction::stx_i8m:
+				case Instruction::stx_fsm:
+				case Instruction::stx_fdm:
+				case Instruction::fill_i1m:
+				case Instruction::fill_i2m:
+				case Instruction::fill_i4m:
+				case Instruction::fill_i8m:
+				case Instruction::fill_fsm:
+				case Instruction::fill_fdm:
+				case Instruction::len_m:
+					return sizeof Internal::InstructionMemoryStructure::IndexedAccess;
+				case Instruction::copy_m:
+					return sizeof Internal::InstructionMemoryStructure::MemoryCopy;
+				case Instruction::add_v:
+				case Instruction::sub_v:
+				case Instruction::mul_v:
+				case Instruction::min_v:
+				case Instruction::max_v:
+				case Instruction::cmpeq_v:
+				case Instruction::cmplt_v:
+				case Instruction::blend_v:
+				case Instruction::splat_v:
+				case Instruction::hadd_v:
+				case Instruction::hmin_v:
+				case Instruction::hmax_v:
+					return sizeof Internal::InstructionMemoryStructure::VectorOperation;
+				case Instruction::push_vr:
+				case Instruction::set_vr:
+					return sizeof Internal::InstructionMemoryStructure::VectorRegisterAccess;
+				case Instruction::shuffle_v:
+					return sizeof Internal::InstructionMemoryStructure::VectorShuffle;
+				case Instruction::ldx_vm:
+				case Instruction::stx_vm:
+					return sizeof Internal::InstructionMemoryStructure::VectorMemoryAccess;
+				case Instruction::cmpeq_i4:
+				case Instruction::cmpne_i4:
+				case Instruction::cmplt_i4:
+				case Instruction::cmple_i4:
+				case Instruction::cmpgt_i4:
+				case Instruction::cmpge_i4:
+					return sizeof Internal::InstructionMemoryStructure::Compare;
+				case Instruction::jmp:
+				case Instruction::jt:
+				case Instruction::jf:
+				case Instruction::jeq_i4:
+				case Instruction::jne_i4:
+				case Instruction::jlt_i4:
+				case Instruction::jle_i4:
+				case Instruction::jgt_i4:
+				case Instruction::jge_i4:
+					return sizeof Internal::InstructionMemoryStructure::Branch;
+				case Instruction::djnz_i4r:
+					return sizeof Internal::InstructionMemoryStructure::DecrementBranch;
+				case Instruction::send:
+				case Instruction::recv:
+					return sizeof Internal::InstructionMemoryStructure::ChannelAccess;
+				case Instruction::send_m:
+				case Instruction::recv_m:
+					return sizeof Internal::InstructionMemoryStructure::ChannelMemoryAccess;
+				case Instruction::pmap:
+					return sizeof Internal::InstructionMemoryStructure::ParallelMap;
+				case Instruction::set_spr:
+					return sizeof Internal::InstructionMemoryStructure::SetSpR;
+				case Instruction::ld_i1s:
+				case Instruction::ld_i2s:
+				case Instruction::ld_i4s:
+				case Instruction::ld_i8s:
+				case Instruction::ld_fss:
+				case Instruction::ld_fds:
+				case Instruction::ld_rfs:
+				case Instruction::st_i1s:
+				case Instruction::st_i2s:
+				case Instruction::st_i4s:
+				case Instruction::st_i8s:
+				case Instruction::st_fss:
+				case Instruction::st_fds:
+				case Instruction::st_rfs:
+					return sizeof Internal::InstructionMemoryStructure::FrameAccess;
+				case Instruction::dup:
+				case Instruction::swap:
+					return sizeof Internal::InstructionMemoryStructure::StackOperation;
+				case Instruction::pick:
+					return sizeof Internal::InstructionMemoryStructure::StackPick;
+				case Instruction::drop_n:
+					return sizeof Internal::InstructionMemoryStructure::StackDrop;
+				case Instruction::ld_k:
+				case Instruction::ldx_k:
+					return sizeof Internal::InstructionMemoryStructure::ConstantAccess;
+				case Instruction::alloc_k:
+					return sizeof Internal::InstructionMemoryStructure::ConstantAllocation;
+				case Instruction::brk4:
+					return 4;
+				case Instruction::brk8:
+					return 8;
+				case Instruction::brk12:
+					return 12;
+				case Instruction::brk16:
+					return 16;
+				case Instruction::brk20:
+					return 20;
+				case Instruction::brk24:
+					return 24;
+				default:
+					return 0;
+				}
+			}
+
+		static inline bool IsBreakpoint(
+			Instruction instruction
+			) {
+				return instruction >= Instruction::brk4 && instruction <= Instruction::brk24;
+			}
+
+		/// <summary>
+		/// Returns the breakpoint trap which can replace an instruction of a size, or nop if none can.
+		/// </summary>
+		static inline Instruction GetBreakpoint(
+			size_t instructionSize
+			) {
+				if (instructionSize == 0 || instructionSize % 4 != 0 || instructionSize > 24)
+					return Instruction::nop;
+				return static_cast<Instruction>(static_cast<int>(Instruction::brk4) + static_cast<int>(instructionSize / 4) - 1);
+			}
+
 		inline void GoNextInstruction(
 			DynamicBuffer::ConstIterator & buffer
 			) const {
-				switch (GetInstructionId(buffer)) {
-				case Instruction::nop:
-					buffer.Skip(sizeof Internal::InstructionMemoryStructure::Nop);
-					break;
-				case Instruction::push_i4c:
-					buffer.Skip(sizeof Internal::InstructionMemoryStructure::PushI4C);
-					break;
-				case Instruction::push_i4r:
-					buffer.Skip(sizeof Internal::InstructionMemoryStructure::PushI4R);
-					break;
-				case Instruction::add_i4:
-					buffer.Skip(sizeof Internal::InstructionMemoryStructure::AddI4);
-					break;
-				case Instruction::set_i4r:
-					buffer.Skip(sizeof Internal::InstructionMemoryStructure::SetI4R);
-					break;
-				case Instruction::call:
-					buffer.Skip(sizeof Internal::InstructionMemoryStructure::Call);
-					break;
-				case Instruction::xcall:
-					buffer.Skip(sizeof Internal::InstructionMemoryStructure::XCall);
-					break;
-				case Instruction::ret:
-					buffer.Skip(sizeof Internal::InstructionMemoryStructure::Ret);
-					break;
-				default:
+				size_t size = GetInstructionSize(GetInstructionId(buffer));
+				if (size == 0)
 					throw RuntimeException("Unsupported instruction.");
-				}
+				buffer.Skip(size);
 			}
 
 		inline Instruction GetInstructionId(
 			const DynamicBuffer::ConstIterator & bufferIterator
 			) const {
-				Internal::InstructionMemoryStructure::Base baseInstruction;
-				bufferIterator.Read(&baseInstruction, sizeof baseInstruction);
-				return baseInstruction.Instruction;
+				return bufferIterator.Load<Internal::InstructionMemoryStructure::Base>().Instruction;
 			}
 
 		inline AssemblyReader & Nop(
@@ -278,8 +1488,357 @@ namespace Nova {
 			) {
 				_ThrowIfInvalidInstruction(bufferIterator, Instruction::ret);
 
-				Internal::InstructionMemoryStructure::Call instructionData;
+				Internal::InstructionMemoryStructure::Ret instructionData;
+				bufferIterator.Read(&instructionData, sizeof instructionData);
+
+				return * this;
+			}
+
+		inline AssemblyReader & Alloc(
+			const DynamicBuffer::ConstIterator & bufferIterator, Register & mId
+			) {
+				_ThrowIfInvalidInstruction(bufferIterator, Instruction::alloc);
+
+				Internal::InstructionMemoryStructure::Alloc instructionData;
+				bufferIterator.Read(&instructionData, sizeof instructionData);
+				mId = instructionData.MId;
+
+				return * this;
+			}
+
+		inline AssemblyReader & PushRfR(
+			const DynamicBuffer::ConstIterator & bufferIterator, Register & mId
+			) {
+				_ThrowIfInvalidInstruction(bufferIterator, Instruction::push_rfr);
+
+				Internal::InstructionMemoryStructure::PushRfR instructionData;
+				bufferIterator.Read(&instructionData, sizeof instructionData);
+				mId = instructionData.MId;
+
+				return * this;
+			}
+
+		inline AssemblyReader & SetRfR(
+			const DynamicBuffer::ConstIterator & bufferIterator, Register & mId
+			) {
+				_ThrowIfInvalidInstruction(bufferIterator, Instruction::set_rfr);
+
+				Internal::InstructionMemoryStructure::SetRfR instructionData;
+				bufferIterator.Read(&instructionData, sizeof instructionData);
+				mId = instructionData.MId;
+
+				return * this;
+			}
+
+		/// <summary>
+		/// Reads any of the ld_*m and st_*m instructions.
+		/// </summary>
+		inline AssemblyReader & MemoryAccess(
+			const DynamicBuffer::ConstIterator & bufferIterator, Register & mId, std::int32_t & offset
+			) {
+				Instruction instruction = GetInstructionId(bufferIterator);
+				if (instruction < Instruction::ld_i1m || instruction > Instruction::st_rfm)
+					throw InvalidArgumentException("The instruction is not valid for this method.");
+
+				Internal::InstructionMemoryStructure::MemoryAccess instructionData;
+				bufferIterator.Read(&instructionData, sizeof instructionData);
+				mId = instructionData.MId;
+				offset = instructionData.Offset;
+
+				return * this;
+			}
+
+		/// <summary>
+		/// Reads any of the ldx_*m, stx_*m and fill_*m instructions, or len_m.
+		/// </summary>
+		inline AssemblyReader & IndexedAccess(
+			const DynamicBuffer::ConstIterator & bufferIterator, Register & mId
+			) {
+				Instruction instruction = GetInstructionId(bufferIterator);
+				if (instruction < Instruction::ldx_i1m || instruction > Instruction::len_m)
+					throw InvalidArgumentException("The instruction is not valid for this method.");
+
+				Internal::InstructionMemoryStructure::IndexedAccess instructionData;
+				bufferIterator.Read(&instructionData, sizeof instructionData);
+				mId = instructionData.MId;
+
+				return * this;
+			}
+
+		inline AssemblyReader & CopyM(
+			const DynamicBuffer::ConstIterator & bufferIterator, Register & destinationMId, Register & sourceMId
+			) {
+				_ThrowIfInvalidInstruction(bufferIterator, Instruction::copy_m);
+
+				Internal::InstructionMemoryStructure::MemoryCopy instructionData;
+				bufferIterator.Read(&instructionData, sizeof instructionData);
+				destinationMId = instructionData.DestinationMId;
+				sourceMId = instructionData.SourceMId;
+
+				return * this;
+			}
+
+		/// <summary>
+		/// Reads any of the vector instructions taking only the type as operand.
+		/// </summary>
+		inline AssemblyReader & VectorOperation(
+			const DynamicBuffer::ConstIterator & bufferIterator, ValueType & type
+			) {
+				Instruction instruction = GetInstructionId(bufferIterator);
+				if (instruction < Instruction::add_v || instruction > Instruction::hmax_v)
+					throw InvalidArgumentException("The instruction is not valid for this method.");
+
+				Internal::InstructionMemoryStructure::VectorOperation instructionData;
+				bufferIterator.Read(&instructionData, sizeof instructionData);
+				type = instructionData.Type;
+
+				return * this;
+			}
+
+		/// <summary>
+		/// Reads push_vr or set_vr.
+		/// </summary>
+		inline AssemblyReader & VectorRegisterAccess(
+			const DynamicBuffer::ConstIterator & bufferIterator, ValueType & type, Register & vId
+			) {
+				Instruction instruction = GetInstructionId(bufferIterator);
+				if (instruction != Instruction::push_vr && instruction != Instruction::set_vr)
+					throw InvalidArgumentException("The instruction is not valid for this method.");
+
+				Internal::InstructionMemoryStructure::VectorRegisterAccess instructionData;
+				bufferIterator.Read(&instructionData, sizeof instructionData);
+				type = instructionData.Type;
+				vId = instructionData.VId;
+
+				return * this;
+			}
+
+		inline AssemblyReader & ShuffleV(
+			const DynamicBuffer::ConstIterator & bufferIterator, ValueType & type, std::uint8_t (& lanes)[8]
+			) {
+				_ThrowIfInvalidInstruction(bufferIterator, Instruction::shuffle_v);
+
+				Internal::InstructionMemoryStructure::VectorShuffle instructionData;
+				bufferIterator.Read(&instructionData, sizeof instructionData);
+				type = instructionData.Type;
+				memcpy(lanes, instructionData.Lanes, sizeof lanes);
+
+				return * this;
+			}
+
+		/// <summary>
+		/// Reads ldx_vm or stx_vm.
+		/// </summary>
+		inline AssemblyReader & VectorMemoryAccess(
+			const DynamicBuffer::ConstIterator & bufferIterator, ValueType & type, Register & mId
+			) {
+				Instruction instruction = GetInstructionId(bufferIterator);
+				if (instruction != Instruction::ldx_vm && instruction != Instruction::stx_vm)
+					throw InvalidArgumentException("The instruction is not valid for this method.");
+
+				Internal::InstructionMemoryStructure::VectorMemoryAccess instructionData;
+				bufferIterator.Read(&instructionData, sizeof instructionData);
+				type = instructionData.Type;
+				mId = instructionData.MId;
+
+				return * this;
+			}
+
+		/// <summary>
+		/// Reads any of the cmp*_i4 instructions.
+		/// </summary>
+		inline AssemblyReader & Compare(
+			const DynamicBuffer::ConstIterator & bufferIterator
+			) {
+				Instruction instruction = GetInstructionId(bufferIterator);
+				if (instruction < Instruction::cmpeq_i4 || instruction > Instruction::cmpge_i4)
+					throw InvalidArgumentException("The instruction is not valid for this method.");
+
+				Internal::InstructionMemoryStructure::Compare instructionData;
+				bufferIterator.Read(&instructionData, sizeof instructionData);
+
+				return * this;
+			}
+
+		/// <summary>
+		/// Reads jmp, jt, jf or any of the j*_i4 instructions.
+		/// </summary>
+		inline AssemblyReader & Branch(
+			const DynamicBuffer::ConstIterator & bufferIterator, std::int32_t & offset
+			) {
+				Instruction instruction = GetInstructionId(bufferIterator);
+				if (instruction < Instruction::jmp || instruction > Instruction::jge_i4)
+					throw InvalidArgumentException("The instruction is not valid for this method.");
+
+				Internal::InstructionMemoryStructure::Branch instructionData;
+				bufferIterator.Read(&instructionData, sizeof instructionData);
+				offset = instructionData.Offset;
+
+				return * this;
+			}
+
+		inline AssemblyReader & DjnzI4R(
+			const DynamicBuffer::ConstIterator & bufferIterator, Register & rId, std::int32_t & offset
+			) {
+				_ThrowIfInvalidInstruction(bufferIterator, Instruction::djnz_i4r);
+
+				Internal::InstructionMemoryStructure::DecrementBranch instructionData;
+				bufferIterator.Read(&instructionData, sizeof instructionData);
+				rId = instructionData.RId;
+				offset = instructionData.Offset;
+
+				return * this;
+			}
+
+		/// <summary>
+		/// Reads send or recv.
+		/// </summary>
+		inline AssemblyReader & ChannelAccess(
+			const DynamicBuffer::ConstIterator & bufferIterator, chanref_t & channel
+			) {
+				Instruction instruction = GetInstructionId(bufferIterator);
+				if (instruction != Instruction::send && instruction != Instruction::recv)
+					throw InvalidArgumentException("The instruction is not valid for this method.");
+
+				Internal::InstructionMemoryStructure::ChannelAccess instructionData;
+				bufferIterator.Read(&instructionData, sizeof instructionData);
+				channel = instructionData.Channel;
+
+				return * this;
+			}
+
+		/// <summary>
+		/// Reads send_m or recv_m.
+		/// </summary>
+		inline AssemblyReader & ChannelMemoryAccess(
+			const DynamicBuffer::ConstIterator & bufferIterator, chanref_t & channel, Register & mId
+			) {
+				Instruction instruction = GetInstructionId(bufferIterator);
+				if (instruction != Instruction::send_m && instruction != Instruction::recv_m)
+					throw InvalidArgumentException("The instruction is not valid for this method.");
+
+				Internal::InstructionMemoryStructure::ChannelMemoryAccess instructionData;
+				bufferIterator.Read(&instructionData, sizeof instructionData);
+				channel = instructionData.Channel;
+				mId = instructionData.MId;
+
+				return * this;
+			}
+
+		inline AssemblyReader & PMap(
+			const DynamicBuffer::ConstIterator & bufferIterator, scoperef_t & scope, Register & sourceMId,
+			Register & destinationMId
+			) {
+				_ThrowIfInvalidInstruction(bufferIterator, Instruction::pmap);
+
+				Internal::InstructionMemoryStructure::ParallelMap instructionData;
+				bufferIterator.Read(&instructionData, sizeof instructionData);
+				scope = instructionData.Scope;
+				sourceMId = instructionData.SourceMId;
+				destinationMId = instructionData.DestinationMId;
+
+				return * this;
+			}
+
+		inline AssemblyReader & SetSpR(
+			const DynamicBuffer::ConstIterator & bufferIterator, Register & spId
+			) {
+				_ThrowIfInvalidInstruction(bufferIterator, Instruction::set_spr);
+
+				Internal::InstructionMemoryStructure::SetSpR instructionData;
+				bufferIterator.Read(&instructionData, sizeof instructionData);
+				spId = instructionData.SpId;
+
+				return * this;
+			}
+
+		/// <summary>
+		/// Reads any of the ld_*s and st_*s instructions.
+		/// </summary>
+		inline AssemblyReader & FrameAccess(
+			const DynamicBuffer::ConstIterator & bufferIterator, Register & spId, std::int32_t & offset
+			) {
+				Instruction instruction = GetInstructionId(bufferIterator);
+				if (instruction < Instruction::ld_i1s || instruction > Instruction::st_rfs)
+					throw InvalidArgumentException("The instruction is not valid for this method.");
+
+				Internal::InstructionMemoryStructure::FrameAccess instructionData;
+				bufferIterator.Read(&instructionData, sizeof instructionData);
+				spId = instructionData.SpId;
+				offset = instructionData.Offset;
+
+				return * this;
+			}
+
+		/// <summary>
+		/// Reads dup or swap.
+		/// </summary>
+		inline AssemblyReader & StackOperation(
+			const DynamicBuffer::ConstIterator & bufferIterator, ValueType & type
+			) {
+				Instruction instruction = GetInstructionId(bufferIterator);
+				if (instruction != Instruction::dup && instruction != Instruction::swap)
+					throw InvalidArgumentException("The instruction is not valid for this method.");
+
+				Internal::InstructionMemoryStructure::StackOperation instructionData;
+				bufferIterator.Read(&instructionData, sizeof instructionData);
+				type = instructionData.Type;
+
+				return * this;
+			}
+
+		inline AssemblyReader & Pick(
+			const DynamicBuffer::ConstIterator & bufferIterator, ValueType & type, std::int32_t & offset
+			) {
+				_ThrowIfInvalidInstruction(bufferIterator, Instruction::pick);
+
+				Internal::InstructionMemoryStructure::StackPick instructionData;
+				bufferIterator.Read(&instructionData, sizeof instructionData);
+				type = instructionData.Type;
+				offset = instructionData.Offset;
+
+				return * this;
+			}
+
+		inline AssemblyReader & DropN(
+			const DynamicBuffer::ConstIterator & bufferIterator, std::int32_t & size
+			) {
+				_ThrowIfInvalidInstruction(bufferIterator, Instruction::drop_n);
+
+				Internal::InstructionMemoryStructure::StackDrop instructionData;
+				bufferIterator.Read(&instructionData, sizeof instructionData);
+				size = instructionData.Size;
+
+				return * this;
+			}
+
+		/// <summary>
+		/// Reads ld_k or ldx_k.
+		/// </summary>
+		inline AssemblyReader & ConstantAccess(
+			const DynamicBuffer::ConstIterator & bufferIterator, ValueType & type, constref_t & constant
+			) {
+				Instruction instruction = GetInstructionId(bufferIterator);
+				if (instruction != Instruction::ld_k && instruction != Instruction::ldx_k)
+					throw InvalidArgumentException("The instruction is not valid for this method.");
+
+				Internal::InstructionMemoryStructure::ConstantAccess instructionData;
+				bufferIterator.Read(&instructionData, sizeof instructionData);
+				type = instructionData.Type;
+				constant = instructionData.Constant;
+
+				return * this;
+			}
+
+		inline AssemblyReader & AllocK(
+			const DynamicBuffer::ConstIterator & bufferIterator, Register & mId, constref_t & constant
+			) {
+				_ThrowIfInvalidInstruction(bufferIterator, Instruction::alloc_k);
+
+				Internal::InstructionMemoryStructure::ConstantAllocation instructionData;
 				bufferIterator.Read(&instructionData, sizeof instructionData);
+				mId = instructionData.MId;
+				constant = instructionData.Constant;
 
 				return * this;
 			}
@@ -341,6 +1900,143 @@ namespace Nova {
 			) {
 				_assemblyReader.Ret(_bufferIterator);
 			}
+
+		inline void Alloc(
+			Register & mId
+			) {
+				_assemblyReader.Alloc(_bufferIterator, mId);
+			}
+
+		inline void PushRfR(
+			Register & mId
+			) {
+				_assemblyReader.PushRfR(_bufferIterator, mId);
+			}
+
+		inline void SetRfR(
+			Register & mId
+			) {
+				_assemblyReader.SetRfR(_bufferIterator, mId);
+			}
+
+		inline void MemoryAccess(
+			Register & mId, std::int32_t & offset
+			) {
+				_assemblyReader.MemoryAccess(_bufferIterator, mId, offset);
+			}
+
+		inline void IndexedAccess(
+			Register & mId
+			) {
+				_assemblyReader.IndexedAccess(_bufferIterator, mId);
+			}
+
+		inline void CopyM(
+			Register & destinationMId, Register & sourceMId
+			) {
+				_assemblyReader.CopyM(_bufferIterator, destinationMId, sourceMId);
+			}
+
+		inline void VectorOperation(
+			ValueType & type
+			) {
+				_assemblyReader.VectorOperation(_bufferIterator, type);
+			}
+
+		inline void VectorRegisterAccess(
+			ValueType & type, Register & vId
+			) {
+				_assemblyReader.VectorRegisterAccess(_bufferIterator, type, vId);
+			}
+
+		inline void ShuffleV(
+			ValueType & type, std::uint8_t (& lanes)[8]
+			) {
+				_assemblyReader.ShuffleV(_bufferIterator, type, lanes);
+			}
+
+		inline void VectorMemoryAccess(
+			ValueType & type, Register & mId
+			) {
+				_assemblyReader.VectorMemoryAccess(_bufferIterator, type, mId);
+			}
+
+		inline void Compare(
+			) {
+				_assemblyReader.Compare(_bufferIterator);
+			}
+
+		inline void Branch(
+			std::int32_t & offset
+			) {
+				_assemblyReader.Branch(_bufferIterator, offset);
+			}
+
+		inline void DjnzI4R(
+			Register & rId, std::int32_t & offset
+			) {
+				_assemblyReader.DjnzI4R(_bufferIterator, rId, offset);
+			}
+
+		inline void ChannelAccess(
+			chanref_t & channel
+			) {
+				_assemblyReader.ChannelAccess(_bufferIterator, channel);
+			}
+
+		inline void ChannelMemoryAccess(
+			chanref_t & channel, Register & mId
+			) {
+				_assemblyReader.ChannelMemoryAccess(_bufferIterator, channel, mId);
+			}
+
+		inline void PMap(
+			scoperef_t & scope, Register & sourceMId, Register & destinationMId
+			) {
+				_assemblyReader.PMap(_bufferIterator, scope, sourceMId, destinationMId);
+			}
+
+		inline void SetSpR(
+			Register & spId
+			) {
+				_assemblyReader.SetSpR(_bufferIterator, spId);
+			}
+
+		inline void FrameAccess(
+			Register & spId, std::int32_t & offset
+			) {
+				_assemblyReader.FrameAccess(_bufferIterator, spId, offset);
+			}
+
+		inline void StackOperation(
+			ValueType & type
+			) {
+				_assemblyReader.StackOperation(_bufferIterator, type);
+			}
+
+		inline void Pick(
+			ValueType & type, std::int32_t & offset
+			) {
+				_assemblyReader.Pick(_bufferIterator, type, offset);
+			}
+
+		inline void DropN(
+			std::int32_t & size
+			) {
+				_assemblyReader.DropN(_bufferIterator, size);
+			}
+
+		inline void ConstantAccess(
+			ValueType & type, constref_t & constant
+			) {
+				_assemblyReader.ConstantAccess(_bufferIterator, type, constant);
+			}
+
+		inline void AllocK(
+			Register & mId, constref_t & constant
+			) {
+				_assemblyReader.AllocK(_bufferIterator, mId, constant);
+			}
 	};
 
 } // namespace Nova
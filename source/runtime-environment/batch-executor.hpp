@@ -0,0 +1,432 @@
+//
+// batch-executor.hpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#ifndef _NOVA_RUNTIME_ENVIRONMENT_BATCH_EXECUTOR_HEADER_
+#define _NOVA_RUNTIME_ENVIRONMENT_BATCH_EXECUTOR_HEADER_
+
+#include "runtime-context.hpp"
+#include "scope-verifier.hpp"
+
+#include "..\common\exception.hpp"
+#include "..\common\platform.hpp"
+#include "..\common\type-traits.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <functional>
+
+namespace Nova {
+
+	namespace Internal {
+		/// <summary>
+		/// Value of the stack for all the rows of a batch.
+		/// </summary>
+		struct BatchColumn {
+			ValueType Type;
+			std::int8_t * Data;
+		};
+	}
+
+	/// <summary>
+	/// Runs a scope over many rows of input, stored as one array per parameter.
+	/// </summary>
+	/// <remarks>
+	/// <para>Rows are processed in batches. When every instruction reachable from the scope can be
+	/// applied to whole columns, each instruction is dispatched once per batch and its kernel loops
+	/// over the batch; external scopes are still called once per row. Otherwise the batch falls back
+	/// to running the scope row by row in an internal context.</para>
+	/// <para>The scope is verified if it wasn't yet, and its parameters and results can't be
+	/// references. The executor isn't synchronized.</para>
+	/// </remarks>
+	class BatchExecutor {
+		enum class _ExecutionMode {
+			Unknown = 0,
+			Vector,
+			Row
+		};
+
+		RuntimeScopeManager & _scopeManager;
+		const size_t _batchSize;
+		size_t _rowCount;
+		std::vector<std::int8_t *> _buffers;
+		std::vector<Internal::BatchColumn> _columns;
+		std::vector<_ExecutionMode> _modes;
+		std::uint32_t _modesEpoch;
+		std::vector<scoperef_t> _activeScopes;
+		RuntimeFixedStack _rowStack;
+		RegisterSet _rowRegisters;
+		RuntimeContext _rowContext;
+		Internal::ScopeReader _scopeReader;
+
+		template <typename _Ty>
+		static inline void _PushValue(
+			RuntimeFixedStack & stack, const std::int8_t * address
+			) {
+				_Ty value;
+				memcpy(&value, address, sizeof value);
+				stack.Push<_Ty>(value);
+			}
+
+		template <typename _Ty>
+		static inline void _PopValue(
+			RuntimeFixedStack & stack, std::int8_t * address
+			) {
+				_Ty value = stack.Pop<_Ty>();
+				memcpy(address, &value, sizeof value);
+			}
+
+		static inline void _PushValue(
+			RuntimeFixedStack & stack, ValueType type, const std::int8_t * address
+			) {
+				switch (type) {
+				case ValueType::i1: _PushValue<std::int8_t>(stack, address); break;
+				case ValueType::i2: _PushValue<std::int16_t>(stack, address); break;
+				case ValueType::i4: _PushValue<std::int32_t>(stack, address); break;
+				case ValueType::i8: _PushValue<std::int64_t>(stack, address); break;
+				case ValueType::fs: _PushValue<float>(stack, address); break;
+				case ValueType::fd: _PushValue<double>(stack, address); break;
+				default: throw InvalidArgumentException("Only scalar values can be used in batches.");
+				}
+			}
+
+		static inline void _PopValue(
+			RuntimeFixedStack & stack, ValueType type, std::int8_t * address
+			) {
+				switch (type) {
+				case ValueType::i1: _PopValue<std::int8_t>(stack, address); break;
+				case ValueType::i2: _PopValue<std::int16_t>(stack, address); break;
+				case ValueType::i4: _PopValue<std::int32_t>(stack, address); break;
+				case ValueType::i8: _PopValue<std::int64_t>(stack, address); break;
+				case ValueType::fs: _PopValue<float>(stack, address); break;
+				case ValueType::fd: _PopValue<double>(stack, address); break;
+				default: throw InvalidArgumentException("Only scalar values can be used in batches.");
+				}
+			}
+
+		static inline bool _IsScalarSignature(
+			const ScopeSignature & signature
+			) {
+				for (auto type : signature.GetParameters()) {
+					if (type == ValueType::rf || IsVectorType(type))
+						return false;
+				}
+				for (auto type : signature.GetResults()) {
+					if (type == ValueType::rf || IsVectorType(type))
+						return false;
+				}
+				return true;
+			}
+
+		inline Internal::BatchColumn & _PushColumn(
+			ValueType type
+			) {
+				size_t position = _columns.size();
+				if (position == _buffers.size())
+					_buffers.push_back(reinterpret_cast<std::int8_t *>(AlignedAllocate(_batchSize * sizeof(std::int64_t), CacheLineSize)));
+
+				Internal::BatchColumn column;
+				column.Type = type;
+				column.Data = _buffers[position];
+				_columns.push_back(column);
+				return _columns.back();
+			}
+
+		inline Internal::BatchColumn & _GetColumn(
+			size_t depth
+			) {
+				if (depth >= _columns.size())
+					throw StackException("Value can't getted from stack. Stack size too small.");
+				return _columns[_columns.size() - depth - 1];
+			}
+
+		inline void _PopColumns(
+			size_t count
+			) {
+				_columns.resize(_columns.size() - count);
+			}
+
+		/// <summary>
+		/// Checks if all the instructions reachable from a scope can be applied to whole columns.
+		/// </summary>
+		inline bool _IsVectorizable(
+			scoperef_t scopeId
+			) {
+				size_t index = reinterpret_cast<size_t>(scopeId);
+				// A new version of any scope can change the mode of its callers.
+				if (_modesEpoch != _scopeManager.GetEpoch()) {
+					_modes.clear();
+					_modesEpoch = _scopeManager.GetEpoch();
+				}
+				if (_modes.size() < _scopeManager.GetScopeCount())
+					_modes.resize(_scopeManager.GetScopeCount(), _ExecutionMode::Unknown);
+				if (_modes[index] != _ExecutionMode::Unknown)
+					return _modes[index] == _ExecutionMode::Vector;
+				if (std::find(_activeScopes.begin(), _activeScopes.end(), scopeId) != _activeScopes.end())
+					return false;
+
+				RuntimeScope & scope = _scopeManager.GetScope(scopeId);
+				if (!scope.IsLoaded())
+					ScopeVerifier(_scopeManager).Verify(scope);
+
+				_activeScopes.push_back(scopeId);
+				bool vectorizable = true;
+				AssemblyReader assemblyReader;
+				DynamicBuffer::ConstIterator bufferIterator = scope.GetCodeBuffer().GetConstIterator();
+				while (vectorizable && bufferIterator.HasData()) {
+					scoperef_t calleeId;
+					switch (assemblyReader.GetInstructionId(bufferIterator)) {
+					case Instruction::nop:
+					case Instruction::push_i4c:
+					case Instruction::add_i4:
+					case Instruction::ret:
+						break;
+					case Instruction::xcall:
+						{
+							assemblyReader.XCall(bufferIterator, calleeId);
+							const ExternalScope & callee = _scopeManager.GetExternalScope(calleeId);
+							vectorizable = callee.HasSignature() && _IsScalarSignature(callee.GetSignature());
+						}
+						break;
+					case Instruction::call:
+						assemblyReader.Call(bufferIterator, calleeId);
+						vectorizable = _IsVectorizable(calleeId);
+						break;
+					default:
+						vectorizable = false;
+						break;
+					}
+					assemblyReader.GoNextInstruction(bufferIterator);
+				}
+				_activeScopes.pop_back();
+
+				_modes[index] = vectorizable ? _ExecutionMode::Vector : _ExecutionMode::Row;
+				return vectorizable;
+			}
+
+		/// <summary>
+		/// Calls an external scope once per row, moving its parameters and results between the
+		/// columns and the row stack.
+		/// </summary>
+		inline void _ExecuteExternal(
+			scoperef_t scopeId
+			) {
+				ExternalScope & scope = _scopeManager.GetExternalScope(scopeId);
+				const std::vector<ValueType> & parameters = scope.GetSignature().GetParameters();
+				const std::vector<ValueType> & results = scope.GetSignature().GetResults();
+				std::function<void (RuntimeFixedStack &)> callback = scope.GetCallbackFunction();
+
+				if (parameters.size() > _columns.size())
+					throw StackException("Value can't getted from stack. Stack size too small.");
+				size_t base = _columns.size() - parameters.size();
+				for (auto type : results)
+					_PushColumn(type);
+
+				for (size_t row = 0; row < _rowCount; ++row) {
+					_rowStack.Reset();
+					for (size_t i = 0; i < parameters.size(); ++i) {
+						size_t size = GetValueTypeSize(parameters[i]);
+						_PushValue(_rowStack, parameters[i], _columns[base + i].Data + row * size);
+					}
+					callback(_rowStack);
+					for (size_t i = results.size(); i-- > 0;) {
+						size_t size = GetValueTypeSize(results[i]);
+						_PopValue(_rowStack, results[i], _columns[base + parameters.size() + i].Data + row * size);
+					}
+				}
+
+				// Moves the results over the parameters, keeping every buffer at the position of its column.
+				for (size_t i = 0; i < results.size(); ++i) {
+					std::swap(_buffers[base + i], _buffers[base + parameters.size() + i]);
+					std::swap(_columns[base + i], _columns[base + parameters.size() + i]);
+				}
+				_PopColumns(parameters.size());
+			}
+
+		inline void _ExecuteVector(
+			scoperef_t scopeId
+			) {
+				AssemblyReader assemblyReader;
+				DynamicBuffer::ConstIterator bufferIterator = _scopeManager.GetScope(scopeId).GetCodeBuffer().GetConstIterator();
+				while (bufferIterator.HasData()) {
+					switch (assemblyReader.GetInstructionId(bufferIterator)) {
+					case Instruction::nop:
+						break;
+					case Instruction::push_i4c:
+						{
+							std::int32_t value;
+							assemblyReader.PushI4C(bufferIterator, value);
+							std::int32_t * data = reinterpret_cast<std::int32_t *>(_PushColumn(ValueType::i4).Data);
+							for (size_t i = 0; i < _rowCount; ++i)
+								data[i] = value;
+						}
+						break;
+					case Instruction::add_i4:
+						{
+							const std::int32_t * a = reinterpret_cast<const std::int32_t *>(_GetColumn(0).Data);
+							std::int32_t * b = reinterpret_cast<std::int32_t *>(_GetColumn(1).Data);
+							for (size_t i = 0; i < _rowCount; ++i)
+								b[i] += a[i];
+							_PopColumns(1);
+						}
+						break;
+					case Instruction::call:
+						{
+							scoperef_t calleeId;
+							assemblyReader.Call(bufferIterator, calleeId);
+							_ExecuteVector(calleeId);
+						}
+						break;
+					case Instruction::xcall:
+						{
+							scoperef_t calleeId;
+							assemblyReader.XCall(bufferIterator, calleeId);
+							_ExecuteExternal(calleeId);
+						}
+						break;
+					case Instruction::ret:
+						return;
+					default:
+						throw RuntimeException("Unsupported instruction.");
+					}
+					assemblyReader.GoNextInstruction(bufferIterator);
+				}
+			}
+
+		inline void _RunVectorBatch(
+			scoperef_t scopeId, const ScopeSignature & signature, size_t start,
+			const void * const * inputColumns, void * const * outputColumns
+			) {
+				_columns.clear();
+				const std::vector<ValueType> & parameters = signature.GetParameters();
+				for (size_t i = 0; i < parameters.size(); ++i) {
+					size_t size = GetValueTypeSize(parameters[i]);
+					memcpy(_PushColumn(parameters[i]).Data,
+						reinterpret_cast<const std::int8_t *>(inputColumns[i]) + start * size, _rowCount * size);
+				}
+
+				_ExecuteVector(scopeId);
+
+				const std::vector<ValueType> & results = signature.GetResults();
+				for (size_t i = 0; i < results.size(); ++i) {
+					size_t size = GetValueTypeSize(results[i]);
+					memcpy(reinterpret_cast<std::int8_t *>(outputColumns[i]) + start * size,
+						_columns[i].Data, _rowCount * size);
+				}
+			}
+
+		inline void _RunRowBatch(
+			scoperef_t scopeId, const ScopeSignature & signature, size_t start,
+			const void * const * inputColumns, void * const * outputColumns
+			) {
+				const std::vector<ValueType> & parameters = signature.GetParameters();
+				const std::vector<ValueType> & results = signature.GetResults();
+				for (size_t row = start; row < start + _rowCount; ++row) {
+					_rowContext.Reset(scopeId);
+					for (size_t i = 0; i < parameters.size(); ++i) {
+						size_t size = GetValueTypeSize(parameters[i]);
+						_PushValue(_rowStack, parameters[i], reinterpret_cast<const std::int8_t *>(inputColumns[i]) + row * size);
+					}
+
+					_rowContext.Run();
+					if (_rowContext.IsSuspended()) {
+						_rowContext.Reset(InvalidScope);
+						throw RuntimeException("Scopes blocked on channels can't run in batches.");
+					}
+
+					for (size_t i = results.size(); i-- > 0;) {
+						size_t size = GetValueTypeSize(results[i]);
+						_PopValue(_rowStack, results[i], reinterpret_cast<std::int8_t *>(outputColumns[i]) + row * size);
+					}
+				}
+			}
+
+	public:
+		static const size_t DefaultBatchSize = 1024;
+		static const size_t DefaultStackSize = 4096;
+
+		/// <param name='scopeManager'>Scope manager holding the scopes to run. It isn't owned by the executor.</param>
+		/// <param name='batchSize'>Maximum number of rows processed by every dispatch of an instruction.</param>
+		/// <param name='stackSize'>Size of the stack used to run the scopes row by row.</param>
+		inline explicit BatchExecutor(
+			RuntimeScopeManager & scopeManager, size_t batchSize = DefaultBatchSize, size_t stackSize = DefaultStackSize
+			)
+			: _scopeManager(scopeManager), _batchSize(batchSize), _rowCount(0), _modesEpoch(0), _rowStack(stackSize),
+			  _rowContext(&_rowStack, &_rowRegisters, &scopeManager, InvalidScope, nullptr, false)
+			{
+				if (batchSize == 0)
+					throw InvalidArgumentException("The batch size can't be zero.");
+				_scopeManager.RegisterReader(&_scopeReader);
+			}
+
+		inline ~BatchExecutor(
+			) {
+				_scopeManager.UnregisterReader(&_scopeReader);
+				for (auto buffer : _buffers)
+					AlignedFree(buffer);
+			}
+
+		/// <summary>
+		/// Runs a scope for every row.
+		/// </summary>
+		/// <param name='rowCount'>Number of rows.</param>
+		/// <param name='inputColumns'>One array of rowCount values per parameter of the scope, in the
+		/// order of its signature.</param>
+		/// <param name='outputColumns'>One array of rowCount values per result of the scope.</param>
+		inline void Run(
+			scoperef_t scopeId, size_t rowCount, const void * const * inputColumns, void * const * outputColumns
+			) {
+				// The vector batches read the scopes outside of any context.
+				_scopeManager.EnterReader(_scopeReader);
+				try {
+					RuntimeScope & scope = _scopeManager.GetScope(scopeId);
+					if (!scope.IsLoaded() || !scope.IsVerified())
+						ScopeVerifier(_scopeManager).Verify(scope);
+
+					const ScopeSignature & signature = scope.GetSignature();
+					if (!_IsScalarSignature(signature))
+						throw InvalidArgumentException("Only scalar values can be used in batches.");
+
+					_activeScopes.clear();
+					bool vectorizable = _IsVectorizable(scopeId);
+					for (size_t start = 0; start < rowCount; start += _batchSize) {
+						_rowCount = std::min(_batchSize, rowCount - start);
+						if (vectorizable)
+							_RunVectorBatch(scopeId, signature, start, inputColumns, outputColumns);
+						else
+							_RunRowBatch(scopeId, signature, start, inputColumns, outputColumns);
+					}
+				} catch (...) {
+					_scopeManager.LeaveReader(_scopeReader);
+					throw;
+				}
+				_scopeManager.LeaveReader(_scopeReader);
+			}
+
+		/// <summary>
+		/// Returns true if the scope is run a batch at a time, instead of row by row.
+		/// </summary>
+		inline bool IsVectorizable(
+			scoperef_t scopeId
+			) {
+				_scopeManager.EnterReader(_scopeReader);
+				try {
+					_activeScopes.clear();
+					bool vectorizable = _IsVectorizable(scopeId);
+					_scopeManager.LeaveReader(_scopeReader);
+					return vectorizable;
+				} catch (...) {
+					_scopeManager.LeaveReader(_scopeReader);
+					throw;
+				}
+			}
+	};
+
+} // namespace Nova
+
+#endif // !_NOVA_RUNTIME_ENVIRONMENT_BATCH_EXECUTOR_HEADER_
\ No newline at end of file
@@ -0,0 +1,354 @@
+//
+// channel.hpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#ifndef _NOVA_RUNTIME_ENVIRONMENT_CHANNEL_HEADER_
+#define _NOVA_RUNTIME_ENVIRONMENT_CHANNEL_HEADER_
+
+#include "..\common\exception.hpp"
+#include "..\common\platform.hpp"
+#include "..\common\type-traits.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+namespace Nova {
+
+	namespace Internal {
+		/// <summary>
+		/// Wakes the threads waiting for any channel of a scope manager to change.
+		/// </summary>
+		/// <remarks>
+		/// Channels only notify when somebody waits. The waiter is counted before it checks the
+		/// channels for the last time, and the channels check the count after their change, so one of
+		/// them always sees the other.
+		/// </remarks>
+		class ChannelSignal {
+			std::atomic<size_t> _waiterCount;
+			std::mutex _mutex;
+			std::condition_variable _condition;
+			std::uint64_t _version;
+
+		public:
+			inline ChannelSignal(
+				)
+				: _waiterCount(0), _version(0)
+				{
+				}
+
+			/// <summary>
+			/// Wakes the waiting threads if there are any, or all of them if forced.
+			/// </summary>
+			inline void Notify(
+				bool force = false
+				) {
+					std::atomic_thread_fence(std::memory_order_seq_cst);
+					if (!force && _waiterCount.load(std::memory_order_relaxed) == 0)
+						return;
+					{
+						std::lock_guard<std::mutex> lock(_mutex);
+						++_version;
+					}
+					_condition.notify_all();
+				}
+
+			/// <summary>
+			/// Starts waiting. The channels must be checked after this call, and Wait only returns if
+			/// something changed since.
+			/// </summary>
+			inline std::uint64_t BeginWait(
+				) {
+					_waiterCount.fetch_add(1);
+					std::atomic_thread_fence(std::memory_order_seq_cst);
+					std::lock_guard<std::mutex> lock(_mutex);
+					return _version;
+				}
+
+			inline void Wait(
+				std::uint64_t version
+				) {
+					std::unique_lock<std::mutex> lock(_mutex);
+					while (_version == version)
+						_condition.wait(lock);
+				}
+
+			inline void EndWait(
+				) {
+					_waiterCount.fetch_sub(1);
+				}
+		};
+	}
+
+	enum class ChannelMode {
+		/// <summary>
+		/// Only one thread sends and one thread receives at a time, so the positions are advanced
+		/// without compare-and-swap.
+		/// </summary>
+		SingleProducerSingleConsumer = 0,
+		MultiProducerMultiConsumer
+	};
+
+	/// <summary>
+	/// Bounded lock-free queue of values of a fixed size, used to pass data between contexts.
+	/// </summary>
+	/// <remarks>
+	/// <para>Every cell holds a sequence number next to its value: it tells senders that the cell is
+	/// free and receivers that it's full, so the positions are the only data shared by both sides. The
+	/// positions are kept on their own cache lines.</para>
+	/// <para>The elements are either values of a type, which scripts send and receive through the
+	/// stack, or byte buffers of a fixed size, which they copy from and to objects. References can't
+	/// be sent, since every context has its own heap.</para>
+	/// </remarks>
+	class Channel {
+		chanref_t _id;
+		ValueType _elementType;
+		bool _hasElementType;
+		ChannelMode _mode;
+		size_t _elementSize;
+		size_t _cellSize;
+		size_t _mask;
+		std::int8_t * _cells;
+		Internal::ChannelSignal * _signal;
+
+		std::int8_t _padding0[CacheLineSize];
+		std::atomic<size_t> _sendPosition;
+		std::int8_t _padding1[CacheLineSize];
+		std::atomic<size_t> _receivePosition;
+		std::int8_t _padding2[CacheLineSize];
+
+		inline std::int8_t * _GetCell(
+			size_t position
+			) const {
+				return _cells + (position & _mask) * _cellSize;
+			}
+
+		static inline std::atomic<size_t> & _GetSequence(
+			std::int8_t * cell
+			) {
+				return * reinterpret_cast<std::atomic<size_t> *>(cell);
+			}
+
+		static inline std::int8_t * _GetData(
+			std::int8_t * cell
+			) {
+				return cell + sizeof(std::atomic<size_t>);
+			}
+
+		/// <summary>
+		/// Claims the cell at a position whose sequence number is the position plus an offset: zero to
+		/// send, one to receive. Returns null if the channel is full or empty.
+		/// </summary>
+		inline std::int8_t * _Claim(
+			std::atomic<size_t> & position, size_t offset, size_t & claimed
+			) {
+				size_t current = position.load(std::memory_order_relaxed);
+				for (;;) {
+					std::int8_t * cell = _GetCell(current);
+					size_t sequence = _GetSequence(cell).load(std::memory_order_acquire);
+					std::intptr_t difference = static_cast<std::intptr_t>(sequence - (current + offset));
+					if (difference < 0)
+						return nullptr;
+
+					if (difference == 0) {
+						if (_mode == ChannelMode::SingleProducerSingleConsumer) {
+							position.store(current + 1, std::memory_order_relaxed);
+							claimed = current;
+							return cell;
+						}
+						if (position.compare_exchange_weak(current, current + 1, std::memory_order_relaxed)) {
+							claimed = current;
+							return cell;
+						}
+					} else {
+						current = position.load(std::memory_order_relaxed);
+					}
+				}
+			}
+
+		inline void _Initialize(
+			size_t capacity
+			) {
+				if (capacity == 0)
+					throw InvalidArgumentException("The capacity of a channel can't be zero.");
+				size_t cellCount = 1;
+				while (cellCount < capacity)
+					cellCount <<= 1;
+
+				_mask = cellCount - 1;
+				_cellSize = (sizeof(std::atomic<size_t>) + _elementSize + sizeof(size_t) - 1) & ~(sizeof(size_t) - 1);
+				_cells = reinterpret_cast<std::int8_t *>(AlignedAllocate(cellCount * _cellSize, CacheLineSize));
+				for (size_t i = 0; i < cellCount; ++i)
+					new (_cells + i * _cellSize) std::atomic<size_t>(i);
+			}
+
+		template <typename _Ty>
+		inline void _CheckType(
+			) const {
+				if (!_hasElementType || EngineTypeTraits<_Ty>::Type != _elementType)
+					throw InvalidArgumentException("The type doesn't match the elements of the channel.");
+			}
+
+	public:
+		/// <summary>
+		/// Creates a channel of values of a type.
+		/// </summary>
+		/// <param name='capacity'>Minimum number of elements; it's rounded up to a power of two.</param>
+		/// <param name='signal'>Signal notified when values are sent or received, if any.</param>
+		inline Channel(
+			chanref_t id, ValueType elementType, size_t capacity, ChannelMode mode,
+			Internal::ChannelSignal * signal = nullptr
+			)
+			: _id(id), _elementType(elementType), _hasElementType(true), _mode(mode),
+			  _elementSize(GetValueTypeSize(elementType)), _signal(signal),
+			  _sendPosition(0), _receivePosition(0)
+			{
+				if (elementType == ValueType::rf)
+					throw InvalidArgumentException("References can't be sent through channels.");
+				_Initialize(capacity);
+			}
+
+		/// <summary>
+		/// Creates a channel of byte buffers of a fixed size.
+		/// </summary>
+		inline Channel(
+			chanref_t id, size_t elementSize, size_t capacity, ChannelMode mode,
+			Internal::ChannelSignal * signal = nullptr
+			)
+			: _id(id), _elementType(ValueType::i1), _hasElementType(false), _mode(mode),
+			  _elementSize(elementSize), _signal(signal),
+			  _sendPosition(0), _receivePosition(0)
+			{
+				if (elementSize == 0)
+					throw InvalidArgumentException("The elements of a channel can't be empty.");
+				_Initialize(capacity);
+			}
+
+		inline ~Channel(
+			) {
+				AlignedFree(_cells);
+			}
+
+		/// <summary>
+		/// Copies an element to the channel. Returns false, without blocking, if the channel is full.
+		/// </summary>
+		inline bool TrySendBytes(
+			const void * value
+			) {
+				size_t position;
+				std::int8_t * cell = _Claim(_sendPosition, 0, position);
+				if (cell == nullptr)
+					return false;
+
+				memcpy(_GetData(cell), value, _elementSize);
+				_GetSequence(cell).store(position + 1, std::memory_order_release);
+				if (_signal != nullptr)
+					_signal->Notify();
+				return true;
+			}
+
+		/// <summary>
+		/// Copies the oldest element out of the channel. Returns false, without blocking, if the channel
+		/// is empty.
+		/// </summary>
+		inline bool TryReceiveBytes(
+			void * value
+			) {
+				size_t position;
+				std::int8_t * cell = _Claim(_receivePosition, 1, position);
+				if (cell == nullptr)
+					return false;
+
+				memcpy(value, _GetData(cell), _elementSize);
+				_GetSequence(cell).store(position + _mask + 1, std::memory_order_release);
+				if (_signal != nullptr)
+					_signal->Notify();
+				return true;
+			}
+
+		template <typename _Ty>
+		inline bool TrySend(
+			const _Ty & value
+			) {
+				_CheckType<_Ty>();
+				return TrySendBytes(&value);
+			}
+
+		template <typename _Ty>
+		inline bool TryReceive(
+			_Ty & value
+			) {
+				_CheckType<_Ty>();
+				return TryReceiveBytes(&value);
+			}
+
+		/// <summary>
+		/// Returns true if a send would find a free cell. Other senders may take it first.
+		/// </summary>
+		inline bool CanSend(
+			) const {
+				size_t position = _sendPosition.load(std::memory_order_relaxed);
+				return _GetSequence(_GetCell(position)).load(std::memory_order_acquire) == position;
+			}
+
+		/// <summary>
+		/// Returns true if a receive would find a value. Other receivers may take it first.
+		/// </summary>
+		inline bool CanReceive(
+			) const {
+				size_t position = _receivePosition.load(std::memory_order_relaxed);
+				return _GetSequence(_GetCell(position)).load(std::memory_order_acquire) == position + 1;
+			}
+
+		/// <summary>
+		/// Returns the number of elements in the channel. It's only exact while nobody uses it.
+		/// </summary>
+		inline size_t GetSize(
+			) const {
+				size_t receivePosition = _receivePosition.load(std::memory_order_acquire);
+				size_t sendPosition = _sendPosition.load(std::memory_order_acquire);
+				return sendPosition > receivePosition ? sendPosition - receivePosition : 0;
+			}
+
+		inline size_t GetCapacity(
+			) const {
+				return _mask + 1;
+			}
+
+		inline chanref_t GetId(
+			) const {
+				return _id;
+			}
+
+		inline ChannelMode GetMode(
+			) const {
+				return _mode;
+			}
+
+		/// <summary>
+		/// Returns true if the elements are values of a type, false if they're byte buffers.
+		/// </summary>
+		inline bool HasElementType(
+			) const {
+				return _hasElementType;
+			}
+
+		inline ValueType GetElementType(
+			) const {
+				return _elementType;
+			}
+
+		inline size_t GetElementSize(
+			) const {
+				return _elementSize;
+			}
+	};
+
+} // namespace Nova
+
+#endif // !_NOVA_RUNTIME_ENVIRONMENT_CHANNEL_HEADER_
\ No newline at end of file
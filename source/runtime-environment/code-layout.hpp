@@ -0,0 +1,194 @@
+//
+// code-layout.hpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#ifndef _NOVA_RUNTIME_ENVIRONMENT_CODE_LAYOUT_HEADER_
+#define _NOVA_RUNTIME_ENVIRONMENT_CODE_LAYOUT_HEADER_
+
+#include "runtime-scope.hpp"
+
+#include "..\common\exception.hpp"
+#include "..\common\type-traits.hpp"
+
+#include <cstdint>
+#include <vector>
+#include <map>
+#include <utility>
+#include <algorithm>
+
+namespace Nova {
+
+	/// <summary>
+	/// Calls made by a program while it was profiled: how many times each scope was called, and from
+	/// which scopes. Only the scopes of the manager are profiled; external scopes have no code to lay out.
+	/// </summary>
+	class ScopeProfile {
+	public:
+		struct Edge {
+			scoperef_t Caller;
+			scoperef_t Callee;
+			std::uint64_t Count;
+		};
+
+	private:
+		std::map<scoperef_t, std::uint64_t> _callCounts;
+		std::map<std::pair<scoperef_t, scoperef_t>, std::uint64_t> _edges;
+
+	public:
+		/// <summary>
+		/// Counts calls to a scope whose caller isn't known, such as runs started by the host.
+		/// </summary>
+		inline void AddCalls(
+			scoperef_t scope, std::uint64_t count
+			) {
+				_callCounts[scope] += count;
+			}
+
+		/// <summary>
+		/// Counts calls from a scope to another one.
+		/// </summary>
+		inline void AddCalls(
+			scoperef_t caller, scoperef_t callee, std::uint64_t count
+			) {
+				_callCounts[caller];
+				_callCounts[callee] += count;
+				_edges[std::make_pair(caller, callee)] += count;
+			}
+
+		inline std::uint64_t GetCallCount(
+			scoperef_t scope
+			) const {
+				std::map<scoperef_t, std::uint64_t>::const_iterator it = _callCounts.find(scope);
+				return it != _callCounts.end() ? it->second : 0;
+			}
+
+		/// <summary>
+		/// Returns the scopes which were called or called others.
+		/// </summary>
+		inline std::vector<scoperef_t> GetScopes(
+			) const {
+				std::vector<scoperef_t> scopes;
+				for (auto & item : _callCounts)
+					scopes.push_back(item.first);
+				return scopes;
+			}
+
+		inline std::vector<Edge> GetEdges(
+			) const {
+				std::vector<Edge> edges;
+				for (auto & item : _edges) {
+					Edge edge = { item.first.first, item.first.second, item.second };
+					edges.push_back(edge);
+				}
+				return edges;
+			}
+	};
+
+	/// <summary>
+	/// Orders the code of a program from a profile, so hot scopes sit next to their hot callees and
+	/// the scopes never run go to the end of the code region.
+	/// </summary>
+	/// <remarks>
+	/// Scopes are merged into chains following the call edges from the heaviest one, as in the
+	/// procedure ordering of Pettis and Hansen: the chain of the callee goes after the chain of the
+	/// caller. Chains are then placed from the most called one. Scopes are laid out whole; calls go
+	/// through the ids of the scopes, so the code doesn't need to be rewritten.
+	/// </remarks>
+	class CodeLayout {
+		struct _Chain {
+			std::vector<scoperef_t> Scopes;
+			std::uint64_t Count;
+		};
+
+		struct _EdgeComparer {
+			inline bool operator () (
+				const ScopeProfile::Edge & edge, const ScopeProfile::Edge & other
+				) const {
+					if (edge.Count != other.Count)
+						return edge.Count > other.Count;
+					if (edge.Caller != other.Caller)
+						return edge.Caller < other.Caller;
+					return edge.Callee < other.Callee;
+				}
+		};
+
+		struct _ChainComparer {
+			inline bool operator () (
+				const _Chain * chain, const _Chain * other
+				) const {
+					if (chain->Count != other->Count)
+						return chain->Count > other->Count;
+					return chain->Scopes.front() < other->Scopes.front();
+				}
+		};
+
+	public:
+		/// <summary>
+		/// Returns the order of the profiled scopes. The scopes of the manager missing from it are cold.
+		/// </summary>
+		static inline std::vector<scoperef_t> GetOrder(
+			const ScopeProfile & profile, size_t scopeCount
+			) {
+				std::vector<scoperef_t> scopes = profile.GetScopes();
+				std::vector<_Chain> chains;
+				std::vector<size_t> chainIndices(scopeCount, static_cast<size_t>(-1));
+				chains.reserve(scopes.size());
+				for (auto scope : scopes) {
+					size_t index = reinterpret_cast<size_t>(scope);
+					if (index >= scopeCount)
+						throw InvalidArgumentException("The profile holds a scope which doesn't exist.");
+					_Chain chain;
+					chain.Scopes.push_back(scope);
+					chain.Count = profile.GetCallCount(scope);
+					chainIndices[index] = chains.size();
+					chains.push_back(chain);
+				}
+
+				std::vector<ScopeProfile::Edge> edges = profile.GetEdges();
+				std::sort(edges.begin(), edges.end(), _EdgeComparer());
+				for (auto & edge : edges) {
+					size_t callerChain = chainIndices[reinterpret_cast<size_t>(edge.Caller)];
+					size_t calleeChain = chainIndices[reinterpret_cast<size_t>(edge.Callee)];
+					if (callerChain == calleeChain)
+						continue;
+
+					_Chain & target = chains[callerChain];
+					_Chain & source = chains[calleeChain];
+					for (auto scope : source.Scopes)
+						chainIndices[reinterpret_cast<size_t>(scope)] = callerChain;
+					target.Scopes.insert(target.Scopes.end(), source.Scopes.begin(), source.Scopes.end());
+					target.Count += source.Count;
+					source.Scopes.clear();
+				}
+
+				std::vector<const _Chain *> orderedChains;
+				for (auto & chain : chains) {
+					if (!chain.Scopes.empty())
+						orderedChains.push_back(&chain);
+				}
+				std::sort(orderedChains.begin(), orderedChains.end(), _ChainComparer());
+
+				std::vector<scoperef_t> order;
+				order.reserve(scopes.size());
+				for (auto chain : orderedChains)
+					order.insert(order.end(), chain->Scopes.begin(), chain->Scopes.end());
+				return order;
+			}
+
+		/// <summary>
+		/// Packs the code of the scopes of a manager in the order of the profile. Returns the size of
+		/// the code. It must be called while no context runs.
+		/// </summary>
+		static inline size_t Apply(
+			RuntimeScopeManager & scopeManager, const ScopeProfile & profile
+			) {
+				return scopeManager.PackCode(GetOrder(profile, scopeManager.GetScopeCount()));
+			}
+	};
+
+} // namespace Nova
+
+#endif // !_NOVA_RUNTIME_ENVIRONMENT_CODE_LAYOUT_HEADER_
\ No newline at end of file
@@ -0,0 +1,311 @@
+//
+// constant-pool.hpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#ifndef _NOVA_RUNTIME_ENVIRONMENT_CONSTANT_POOL_HEADER_
+#define _NOVA_RUNTIME_ENVIRONMENT_CONSTANT_POOL_HEADER_
+
+#include "..\common\exception.hpp"
+#include "..\common\dynamic-buffer.hpp"
+#include "..\common\type-traits.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+
+namespace Nova {
+
+	/// <summary>
+	/// Constants of a program, loaded by the ld_k, ldx_k and alloc_k instructions. A constant is
+	/// either a value of a type, or an array of values of a type, such as a lookup table or a string
+	/// of i1 values. Equal constants are stored once.
+	/// </summary>
+	/// <remarks>
+	/// <para>The pool can be saved to an image holding the constants and their data in one block, and
+	/// loaded from it without copying the data, so the image can be mapped with the program. The
+	/// data is copied only if constants are added afterwards.</para>
+	/// <para>The pool is shared by the contexts running the program, which only read it. Constants
+	/// must be added and loaded while no context runs.</para>
+	/// </remarks>
+	class ConstantPool {
+		struct _Entry {
+			ValueType Type;
+			std::uint32_t IsArray;
+			std::uint32_t Offset;
+			std::uint32_t Size;
+		};
+
+		struct _ImageHeader {
+			std::uint32_t Magic;
+			std::uint32_t Count;
+			std::uint32_t DataOffset;
+			std::uint32_t DataSize;
+		};
+
+		static const std::uint32_t _ImageMagic = 0x4b504e4e;
+		static const size_t _Alignment = 32;
+
+		std::vector<_Entry> _entries;
+		DynamicBuffer _data;
+
+		/// <summary>
+		/// Index of the constants by their type and bytes, built on the first addition after a load
+		/// so loading doesn't read the data.
+		/// </summary>
+		std::map<std::string, size_t> _indices;
+		bool _isIndexed;
+
+		static inline std::string _GetKey(
+			ValueType type, bool isArray, const void * data, size_t size
+			) {
+				std::string key;
+				key.reserve(size + 2);
+				key.push_back(static_cast<char>(type));
+				key.push_back(isArray ? 1 : 0);
+				key.append(reinterpret_cast<const char *>(data), size);
+				return key;
+			}
+
+		inline void _BuildIndex(
+			) {
+				if (_isIndexed)
+					return;
+				for (size_t i = 0; i < _entries.size(); ++i) {
+					const _Entry & entry = _entries[i];
+					_indices[_GetKey(entry.Type, entry.IsArray != 0, GetData(reinterpret_cast<constref_t>(i)), entry.Size)] = i;
+				}
+				_isIndexed = true;
+			}
+
+		inline constref_t _Add(
+			ValueType type, bool isArray, const void * data, size_t size
+			) {
+				if (type == ValueType::rf)
+					throw InvalidArgumentException("References can't be constants.");
+				if (size > static_cast<std::uint32_t>(-1) - _data.GetSize() - _Alignment)
+					throw InvalidArgumentException("The constant pool is too big.");
+
+				_BuildIndex();
+				std::string key = _GetKey(type, isArray, data, size);
+				std::map<std::string, size_t>::const_iterator it = _indices.find(key);
+				if (it != _indices.end())
+					return reinterpret_cast<constref_t>(it->second);
+
+				_Entry entry;
+				entry.Type = type;
+				entry.IsArray = isArray ? 1 : 0;
+				entry.Offset = static_cast<std::uint32_t>((_data.GetSize() + _Alignment - 1) & ~(_Alignment - 1));
+				entry.Size = static_cast<std::uint32_t>(size);
+				_data.Resize(entry.Offset);
+				_data.Push(data, size);
+				_entries.push_back(entry);
+				_indices[key] = _entries.size() - 1;
+				return reinterpret_cast<constref_t>(_entries.size() - 1);
+			}
+
+		inline const _Entry & _GetEntry(
+			constref_t constant
+			) const {
+				if (!Contains(constant))
+					throw InvalidArgumentException("The constant doesn't exist.");
+				return _entries[reinterpret_cast<size_t>(constant)];
+			}
+
+	public:
+		inline ConstantPool(
+			)
+			: _isIndexed(true)
+			{
+			}
+
+		/// <summary>
+		/// Adds a value, or returns the constant holding an equal one.
+		/// </summary>
+		template <typename _Ty>
+		inline constref_t AddValue(
+			const _Ty & value
+			) {
+				static_assert(EngineTypeTraits<_Ty>::Supported == true, "Type used is not supported by the engine");
+				return _Add(EngineTypeTraits<_Ty>::Type, false, &value, sizeof value);
+			}
+
+		/// <summary>
+		/// Adds a value whose type is only known at runtime, copying its bytes.
+		/// </summary>
+		inline constref_t AddValue(
+			ValueType type, const void * value
+			) {
+				return _Add(type, false, value, GetValueTypeSize(type));
+			}
+
+		/// <summary>
+		/// Adds an array of values, or returns the constant holding an equal one.
+		/// </summary>
+		template <typename _Ty>
+		inline constref_t AddArray(
+			const _Ty * elements, size_t count
+			) {
+				static_assert(EngineTypeTraits<_Ty>::Supported == true, "Type used is not supported by the engine");
+				return _Add(EngineTypeTraits<_Ty>::Type, true, elements, count * sizeof(_Ty));
+			}
+
+		inline constref_t AddArray(
+			ValueType elementType, const void * elements, size_t count
+			) {
+				return _Add(elementType, true, elements, count * GetValueTypeSize(elementType));
+			}
+
+		/// <summary>
+		/// Adds the bytes of a string as an array of i1 values, without a terminator.
+		/// </summary>
+		inline constref_t AddString(
+			const std::string & value
+			) {
+				return _Add(ValueType::i1, true, value.data(), value.size());
+			}
+
+		inline bool Contains(
+			constref_t constant
+			) const {
+				return reinterpret_cast<size_t>(constant) < _entries.size();
+			}
+
+		inline size_t GetCount(
+			) const {
+				return _entries.size();
+			}
+
+		/// <summary>
+		/// Returns the type of a value, or the type of the elements of an array.
+		/// </summary>
+		inline ValueType GetType(
+			constref_t constant
+			) const {
+				return _GetEntry(constant).Type;
+			}
+
+		inline bool IsArray(
+			constref_t constant
+			) const {
+				return _GetEntry(constant).IsArray != 0;
+			}
+
+		/// <summary>
+		/// Returns the size of the constant in bytes.
+		/// </summary>
+		inline size_t GetSize(
+			constref_t constant
+			) const {
+				return _GetEntry(constant).Size;
+			}
+
+		/// <summary>
+		/// Returns the number of elements of an array, or one for a value.
+		/// </summary>
+		inline size_t GetLength(
+			constref_t constant
+			) const {
+				const _Entry & entry = _GetEntry(constant);
+				return entry.IsArray != 0 ? entry.Size / GetValueTypeSize(entry.Type) : 1;
+			}
+
+		inline const void * GetData(
+			constref_t constant
+			) const {
+				return static_cast<const std::int8_t *>(_data.GetPointer()) + _GetEntry(constant).Offset;
+			}
+
+		template <typename _Ty>
+		inline _Ty GetValue(
+			constref_t constant
+			) const {
+				const _Entry & entry = _GetEntry(constant);
+				if (entry.IsArray != 0 || entry.Type != EngineTypeTraits<_Ty>::Type)
+					throw InvalidArgumentException("The type doesn't match the constant.");
+				_Ty value;
+				memcpy(&value, GetData(constant), sizeof value);
+				return value;
+			}
+
+		/// <summary>
+		/// Returns the number of bytes of data held by the constants, including their alignment.
+		/// </summary>
+		inline size_t GetDataSize(
+			) const {
+				return _data.GetSize();
+			}
+
+		/// <summary>
+		/// Returns true if the data is read from the image given to Load, without a copy.
+		/// </summary>
+		inline bool IsMapped(
+			) const {
+				return _data.IsView() && _data.GetSize() != 0;
+			}
+
+		/// <summary>
+		/// Writes the image of the pool, which Load reads back on any process with the same byte order.
+		/// The data starts at an offset aligned to the largest vector type.
+		/// </summary>
+		inline void Save(
+			DynamicBuffer & image
+			) const {
+				_ImageHeader header;
+				header.Magic = _ImageMagic;
+				header.Count = static_cast<std::uint32_t>(_entries.size());
+				size_t entriesSize = _entries.size() * sizeof(_Entry);
+				header.DataOffset = static_cast<std::uint32_t>((sizeof header + entriesSize + _Alignment - 1) & ~(_Alignment - 1));
+				header.DataSize = static_cast<std::uint32_t>(_data.GetSize());
+
+				image.Clear();
+				image.Reserve(header.DataOffset + header.DataSize);
+				image.Push(&header, sizeof header);
+				if (!_entries.empty())
+					image.Push(&_entries[0], entriesSize);
+				image.Resize(header.DataOffset);
+				if (header.DataSize != 0)
+					image.Push(_data.GetPointer(), header.DataSize);
+			}
+
+		/// <summary>
+		/// Replaces the constants with the ones of an image written by Save. The data isn't copied, so
+		/// the image must outlive the pool, or the next constant added.
+		/// </summary>
+		inline void Load(
+			const void * image, size_t size
+			) {
+				_ImageHeader header;
+				if (size < sizeof header)
+					throw InvalidArgumentException("The image of the constant pool is too small.");
+				memcpy(&header, image, sizeof header);
+				if (header.Magic != _ImageMagic)
+					throw InvalidArgumentException("The image isn't a constant pool.");
+				if (header.DataOffset < sizeof header || header.DataOffset > size || header.DataSize > size - header.DataOffset
+					|| header.Count > (header.DataOffset - sizeof header) / sizeof(_Entry))
+					throw InvalidArgumentException("The image of the constant pool is truncated.");
+
+				std::vector<_Entry> entries(header.Count);
+				if (header.Count != 0)
+					memcpy(&entries[0], static_cast<const std::int8_t *>(image) + sizeof header, header.Count * sizeof(_Entry));
+				for (auto & entry : entries) {
+					if (entry.Type < ValueType::i1 || entry.Type > ValueType::v4fd || entry.Type == ValueType::rf
+						|| entry.Offset > header.DataSize || entry.Size > header.DataSize - entry.Offset
+						|| (entry.IsArray != 0 ? entry.Size % GetValueTypeSize(entry.Type) : entry.Size - GetValueTypeSize(entry.Type)) != 0)
+						throw InvalidArgumentException("The image holds an invalid constant.");
+				}
+
+				_entries.swap(entries);
+				_data = DynamicBuffer::CreateView(static_cast<const std::int8_t *>(image) + header.DataOffset, header.DataSize);
+				_indices.clear();
+				_isIndexed = false;
+			}
+	};
+
+} // namespace Nova
+
+#endif // !_NOVA_RUNTIME_ENVIRONMENT_CONSTANT_POOL_HEADER_
\ No newline at end of file
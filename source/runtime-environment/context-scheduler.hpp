@@ -0,0 +1,187 @@
+//
+// context-scheduler.hpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#ifndef _NOVA_RUNTIME_ENVIRONMENT_CONTEXT_SCHEDULER_HEADER_
+#define _NOVA_RUNTIME_ENVIRONMENT_CONTEXT_SCHEDULER_HEADER_
+
+#include "runtime-context.hpp"
+#include "channel.hpp"
+
+#include "..\common\exception.hpp"
+
+#include <cstdint>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <exception>
+
+namespace Nova {
+
+	INHERIT_EXCEPTION(SchedulerException, RuntimeException)
+
+	/// <summary>
+	/// Runs contexts over the same scope manager on a pool of threads, so scripts connected by
+	/// channels can work as the stages of a pipeline.
+	/// </summary>
+	/// <remarks>
+	/// <para>A context runs on a thread until it finishes or is suspended by a channel. Suspended
+	/// contexts are parked until their channel can be used, and the thread takes another context, so
+	/// threads never block on channels while some context can run. Idle threads sleep on the signal of
+	/// the channels of the manager.</para>
+	/// <para>Run returns once every context has finished. If all the remaining contexts wait for
+	/// channels, none can make progress and Run throws: values sent by the host must be in the channels
+	/// before Run is called.</para>
+	/// </remarks>
+	class ContextScheduler {
+		RuntimeScopeManager & _scopeManager;
+		const size_t _threadCount;
+		std::mutex _mutex;
+		std::deque<RuntimeContext *> _readyContexts;
+		std::vector<RuntimeContext *> _blockedContexts;
+		size_t _runningCount;
+		size_t _suspensionCount;
+		std::exception_ptr _error;
+
+		/// <summary>
+		/// Moves the blocked contexts whose channels can be used to the ready ones.
+		/// </summary>
+		inline void _WakeContexts(
+			) {
+				for (size_t i = 0; i < _blockedContexts.size(); ) {
+					if (_blockedContexts[i]->CanResume()) {
+						_readyContexts.push_back(_blockedContexts[i]);
+						_blockedContexts[i] = _blockedContexts.back();
+						_blockedContexts.pop_back();
+					} else {
+						++i;
+					}
+				}
+			}
+
+		inline void _Work(
+			) {
+				Internal::ChannelSignal & signal = _scopeManager.GetChannelSignal();
+				std::unique_lock<std::mutex> lock(_mutex);
+				while (!_error) {
+					if (!_readyContexts.empty()) {
+						RuntimeContext * context = _readyContexts.front();
+						_readyContexts.pop_front();
+						++_runningCount;
+						lock.unlock();
+
+						std::exception_ptr error;
+						try {
+							if (context->IsSuspended())
+								context->Resume();
+							else
+								context->Run();
+						} catch (...) {
+							error = std::current_exception();
+						}
+
+						lock.lock();
+						--_runningCount;
+						if (error) {
+							_error = error;
+						} else if (context->IsSuspended()) {
+							_blockedContexts.push_back(context);
+							++_suspensionCount;
+						}
+						_WakeContexts();
+						// The idle threads may be waiting for this context to finish.
+						signal.Notify(true);
+						continue;
+					}
+
+					if (_blockedContexts.empty() && _runningCount == 0)
+						return;
+
+					// The channels are checked again once the thread counts as a waiter, so a change made
+					// meanwhile either wakes a context here or notifies the signal.
+					std::uint64_t version = signal.BeginWait();
+					_WakeContexts();
+					if (!_readyContexts.empty()) {
+						signal.EndWait();
+						continue;
+					}
+					if (_runningCount == 0) {
+						signal.EndWait();
+						_error = std::make_exception_ptr(SchedulerException("All the contexts left are waiting for channels."));
+						signal.Notify(true);
+						return;
+					}
+
+					lock.unlock();
+					signal.Wait(version);
+					signal.EndWait();
+					lock.lock();
+				}
+			}
+
+	public:
+		/// <param name='threadCount'>Number of threads running the contexts, including the one
+		/// calling Run.</param>
+		inline explicit ContextScheduler(
+			RuntimeScopeManager & scopeManager, size_t threadCount = 1
+			)
+			: _scopeManager(scopeManager), _threadCount(threadCount), _runningCount(0), _suspensionCount(0)
+			{
+				if (threadCount == 0)
+					throw InvalidArgumentException("The scheduler needs at least one thread.");
+			}
+
+		/// <summary>
+		/// Adds a context to the next call to Run. Suspended contexts are resumed when their channel
+		/// can be used. The context isn't owned by the scheduler.
+		/// </summary>
+		inline void Add(
+			RuntimeContext & context
+			) {
+				if (&context.GetRuntimeScopeManager() != &_scopeManager)
+					throw InvalidArgumentException("The context uses another scope manager.");
+
+				std::lock_guard<std::mutex> lock(_mutex);
+				if (context.IsSuspended())
+					_blockedContexts.push_back(&context);
+				else
+					_readyContexts.push_back(&context);
+			}
+
+		/// <summary>
+		/// Runs the contexts added until all of them finish. If one throws, the others stop being
+		/// scheduled and the exception is thrown once the running ones are suspended or finished.
+		/// </summary>
+		inline void Run(
+			) {
+				std::vector<std::thread> threads;
+				for (size_t i = 1; i < _threadCount; ++i)
+					threads.push_back(std::thread([this] { _Work(); }));
+				_Work();
+				for (auto & thread : threads)
+					thread.join();
+
+				std::exception_ptr error = _error;
+				_error = nullptr;
+				_readyContexts.clear();
+				_blockedContexts.clear();
+				if (error)
+					std::rethrow_exception(error);
+			}
+
+		/// <summary>
+		/// Returns how many times the contexts were suspended by a channel.
+		/// </summary>
+		inline size_t GetSuspensionCount(
+			) const {
+				return _suspensionCount;
+			}
+	};
+
+} // namespace Nova
+
+#endif // !_NOVA_RUNTIME_ENVIRONMENT_CONTEXT_SCHEDULER_HEADER_
\ No newline at end of file
@@ -0,0 +1,286 @@
+//
+// context-snapshot.hpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#ifndef _NOVA_RUNTIME_ENVIRONMENT_CONTEXT_SNAPSHOT_HEADER_
+#define _NOVA_RUNTIME_ENVIRONMENT_CONTEXT_SNAPSHOT_HEADER_
+
+#include "runtime-context.hpp"
+
+#include "..\common\exception.hpp"
+#include "..\common\dynamic-buffer.hpp"
+#include "..\common\type-traits.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <map>
+
+namespace Nova {
+
+	INHERIT_EXCEPTION(SnapshotException, RuntimeException)
+
+	/// <summary>
+	/// Copy of the state left in a context by a run, so other contexts can start from it instead of
+	/// running the same initialization again.
+	/// </summary>
+	/// <remarks>
+	/// <para>The snapshot holds the used part of the stack, the registers, and the heap objects
+	/// reachable from the memory-address registers. Stack-frame registers are kept relative to the
+	/// bottom of the stack. Values in the stack are copied as bytes, so they must not be references:
+	/// the stack is checked for the addresses of the objects copied, which would point to the heap of
+	/// the context the snapshot was taken from.</para>
+	/// <para>Snapshots are taken between runs, since a run can't be resumed from the middle of a scope.
+	/// They aren't changed by Restore, so a snapshot can be restored by several threads at once.</para>
+	/// </remarks>
+	class ContextSnapshot {
+		static const size_t _NoObject = static_cast<size_t>(-1);
+		static const int _MRegisterCount = 4;
+		static const int _VRegisterSize = 32;
+
+		struct _Object {
+			size_t Size;
+			size_t DataOffset;
+		};
+
+		/// <summary>
+		/// Addresses of the restored objects by index. The heap may move them while the next ones are
+		/// allocated, so they're roots of the heap until all the objects exist.
+		/// </summary>
+		class _RestoredObjects : public IHeapRootEnumerator {
+			IHeapRootEnumerator & _context;
+
+		public:
+			std::vector<refaddr_t> Addresses;
+
+			inline explicit _RestoredObjects(
+				IHeapRootEnumerator & context, size_t objectCount
+				)
+				: _context(context), Addresses(objectCount, nullptr)
+				{
+				}
+
+			inline void EnumerateRoots(
+				IHeapRootVisitor & visitor
+				) {
+					_context.EnumerateRoots(visitor);
+					for (auto & address : Addresses) {
+						if (address != nullptr)
+							visitor.VisitRoot(&address);
+					}
+				}
+		};
+
+		struct _Reference {
+			size_t Object;
+			std::int32_t Offset;
+			size_t Target;
+		};
+
+		DynamicBuffer _stack;
+		std::int64_t _rRegisters[8];
+		std::int64_t _spOffsets[6];
+		bool _spIsNull[6];
+		bool _cpRegister;
+		std::int8_t _vRegisters[4][_VRegisterSize];
+		size_t _mObjects[_MRegisterCount];
+
+		std::vector<_Object> _objects;
+		std::vector<_Reference> _references;
+		DynamicBuffer _objectData;
+
+		static inline Register _GetMRegister(
+			int index
+			) {
+				return static_cast<Register>(static_cast<int>(Register::m0) + index);
+			}
+
+		/// <summary>
+		/// Copies the objects reachable from the memory-address registers, and returns their addresses.
+		/// </summary>
+		inline std::map<refaddr_t, size_t> _CaptureHeap(
+			RegisterSet & registerSet
+			) {
+				std::map<refaddr_t, size_t> indices;
+				std::vector<refaddr_t> addresses;
+				auto addObject = [&] (refaddr_t address) -> size_t {
+					std::map<refaddr_t, size_t>::const_iterator it = indices.find(address);
+					if (it != indices.end())
+						return it->second;
+					if (HeapObject::IsHostView(address))
+						throw SnapshotException("Host views can't be stored in a snapshot.");
+
+					_Object object;
+					object.Size = HeapObject::GetSize(address);
+					object.DataOffset = _objectData.GetSize();
+					_objects.push_back(object);
+					_objectData.Push(address, object.Size);
+					addresses.push_back(address);
+					indices[address] = _objects.size() - 1;
+					return _objects.size() - 1;
+				};
+
+				for (int i = 0; i < _MRegisterCount; ++i) {
+					refaddr_t address = registerSet.GetMRegister(_GetMRegister(i));
+					_mObjects[i] = address != nullptr ? addObject(address) : _NoObject;
+				}
+
+				for (size_t i = 0; i < addresses.size(); ++i) {
+					refaddr_t address = addresses[i];
+					HeapObject::ForEachReference(address, [&] (refaddr_t * slot) {
+						std::int32_t offset = static_cast<std::int32_t>(
+							reinterpret_cast<std::int8_t *>(slot) - reinterpret_cast<std::int8_t *>(address));
+						// The data of the object is copied without its references.
+						memset(static_cast<std::int8_t *>(_objectData.GetPointer()) + _objects[i].DataOffset + offset,
+							0, sizeof (refaddr_t));
+						if (* slot == nullptr)
+							return;
+
+						_Reference reference;
+						reference.Object = i;
+						reference.Offset = offset;
+						reference.Target = addObject(* slot);
+						_references.push_back(reference);
+					});
+				}
+				return indices;
+			}
+
+		/// <summary>
+		/// Checks that the stack doesn't hold the address of any object copied. Stack values aren't
+		/// aligned, so every offset is checked.
+		/// </summary>
+		inline void _CheckStack(
+			const std::map<refaddr_t, size_t> & indices
+			) const {
+				if (indices.empty())
+					return;
+				const std::int8_t * data = static_cast<const std::int8_t *>(_stack.GetPointer());
+				for (size_t offset = 0; offset + sizeof (refaddr_t) <= _stack.GetSize(); ++offset) {
+					refaddr_t value;
+					memcpy(&value, data + offset, sizeof (value));
+					if (indices.count(value) != 0)
+						throw SnapshotException("References in the stack can't be stored in a snapshot.");
+				}
+			}
+
+		/// <summary>
+		/// Allocates the objects, then sets their references and the registers from the table of their
+		/// addresses. Nothing is allocated once the references are set, so the addresses don't move.
+		/// </summary>
+		inline void _RestoreHeap(
+			RuntimeContext & context
+			) const {
+				RegisterSet & registerSet = context.GetRegisterSet();
+				IRuntimeHeap & heap = context.GetRuntimeHeap();
+				_RestoredObjects objects(context, _objects.size());
+				heap.SetRootEnumerator(&objects);
+				try {
+					for (size_t i = 0; i < _objects.size(); ++i) {
+						const _Object & object = _objects[i];
+						refaddr_t address = heap.Allocate(object.Size);
+						if (object.Size != 0)
+							memcpy(address, static_cast<const std::int8_t *>(_objectData.GetPointer()) + object.DataOffset, object.Size);
+						objects.Addresses[i] = address;
+					}
+				} catch (...) {
+					heap.SetRootEnumerator(&context);
+					throw;
+				}
+				heap.SetRootEnumerator(&context);
+
+				for (auto & reference : _references) {
+					refaddr_t object = objects.Addresses[reference.Object];
+					refaddr_t target = objects.Addresses[reference.Target];
+					HeapObject::Store<refaddr_t>(object, reference.Offset, target);
+					heap.WriteBarrier(object, target);
+				}
+				for (int i = 0; i < _MRegisterCount; ++i) {
+					if (_mObjects[i] != _NoObject)
+						registerSet.SetMRegister(_GetMRegister(i), objects.Addresses[_mObjects[i]]);
+				}
+			}
+
+	public:
+		/// <summary>
+		/// Takes a snapshot of a context which isn't running.
+		/// </summary>
+		inline explicit ContextSnapshot(
+			RuntimeContext & context
+			) {
+				if (!context.GetCallFrames().empty())
+					throw SnapshotException("Snapshots can't be taken while the context is running.");
+
+				RuntimeFixedStack & stack = context.GetRuntimeStack();
+				staddr_t base = stack.GetBaseAddress();
+				_stack.Push(base, stack.GetCurrentAddress() - base);
+
+				RegisterSet & registerSet = context.GetRegisterSet();
+				for (int i = 0; i < 8; ++i)
+					_rRegisters[i] = registerSet.GetRRegister(static_cast<Register>(i));
+				for (int i = 0; i < 6; ++i) {
+					staddr_t address = registerSet.GetSPRegister(static_cast<Register>(static_cast<int>(Register::sp0) + i));
+					_spIsNull[i] = address == nullptr;
+					_spOffsets[i] = address != nullptr ? address - base : 0;
+					if (address != nullptr && (address < base || address > base + stack.GetSize()))
+						throw SnapshotException("A stack-frame register points out of the stack.");
+				}
+				_cpRegister = registerSet.GetCPRegister();
+				for (int i = 0; i < 4; ++i)
+					memcpy(_vRegisters[i], registerSet.GetVRegisterData(static_cast<Register>(static_cast<int>(Register::v0) + i)), _VRegisterSize);
+
+				_CheckStack(_CaptureHeap(registerSet));
+			}
+
+		/// <summary>
+		/// Resets a context to the state of the snapshot. The objects are allocated in the heap of the
+		/// context, and its host views are removed.
+		/// </summary>
+		/// <param name='startScope'>Scope executed by the next call to Run.</param>
+		inline void Restore(
+			RuntimeContext & context, scoperef_t startScope
+			) const {
+				if (!context.GetCallFrames().empty())
+					throw SnapshotException("Snapshots can't be restored while the context is running.");
+				context.Reset(startScope);
+
+				RuntimeFixedStack & stack = context.GetRuntimeStack();
+				if (_stack.GetSize() != 0)
+					stack.PushBytes(_stack.GetPointer(), _stack.GetSize());
+
+				RegisterSet & registerSet = context.GetRegisterSet();
+				for (int i = 0; i < 8; ++i)
+					registerSet.SetRRegister(static_cast<Register>(i), _rRegisters[i]);
+				for (int i = 0; i < 6; ++i) {
+					if (!_spIsNull[i] && static_cast<size_t>(_spOffsets[i]) > stack.GetSize())
+						throw SnapshotException("The stack of the context is smaller than the one of the snapshot.");
+					registerSet.SetSPRegister(static_cast<Register>(static_cast<int>(Register::sp0) + i),
+						_spIsNull[i] ? nullptr : stack.GetBaseAddress() + _spOffsets[i]);
+				}
+				registerSet.SetCPRegister(_cpRegister);
+				for (int i = 0; i < 4; ++i)
+					memcpy(registerSet.GetVRegisterData(static_cast<Register>(static_cast<int>(Register::v0) + i)), _vRegisters[i], _VRegisterSize);
+
+				_RestoreHeap(context);
+			}
+
+		/// <summary>
+		/// Returns the number of bytes of stack and object data held by the snapshot.
+		/// </summary>
+		inline size_t GetDataSize(
+			) const {
+				return _stack.GetSize() + _objectData.GetSize();
+			}
+
+		inline size_t GetObjectCount(
+			) const {
+				return _objects.size();
+			}
+	};
+
+} // namespace Nova
+
+#endif // !_NOVA_RUNTIME_ENVIRONMENT_CONTEXT_SNAPSHOT_HEADER_
\ No newline at end of file
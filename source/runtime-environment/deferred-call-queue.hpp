@@ -0,0 +1,129 @@
+//
+// deferred-call-queue.hpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#ifndef _NOVA_RUNTIME_ENVIRONMENT_DEFERRED_CALL_QUEUE_HEADER_
+#define _NOVA_RUNTIME_ENVIRONMENT_DEFERRED_CALL_QUEUE_HEADER_
+
+#include "runtime-scope.hpp"
+
+#include "..\common\dynamic-buffer.hpp"
+#include "..\common\type-traits.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace Nova {
+
+	namespace Internal {
+		/// <summary>
+		/// Arguments of the deferred calls made by a context, grouped by external scope.
+		/// </summary>
+		/// <remarks>
+		/// The batches are delivered in the order of the first call to their scope. Their buffers are
+		/// kept after a flush, so a context buffering the same calls on every run doesn't allocate once
+		/// it's warm.
+		/// </remarks>
+		class DeferredCallQueue {
+			struct _Batch {
+				ExternalScope * Scope;
+				DynamicBuffer Arguments;
+				size_t CallCount;
+			};
+
+			std::vector<_Batch *> _batches;
+			size_t _batchCount;
+
+			/// <summary>
+			/// Position of the active batch of every external scope plus one, or zero if it has none.
+			/// </summary>
+			std::vector<size_t> _batchPositions;
+
+			DeferredCallQueue(const DeferredCallQueue &);
+			DeferredCallQueue & operator = (const DeferredCallQueue &);
+
+			static inline void _Deliver(
+				_Batch & batch
+				) {
+					if (batch.CallCount == 0)
+						return;
+					size_t callCount = batch.CallCount;
+					batch.CallCount = 0;
+					ExternalCallBatch calls(batch.Scope->GetId(), batch.Arguments.GetPointer(),
+						callCount, batch.Arguments.GetSize() / callCount);
+					batch.Scope->GetBatchCallbackFunction()(calls);
+					batch.Arguments.Clear();
+				}
+
+		public:
+			inline DeferredCallQueue(
+				)
+				: _batchCount(0)
+				{
+				}
+
+			inline ~DeferredCallQueue(
+				) {
+					for (auto batch : _batches)
+						delete batch;
+				}
+
+			/// <summary>
+			/// Copies the arguments of a call. The batch of the scope is delivered once it's full.
+			/// </summary>
+			inline void Add(
+				ExternalScope & scope, const void * arguments, size_t size
+				) {
+					size_t index = reinterpret_cast<size_t>(scope.GetId());
+					if (index >= _batchPositions.size())
+						_batchPositions.resize(index + 1, 0);
+
+					if (_batchPositions[index] == 0) {
+						if (_batchCount == _batches.size())
+							_batches.push_back(new _Batch());
+						_Batch & batch = * _batches[_batchCount++];
+						batch.Scope = &scope;
+						batch.Arguments.Clear();
+						batch.CallCount = 0;
+						_batchPositions[index] = _batchCount;
+					}
+
+					_Batch & batch = * _batches[_batchPositions[index] - 1];
+					batch.Arguments.Push(arguments, size);
+					if (++batch.CallCount == scope.GetMaxBatchSize())
+						_Deliver(batch);
+				}
+
+			/// <summary>
+			/// Delivers the buffered calls. If a callback throws, the calls of the batches after it are
+			/// dropped.
+			/// </summary>
+			inline void Flush(
+				) {
+					size_t batchCount = _batchCount;
+					_batchCount = 0;
+					for (size_t i = 0; i < batchCount; ++i)
+						_batchPositions[reinterpret_cast<size_t>(_batches[i]->Scope->GetId())] = 0;
+					for (size_t i = 0; i < batchCount; ++i)
+						_Deliver(* _batches[i]);
+				}
+
+			/// <summary>
+			/// Returns the number of calls buffered and not delivered yet.
+			/// </summary>
+			inline size_t GetCallCount(
+				) const {
+					size_t callCount = 0;
+					for (size_t i = 0; i < _batchCount; ++i)
+						callCount += _batches[i]->CallCount;
+					return callCount;
+				}
+		};
+	}
+
+} // namespace Nova
+
+#endif // !_NOVA_RUNTIME_ENVIRONMENT_DEFERRED_CALL_QUEUE_HEADER_
\ No newline at end of file
@@ -0,0 +1,528 @@
+//
+// engine-metrics.hpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#ifndef _NOVA_RUNTIME_ENVIRONMENT_ENGINE_METRICS_HEADER_
+#define _NOVA_RUNTIME_ENVIRONMENT_ENGINE_METRICS_HEADER_
+
+#include "..\common\platform.hpp"
+
+#include <cstdint>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <algorithm>
+
+namespace Nova {
+
+	/// <summary>
+	/// Kind of the exceptions which stopped a run.
+	/// </summary>
+	enum class TrapKind {
+		Stack = 0,
+		Heap,
+		Verification,
+		Runtime,
+		Other
+	};
+
+	static const size_t TrapKindCount = 5;
+
+	/// <summary>
+	/// Distribution of latencies in nanoseconds, taken from the engine metrics.
+	/// </summary>
+	/// <remarks>
+	/// Values are counted in buckets of logarithmic size: every power of two is split in sixteen
+	/// buckets, so a value is known within 1/16 of itself, whatever its magnitude.
+	/// </remarks>
+	class HistogramSnapshot {
+		std::vector<std::uint64_t> _counts;
+		std::uint64_t _count;
+		std::uint64_t _total;
+		std::uint64_t _max;
+
+	public:
+		static const size_t SubBucketBits = 4;
+		static const size_t SubBucketCount = 1 << SubBucketBits;
+		static const size_t BucketCount = SubBucketCount + (64 - SubBucketBits) * SubBucketCount;
+
+		static inline size_t GetBucketIndex(
+			std::uint64_t value
+			) {
+				if (value < SubBucketCount)
+					return static_cast<size_t>(value);
+				size_t exponent = 63;
+				while ((value >> exponent) == 0)
+					--exponent;
+				size_t shift = exponent - SubBucketBits;
+				return SubBucketCount + shift * SubBucketCount + static_cast<size_t>((value >> shift) & (SubBucketCount - 1));
+			}
+
+		/// <summary>
+		/// Returns the highest value counted in a bucket.
+		/// </summary>
+		static inline std::uint64_t GetBucketLimit(
+			size_t index
+			) {
+				if (index < SubBucketCount)
+					return index;
+				size_t shift = (index - SubBucketCount) / SubBucketCount;
+				std::uint64_t subBucket = SubBucketCount + (index - SubBucketCount) % SubBucketCount;
+				return ((subBucket + 1) << shift) - 1;
+			}
+
+		inline HistogramSnapshot(
+			)
+			: _counts(BucketCount, 0), _count(0), _total(0), _max(0)
+			{
+			}
+
+		/// <summary>
+		/// Adds the values of a bucket.
+		/// </summary>
+		inline void Add(
+			size_t index, std::uint64_t count
+			) {
+				_counts[index] += count;
+			}
+
+		/// <summary>
+		/// Adds the totals of the values added to the buckets.
+		/// </summary>
+		inline void AddTotals(
+			std::uint64_t count, std::uint64_t total, std::uint64_t max
+			) {
+				_count += count;
+				_total += total;
+				_max = std::max(_max, max);
+			}
+
+		inline void Merge(
+			const HistogramSnapshot & other
+			) {
+				for (size_t i = 0; i < BucketCount; ++i)
+					_counts[i] += other._counts[i];
+				AddTotals(other._count, other._total, other._max);
+			}
+
+		inline std::uint64_t GetCount(
+			) const {
+				return _count;
+			}
+
+		inline std::uint64_t GetTotal(
+			) const {
+				return _total;
+			}
+
+		inline std::uint64_t GetMax(
+			) const {
+				return _max;
+			}
+
+		inline std::uint64_t GetMean(
+			) const {
+				return _count != 0 ? _total / _count : 0;
+			}
+
+		/// <summary>
+		/// Returns the value below which the percentage of the values fall, rounded up to the limit of
+		/// its bucket.
+		/// </summary>
+		inline std::uint64_t GetValueAtPercentile(
+			double percentile
+			) const {
+				std::uint64_t bucketTotal = 0;
+				for (size_t i = 0; i < BucketCount; ++i)
+					bucketTotal += _counts[i];
+				if (bucketTotal == 0)
+					return 0;
+
+				std::uint64_t rank = static_cast<std::uint64_t>(percentile / 100.0 * bucketTotal + 0.5);
+				rank = std::max<std::uint64_t>(rank, 1);
+				std::uint64_t seen = 0;
+				for (size_t i = 0; i < BucketCount; ++i) {
+					seen += _counts[i];
+					if (seen >= rank)
+						return std::min(GetBucketLimit(i), _max);
+				}
+				return _max;
+			}
+	};
+
+	namespace Internal {
+		/// <summary>
+		/// Histogram written by a single thread and read by any.
+		/// </summary>
+		class LatencyHistogram {
+			std::atomic<std::uint64_t> _counts[HistogramSnapshot::BucketCount];
+			std::atomic<std::uint64_t> _count;
+			std::atomic<std::uint64_t> _total;
+			std::atomic<std::uint64_t> _max;
+
+			static inline void _Add(
+				std::atomic<std::uint64_t> & counter, std::uint64_t value
+				) {
+					counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+				}
+
+		public:
+			inline LatencyHistogram(
+				)
+				: _count(0), _total(0), _max(0)
+				{
+					for (auto & count : _counts)
+						count.store(0, std::memory_order_relaxed);
+				}
+
+			inline void Record(
+				std::uint64_t nanoseconds
+				) {
+					_Add(_counts[HistogramSnapshot::GetBucketIndex(nanoseconds)], 1);
+					_Add(_count, 1);
+					_Add(_total, nanoseconds);
+					if (nanoseconds > _max.load(std::memory_order_relaxed))
+						_max.store(nanoseconds, std::memory_order_relaxed);
+				}
+
+			inline void AddTo(
+				HistogramSnapshot & snapshot
+				) const {
+					for (size_t i = 0; i < HistogramSnapshot::BucketCount; ++i) {
+						std::uint64_t count = _counts[i].load(std::memory_order_relaxed);
+						if (count != 0)
+							snapshot.Add(i, count);
+					}
+					snapshot.AddTotals(_count.load(std::memory_order_relaxed), _total.load(std::memory_order_relaxed),
+						_max.load(std::memory_order_relaxed));
+				}
+		};
+
+		/// <summary>
+		/// Metrics of the runs of one thread. Only that thread writes them, so the counters are updated
+		/// without read-modify-write instructions, and scraping only reads them.
+		/// </summary>
+		class MetricsShard {
+			typedef std::vector<LatencyHistogram *> _HistogramTable;
+
+			const std::thread::id _thread;
+			std::atomic<std::uint64_t> _runs;
+			std::atomic<std::uint64_t> _instructions;
+			std::atomic<std::uint64_t> _traps[TrapKindCount];
+			std::atomic<std::uint64_t> _contextAllocations;
+			std::atomic<size_t> _maxStackDepth;
+			std::atomic<std::uint64_t> _minorCollections;
+			std::atomic<std::uint64_t> _majorCollections;
+			LatencyHistogram _runLatency;
+			LatencyHistogram _collectionPause;
+
+			/// <summary>
+			/// Histograms of the external scopes, by index. The table is replaced, never changed, when it
+			/// grows; the replaced ones are kept so scrapers can still read them.
+			/// </summary>
+			std::atomic<const _HistogramTable *> _xcallLatency;
+			std::vector<const _HistogramTable *> _tables;
+
+			static inline void _Add(
+				std::atomic<std::uint64_t> & counter, std::uint64_t value
+				) {
+					counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+				}
+
+			inline LatencyHistogram & _GetXCallHistogram(
+				size_t index
+				) {
+					const _HistogramTable * table = _xcallLatency.load(std::memory_order_relaxed);
+					if (index < table->size())
+						return * (* table)[index];
+
+					_HistogramTable * newTable = new _HistogramTable(* table);
+					newTable->resize(std::max(index + 1, table->size() * 2), nullptr);
+					for (auto & histogram : * newTable) {
+						if (histogram == nullptr)
+							histogram = new LatencyHistogram();
+					}
+					_tables.push_back(newTable);
+					_xcallLatency.store(newTable, std::memory_order_release);
+					return * (* newTable)[index];
+				}
+
+		public:
+			inline explicit MetricsShard(
+				std::thread::id thread
+				)
+				: _thread(thread), _runs(0), _instructions(0), _contextAllocations(0), _maxStackDepth(0),
+				  _minorCollections(0), _majorCollections(0)
+				{
+					for (auto & count : _traps)
+						count.store(0, std::memory_order_relaxed);
+					_tables.push_back(new _HistogramTable());
+					_xcallLatency.store(_tables.back());
+				}
+
+			inline ~MetricsShard(
+				) {
+					for (auto histogram : * _tables.back())
+						delete histogram;
+					for (auto table : _tables)
+						delete table;
+				}
+
+			inline std::thread::id GetThread(
+				) const {
+					return _thread;
+				}
+
+			inline void AddRun(
+				) {
+					_Add(_runs, 1);
+				}
+
+			inline void AddRunLatency(
+				std::uint64_t nanoseconds
+				) {
+					_runLatency.Record(nanoseconds);
+				}
+
+			inline void AddInstructions(
+				std::uint64_t count
+				) {
+					_Add(_instructions, count);
+				}
+
+			inline void AddTrap(
+				TrapKind kind
+				) {
+					_Add(_traps[static_cast<size_t>(kind)], 1);
+				}
+
+			inline void AddContextAllocation(
+				) {
+					_Add(_contextAllocations, 1);
+				}
+
+			inline void UpdateStackDepth(
+				size_t depth
+				) {
+					if (depth > _maxStackDepth.load(std::memory_order_relaxed))
+						_maxStackDepth.store(depth, std::memory_order_relaxed);
+				}
+
+			/// <summary>
+			/// Records a pause of a garbage-collected heap. Major collections include the minor one
+			/// before them, and are only counted as major.
+			/// </summary>
+			inline void AddCollection(
+				bool major, std::uint64_t nanoseconds
+				) {
+					_Add(major ? _majorCollections : _minorCollections, 1);
+					_collectionPause.Record(nanoseconds);
+				}
+
+			inline void AddXCallLatency(
+				size_t externalScope, std::uint64_t nanoseconds
+				) {
+					_GetXCallHistogram(externalScope).Record(nanoseconds);
+				}
+
+			/// <summary>
+			/// Adds the metrics to a snapshot. Called by any thread while the owner keeps writing.
+			/// </summary>
+			template <typename _Snapshot>
+			inline void AddTo(
+				_Snapshot & snapshot
+				) const {
+					snapshot.Runs += _runs.load(std::memory_order_relaxed);
+					snapshot.InstructionsRetired += _instructions.load(std::memory_order_relaxed);
+					for (size_t i = 0; i < TrapKindCount; ++i)
+						snapshot.Traps[i] += _traps[i].load(std::memory_order_relaxed);
+					snapshot.ContextAllocations += _contextAllocations.load(std::memory_order_relaxed);
+					snapshot.MaxStackDepth = std::max(snapshot.MaxStackDepth, _maxStackDepth.load(std::memory_order_relaxed));
+					snapshot.MinorCollections += _minorCollections.load(std::memory_order_relaxed);
+					snapshot.MajorCollections += _majorCollections.load(std::memory_order_relaxed);
+					_runLatency.AddTo(snapshot.RunLatency);
+					_collectionPause.AddTo(snapshot.CollectionPause);
+
+					const _HistogramTable * table = _xcallLatency.load(std::memory_order_acquire);
+					if (snapshot.XCallLatency.size() < table->size())
+						snapshot.XCallLatency.resize(table->size());
+					for (size_t i = 0; i < table->size(); ++i)
+						(* table)[i]->AddTo(snapshot.XCallLatency[i]);
+				}
+		};
+	}
+
+	/// <summary>
+	/// Metrics of all the threads, added up when they were scraped.
+	/// </summary>
+	struct MetricsSnapshot {
+		std::uint64_t Runs;
+		std::uint64_t InstructionsRetired;
+		std::uint64_t Traps[TrapKindCount];
+		std::uint64_t ContextAllocations;
+
+		/// <summary>
+		/// Maximum number of bytes of a context stack used by a run, counting the whole frame of the
+		/// scopes verified.
+		/// </summary>
+		size_t MaxStackDepth;
+		HistogramSnapshot RunLatency;
+
+		/// <summary>
+		/// Collections of the garbage-collected heaps used by the contexts, and their pauses.
+		/// </summary>
+		std::uint64_t MinorCollections;
+		std::uint64_t MajorCollections;
+		HistogramSnapshot CollectionPause;
+
+		/// <summary>
+		/// Latency of the calls to every external scope, by its index.
+		/// </summary>
+		std::vector<HistogramSnapshot> XCallLatency;
+
+		inline MetricsSnapshot(
+			)
+			: Runs(0), InstructionsRetired(0), ContextAllocations(0), MaxStackDepth(0),
+			  MinorCollections(0), MajorCollections(0)
+			{
+				for (auto & count : Traps)
+					count = 0;
+			}
+
+		inline std::uint64_t GetTrapCount(
+			TrapKind kind
+			) const {
+				return Traps[static_cast<size_t>(kind)];
+			}
+	};
+
+	/// <summary>
+	/// Counters and latency histograms of the contexts running the scopes of a manager.
+	/// </summary>
+	/// <remarks>
+	/// <para>Every thread writes to its own shard, found through a thread-local cache, so recording
+	/// never takes a lock or contends with other threads. The cache holds the shards of the last few
+	/// metrics used by the thread, so threads switching between managers don't look them up again. Scrape reads every shard without stopping
+	/// their threads; counters of runs in progress may be seen in part.</para>
+	/// <para>Shards live as long as the metrics, even if their threads exit. Timing the runs and the
+	/// calls to external scopes reads the clock twice per event, so it can be turned off.</para>
+	/// </remarks>
+	class EngineMetrics {
+		static const size_t _ThreadCacheSize = 8;
+
+		/// <summary>
+		/// Shards of the thread by the id of their metrics. Ids aren't reused, so entries of metrics
+		/// destroyed are never matched again; they're replaced in turn once the cache is full.
+		/// </summary>
+		struct _ThreadCache {
+			struct Entry {
+				std::uint64_t Owner;
+				Internal::MetricsShard * Shard;
+			};
+
+			Entry Entries[_ThreadCacheSize];
+			size_t Next;
+		};
+
+		const std::uint64_t _id;
+		mutable std::mutex _mutex;
+		std::vector<Internal::MetricsShard *> _shards;
+		std::atomic<bool> _latencyEnabled;
+
+		static inline std::uint64_t _CreateId(
+			) {
+				static std::atomic<std::uint64_t> nextId(1);
+				return nextId.fetch_add(1);
+			}
+
+		static inline _ThreadCache & _GetThreadCache(
+			) {
+				static NOVA_THREAD_LOCAL _ThreadCache cache;
+				return cache;
+			}
+
+		EngineMetrics(const EngineMetrics &);
+		EngineMetrics & operator=(const EngineMetrics &);
+
+	public:
+		inline EngineMetrics(
+			)
+			: _id(_CreateId()), _latencyEnabled(true)
+			{
+			}
+
+		inline ~EngineMetrics(
+			) {
+				for (auto shard : _shards)
+					delete shard;
+			}
+
+		/// <summary>
+		/// Returns the shard of the calling thread, creating it on its first use.
+		/// </summary>
+		inline Internal::MetricsShard & GetShard(
+			) {
+				_ThreadCache & cache = _GetThreadCache();
+				for (size_t i = 0; i < _ThreadCacheSize; ++i) {
+					if (cache.Entries[i].Owner == _id)
+						return * cache.Entries[i].Shard;
+				}
+
+				// A thread working for more managers than the cache holds may have its shard already.
+				Internal::MetricsShard * shard = nullptr;
+				std::thread::id thread = std::this_thread::get_id();
+				{
+					std::lock_guard<std::mutex> lock(_mutex);
+					for (auto item : _shards) {
+						if (item->GetThread() == thread)
+							shard = item;
+					}
+					if (shard == nullptr) {
+						shard = new Internal::MetricsShard(thread);
+						_shards.push_back(shard);
+					}
+				}
+				_ThreadCache::Entry & entry = cache.Entries[cache.Next];
+				cache.Next = (cache.Next + 1) % _ThreadCacheSize;
+				entry.Owner = _id;
+				entry.Shard = shard;
+				return * shard;
+			}
+
+		inline bool IsLatencyEnabled(
+			) const {
+				return _latencyEnabled.load(std::memory_order_relaxed);
+			}
+
+		inline void SetLatencyEnabled(
+			bool enabled
+			) {
+				_latencyEnabled.store(enabled, std::memory_order_relaxed);
+			}
+
+		/// <summary>
+		/// Adds up the metrics of all the threads.
+		/// </summary>
+		inline MetricsSnapshot Scrape(
+			) const {
+				MetricsSnapshot snapshot;
+				std::lock_guard<std::mutex> lock(_mutex);
+				for (auto shard : _shards)
+					shard->AddTo(snapshot);
+				return snapshot;
+			}
+
+		inline size_t GetShardCount(
+			) const {
+				std::lock_guard<std::mutex> lock(_mutex);
+				return _shards.size();
+			}
+	};
+
+} // namespace Nova
+
+#endif // !_NOVA_RUNTIME_ENVIRONMENT_ENGINE_METRICS_HEADER_
\ No newline at end of file
@@ -0,0 +1,382 @@
+//
+// generational-heap.hpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#ifndef _NOVA_RUNTIME_ENVIRONMENT_GENERATIONAL_HEAP_HEADER_
+#define _NOVA_RUNTIME_ENVIRONMENT_GENERATIONAL_HEAP_HEADER_
+
+#include "runtime-heap.hpp"
+#include "engine-metrics.hpp"
+
+#include "..\common\exception.hpp"
+#include "..\common\platform.hpp"
+#include "..\common\type-traits.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+
+namespace Nova {
+
+	struct GarbageCollectorStatistics {
+		size_t MinorCollections;
+		size_t MajorCollections;
+		size_t PromotedBytes;
+		std::uint64_t LastPauseMicroseconds;
+		std::uint64_t MaxPauseMicroseconds;
+		std::uint64_t TotalPauseMicroseconds;
+	};
+
+	/// <summary>
+	/// Garbage-collected heap for long-lived contexts.
+	/// </summary>
+	/// <remarks>
+	/// <para>New objects are allocated in a nursery by bumping a pointer. When the nursery is full, the
+	/// objects reachable from the roots are copied to the old generation and the nursery is reused. The
+	/// old generation is collected with mark and sweep when it grows over a threshold.</para>
+	/// <para>Collection is precise: roots are the memory-address registers, the references in the stack
+	/// located through the stack maps of the verifier, and the slots registered with AddRoot. References
+	/// inside objects are found through their reference bitmaps. The heap belongs to a single context,
+	/// and scopes running on it must be verified.</para>
+	/// </remarks>
+	class GenerationalHeap : public IRuntimeHeap {
+		class _PromoteVisitor : public IHeapRootVisitor {
+			GenerationalHeap & _heap;
+
+		public:
+			inline explicit _PromoteVisitor(
+				GenerationalHeap & heap
+				)
+				: _heap(heap)
+				{
+				}
+
+			inline void VisitRoot(
+				void * slot
+				) {
+					refaddr_t value;
+					memcpy(&value, slot, sizeof value);
+					value = _heap._Promote(value);
+					memcpy(slot, &value, sizeof value);
+				}
+		};
+
+		class _MarkVisitor : public IHeapRootVisitor {
+			GenerationalHeap & _heap;
+
+		public:
+			inline explicit _MarkVisitor(
+				GenerationalHeap & heap
+				)
+				: _heap(heap)
+				{
+				}
+
+			inline void VisitRoot(
+				void * slot
+				) {
+					refaddr_t value;
+					memcpy(&value, slot, sizeof value);
+					_heap._Mark(value);
+				}
+		};
+
+		std::int8_t * _nursery;
+		std::int8_t * _nurseryCurrent;
+		std::int8_t * _nurseryEnd;
+		std::vector<Internal::HeapObjectHeader *> _oldObjects;
+		std::vector<Internal::HeapObjectHeader *> _rememberedObjects;
+		std::vector<Internal::HeapObjectHeader *> _pendingObjects;
+		std::vector<refaddr_t *> _roots;
+		size_t _oldBytes;
+		size_t _majorThreshold;
+		const size_t _initialMajorThreshold;
+		IHeapRootEnumerator * _rootEnumerator;
+		EngineMetrics * _metrics;
+		GarbageCollectorStatistics _statistics;
+
+		inline bool _IsInNursery(
+			refaddr_t address
+			) const {
+				const std::int8_t * ptr = reinterpret_cast<const std::int8_t *>(address);
+				return ptr >= _nursery && ptr < _nurseryEnd;
+			}
+
+		inline refaddr_t _AllocateOld(
+			const void * source, size_t size
+			) {
+				size_t totalSize = HeapObject::GetAllocationSize(size);
+				void * memory = malloc(totalSize);
+				if (memory == nullptr)
+					throw HeapException("Out of memory.");
+
+				refaddr_t object;
+				if (source != nullptr) {
+					memcpy(memory, source, totalSize);
+					object = reinterpret_cast<refaddr_t>(reinterpret_cast<Internal::HeapObjectHeader *>(memory) + 1);
+				} else {
+					object = HeapObject::Initialize(memory, size, 0);
+				}
+
+				Internal::HeapObjectHeader * header = HeapObject::GetHeader(object);
+				header->Flags |= Internal::HeapObjectOld;
+				_oldObjects.push_back(header);
+				_oldBytes += totalSize;
+				return object;
+			}
+
+		/// <summary>
+		/// Copies a nursery object to the old generation, leaving a forwarding reference in the nursery.
+		/// </summary>
+		inline refaddr_t _Promote(
+			refaddr_t address
+			) {
+				if (address == nullptr || !_IsInNursery(address))
+					return address;
+
+				Internal::HeapObjectHeader * header = HeapObject::GetHeader(address);
+				if (header->Flags & Internal::HeapObjectForwarded) {
+					refaddr_t forwarded;
+					memcpy(&forwarded, address, sizeof forwarded);
+					return forwarded;
+				}
+
+				refaddr_t promoted = _AllocateOld(header, header->Size);
+				_statistics.PromotedBytes += HeapObject::GetAllocationSize(header->Size);
+				_pendingObjects.push_back(HeapObject::GetHeader(promoted));
+
+				header->Flags |= Internal::HeapObjectForwarded;
+				memcpy(address, &promoted, sizeof promoted);
+				return promoted;
+			}
+
+		inline void _Mark(
+			refaddr_t address
+			) {
+				if (address == nullptr)
+					return;
+
+				// Host views are owned by the context, not by the heap.
+				Internal::HeapObjectHeader * header = HeapObject::GetHeader(address);
+				if (header->Flags & Internal::HeapObjectHostView)
+					return;
+				if ((header->Flags & Internal::HeapObjectMarked) == 0) {
+					header->Flags |= Internal::HeapObjectMarked;
+					_pendingObjects.push_back(header);
+				}
+			}
+
+		inline void _CollectNursery(
+			) {
+				_PromoteVisitor visitor(* this);
+				if (_rootEnumerator != nullptr)
+					_rootEnumerator->EnumerateRoots(visitor);
+				for (auto root : _roots)
+					visitor.VisitRoot(root);
+
+				for (auto header : _rememberedObjects) {
+					header->Flags &= ~Internal::HeapObjectRemembered;
+					_pendingObjects.push_back(header);
+				}
+				_rememberedObjects.clear();
+
+				while (!_pendingObjects.empty()) {
+					Internal::HeapObjectHeader * header = _pendingObjects.back();
+					_pendingObjects.pop_back();
+					HeapObject::ForEachReference(reinterpret_cast<refaddr_t>(header + 1),
+						[this] (refaddr_t * slot) {
+							* slot = _Promote(* slot);
+						});
+				}
+
+				_nurseryCurrent = _nursery;
+				++_statistics.MinorCollections;
+			}
+
+		/// <summary>
+		/// Marks and sweeps the old generation. The nursery must be empty.
+		/// </summary>
+		inline void _CollectOldGeneration(
+			) {
+				_MarkVisitor visitor(* this);
+				if (_rootEnumerator != nullptr)
+					_rootEnumerator->EnumerateRoots(visitor);
+				for (auto root : _roots)
+					visitor.VisitRoot(root);
+
+				while (!_pendingObjects.empty()) {
+					Internal::HeapObjectHeader * header = _pendingObjects.back();
+					_pendingObjects.pop_back();
+					HeapObject::ForEachReference(reinterpret_cast<refaddr_t>(header + 1),
+						[this] (refaddr_t * slot) {
+							_Mark(* slot);
+						});
+				}
+
+				size_t liveCount = 0;
+				for (size_t i = 0; i < _oldObjects.size(); ++i) {
+					Internal::HeapObjectHeader * header = _oldObjects[i];
+					if (header->Flags & Internal::HeapObjectMarked) {
+						header->Flags &= ~Internal::HeapObjectMarked;
+						_oldObjects[liveCount++] = header;
+					} else {
+						_oldBytes -= HeapObject::GetAllocationSize(header->Size);
+						free(header);
+					}
+				}
+				_oldObjects.resize(liveCount);
+
+				_majorThreshold = std::max(_initialMajorThreshold, _oldBytes * 2);
+				++_statistics.MajorCollections;
+			}
+
+		inline void _Collect(
+			bool full
+			) {
+				std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+				_CollectNursery();
+				bool major = full || _oldBytes > _majorThreshold;
+				if (major)
+					_CollectOldGeneration();
+
+				std::uint64_t nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(
+					std::chrono::high_resolution_clock::now() - start).count();
+				if (_metrics != nullptr)
+					_metrics->GetShard().AddCollection(major, nanoseconds);
+
+				std::uint64_t pause = nanoseconds / 1000;
+				_statistics.LastPauseMicroseconds = pause;
+				_statistics.MaxPauseMicroseconds = std::max(_statistics.MaxPauseMicroseconds, pause);
+				_statistics.TotalPauseMicroseconds += pause;
+			}
+
+	public:
+		static const size_t DefaultNurserySize = 256 * 1024;
+		static const size_t DefaultMajorThreshold = 4 * 1024 * 1024;
+
+		/// <param name='nurserySize'>Size of the nursery. Objects bigger than a quarter of it are
+		/// allocated directly in the old generation.</param>
+		/// <param name='majorThreshold'>Minimum size of the old generation to collect it.</param>
+		inline explicit GenerationalHeap(
+			size_t nurserySize = DefaultNurserySize, size_t majorThreshold = DefaultMajorThreshold
+			)
+			: _nursery(reinterpret_cast<std::int8_t *>(AlignedAllocate(nurserySize, CacheLineSize))),
+			  _nurseryCurrent(_nursery), _nurseryEnd(_nursery + nurserySize),
+			  _oldBytes(0), _majorThreshold(majorThreshold), _initialMajorThreshold(majorThreshold),
+			  _rootEnumerator(nullptr), _metrics(nullptr)
+			{
+				memset(&_statistics, 0, sizeof _statistics);
+			}
+
+		inline ~GenerationalHeap(
+			) {
+				for (auto header : _oldObjects)
+					free(header);
+				AlignedFree(_nursery);
+			}
+
+		inline refaddr_t Allocate(
+			size_t size
+			) {
+				if (size > RuntimeHeap::MaxObjectSize)
+					throw HeapException("The object is too big.");
+
+				size_t totalSize = HeapObject::GetAllocationSize(size);
+				if (totalSize > static_cast<size_t>(_nurseryEnd - _nursery) / 4) {
+					if (_oldBytes + totalSize > _majorThreshold)
+						_Collect(true);
+					return _AllocateOld(nullptr, size);
+				}
+
+				if (static_cast<size_t>(_nurseryEnd - _nurseryCurrent) < totalSize)
+					_Collect(false);
+
+				void * memory = _nurseryCurrent;
+				_nurseryCurrent += totalSize;
+				return HeapObject::Initialize(memory, size, 0);
+			}
+
+		inline void WriteBarrier(
+			refaddr_t object, refaddr_t value
+			) {
+				Internal::HeapObjectHeader * header = HeapObject::GetHeader(object);
+				if ((header->Flags & (Internal::HeapObjectOld | Internal::HeapObjectRemembered)) == Internal::HeapObjectOld
+					&& _IsInNursery(value)) {
+					header->Flags |= Internal::HeapObjectRemembered;
+					_rememberedObjects.push_back(header);
+				}
+			}
+
+		inline void SetRootEnumerator(
+			IHeapRootEnumerator * enumerator
+			) {
+				_rootEnumerator = enumerator;
+			}
+
+		/// <summary>
+		/// Sets the metrics where the pauses are recorded, besides the statistics of the heap. Contexts
+		/// set the metrics of their scope manager.
+		/// </summary>
+		inline void SetMetrics(
+			EngineMetrics * metrics
+			) {
+				_metrics = metrics;
+			}
+
+		inline bool OnRunFinished(
+			) {
+				return false;
+			}
+
+		/// <summary>
+		/// Collects the heap. The owner context must not be running, or it must be at a safepoint.
+		/// </summary>
+		/// <param name='full'>If true, the old generation is collected too.</param>
+		inline void Collect(
+			bool full
+			) {
+				_Collect(full);
+			}
+
+		/// <summary>
+		/// Registers a slot of the host holding a reference, so the object stays alive and the slot
+		/// is updated when the object is moved.
+		/// </summary>
+		inline void AddRoot(
+			refaddr_t * slot
+			) {
+				_roots.push_back(slot);
+			}
+
+		inline void RemoveRoot(
+			refaddr_t * slot
+			) {
+				_roots.erase(std::remove(_roots.begin(), _roots.end(), slot), _roots.end());
+			}
+
+		inline size_t GetNurseryUsage(
+			) const {
+				return _nurseryCurrent - _nursery;
+			}
+
+		inline size_t GetOldGenerationSize(
+			) const {
+				return _oldBytes;
+			}
+
+		inline const GarbageCollectorStatistics & GetStatistics(
+			) const {
+				return _statistics;
+			}
+	};
+
+} // namespace Nova
+
+#endif // !_NOVA_RUNTIME_ENVIRONMENT_GENERATIONAL_HEAP_HEADER_
\ No newline at end of file
@@ -0,0 +1,138 @@
+//
+// host-view.hpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#ifndef _NOVA_RUNTIME_ENVIRONMENT_HOST_VIEW_HEADER_
+#define _NOVA_RUNTIME_ENVIRONMENT_HOST_VIEW_HEADER_
+
+#include "runtime-heap.hpp"
+
+#include "..\common\exception.hpp"
+#include "..\common\type-traits.hpp"
+
+#include <cstdint>
+#include <vector>
+#include <limits>
+
+namespace Nova {
+
+	enum class HostViewAccess {
+		ReadOnly = 0,
+		ReadWrite
+	};
+
+	namespace Internal {
+		/// <summary>
+		/// Storage of a host view, reused by the views registered after it's cleared.
+		/// </summary>
+		/// <remarks>
+		/// Every generation of the view is referenced through its own slot, taken in turn, and the
+		/// references point to the Reference member of the slot, so they look like objects to the heap
+		/// instructions. A stale reference only reaches a new view after the storage is reused
+		/// SlotCount times.
+		/// </remarks>
+		struct HostViewBlock {
+			static const size_t SlotCount = 16;
+
+			struct Slot {
+				HeapObjectHeader Header;
+				HostViewReference Reference;
+			};
+
+			HostView View;
+			Slot Slots[SlotCount];
+		};
+	}
+
+	/// <summary>
+	/// Views of memory owned by the host, addressable by the scripts through memory-address registers.
+	/// </summary>
+	/// <remarks>
+	/// The data isn't copied: scripts read and write the host buffers directly, with bounds checks.
+	/// Views live until the table is cleared, and their storage is reused after that, so registering
+	/// views doesn't allocate once the table is warm. References are tagged with the generation of
+	/// their view, so references to a cleared view fail on access.
+	/// </remarks>
+	class HostViewTable {
+		std::vector<Internal::HostViewBlock *> _blocks;
+		size_t _count;
+
+	public:
+		inline HostViewTable(
+			)
+			: _count(0)
+			{
+			}
+
+		inline ~HostViewTable(
+			) {
+				for (auto block : _blocks)
+					delete block;
+			}
+
+		/// <summary>
+		/// Registers a buffer of the host and returns a reference to it.
+		/// </summary>
+		/// <param name='data'>Buffer of the host. It must outlive the view.</param>
+		/// <param name='length'>Number of elements in the buffer.</param>
+		/// <param name='elementType'>Type of the elements. References can't be stored in views.</param>
+		inline refaddr_t Register(
+			void * data, size_t length, ValueType elementType, HostViewAccess access
+			) {
+				if (elementType == ValueType::rf)
+					throw InvalidArgumentException("Host views can't hold references.");
+				if (data == nullptr && length != 0)
+					throw InvalidArgumentException("The data of the view can't be null.");
+
+				size_t elementSize = GetValueTypeSize(elementType);
+				if (length > static_cast<size_t>(std::numeric_limits<std::int32_t>::max()) / elementSize)
+					throw InvalidArgumentException("The view is too big.");
+
+				if (_count == _blocks.size()) {
+					Internal::HostViewBlock * newBlock = new Internal::HostViewBlock();
+					newBlock->View.Generation = 0;
+					for (auto & slot : newBlock->Slots) {
+						slot.Header.Size = 0;
+						slot.Header.Flags = Internal::HeapObjectHostView;
+						slot.Reference.View = &newBlock->View;
+						slot.Reference.Generation = 0;
+					}
+					_blocks.push_back(newBlock);
+				}
+
+				Internal::HostViewBlock * block = _blocks[_count++];
+				block->View.Data = reinterpret_cast<std::int8_t *>(data);
+				block->View.Size = length * elementSize;
+				block->View.ElementType = elementType;
+				block->View.Writable = access == HostViewAccess::ReadWrite;
+
+				Internal::HostViewBlock::Slot & slot = block->Slots[block->View.Generation % Internal::HostViewBlock::SlotCount];
+				slot.Reference.Generation = block->View.Generation;
+				return reinterpret_cast<refaddr_t>(&slot.Reference);
+			}
+
+		/// <summary>
+		/// Removes all the views. Their buffers are no longer accessed by the engine.
+		/// </summary>
+		inline void Clear(
+			) {
+				for (size_t i = 0; i < _count; ++i) {
+					_blocks[i]->View.Data = nullptr;
+					_blocks[i]->View.Size = 0;
+					++_blocks[i]->View.Generation;
+				}
+				_count = 0;
+			}
+
+		inline size_t GetCount(
+			) const {
+				return _count;
+			}
+	};
+
+} // namespace Nova
+
+#endif // !_NOVA_RUNTIME_ENVIRONMENT_HOST_VIEW_HEADER_
\ No newline at end of file
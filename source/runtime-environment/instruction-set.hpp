@@ -46,6 +46,37 @@ namespace Nova {
 	///     <term>bn</term>
 	///     <description>Boolean</description>
 	///   </item>
+	///   <item>
+	///     <term>rf</term>
+	///     <description>Reference to an object in the heap.</description>
+	///   </item>
+	///   <item>
+	///     <term>v</term>
+	///     <description>Vector, with its type as operand.</description>
+	///   </item>
+	/// </list>
+	/// <para>Then, it has the source or target of the value:</para>
+	/// <list type="bullet">
+	///   <item>
+	///     <term>c</term>
+	///     <description>Constant stored in the instruction.</description>
+	///   </item>
+	///   <item>
+	///     <term>r</term>
+	///     <description>Register.</description>
+	///   </item>
+	///   <item>
+	///     <term>m</term>
+	///     <description>Object referenced by a memory-address register, at a constant offset.</description>
+	///   </item>
+	///   <item>
+	///     <term>s</term>
+	///     <description>Value in the stack, at a constant offset from a stack-frame register.</description>
+	///   </item>
+	///   <item>
+	///     <term>k</term>
+	///     <description>Constant in the pool of the program, referenced by the instruction.</description>
+	///   </item>
 	/// </list>
 	/// </remarks>
 	enum class Instruction {
@@ -56,7 +87,154 @@ namespace Nova {
 		add_i4,
 		call,
 		xcall,
-		ret
+		ret,
+
+		// Heap instructions. The size of a new object is popped as i4, and its reference is stored
+		// in a memory-address register.
+		alloc,
+		push_rfr,
+		set_rfr,
+		ld_i1m,
+		ld_i2m,
+		ld_i4m,
+		ld_i8m,
+		ld_fsm,
+		ld_fdm,
+		ld_rfm,
+		st_i1m,
+		st_i2m,
+		st_i4m,
+		st_i8m,
+		st_fsm,
+		st_fdm,
+		st_rfm,
+
+		// Array instructions, for objects and host views holding values of a single type. Indices,
+		// counts and offsets are popped as i4; copy_m and len_m work in bytes.
+		ldx_i1m,
+		ldx_i2m,
+		ldx_i4m,
+		ldx_i8m,
+		ldx_fsm,
+		ldx_fdm,
+		stx_i1m,
+		stx_i2m,
+		stx_i4m,
+		stx_i8m,
+		stx_fsm,
+		stx_fdm,
+		fill_i1m,
+		fill_i2m,
+		fill_i4m,
+		fill_i8m,
+		fill_fsm,
+		fill_fdm,
+		len_m,
+		copy_m,
+
+		// Vector instructions. The vector type, such as v4i4 or v2fd, is an operand of the
+		// instruction. Comparisons push masks with all the bits of the true lanes set, and blend
+		// takes the lanes of the second vector where the mask has the sign bit set. Reductions and
+		// splat work with values of the lane type.
+		push_vr,
+		set_vr,
+		add_v,
+		sub_v,
+		mul_v,
+		min_v,
+		max_v,
+		cmpeq_v,
+		cmplt_v,
+		blend_v,
+		splat_v,
+		hadd_v,
+		hmin_v,
+		hmax_v,
+		shuffle_v,
+		ldx_vm,
+		stx_vm,
+
+		// Control flow. Comparisons pop two values and set the cp register with the result of
+		// comparing the first pushed value to the second one. Branch offsets are relative to the end
+		// of the branch instruction. The fused j*_i4 instructions compare and branch in one step,
+		// and djnz_i4r decrements a register and branches if the result isn't zero.
+		cmpeq_i4,
+		cmpne_i4,
+		cmplt_i4,
+		cmple_i4,
+		cmpgt_i4,
+		cmpge_i4,
+		jmp,
+		jt,
+		jf,
+		jeq_i4,
+		jne_i4,
+		jlt_i4,
+		jle_i4,
+		jgt_i4,
+		jge_i4,
+		djnz_i4r,
+
+		// Channel instructions, with the channel as operand. send and recv move a value of the type
+		// of the channel between the stack and the channel; send_m and recv_m copy a whole element
+		// between the channel and the start of the object in a memory-address register. If the
+		// channel is full or empty, the context is suspended before the instruction, which runs
+		// again when the context is resumed.
+		send,
+		recv,
+		send_m,
+		recv_m,
+
+		// Data-parallel map, with the scope and two memory-address registers as operands. It pops the
+		// maximum number of threads to use, or zero for no limit, and the element count, both int32,
+		// and calls the scope, which takes one scalar value and returns another, for every element of
+		// the object in the first register, storing the results in the object in the second one. The
+		// calls may run in other contexts at once, so the scope can't rely on their order or on
+		// registers; the registers of the context are undefined after the instruction.
+		pmap,
+
+		// Stack-frame instructions. set_spr sets a stack-frame register to the top of the stack, and
+		// the ld_*s and st_*s instructions load and store the value at an offset, in bytes, from it.
+		// Calls preserve the stack-frame registers. dup and swap work with the values of the type
+		// operand at the top of the stack, pick pushes a copy of the value of the type which ends at a
+		// number of bytes below the top, and drop_n removes a number of bytes.
+		set_spr,
+		ld_i1s,
+		ld_i2s,
+		ld_i4s,
+		ld_i8s,
+		ld_fss,
+		ld_fds,
+		ld_rfs,
+		st_i1s,
+		st_i2s,
+		st_i4s,
+		st_i8s,
+		st_fss,
+		st_fds,
+		st_rfs,
+		dup,
+		swap,
+		pick,
+		drop_n,
+
+		// Constant-pool instructions, with the type and a constant of the pool of the scope manager as
+		// operands. ld_k pushes a value, ldx_k pops an int32 index and pushes that element of an array,
+		// which is checked against its length, and alloc_k allocates an object holding a copy of an
+		// array and sets the memory-address register operand to it.
+		ld_k,
+		ldx_k,
+		alloc_k,
+
+		// Breakpoint traps, reserved for the debugger. It patches them over instructions of the same
+		// size, in bytes, so the code keeps its layout; the original instruction is kept out of line
+		// and runs once the debugger returns. Scopes holding traps can't be verified.
+		brk4,
+		brk8,
+		brk12,
+		brk16,
+		brk20,
+		brk24
 	};
 
 } // namespace Nova
@@ -0,0 +1,384 @@
+//
+// ir-function.hpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#ifndef _NOVA_RUNTIME_ENVIRONMENT_IR_FUNCTION_HEADER_
+#define _NOVA_RUNTIME_ENVIRONMENT_IR_FUNCTION_HEADER_
+
+#include "register-set.hpp"
+
+#include "..\common\exception.hpp"
+#include "..\common\type-traits.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace Nova {
+
+	INHERIT_EXCEPTION(IrException, RuntimeException)
+
+	/// <summary>
+	/// Reference to a value of an IrFunction. Every value is defined once, by an instruction or as a
+	/// parameter of a block.
+	/// </summary>
+	typedef size_t irvalue_t;
+
+	/// <summary>
+	/// Reference to a block of an IrFunction.
+	/// </summary>
+	typedef size_t irblock_t;
+
+	enum class IrOperation {
+		Parameter = 0,
+		Constant,
+		Add,
+		LoadI4,
+		StoreI4,
+		Call,
+		XCall
+	};
+
+	enum class IrCondition {
+		Equal = 0,
+		NotEqual,
+		Less,
+		LessOrEqual,
+		Greater,
+		GreaterOrEqual
+	};
+
+	enum class IrTerminator {
+		None = 0,
+		Jump,
+		Branch,
+		Return
+	};
+
+	namespace Internal {
+		struct IrInstruction {
+			IrOperation Operation;
+			irblock_t Block;
+			std::vector<irvalue_t> Operands;
+
+			/// <summary>
+			/// Value of a constant, or offset of a memory access.
+			/// </summary>
+			std::int32_t Immediate;
+
+			Register MId;
+			scoperef_t Scope;
+			bool HasResult;
+		};
+
+		struct IrBlock {
+			std::vector<irvalue_t> Parameters;
+			std::vector<irvalue_t> Instructions;
+			IrTerminator Terminator;
+			IrCondition Condition;
+
+			/// <summary>
+			/// Arguments of a jump, operands of a branch, or values returned.
+			/// </summary>
+			std::vector<irvalue_t> Operands;
+
+			/// <summary>
+			/// Target of a jump, or targets of a branch when the condition holds and when it doesn't.
+			/// </summary>
+			irblock_t Targets[2];
+
+			/// <summary>
+			/// Set by the optimizer when the block can't be reached.
+			/// </summary>
+			bool Removed;
+		};
+	}
+
+	/// <summary>
+	/// Code of a scope in SSA form, built by the code generators and optimized before it's lowered to
+	/// bytecode.
+	/// </summary>
+	/// <remarks>
+	/// <para>Values are 32-bits integers. Blocks take parameters instead of phi nodes: a jump passes one
+	/// argument for each parameter of its target. The parameters of the entry block are the parameters
+	/// of the scope, popped from the stack.</para>
+	/// <para>Instructions are appended to the insertion block, which is the entry block at first, and
+	/// every block ends with a jump, a branch or a return.</para>
+	/// </remarks>
+	class IrFunction {
+		std::vector<Internal::IrInstruction> _values;
+		std::vector<Internal::IrBlock> _blocks;
+		irblock_t _insertBlock;
+
+		inline void _CheckValue(
+			irvalue_t value
+			) const {
+				if (value >= _values.size() || !_values[value].HasResult)
+					throw InvalidArgumentException("The value doesn't exist.");
+			}
+
+		inline void _CheckBlock(
+			irblock_t block
+			) const {
+				if (block >= _blocks.size())
+					throw InvalidArgumentException("The block doesn't exist.");
+			}
+
+		inline Internal::IrBlock & _GetInsertBlock(
+			) {
+				Internal::IrBlock & block = _blocks[_insertBlock];
+				if (block.Terminator != IrTerminator::None)
+					throw IrException("The block is already terminated.");
+				return block;
+			}
+
+		inline irvalue_t _Append(
+			IrOperation operation, const std::vector<irvalue_t> & operands, bool hasResult
+			) {
+				for (auto operand : operands)
+					_CheckValue(operand);
+				Internal::IrBlock & block = _GetInsertBlock();
+
+				Internal::IrInstruction instruction;
+				instruction.Operation = operation;
+				instruction.Block = _insertBlock;
+				instruction.Operands = operands;
+				instruction.Immediate = 0;
+				instruction.MId = Register::m0;
+				instruction.Scope = nullptr;
+				instruction.HasResult = hasResult;
+				_values.push_back(instruction);
+
+				block.Instructions.push_back(_values.size() - 1);
+				return _values.size() - 1;
+			}
+
+		inline irvalue_t _AppendCall(
+			IrOperation operation, scoperef_t scope, const std::vector<irvalue_t> & arguments, bool hasResult
+			) {
+				irvalue_t value = _Append(operation, arguments, hasResult);
+				_values[value].Scope = scope;
+				return value;
+			}
+
+	public:
+		/// <param name='parameterCount'>Number of parameters of the scope.</param>
+		inline explicit IrFunction(
+			size_t parameterCount
+			)
+			: _insertBlock(0)
+			{
+				CreateBlock(parameterCount);
+			}
+
+		inline irblock_t GetEntryBlock(
+			) const {
+				return 0;
+			}
+
+		inline irblock_t CreateBlock(
+			size_t parameterCount
+			) {
+				Internal::IrBlock block;
+				block.Terminator = IrTerminator::None;
+				block.Condition = IrCondition::Equal;
+				block.Targets[0] = block.Targets[1] = 0;
+				block.Removed = false;
+				_blocks.push_back(block);
+
+				irblock_t id = _blocks.size() - 1;
+				for (size_t i = 0; i < parameterCount; ++i) {
+					Internal::IrInstruction parameter;
+					parameter.Operation = IrOperation::Parameter;
+					parameter.Block = id;
+					parameter.Immediate = static_cast<std::int32_t>(i);
+					parameter.MId = Register::m0;
+					parameter.Scope = nullptr;
+					parameter.HasResult = true;
+					_values.push_back(parameter);
+					_blocks[id].Parameters.push_back(_values.size() - 1);
+				}
+				return id;
+			}
+
+		inline irvalue_t GetParameter(
+			irblock_t block, size_t index
+			) const {
+				_CheckBlock(block);
+				if (index >= _blocks[block].Parameters.size())
+					throw InvalidArgumentException("The parameter doesn't exist.");
+				return _blocks[block].Parameters[index];
+			}
+
+		inline IrFunction & SetInsertBlock(
+			irblock_t block
+			) {
+				_CheckBlock(block);
+				_insertBlock = block;
+				return * this;
+			}
+
+		inline irblock_t GetInsertBlock(
+			) const {
+				return _insertBlock;
+			}
+
+		inline irvalue_t Constant(
+			std::int32_t value
+			) {
+				irvalue_t constant = _Append(IrOperation::Constant, std::vector<irvalue_t>(), true);
+				_values[constant].Immediate = value;
+				return constant;
+			}
+
+		inline irvalue_t Add(
+			irvalue_t a, irvalue_t b
+			) {
+				std::vector<irvalue_t> operands;
+				operands.push_back(a);
+				operands.push_back(b);
+				return _Append(IrOperation::Add, operands, true);
+			}
+
+		inline irvalue_t LoadI4(
+			Register mId, std::int32_t offset
+			) {
+				irvalue_t value = _Append(IrOperation::LoadI4, std::vector<irvalue_t>(), true);
+				_values[value].MId = mId;
+				_values[value].Immediate = offset;
+				return value;
+			}
+
+		inline void StoreI4(
+			Register mId, std::int32_t offset, irvalue_t value
+			) {
+				irvalue_t store = _Append(IrOperation::StoreI4, std::vector<irvalue_t>(1, value), false);
+				_values[store].MId = mId;
+				_values[store].Immediate = offset;
+			}
+
+		/// <summary>
+		/// Calls a scope taking the arguments and leaving at most one value, all of them i4.
+		/// </summary>
+		/// <returns>The result of the call, if it has one.</returns>
+		inline irvalue_t Call(
+			scoperef_t scope, const std::vector<irvalue_t> & arguments, bool hasResult
+			) {
+				return _AppendCall(IrOperation::Call, scope, arguments, hasResult);
+			}
+
+		inline irvalue_t XCall(
+			scoperef_t scope, const std::vector<irvalue_t> & arguments, bool hasResult
+			) {
+				return _AppendCall(IrOperation::XCall, scope, arguments, hasResult);
+			}
+
+		inline void Jump(
+			irblock_t target, const std::vector<irvalue_t> & arguments
+			) {
+				_CheckBlock(target);
+				if (arguments.size() != _blocks[target].Parameters.size())
+					throw InvalidArgumentException("The arguments don't match the parameters of the block.");
+				for (auto argument : arguments)
+					_CheckValue(argument);
+
+				Internal::IrBlock & block = _GetInsertBlock();
+				block.Terminator = IrTerminator::Jump;
+				block.Operands = arguments;
+				block.Targets[0] = target;
+			}
+
+		/// <summary>
+		/// Compares a to b and continues in one of the blocks, which can't have parameters.
+		/// </summary>
+		inline void Branch(
+			IrCondition condition, irvalue_t a, irvalue_t b, irblock_t trueTarget, irblock_t falseTarget
+			) {
+				_CheckValue(a);
+				_CheckValue(b);
+				_CheckBlock(trueTarget);
+				_CheckBlock(falseTarget);
+				if (!_blocks[trueTarget].Parameters.empty() || !_blocks[falseTarget].Parameters.empty())
+					throw InvalidArgumentException("The targets of a branch can't have parameters.");
+
+				Internal::IrBlock & block = _GetInsertBlock();
+				block.Terminator = IrTerminator::Branch;
+				block.Condition = condition;
+				block.Operands.clear();
+				block.Operands.push_back(a);
+				block.Operands.push_back(b);
+				block.Targets[0] = trueTarget;
+				block.Targets[1] = falseTarget;
+			}
+
+		inline void Return(
+			const std::vector<irvalue_t> & values
+			) {
+				for (auto value : values)
+					_CheckValue(value);
+
+				Internal::IrBlock & block = _GetInsertBlock();
+				block.Terminator = IrTerminator::Return;
+				block.Operands = values;
+			}
+
+		inline size_t GetValueCount(
+			) const {
+				return _values.size();
+			}
+
+		inline size_t GetBlockCount(
+			) const {
+				return _blocks.size();
+			}
+
+		inline Internal::IrInstruction & GetValue(
+			irvalue_t value
+			) {
+				return _values[value];
+			}
+
+		inline const Internal::IrInstruction & GetValue(
+			irvalue_t value
+			) const {
+				return _values[value];
+			}
+
+		inline Internal::IrBlock & GetBlock(
+			irblock_t block
+			) {
+				return _blocks[block];
+			}
+
+		inline const Internal::IrBlock & GetBlock(
+			irblock_t block
+			) const {
+				return _blocks[block];
+			}
+
+		/// <summary>
+		/// Makes every instruction and terminator using a value use another one instead.
+		/// </summary>
+		inline void ReplaceAllUses(
+			irvalue_t value, irvalue_t replacement
+			) {
+				for (auto & instruction : _values) {
+					for (auto & operand : instruction.Operands) {
+						if (operand == value)
+							operand = replacement;
+					}
+				}
+				for (auto & block : _blocks) {
+					for (auto & operand : block.Operands) {
+						if (operand == value)
+							operand = replacement;
+					}
+				}
+			}
+	};
+
+} // namespace Nova
+
+#endif // !_NOVA_RUNTIME_ENVIRONMENT_IR_FUNCTION_HEADER_
\ No newline at end of file
@@ -0,0 +1,455 @@
+//
+// ir-lowering.hpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#ifndef _NOVA_RUNTIME_ENVIRONMENT_IR_LOWERING_HEADER_
+#define _NOVA_RUNTIME_ENVIRONMENT_IR_LOWERING_HEADER_
+
+#include "ir-function.hpp"
+#include "runtime-scope.hpp"
+#include "assembly.hpp"
+
+#include "..\common\dynamic-buffer.hpp"
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <utility>
+
+namespace Nova {
+
+	/// <summary>
+	/// Writes the bytecode of an IrFunction, keeping its values in the general-purpose registers.
+	/// </summary>
+	/// <remarks>
+	/// <para>The lowered code owns r0 to r7. Values live at the same time get different registers, and
+	/// values live across a call avoid the registers the callee writes, found by scanning its code.
+	/// Recursive calls are assumed to write all of them. Functions needing more than eight registers
+	/// at once are rejected, since there is nowhere else to keep values yet.</para>
+	/// <para>A value used once, right by the next instruction, stays on the stack instead, and
+	/// constants are pushed where they're used.</para>
+	/// </remarks>
+	class IrLowering {
+	public:
+		static const size_t RegisterCount = 8;
+
+	private:
+		RuntimeScopeManager & _scopeManager;
+		scoperef_t _scope;
+		std::vector<int> _clobbers;
+
+		static inline Register _GetRegister(
+			int index
+			) {
+				return static_cast<Register>(static_cast<int>(Register::r0) + index);
+			}
+
+		static inline IrCondition _Invert(
+			IrCondition condition
+			) {
+				switch (condition) {
+				case IrCondition::Equal: return IrCondition::NotEqual;
+				case IrCondition::NotEqual: return IrCondition::Equal;
+				case IrCondition::Less: return IrCondition::GreaterOrEqual;
+				case IrCondition::LessOrEqual: return IrCondition::Greater;
+				case IrCondition::Greater: return IrCondition::LessOrEqual;
+				default: return IrCondition::Less;
+				}
+			}
+
+		static inline Instruction _GetBranchInstruction(
+			IrCondition condition
+			) {
+				return static_cast<Instruction>(static_cast<int>(Instruction::jeq_i4) + static_cast<int>(condition));
+			}
+
+		/// <summary>
+		/// Returns a mask of the r registers written by a scope and the scopes it calls.
+		/// </summary>
+		inline int _GetClobbers(
+			scoperef_t scopeId
+			) {
+				const int all = (1 << RegisterCount) - 1;
+				size_t index = reinterpret_cast<size_t>(scopeId);
+				if (scopeId == _scope || index >= _scopeManager.GetScopeCount())
+					return all;
+				// Lazy scopes aren't loaded just to look at their code.
+				if (!_scopeManager.GetScope(scopeId).IsLoaded())
+					return all;
+				if (_clobbers.size() < _scopeManager.GetScopeCount())
+					_clobbers.resize(_scopeManager.GetScopeCount(), -1);
+				if (_clobbers[index] >= 0)
+					return _clobbers[index];
+
+				// Scopes calling back into a scope being scanned are assumed to write everything.
+				_clobbers[index] = all;
+				int clobbers = 0;
+				AssemblyReader assemblyReader;
+				DynamicBuffer::ConstIterator bufferIterator = _scopeManager.GetScope(scopeId).GetCodeBuffer().GetConstIterator();
+				while (bufferIterator.HasData()) {
+					Register registerId;
+					std::int32_t offset;
+					scoperef_t calleeId;
+					switch (assemblyReader.GetInstructionId(bufferIterator)) {
+					case Instruction::set_i4r:
+						assemblyReader.SetI4R(bufferIterator, registerId);
+						clobbers |= 1 << static_cast<int>(registerId);
+						break;
+					case Instruction::djnz_i4r:
+						assemblyReader.DjnzI4R(bufferIterator, registerId, offset);
+						clobbers |= 1 << static_cast<int>(registerId);
+						break;
+					case Instruction::call:
+						assemblyReader.Call(bufferIterator, calleeId);
+						clobbers |= _GetClobbers(calleeId);
+						break;
+					case Instruction::pmap:
+						{
+							// Without a parallel mapper, the scope runs in the context of the caller.
+							Register destinationId;
+							assemblyReader.PMap(bufferIterator, calleeId, registerId, destinationId);
+							clobbers |= _GetClobbers(calleeId);
+						}
+						break;
+					default:
+						break;
+					}
+					assemblyReader.GoNextInstruction(bufferIterator);
+				}
+				_clobbers[index] = clobbers & all;
+				return _clobbers[index];
+			}
+
+	public:
+		inline explicit IrLowering(
+			RuntimeScopeManager & scopeManager
+			)
+			: _scopeManager(scopeManager), _scope(nullptr)
+			{
+			}
+
+		/// <summary>
+		/// Writes the bytecode of the function as the code of the scope.
+		/// </summary>
+		inline void Lower(
+			const IrFunction & function, RuntimeScope & scope
+			) {
+				DynamicBuffer output;
+				_scope = scope.GetId();
+				try {
+					Lower(function, output);
+				} catch (...) {
+					_scope = nullptr;
+					throw;
+				}
+				_scope = nullptr;
+				scope.SetCodeBuffer(std::move(output));
+			}
+
+		/// <summary>
+		/// Writes the bytecode of the function to the output.
+		/// </summary>
+		inline void Lower(
+			const IrFunction & function, DynamicBuffer & output
+			) {
+				size_t valueCount = function.GetValueCount();
+				irblock_t entry = function.GetEntryBlock();
+				_clobbers.clear();
+
+				std::vector<irblock_t> layout;
+				for (size_t i = 0; i < function.GetBlockCount(); ++i) {
+					const Internal::IrBlock & block = function.GetBlock(i);
+					if (block.Removed)
+						continue;
+					if (block.Terminator == IrTerminator::None)
+						throw IrException("The block isn't terminated.");
+					layout.push_back(i);
+				}
+
+				std::vector<size_t> uses(valueCount, 0);
+				for (auto b : layout) {
+					const Internal::IrBlock & block = function.GetBlock(b);
+					for (auto value : block.Instructions) {
+						for (auto operand : function.GetValue(value).Operands)
+							++uses[operand];
+					}
+					for (auto operand : block.Operands)
+						++uses[operand];
+				}
+
+				// Values left on the stack for the next instruction, which takes them as its first
+				// operand. Additions get their operands swapped if that helps.
+				std::vector<bool> stacked(valueCount, false), swapped(valueCount, false);
+				for (auto b : layout) {
+					const Internal::IrBlock & block = function.GetBlock(b);
+					std::vector<irvalue_t> emitted;
+					for (auto value : block.Instructions) {
+						if (function.GetValue(value).Operation != IrOperation::Constant)
+							emitted.push_back(value);
+					}
+
+					for (size_t i = 0; i < emitted.size(); ++i) {
+						irvalue_t value = emitted[i];
+						if (!function.GetValue(value).HasResult || uses[value] != 1)
+							continue;
+
+						if (i + 1 < emitted.size()) {
+							const Internal::IrInstruction & next = function.GetValue(emitted[i + 1]);
+							if (!next.Operands.empty() && next.Operands[0] == value) {
+								stacked[value] = true;
+							} else if (next.Operation == IrOperation::Add && next.Operands[1] == value) {
+								stacked[value] = true;
+								swapped[emitted[i + 1]] = true;
+							}
+						} else if (!block.Operands.empty() && block.Operands[0] == value) {
+							stacked[value] = true;
+						}
+					}
+				}
+
+				auto inRegister = [&] (irvalue_t value) -> bool {
+					const Internal::IrInstruction & instruction = function.GetValue(value);
+					return instruction.HasResult && instruction.Operation != IrOperation::Constant && !stacked[value];
+				};
+
+				// Liveness of the values in registers at the start of every block.
+				std::vector<std::vector<bool> > liveIn(function.GetBlockCount(), std::vector<bool>(valueCount, false));
+				auto getLiveOut = [&] (irblock_t b) -> std::vector<bool> {
+					const Internal::IrBlock & block = function.GetBlock(b);
+					std::vector<bool> live(valueCount, false);
+					size_t targetCount = block.Terminator == IrTerminator::Jump ? 1
+						: block.Terminator == IrTerminator::Branch ? 2 : 0;
+					for (size_t t = 0; t < targetCount; ++t) {
+						const Internal::IrBlock & target = function.GetBlock(block.Targets[t]);
+						for (size_t v = 0; v < valueCount; ++v) {
+							if (liveIn[block.Targets[t]][v] && std::find(target.Parameters.begin(), target.Parameters.end(), v) == target.Parameters.end())
+								live[v] = true;
+						}
+					}
+					for (auto operand : block.Operands) {
+						if (inRegister(operand))
+							live[operand] = true;
+					}
+					return live;
+				};
+
+				bool changed = true;
+				while (changed) {
+					changed = false;
+					for (size_t i = layout.size(); i-- > 0; ) {
+						const Internal::IrBlock & block = function.GetBlock(layout[i]);
+						std::vector<bool> live = getLiveOut(layout[i]);
+						for (size_t j = block.Instructions.size(); j-- > 0; ) {
+							const Internal::IrInstruction & instruction = function.GetValue(block.Instructions[j]);
+							live[block.Instructions[j]] = false;
+							for (auto operand : instruction.Operands) {
+								if (inRegister(operand))
+									live[operand] = true;
+							}
+						}
+						if (live != liveIn[layout[i]]) {
+							liveIn[layout[i]] = live;
+							changed = true;
+						}
+					}
+				}
+
+				const Internal::IrBlock & entryBlock = function.GetBlock(entry);
+				for (size_t v = 0; v < valueCount; ++v) {
+					if (liveIn[entry][v] && std::find(entryBlock.Parameters.begin(), entryBlock.Parameters.end(), v) == entryBlock.Parameters.end())
+						throw IrException("A value is used where it may not be defined.");
+				}
+
+				// Interferences between the values, and registers they can't use because a call
+				// writes them while they're live.
+				std::vector<std::vector<irvalue_t> > interferences(valueCount);
+				std::vector<int> forbidden(valueCount, 0);
+				auto interfere = [&] (irvalue_t a, const std::vector<bool> & live) {
+					for (size_t v = 0; v < valueCount; ++v) {
+						if (live[v] && v != a) {
+							interferences[a].push_back(v);
+							interferences[v].push_back(a);
+						}
+					}
+				};
+
+				for (auto b : layout) {
+					const Internal::IrBlock & block = function.GetBlock(b);
+					std::vector<bool> live = getLiveOut(b);
+					for (size_t j = block.Instructions.size(); j-- > 0; ) {
+						irvalue_t value = block.Instructions[j];
+						const Internal::IrInstruction & instruction = function.GetValue(value);
+						if (inRegister(value))
+							interfere(value, live);
+						live[value] = false;
+						if (instruction.Operation == IrOperation::Call) {
+							int clobbers = _GetClobbers(instruction.Scope);
+							for (size_t v = 0; v < valueCount; ++v) {
+								if (live[v])
+									forbidden[v] |= clobbers;
+							}
+						}
+						for (auto operand : instruction.Operands) {
+							if (inRegister(operand))
+								live[operand] = true;
+						}
+					}
+					for (auto parameter : block.Parameters) {
+						live[parameter] = true;
+						interfere(parameter, live);
+					}
+				}
+
+				// Arguments and parameters try to share a register, so jumps don't need to copy them.
+				std::vector<std::vector<irvalue_t> > hints(valueCount);
+				for (auto b : layout) {
+					const Internal::IrBlock & block = function.GetBlock(b);
+					if (block.Terminator != IrTerminator::Jump)
+						continue;
+					const Internal::IrBlock & target = function.GetBlock(block.Targets[0]);
+					for (size_t i = 0; i < block.Operands.size(); ++i) {
+						hints[block.Operands[i]].push_back(target.Parameters[i]);
+						hints[target.Parameters[i]].push_back(block.Operands[i]);
+					}
+				}
+
+				std::vector<int> registers(valueCount, -1);
+				for (auto b : layout) {
+					const Internal::IrBlock & block = function.GetBlock(b);
+					std::vector<irvalue_t> values(block.Parameters);
+					values.insert(values.end(), block.Instructions.begin(), block.Instructions.end());
+					for (auto value : values) {
+						if (!inRegister(value))
+							continue;
+
+						int used = forbidden[value];
+						for (auto other : interferences[value]) {
+							if (registers[other] >= 0)
+								used |= 1 << registers[other];
+						}
+						int chosen = -1;
+						for (auto other : hints[value]) {
+							if (registers[other] >= 0 && (used & (1 << registers[other])) == 0) {
+								chosen = registers[other];
+								break;
+							}
+						}
+						for (int r = 0; chosen < 0 && r < static_cast<int>(RegisterCount); ++r) {
+							if ((used & (1 << r)) == 0)
+								chosen = r;
+						}
+						if (chosen < 0)
+							throw IrException("The function needs more registers than available.");
+						registers[value] = chosen;
+					}
+				}
+
+				AssemblyWriter writer;
+				std::vector<label_t> labels(function.GetBlockCount());
+				for (auto b : layout)
+					labels[b] = writer.CreateLabel();
+
+				auto push = [&] (irvalue_t value) {
+					const Internal::IrInstruction & instruction = function.GetValue(value);
+					if (instruction.Operation == IrOperation::Constant)
+						writer.PushI4C(output, instruction.Immediate);
+					else if (!stacked[value])
+						writer.PushI4R(output, _GetRegister(registers[value]));
+				};
+				auto define = [&] (irvalue_t value) {
+					if (inRegister(value))
+						writer.SetI4R(output, _GetRegister(registers[value]));
+				};
+
+				for (size_t i = entryBlock.Parameters.size(); i-- > 0; )
+					define(entryBlock.Parameters[i]);
+
+				for (size_t l = 0; l < layout.size(); ++l) {
+					const Internal::IrBlock & block = function.GetBlock(layout[l]);
+					irblock_t next = l + 1 < layout.size() ? layout[l + 1] : function.GetBlockCount();
+					writer.BindLabel(output, labels[layout[l]]);
+
+					for (auto value : block.Instructions) {
+						const Internal::IrInstruction & instruction = function.GetValue(value);
+						switch (instruction.Operation) {
+						case IrOperation::Constant:
+							break;
+						case IrOperation::Add:
+							push(instruction.Operands[swapped[value] ? 1 : 0]);
+							push(instruction.Operands[swapped[value] ? 0 : 1]);
+							writer.AddI4(output);
+							define(value);
+							break;
+						case IrOperation::LoadI4:
+							writer.LdI4M(output, instruction.MId, instruction.Immediate);
+							define(value);
+							break;
+						case IrOperation::StoreI4:
+							push(instruction.Operands[0]);
+							writer.StI4M(output, instruction.MId, instruction.Immediate);
+							break;
+						case IrOperation::Call:
+						case IrOperation::XCall:
+							for (auto operand : instruction.Operands)
+								push(operand);
+							if (instruction.Operation == IrOperation::Call)
+								writer.Call(output, instruction.Scope);
+							else
+								writer.XCall(output, instruction.Scope);
+							if (instruction.HasResult)
+								define(value);
+							break;
+						default:
+							throw IrException("Unsupported operation.");
+						}
+					}
+
+					switch (block.Terminator) {
+					case IrTerminator::Jump:
+						{
+							// Arguments are all read before any parameter is written, so they can
+							// be permuted freely.
+							const Internal::IrBlock & target = function.GetBlock(block.Targets[0]);
+							std::vector<size_t> copies;
+							for (size_t i = 0; i < block.Operands.size(); ++i) {
+								irvalue_t argument = block.Operands[i];
+								if (!inRegister(target.Parameters[i]))
+									continue;
+								if (inRegister(argument) && registers[argument] == registers[target.Parameters[i]])
+									continue;
+								push(argument);
+								copies.push_back(i);
+							}
+							for (size_t i = copies.size(); i-- > 0; )
+								define(target.Parameters[copies[i]]);
+							if (block.Targets[0] != next)
+								writer.Jmp(output, labels[block.Targets[0]]);
+						}
+						break;
+					case IrTerminator::Branch:
+						push(block.Operands[0]);
+						push(block.Operands[1]);
+						if (block.Targets[0] == next) {
+							writer.Branch(output, _GetBranchInstruction(_Invert(block.Condition)), labels[block.Targets[1]]);
+						} else {
+							writer.Branch(output, _GetBranchInstruction(block.Condition), labels[block.Targets[0]]);
+							if (block.Targets[1] != next)
+								writer.Jmp(output, labels[block.Targets[1]]);
+						}
+						break;
+					default:
+						for (auto operand : block.Operands)
+							push(operand);
+						writer.Ret(output);
+						break;
+					}
+				}
+			}
+	};
+
+} // namespace Nova
+
+#endif // !_NOVA_RUNTIME_ENVIRONMENT_IR_LOWERING_HEADER_
\ No newline at end of file
@@ -0,0 +1,336 @@
+//
+// ir-optimizer.hpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#ifndef _NOVA_RUNTIME_ENVIRONMENT_IR_OPTIMIZER_HEADER_
+#define _NOVA_RUNTIME_ENVIRONMENT_IR_OPTIMIZER_HEADER_
+
+#include "ir-function.hpp"
+
+#include <cstdint>
+#include <vector>
+#include <map>
+#include <utility>
+#include <algorithm>
+
+namespace Nova {
+
+	/// <summary>
+	/// Passes simplifying an IrFunction without changing what it does.
+	/// </summary>
+	/// <remarks>
+	/// Only constants and additions are pure: loads, stores and calls are kept even if their results
+	/// aren't used, since they can fail or have side effects.
+	/// </remarks>
+	class IrOptimizer {
+		static inline bool _IsConstant(
+			const IrFunction & function, irvalue_t value
+			) {
+				return function.GetValue(value).Operation == IrOperation::Constant;
+			}
+
+		static inline std::int32_t _GetConstant(
+			const IrFunction & function, irvalue_t value
+			) {
+				return function.GetValue(value).Immediate;
+			}
+
+		static inline bool _Compare(
+			IrCondition condition, std::int32_t a, std::int32_t b
+			) {
+				switch (condition) {
+				case IrCondition::Equal: return a == b;
+				case IrCondition::NotEqual: return a != b;
+				case IrCondition::Less: return a < b;
+				case IrCondition::LessOrEqual: return a <= b;
+				case IrCondition::Greater: return a > b;
+				default: return a >= b;
+				}
+			}
+
+		static inline void _MakeJump(
+			Internal::IrBlock & block, irblock_t target
+			) {
+				block.Terminator = IrTerminator::Jump;
+				block.Operands.clear();
+				block.Targets[0] = target;
+			}
+
+		/// <summary>
+		/// Removes a parameter from a block, and the matching argument from the jumps to it.
+		/// </summary>
+		static inline void _RemoveParameter(
+			IrFunction & function, irblock_t target, size_t index
+			) {
+				Internal::IrBlock & block = function.GetBlock(target);
+				block.Parameters.erase(block.Parameters.begin() + index);
+				for (size_t i = 0; i < function.GetBlockCount(); ++i) {
+					Internal::IrBlock & predecessor = function.GetBlock(i);
+					if (predecessor.Terminator == IrTerminator::Jump && predecessor.Targets[0] == target)
+						predecessor.Operands.erase(predecessor.Operands.begin() + index);
+				}
+			}
+
+		/// <summary>
+		/// Returns the value passed to a parameter by every jump to its block, if there is only one.
+		/// </summary>
+		static inline bool _GetUniqueArgument(
+			const IrFunction & function, irblock_t target, size_t index, irvalue_t & argument
+			) {
+				irvalue_t parameter = function.GetBlock(target).Parameters[index];
+				bool found = false;
+				for (size_t i = 0; i < function.GetBlockCount(); ++i) {
+					const Internal::IrBlock & predecessor = function.GetBlock(i);
+					if (predecessor.Removed || predecessor.Terminator != IrTerminator::Jump || predecessor.Targets[0] != target)
+						continue;
+					irvalue_t value = predecessor.Operands[index];
+					if (value == parameter)
+						continue;
+					if (found && value != argument)
+						return false;
+					argument = value;
+					found = true;
+				}
+				return found;
+			}
+
+	public:
+		/// <summary>
+		/// Folds the additions and branches on constants, and replaces the block parameters which
+		/// always get the same value. Then removes the blocks that can't be reached.
+		/// </summary>
+		static inline void FoldConstants(
+			IrFunction & function
+			) {
+				bool changed = true;
+				while (changed) {
+					changed = false;
+
+					for (size_t i = 0; i < function.GetValueCount(); ++i) {
+						Internal::IrInstruction & instruction = function.GetValue(i);
+						if (instruction.Operation != IrOperation::Add)
+							continue;
+
+						irvalue_t a = instruction.Operands[0], b = instruction.Operands[1];
+						irvalue_t replacement = i;
+						if (_IsConstant(function, a) && _IsConstant(function, b)) {
+							std::uint32_t sum = static_cast<std::uint32_t>(_GetConstant(function, a))
+								+ static_cast<std::uint32_t>(_GetConstant(function, b));
+							instruction.Operation = IrOperation::Constant;
+							instruction.Immediate = static_cast<std::int32_t>(sum);
+							instruction.Operands.clear();
+							changed = true;
+						} else if (_IsConstant(function, b) && _GetConstant(function, b) == 0) {
+							replacement = a;
+						} else if (_IsConstant(function, a) && _GetConstant(function, a) == 0) {
+							replacement = b;
+						}
+
+						if (replacement != i) {
+							// The addition is left unused, as a constant, for the dead code elimination.
+							function.ReplaceAllUses(i, replacement);
+							Internal::IrInstruction & unused = function.GetValue(i);
+							unused.Operation = IrOperation::Constant;
+							unused.Immediate = 0;
+							unused.Operands.clear();
+							changed = true;
+						}
+					}
+
+					for (size_t i = 0; i < function.GetBlockCount(); ++i) {
+						Internal::IrBlock & block = function.GetBlock(i);
+						if (block.Terminator == IrTerminator::Branch
+							&& _IsConstant(function, block.Operands[0]) && _IsConstant(function, block.Operands[1])) {
+								bool taken = _Compare(block.Condition,
+									_GetConstant(function, block.Operands[0]), _GetConstant(function, block.Operands[1]));
+								_MakeJump(block, block.Targets[taken ? 0 : 1]);
+								changed = true;
+						}
+					}
+
+					// The entry block gets its parameters from the stack.
+					for (size_t i = 1; i < function.GetBlockCount(); ++i) {
+						for (size_t j = 0; j < function.GetBlock(i).Parameters.size(); ) {
+							irvalue_t argument = 0;
+							if (function.GetBlock(i).Removed || !_GetUniqueArgument(function, i, j, argument)) {
+								++j;
+								continue;
+							}
+							function.ReplaceAllUses(function.GetBlock(i).Parameters[j], argument);
+							_RemoveParameter(function, i, j);
+							changed = true;
+						}
+					}
+				}
+
+				RemoveUnreachableBlocks(function);
+			}
+
+		static inline void RemoveUnreachableBlocks(
+			IrFunction & function
+			) {
+				std::vector<bool> reached(function.GetBlockCount(), false);
+				std::vector<irblock_t> pending(1, function.GetEntryBlock());
+				reached[function.GetEntryBlock()] = true;
+				while (!pending.empty()) {
+					const Internal::IrBlock & block = function.GetBlock(pending.back());
+					pending.pop_back();
+
+					size_t targetCount = block.Terminator == IrTerminator::Jump ? 1
+						: block.Terminator == IrTerminator::Branch ? 2 : 0;
+					for (size_t i = 0; i < targetCount; ++i) {
+						if (!reached[block.Targets[i]]) {
+							reached[block.Targets[i]] = true;
+							pending.push_back(block.Targets[i]);
+						}
+					}
+				}
+
+				for (size_t i = 0; i < function.GetBlockCount(); ++i) {
+					Internal::IrBlock & block = function.GetBlock(i);
+					if (!reached[i] && !block.Removed) {
+						block.Removed = true;
+						block.Instructions.clear();
+						block.Operands.clear();
+						block.Terminator = IrTerminator::Return;
+					}
+				}
+			}
+
+		/// <summary>
+		/// Replaces the instructions computing a value already computed earlier in the same block.
+		/// Loads are reused until the next store or call.
+		/// </summary>
+		static inline void EliminateCommonSubexpressions(
+			IrFunction & function
+			) {
+				std::map<std::int32_t, irvalue_t> constants;
+				for (size_t i = 0; i < function.GetBlockCount(); ++i) {
+					Internal::IrBlock & block = function.GetBlock(i);
+					std::map<std::pair<irvalue_t, irvalue_t>, irvalue_t> additions;
+					std::map<std::pair<Register, std::int32_t>, irvalue_t> loads;
+
+					std::vector<irvalue_t> instructions;
+					for (auto value : block.Instructions) {
+						Internal::IrInstruction & instruction = function.GetValue(value);
+						irvalue_t existing = value;
+						switch (instruction.Operation) {
+						case IrOperation::Constant:
+							// Constants aren't stored anywhere, so they can be shared by any block.
+							existing = constants.insert(std::make_pair(instruction.Immediate, value)).first->second;
+							break;
+						case IrOperation::Add:
+							{
+								std::pair<irvalue_t, irvalue_t> key(
+									std::min(instruction.Operands[0], instruction.Operands[1]),
+									std::max(instruction.Operands[0], instruction.Operands[1]));
+								existing = additions.insert(std::make_pair(key, value)).first->second;
+							}
+							break;
+						case IrOperation::LoadI4:
+							existing = loads.insert(std::make_pair(std::make_pair(instruction.MId, instruction.Immediate), value)).first->second;
+							break;
+						case IrOperation::StoreI4:
+						case IrOperation::Call:
+						case IrOperation::XCall:
+							loads.clear();
+							break;
+						default:
+							break;
+						}
+
+						if (existing != value)
+							function.ReplaceAllUses(value, existing);
+						else
+							instructions.push_back(value);
+					}
+					block.Instructions = instructions;
+				}
+			}
+
+		/// <summary>
+		/// Removes the pure instructions and the block parameters whose values aren't used.
+		/// </summary>
+		static inline void EliminateDeadCode(
+			IrFunction & function
+			) {
+				std::vector<bool> live(function.GetValueCount(), false);
+				std::vector<irvalue_t> pending;
+				auto markLive = [&] (irvalue_t value) {
+					if (!live[value]) {
+						live[value] = true;
+						pending.push_back(value);
+					}
+				};
+
+				for (size_t i = 0; i < function.GetBlockCount(); ++i) {
+					const Internal::IrBlock & block = function.GetBlock(i);
+					if (block.Removed)
+						continue;
+					for (auto value : block.Instructions) {
+						IrOperation operation = function.GetValue(value).Operation;
+						if (operation != IrOperation::Constant && operation != IrOperation::Add)
+							markLive(value);
+					}
+					if (block.Terminator != IrTerminator::Jump) {
+						for (auto operand : block.Operands)
+							markLive(operand);
+					}
+				}
+				for (auto parameter : function.GetBlock(function.GetEntryBlock()).Parameters)
+					markLive(parameter);
+
+				// Arguments of jumps are only live if the parameter receiving them is.
+				while (!pending.empty()) {
+					irvalue_t value = pending.back();
+					pending.pop_back();
+
+					const Internal::IrInstruction & instruction = function.GetValue(value);
+					for (auto operand : instruction.Operands)
+						markLive(operand);
+					if (instruction.Operation != IrOperation::Parameter || instruction.Block == function.GetEntryBlock())
+						continue;
+
+					const Internal::IrBlock & target = function.GetBlock(instruction.Block);
+					size_t index = std::find(target.Parameters.begin(), target.Parameters.end(), value) - target.Parameters.begin();
+					for (size_t i = 0; i < function.GetBlockCount(); ++i) {
+						const Internal::IrBlock & predecessor = function.GetBlock(i);
+						if (!predecessor.Removed && predecessor.Terminator == IrTerminator::Jump && predecessor.Targets[0] == instruction.Block)
+							markLive(predecessor.Operands[index]);
+					}
+				}
+
+				for (size_t i = 0; i < function.GetBlockCount(); ++i) {
+					Internal::IrBlock & block = function.GetBlock(i);
+					block.Instructions.erase(std::remove_if(block.Instructions.begin(), block.Instructions.end(),
+						[&live] (irvalue_t value) {
+							return !live[value];
+						}), block.Instructions.end());
+
+					if (i == function.GetEntryBlock())
+						continue;
+					for (size_t j = block.Parameters.size(); j-- > 0; ) {
+						if (!live[block.Parameters[j]])
+							_RemoveParameter(function, i, j);
+					}
+				}
+			}
+
+		/// <summary>
+		/// Runs all the passes.
+		/// </summary>
+		static inline void Optimize(
+			IrFunction & function
+			) {
+				FoldConstants(function);
+				EliminateCommonSubexpressions(function);
+				EliminateDeadCode(function);
+			}
+	};
+
+} // namespace Nova
+
+#endif // !_NOVA_RUNTIME_ENVIRONMENT_IR_OPTIMIZER_HEADER_
\ No newline at end of file
@@ -0,0 +1,222 @@
+//
+// parallel-mapper.hpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#ifndef _NOVA_RUNTIME_ENVIRONMENT_PARALLEL_MAPPER_HEADER_
+#define _NOVA_RUNTIME_ENVIRONMENT_PARALLEL_MAPPER_HEADER_
+
+#include "runtime-scope.hpp"
+#include "scope-verifier.hpp"
+#include "batch-executor.hpp"
+
+#include "..\common\exception.hpp"
+#include "..\common\type-traits.hpp"
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <exception>
+
+namespace Nova {
+
+	/// <summary>
+	/// Pool of threads running the pmap instructions of the contexts over a scope manager.
+	/// </summary>
+	/// <remarks>
+	/// <para>Every call splits its elements in chunks, which the calling thread and the workers take
+	/// one at a time and run with a batch executor of their own, so vectorizable scopes are still run
+	/// a batch at a time. The calling thread works on its own call until no chunk is left, so nested
+	/// and concurrent calls always make progress, even if every worker is busy.</para>
+	/// <para>A call is never worked on by more threads than its parallelism cap, so a large call
+	/// leaves workers free for the others. Workers take the oldest call that still has chunks and
+	/// room for them.</para>
+	/// </remarks>
+	class ParallelMapper : public IParallelMapper {
+		struct _Job {
+			scoperef_t Scope;
+			const std::int8_t * Input;
+			std::int8_t * Output;
+			size_t ParameterSize;
+			size_t ResultSize;
+			size_t Count;
+			size_t ChunkCount;
+			size_t NextChunk;
+			size_t RunningChunks;
+			size_t WorkerCount;
+			size_t MaxWorkers;
+			std::exception_ptr Error;
+		};
+
+		RuntimeScopeManager & _scopeManager;
+		const size_t _chunkSize;
+		const size_t _batchSize;
+		std::mutex _mutex;
+		std::condition_variable _jobCondition;
+		std::condition_variable _doneCondition;
+		std::vector<_Job *> _jobs;
+		std::vector<BatchExecutor *> _idleExecutors;
+		std::vector<std::thread> _threads;
+		bool _stopping;
+
+		inline _Job * _FindJob(
+			) const {
+				for (auto job : _jobs) {
+					if (job->NextChunk < job->ChunkCount && job->WorkerCount < job->MaxWorkers)
+						return job;
+				}
+				return nullptr;
+			}
+
+		/// <summary>
+		/// Runs chunks of a job until none is left. The lock is released while a chunk runs. If a chunk
+		/// throws, the chunks not taken yet are dropped.
+		/// </summary>
+		inline void _RunChunks(
+			_Job & job, BatchExecutor & executor, std::unique_lock<std::mutex> & lock
+			) {
+				while (job.NextChunk < job.ChunkCount) {
+					size_t start = job.NextChunk++ * _chunkSize;
+					size_t count = std::min(_chunkSize, job.Count - start);
+					++job.RunningChunks;
+					lock.unlock();
+
+					std::exception_ptr error;
+					try {
+						const void * input = job.Input + start * job.ParameterSize;
+						void * output = job.Output + start * job.ResultSize;
+						executor.Run(job.Scope, count, &input, &output);
+					} catch (...) {
+						error = std::current_exception();
+					}
+
+					lock.lock();
+					--job.RunningChunks;
+					if (error) {
+						if (!job.Error)
+							job.Error = error;
+						job.NextChunk = job.ChunkCount;
+					}
+				}
+				if (job.RunningChunks == 0)
+					_doneCondition.notify_all();
+			}
+
+		inline void _Work(
+			) {
+				BatchExecutor executor(_scopeManager, _batchSize);
+				std::unique_lock<std::mutex> lock(_mutex);
+				for (;;) {
+					_Job * job = _FindJob();
+					if (job == nullptr) {
+						if (_stopping)
+							return;
+						_jobCondition.wait(lock);
+						continue;
+					}
+
+					++job->WorkerCount;
+					_RunChunks(* job, executor, lock);
+					--job->WorkerCount;
+				}
+			}
+
+	public:
+		static const size_t DefaultChunkSize = 4096;
+
+		/// <param name='threadCount'>Number of worker threads. The threads calling Map work too, so
+		/// zero runs every call on its calling thread.</param>
+		/// <param name='chunkSize'>Number of elements taken by a thread at a time.</param>
+		/// <param name='batchSize'>Batch size of the executors running the chunks.</param>
+		inline ParallelMapper(
+			RuntimeScopeManager & scopeManager, size_t threadCount, size_t chunkSize = DefaultChunkSize,
+			size_t batchSize = BatchExecutor::DefaultBatchSize
+			)
+			: _scopeManager(scopeManager), _chunkSize(chunkSize), _batchSize(batchSize), _stopping(false)
+			{
+				if (chunkSize == 0)
+					throw InvalidArgumentException("The chunk size can't be zero.");
+				for (size_t i = 0; i < threadCount; ++i)
+					_threads.push_back(std::thread([this] { _Work(); }));
+			}
+
+		inline ~ParallelMapper(
+			) {
+				{
+					std::lock_guard<std::mutex> lock(_mutex);
+					_stopping = true;
+				}
+				_jobCondition.notify_all();
+				for (auto & thread : _threads)
+					thread.join();
+				for (auto executor : _idleExecutors)
+					delete executor;
+			}
+
+		/// <summary>
+		/// Calls a scope for every element of the input, using up to maxParallelism threads including the
+		/// calling one, and returns once all the results are stored.
+		/// </summary>
+		inline void Map(
+			scoperef_t scopeId, const ScopeSignature & signature, const void * input, void * output,
+			size_t count, size_t maxParallelism
+			) {
+				if (!ScopeVerifier::IsMapSignature(signature))
+					throw InvalidArgumentException("Mapped scopes must take one scalar value and return another.");
+				if (count == 0)
+					return;
+
+				_Job job;
+				job.Scope = scopeId;
+				job.Input = static_cast<const std::int8_t *>(input);
+				job.Output = static_cast<std::int8_t *>(output);
+				job.ParameterSize = GetValueTypeSize(signature.GetParameters()[0]);
+				job.ResultSize = GetValueTypeSize(signature.GetResults()[0]);
+				job.Count = count;
+				job.ChunkCount = (count + _chunkSize - 1) / _chunkSize;
+				job.NextChunk = 0;
+				job.RunningChunks = 0;
+				// The calling thread counts as a worker of its call.
+				job.WorkerCount = 1;
+				job.MaxWorkers = maxParallelism != 0 ? maxParallelism : _threads.size() + 1;
+
+				BatchExecutor * executor;
+				std::unique_lock<std::mutex> lock(_mutex);
+				if (!_idleExecutors.empty()) {
+					executor = _idleExecutors.back();
+					_idleExecutors.pop_back();
+				} else {
+					lock.unlock();
+					executor = new BatchExecutor(_scopeManager, _batchSize);
+					lock.lock();
+				}
+
+				_jobs.push_back(&job);
+				if (job.MaxWorkers > 1 && job.ChunkCount > 1)
+					_jobCondition.notify_all();
+				_RunChunks(job, * executor, lock);
+				while (job.RunningChunks != 0)
+					_doneCondition.wait(lock);
+
+				_jobs.erase(std::find(_jobs.begin(), _jobs.end(), &job));
+				_idleExecutors.push_back(executor);
+				lock.unlock();
+
+				if (job.Error)
+					std::rethrow_exception(job.Error);
+			}
+
+		inline size_t GetThreadCount(
+			) const {
+				return _threads.size();
+			}
+	};
+
+} // namespace Nova
+
+#endif // !_NOVA_RUNTIME_ENVIRONMENT_PARALLEL_MAPPER_HEADER_
\ No newline at end of file
@@ -11,6 +11,7 @@
 #include "..\common\type-traits.hpp"
 
 #include <cstdint>
+#include <cstring>
 
 namespace Nova {
 
@@ -25,7 +26,10 @@ namespace Nova {
 		m0, m1, m2, m3,
 
 		// Comparison register.
-		cp
+		cp,
+
+		// Vector registers. They are 256 bits words, holding a value of any vector type.
+		v0, v1, v2, v3
 	};
 
 	class RegisterSet {
@@ -33,6 +37,7 @@ namespace Nova {
 		refaddr_t _mRegisters[4];
 		staddr_t _spRegisters[6];
 		bool _cpRegister;
+		std::int8_t _vRegisters[4][32];
 
 		inline std::int64_t & _GetRValueReference(
 			Register id
@@ -52,6 +57,12 @@ namespace Nova {
 				return _mRegisters[static_cast<int>(id) - static_cast<int>(Register::m0)];
 			}
 
+		inline std::int8_t * _GetVValueAddress(
+			Register id
+			) {
+				return _vRegisters[static_cast<int>(id) - static_cast<int>(Register::v0)];
+			}
+
 	public:
 		inline RegisterSet(
 			) {
@@ -61,6 +72,15 @@ namespace Nova {
 			) {
 			}
 
+		inline void Reset(
+			) {
+				memset(_rRegisters, 0, sizeof _rRegisters);
+				memset(_mRegisters, 0, sizeof _mRegisters);
+				memset(_spRegisters, 0, sizeof _spRegisters);
+				_cpRegister = false;
+				memset(_vRegisters, 0, sizeof _vRegisters);
+			}
+
 		inline std::int64_t GetRRegister(
 			Register id
 			) {
@@ -85,7 +105,7 @@ namespace Nova {
 				_GetSPValueReference(id) = value;
 			}
 
-		inline refaddr_t SetMRegister(
+		inline refaddr_t GetMRegister(
 			Register id
 			) {
 				return _GetMValueReference(id);
@@ -94,7 +114,45 @@ namespace Nova {
 		inline void SetMRegister(
 			Register id, refaddr_t value
 			) {
-				_GetMValueReference(id);
+				_GetMValueReference(id) = value;
+			}
+
+		inline bool GetCPRegister(
+			) const {
+				return _cpRegister;
+			}
+
+		inline void SetCPRegister(
+			bool value
+			) {
+				_cpRegister = value;
+			}
+
+		template <typename _Ty>
+		inline _Ty GetVRegister(
+			Register id
+			) {
+				static_assert(sizeof(_Ty) <= sizeof _vRegisters[0], "Type used doesn't fit in a vector register");
+				_Ty value;
+				memcpy(&value, _GetVValueAddress(id), sizeof value);
+				return value;
+			}
+
+		template <typename _Ty>
+		inline void SetVRegister(
+			Register id, const _Ty & value
+			) {
+				static_assert(sizeof(_Ty) <= sizeof _vRegisters[0], "Type used doesn't fit in a vector register");
+				memcpy(_GetVValueAddress(id), &value, sizeof value);
+			}
+
+		/// <summary>
+		/// Returns the storage of a vector register, for values whose type is only known at runtime.
+		/// </summary>
+		inline std::int8_t * GetVRegisterData(
+			Register id
+			) {
+				return _GetVValueAddress(id);
 			}
 	};
 
@@ -0,0 +1,183 @@
+//
+// runtime-context-pool.hpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#ifndef _NOVA_RUNTIME_ENVIRONMENT_RUNTIME_CONTEXT_POOL_HEADER_
+#define _NOVA_RUNTIME_ENVIRONMENT_RUNTIME_CONTEXT_POOL_HEADER_
+
+#include "runtime-context.hpp"
+
+#include "..\common\platform.hpp"
+#include "..\common\type-traits.hpp"
+
+#include <cstdint>
+#include <new>
+
+namespace Nova {
+
+	namespace Internal {
+		/// <summary>
+		/// Storage for a pooled context. The context, its registers and its stack buffer live in a
+		/// single cache-aligned allocation; the stack buffer follows the block.
+		/// </summary>
+		/// <remarks>
+		/// The context must be the first member, so a context pointer can be converted back to its block.
+		/// </remarks>
+		struct NOVA_ALIGN(64) RuntimeContextBlock {
+			RuntimeContext Context;
+			RegisterSet Registers;
+			RuntimeFixedStack Stack;
+			RuntimeContextBlock * Next;
+
+			inline RuntimeContextBlock(
+				RuntimeScopeManager * scopeManager, size_t stackSize
+				)
+				: Context(&Stack, &Registers, scopeManager, InvalidScope, nullptr, false),
+				  Registers(), Stack(GetStackBuffer(), stackSize), Next(nullptr)
+				{
+				}
+
+			inline staddr_t GetStackBuffer(
+				) {
+					return reinterpret_cast<staddr_t>(this + 1);
+				}
+		};
+	}
+
+	/// <summary>
+	/// A pool of reusable contexts over the same scope manager.
+	/// </summary>
+	/// <remarks>
+	/// Every context is created in one cache-aligned block with its register set and stack, and it's
+	/// reset instead of destroyed when released, so acquiring a pooled context doesn't allocate once the
+	/// pool is warm. The pool isn't synchronized; each worker thread must keep its own instance.
+	/// </remarks>
+	class RuntimeContextPool {
+		RuntimeScopeManager * const _scopeManager;
+		const size_t _stackSize;
+		Internal::RuntimeContextBlock * _freeBlocks;
+		size_t _freeCount;
+		size_t _allocatedCount;
+
+		inline size_t _GetBlockSize(
+			) const {
+				size_t size = sizeof(Internal::RuntimeContextBlock) + _stackSize;
+				return (size + CacheLineSize - 1) & ~(CacheLineSize - 1);
+			}
+
+		inline Internal::RuntimeContextBlock * _CreateBlock(
+			) {
+				void * memory = AlignedAllocate(_GetBlockSize(), CacheLineSize);
+				++_allocatedCount;
+				return new (memory) Internal::RuntimeContextBlock(_scopeManager, _stackSize);
+			}
+
+		inline void _DestroyBlock(
+			Internal::RuntimeContextBlock * block
+			) {
+				block->~RuntimeContextBlock();
+				AlignedFree(block);
+				--_allocatedCount;
+			}
+
+	public:
+		/// <summary>
+		/// Default size of the stack embedded in every pooled context.
+		/// </summary>
+		static const size_t DefaultStackSize = 512;
+
+		/// <summary>
+		/// Creates a new pool. The scope manager isn't owned by the pool or its contexts.
+		/// </summary>
+		/// <param name='scopeManager'>Scope manager shared by all the contexts in the pool.</param>
+		/// <param name='stackSize'>Size of the stack for every context.</param>
+		inline explicit RuntimeContextPool(
+			RuntimeScopeManager * scopeManager, size_t stackSize = DefaultStackSize
+			)
+			: _scopeManager(scopeManager), _stackSize(stackSize),
+			  _freeBlocks(nullptr), _freeCount(0), _allocatedCount(0)
+			{
+			}
+
+		/// <summary>
+		/// Release the contexts in the pool. All the acquired contexts must be released before.
+		/// </summary>
+		inline ~RuntimeContextPool(
+			) {
+				while (_freeBlocks != nullptr) {
+					Internal::RuntimeContextBlock * block = _freeBlocks;
+					_freeBlocks = block->Next;
+					_DestroyBlock(block);
+				}
+			}
+
+		/// <summary>
+		/// Creates contexts until the pool holds the specified number of available contexts.
+		/// </summary>
+		inline void Reserve(
+			size_t count
+			) {
+				while (_freeCount < count) {
+					Internal::RuntimeContextBlock * block = _CreateBlock();
+					block->Next = _freeBlocks;
+					_freeBlocks = block;
+					++_freeCount;
+				}
+			}
+
+		/// <summary>
+		/// Returns a clean context ready to run the specified scope.
+		/// </summary>
+		inline RuntimeContext * Acquire(
+			scoperef_t startScope
+			) {
+				Internal::RuntimeContextBlock * block = _freeBlocks;
+				if (block != nullptr) {
+					_freeBlocks = block->Next;
+					--_freeCount;
+				} else {
+					block = _CreateBlock();
+				}
+
+				block->Next = nullptr;
+				block->Context.Reset(startScope);
+				return &block->Context;
+			}
+
+		/// <summary>
+		/// Returns a context to the pool. The context must have been acquired from this pool.
+		/// </summary>
+		inline void Release(
+			RuntimeContext * context
+			) {
+				Internal::RuntimeContextBlock * block = reinterpret_cast<Internal::RuntimeContextBlock *>(context);
+				block->Next = _freeBlocks;
+				_freeBlocks = block;
+				++_freeCount;
+			}
+
+		/// <summary>
+		/// Returns the number of bytes used by every pooled context, including its stack.
+		/// </summary>
+		inline size_t GetContextFootprint(
+			) const {
+				return _GetBlockSize();
+			}
+
+		inline size_t GetAvailableCount(
+			) const {
+				return _freeCount;
+			}
+
+		inline size_t GetAllocatedCount(
+			) const {
+				return _allocatedCount;
+			}
+	};
+
+} // namespace Nova
+
+#endif // !_NOVA_RUNTIME_ENVIRONMENT_RUNTIME_CONTEXT_POOL_HEADER_
\ No newline at end of file
@@ -11,22 +11,750 @@
 #include "runtime-stack.hpp"
 #include "register-set.hpp"
 #include "runtime-scope.hpp"
+#include "scope-verifier.hpp"
+#include "runtime-heap.hpp"
+#include "host-view.hpp"
+#include "deferred-call-queue.hpp"
+#include "vector-kernels.hpp"
 #include "assembly.hpp"
 
 #include "..\common\exception.hpp"
 #include "..\common\type-traits.hpp"
 
 #include <cstdint>
+#include <cstring>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <chrono>
 
 namespace Nova {
-	class RuntimeContext {
+
+	/// <summary>
+	/// State of a scope being executed by a context.
+	/// </summary>
+	struct CallFrame {
+		scoperef_t Scope;
+
+		/// <summary>
+		/// Offset in the scope code of the instruction being executed.
+		/// </summary>
+		size_t InstructionOffset;
+
+		/// <summary>
+		/// Address of the first parameter of the scope in the stack. For scopes without a signature,
+		/// it's the top of the stack when the scope was entered.
+		/// </summary>
+		staddr_t StackBase;
+
+		/// <summary>
+		/// Version of the scope being executed. It stays alive until the run finishes, even if a new one
+		/// is published meanwhile.
+		/// </summary>
+		const RuntimeScope * Version;
+
+		/// <summary>
+		/// Stack-frame registers of the caller, restored when the scope returns. They're only saved for
+		/// scopes which can set them: the ones not verified, and the verified ones using set_spr.
+		/// </summary>
+		bool RestoresSPRegisters;
+		staddr_t SPRegisters[6];
+	};
+
+	namespace Internal {
+		/// <summary>
+		/// State of a context which most runs don't use, allocated the first time it's needed so the
+		/// contexts stay small.
+		/// </summary>
+		struct ContextExtension {
+			HostViewTable HostViews;
+			DeferredCallQueue DeferredCalls;
+		};
+	}
+
+	class RuntimeContext : public IHeapRootEnumerator {
 		RuntimeFixedStack * const _runtimeStack;
 		RegisterSet * const _registerSet;
 		RuntimeScopeManager * const _scopeManager;
-		const scoperef_t _startScope;
+		scoperef_t _startScope;
+		const bool _ownsResources;
+		bool _suspended;
+		Internal::ScopeReader _scopeReader;
+		RuntimeHeap _regionHeap;
+		IRuntimeHeap * const _heap;
+		Internal::ContextExtension * _extension;
+		std::vector<CallFrame> _frames;
 
-		inline bool _ExecuteInstruction(
+		/// <summary>
+		/// Checks a memory-address register read from the code. Verified scopes always pass it, but the
+		/// other ones could index past the register set.
+		/// </summary>
+		static inline Register _CheckMRegister(
+			Register mId
+			) {
+				if (mId < Register::m0 || mId > Register::m3)
+					throw RuntimeException("The register isn't a memory-address register.");
+				return mId;
+			}
+
+		/// <summary>
+		/// Checks a general-purpose register read from the code, the same way as the memory-address ones.
+		/// </summary>
+		static inline Register _CheckRRegister(
+			Register rId
+			) {
+				if (rId < Register::r0 || rId > Register::r7)
+					throw RuntimeException("The register isn't a general-purpose register.");
+				return rId;
+			}
+
+		/// <summary>
+		/// Rejects set_rfr and st_rfm in unverified scopes. Only the verifier proves that the value
+		/// popped is a reference, so unverified code could forge one from any bytes in the stack.
+		/// </summary>
+		inline void _CheckReferenceStore(
+			) {
+				if (!_frames.back().Version->IsVerified())
+					throw RuntimeException("Only verified scopes can store references taken from the stack.");
+			}
+
+		template <typename _Ty>
+		inline void _LoadFromMemory(
+			InstructionAssemblyReader & instructionAssemblyReader
+			) {
+				Register mId;
+				std::int32_t offset;
+				instructionAssemblyReader.MemoryAccess(mId, offset);
+				_runtimeStack->Push<_Ty>(HeapObject::Load<_Ty>(_registerSet->GetMRegister(_CheckMRegister(mId)), offset));
+			}
+
+		template <typename _Ty>
+		inline void _StoreToMemory(
+			InstructionAssemblyReader & instructionAssemblyReader
+			) {
+				Register mId;
+				std::int32_t offset;
+				instructionAssemblyReader.MemoryAccess(mId, offset);
+				HeapObject::Store<_Ty>(_registerSet->GetMRegister(_CheckMRegister(mId)), offset, _runtimeStack->Pop<_Ty>());
+			}
+
+		template <typename _Ty>
+		inline void _LoadElement(
+			InstructionAssemblyReader & instructionAssemblyReader
+			) {
+				Register mId;
+				instructionAssemblyReader.IndexedAccess(mId);
+				std::int32_t index = _runtimeStack->Pop<std::int32_t>();
+				_runtimeStack->Push<_Ty>(HeapObject::LoadElement<_Ty>(_registerSet->GetMRegister(_CheckMRegister(mId)), index));
+			}
+
+		template <typename _Ty>
+		inline void _StoreElement(
+			InstructionAssemblyReader & instructionAssemblyReader
+			) {
+				Register mId;
+				instructionAssemblyReader.IndexedAccess(mId);
+				_Ty value = _runtimeStack->Pop<_Ty>();
+				std::int32_t index = _runtimeStack->Pop<std::int32_t>();
+				HeapObject::StoreElement<_Ty>(_registerSet->GetMRegister(_CheckMRegister(mId)), index, value);
+			}
+
+		template <typename _Ty>
+		inline void _Fill(
+			InstructionAssemblyReader & instructionAssemblyReader
+			) {
+				Register mId;
+				instructionAssemblyReader.IndexedAccess(mId);
+				_Ty value = _runtimeStack->Pop<_Ty>();
+				std::int32_t count = _runtimeStack->Pop<std::int32_t>();
+				std::int32_t start = _runtimeStack->Pop<std::int32_t>();
+				HeapObject::Fill<_Ty>(_registerSet->GetMRegister(_CheckMRegister(mId)), start, count, value);
+			}
+
+		/// <summary>
+		/// Returns the address of a ld_*s or st_*s instruction. The verifier proved the accesses of
+		/// verified scopes, so only the other ones are checked, when the stack reads or writes the value.
+		/// </summary>
+		inline staddr_t _GetFrameAddress(
+			InstructionAssemblyReader & instructionAssemblyReader, bool & checked
+			) {
+				Register spId;
+				std::int32_t offset;
+				instructionAssemblyReader.FrameAccess(spId, offset);
+				checked = !_frames.back().Version->IsVerified();
+				if (checked && (spId < Register::sp0 || spId > Register::sp5))
+					throw RuntimeException("The register isn't a stack-frame register.");
+				staddr_t address = _registerSet->GetSPRegister(spId);
+				if (checked && address == nullptr)
+					throw RuntimeException("The stack-frame register isn't set.");
+				return address + offset;
+			}
+
+		template <typename _Ty>
+		inline void _LoadFromFrame(
+			InstructionAssemblyReader & instructionAssemblyReader
+			) {
+				bool checked;
+				staddr_t address = _GetFrameAddress(instructionAssemblyReader, checked);
+				_runtimeStack->Push<_Ty>(checked ? _runtimeStack->Get<_Ty>(address) : * reinterpret_cast<_Ty *>(address));
+			}
+
+		template <typename _Ty>
+		inline void _StoreToFrame(
+			InstructionAssemblyReader & instructionAssemblyReader
+			) {
+				bool checked;
+				staddr_t address = _GetFrameAddress(instructionAssemblyReader, checked);
+				_Ty value = _runtimeStack->Pop<_Ty>();
+				if (checked)
+					_runtimeStack->Set<_Ty>(address, value);
+				else
+					* reinterpret_cast<_Ty *>(address) = value;
+			}
+
+		/// <summary>
+		/// Runs dup, swap, pick or drop_n. Values are moved as bytes, since the verifier already
+		/// checked their types.
+		/// </summary>
+		inline void _ExecuteStackInstruction(
+			Instruction instruction, InstructionAssemblyReader & instructionAssemblyReader
+			) {
+				// drop_n is the only one without a type.
+				ValueType type = ValueType::i1;
+				std::int32_t offset;
+				staddr_t top = _runtimeStack->GetCurrentAddress();
+				size_t used = static_cast<size_t>(top - _runtimeStack->GetBaseAddress());
+				switch (instruction) {
+				case Instruction::dup:
+				case Instruction::pick:
+					{
+						if (instruction == Instruction::dup) {
+							instructionAssemblyReader.StackOperation(type);
+							offset = 0;
+						} else {
+							instructionAssemblyReader.Pick(type, offset);
+						}
+						size_t size = GetValueTypeSize(type);
+						if (offset < 0 || used < size + offset)
+							throw StackException("Value can't getted from stack. Stack size too small.");
+						_runtimeStack->PushBytes(top - offset - size, size);
+					}
+					break;
+				case Instruction::swap:
+					{
+						instructionAssemblyReader.StackOperation(type);
+						size_t size = GetValueTypeSize(type);
+						if (used < 2 * size)
+							throw StackException("Value can't getted from stack. Stack size too small.");
+						std::int8_t value[32];
+						memcpy(value, top - size, size);
+						memcpy(top - size, top - 2 * size, size);
+						memcpy(top - 2 * size, value, size);
+					}
+					break;
+				default:
+					instructionAssemblyReader.DropN(offset);
+					if (offset < 0)
+						throw StackException("The size dropped can't be negative.");
+					_runtimeStack->Drop(offset);
+					break;
+				}
+			}
+
+		/// <summary>
+		/// Runs ld_k, ldx_k or alloc_k. The verifier checked the constants of verified scopes, but the
+		/// indices of ldx_k are always checked, since they come from the stack.
+		/// </summary>
+		inline void _ExecuteConstantInstruction(
+			Instruction instruction, InstructionAssemblyReader & instructionAssemblyReader
+			) {
+				const ConstantPool & pool = _scopeManager->GetConstantPool();
+				// alloc_k has a register instead of a type.
+				ValueType type = ValueType::i1;
+				Register mId = Register::m0;
+				constref_t constant;
+				if (instruction == Instruction::alloc_k)
+					instructionAssemblyReader.AllocK(mId, constant);
+				else
+					instructionAssemblyReader.ConstantAccess(type, constant);
+
+				if (!_frames.back().Version->IsVerified()) {
+					if (!pool.Contains(constant))
+						throw RuntimeException("The constant doesn't exist.");
+					if (pool.IsArray(constant) != (instruction != Instruction::ld_k))
+						throw RuntimeException(instruction == Instruction::ld_k
+							? "The constant isn't a value." : "The constant isn't an array.");
+					if (instruction != Instruction::alloc_k && pool.GetType(constant) != type)
+						throw RuntimeException("The type doesn't match the constant.");
+				}
+
+				const std::int8_t * data = static_cast<const std::int8_t *>(pool.GetData(constant));
+				switch (instruction) {
+				case Instruction::ld_k:
+					_runtimeStack->PushBytes(data, pool.GetSize(constant));
+					break;
+				case Instruction::ldx_k:
+					{
+						std::int32_t index = _runtimeStack->Pop<std::int32_t>();
+						if (index < 0 || static_cast<size_t>(index) >= pool.GetLength(constant))
+							throw RuntimeException("The index is out of the constant bounds.");
+						size_t size = GetValueTypeSize(type);
+						_runtimeStack->PushBytes(data + index * size, size);
+					}
+					break;
+				default:
+					{
+						std::int32_t size = static_cast<std::int32_t>(pool.GetSize(constant));
+						if (size < 0)
+							throw HeapException("The constant is too big for an object.");
+						refaddr_t object = _heap->Allocate(size);
+						if (size != 0)
+							memcpy(HeapObject::GetBytes(object, 0, size, true), data, size);
+						_registerSet->SetMRegister(_CheckMRegister(mId), object);
+					}
+					break;
+				}
+			}
+
+		static inline ValueType _CheckVectorType(
+			ValueType type
+			) {
+				if (!IsVectorType(type))
+					throw RuntimeException("The instruction requires a vector type.");
+				return type;
+			}
+
+		inline std::int8_t * _GetVectorRegister(
+			Register vId
+			) {
+				if (vId < Register::v0 || vId > Register::v3)
+					throw RuntimeException("The register isn't a vector register.");
+				return _registerSet->GetVRegisterData(vId);
+			}
+
+		/// <summary>
+		/// Executes the vector instructions. Vectors are moved through aligned local storage, and the
+		/// kernels are chosen for the processor when the engine starts.
+		/// </summary>
+		inline void _ExecuteVectorInstruction(
 			Instruction instruction, InstructionAssemblyReader & instructionAssemblyReader
+			) {
+				NOVA_ALIGN(32) std::int8_t a[32];
+				NOVA_ALIGN(32) std::int8_t b[32];
+				NOVA_ALIGN(32) std::int8_t c[32];
+				ValueType type;
+				Register registerId;
+
+				switch (instruction) {
+				case Instruction::push_vr:
+					instructionAssemblyReader.VectorRegisterAccess(type, registerId);
+					_runtimeStack->PushBytes(_GetVectorRegister(registerId), GetValueTypeSize(_CheckVectorType(type)));
+					break;
+				case Instruction::set_vr:
+					instructionAssemblyReader.VectorRegisterAccess(type, registerId);
+					_runtimeStack->PopBytes(_GetVectorRegister(registerId), GetValueTypeSize(_CheckVectorType(type)));
+					break;
+				case Instruction::blend_v:
+					{
+						instructionAssemblyReader.VectorOperation(type);
+						size_t size = GetValueTypeSize(_CheckVectorType(type));
+						_runtimeStack->PopBytes(c, size);
+						_runtimeStack->PopBytes(b, size);
+						_runtimeStack->PopBytes(a, size);
+						Internal::GetVectorKernels().Blend[Internal::GetVectorTypeIndex(type)](a, a, b, c);
+						_runtimeStack->PushBytes(a, size);
+					}
+					break;
+				case Instruction::splat_v:
+					instructionAssemblyReader.VectorOperation(type);
+					_runtimeStack->PopBytes(b, GetValueTypeSize(GetVectorLaneType(_CheckVectorType(type))));
+					Internal::SplatVector(type, b, a);
+					_runtimeStack->PushBytes(a, GetValueTypeSize(type));
+					break;
+				case Instruction::hadd_v:
+				case Instruction::hmin_v:
+				case Instruction::hmax_v:
+					instructionAssemblyReader.VectorOperation(type);
+					_runtimeStack->PopBytes(a, GetValueTypeSize(_CheckVectorType(type)));
+					Internal::ReduceVector(type, static_cast<Internal::VectorReduceOperation>(
+						static_cast<int>(instruction) - static_cast<int>(Instruction::hadd_v)), a, b);
+					_runtimeStack->PushBytes(b, GetValueTypeSize(GetVectorLaneType(type)));
+					break;
+				case Instruction::shuffle_v:
+					{
+						std::uint8_t lanes[8];
+						instructionAssemblyReader.ShuffleV(type, lanes);
+						_runtimeStack->PopBytes(a, GetValueTypeSize(_CheckVectorType(type)));
+						Internal::ShuffleVector(type, a, lanes, b);
+						_runtimeStack->PushBytes(b, GetValueTypeSize(type));
+					}
+					break;
+				case Instruction::ldx_vm:
+					{
+						instructionAssemblyReader.VectorMemoryAccess(type, registerId);
+						std::int32_t index = _runtimeStack->Pop<std::int32_t>();
+						HeapObject::LoadElements(_registerSet->GetMRegister(_CheckMRegister(registerId)), index,
+							GetVectorLaneType(_CheckVectorType(type)), GetVectorLaneCount(type), a);
+						_runtimeStack->PushBytes(a, GetValueTypeSize(type));
+					}
+					break;
+				case Instruction::stx_vm:
+					{
+						instructionAssemblyReader.VectorMemoryAccess(type, registerId);
+						_runtimeStack->PopBytes(a, GetValueTypeSize(_CheckVectorType(type)));
+						std::int32_t index = _runtimeStack->Pop<std::int32_t>();
+						HeapObject::StoreElements(_registerSet->GetMRegister(_CheckMRegister(registerId)), index,
+							GetVectorLaneType(type), GetVectorLaneCount(type), a);
+					}
+					break;
+				default:
+					{
+						// add_v to cmplt_v, in the order of the kernel table.
+						instructionAssemblyReader.VectorOperation(type);
+						size_t size = GetValueTypeSize(_CheckVectorType(type));
+						_runtimeStack->PopBytes(b, size);
+						_runtimeStack->PopBytes(a, size);
+						size_t operation = static_cast<size_t>(instruction) - static_cast<size_t>(Instruction::add_v);
+						Internal::GetVectorKernels().Binary[operation][Internal::GetVectorTypeIndex(type)](a, a, b);
+						_runtimeStack->PushBytes(a, size);
+					}
+					break;
+				}
+			}
+
+		inline Channel & _GetChannel(
+			chanref_t channelId
+			) {
+				if (reinterpret_cast<size_t>(channelId) >= _scopeManager->GetChannelCount())
+					throw RuntimeException("The channel doesn't exist.");
+				return _scopeManager->GetChannel(channelId);
+			}
+
+		/// <summary>
+		/// Returns the state most runs don't use, allocating it the first time it's needed.
+		/// </summary>
+		inline Internal::ContextExtension & _GetExtension(
+			) {
+				if (_extension == nullptr)
+					_extension = new Internal::ContextExtension();
+				return * _extension;
+			}
+
+		/// <summary>
+		/// Moves the arguments of a call to a deferred external scope from the stack to the queue.
+		/// </summary>
+		inline void _DeferCall(
+			ExternalScope & scope
+			) {
+				size_t size = scope.GetSignature().GetParametersSize();
+				staddr_t top = _runtimeStack->GetCurrentAddress();
+				if (static_cast<size_t>(top - _runtimeStack->GetBaseAddress()) < size)
+					throw StackException("Value can't getted from stack. Stack size too small.");
+				_GetExtension().DeferredCalls.Add(scope, top - size, size);
+				_runtimeStack->Drop(size);
+			}
+
+		inline void _FlushDeferredCalls(
+			) {
+				if (_extension != nullptr)
+					_extension->DeferredCalls.Flush();
+			}
+
+		/// <summary>
+		/// Stops the run before the current instruction, keeping the frames so it can be resumed.
+		/// </summary>
+		inline bool _Suspend(
+			) {
+				_suspended = true;
+				return false;
+			}
+
+		/// <summary>
+		/// Reads the channel instruction which suspended the context. The channel isn't stored, to keep
+		/// the context small, since it's only needed to resume.
+		/// </summary>
+		inline Instruction _GetWaitInstruction(
+			chanref_t & channelId
+			) const {
+				const CallFrame & frame = _frames.back();
+				DynamicBuffer::ConstIterator bufferIterator = frame.Version->GetCodeBuffer().GetConstIterator();
+				bufferIterator.Seek(frame.InstructionOffset);
+
+				AssemblyReader assemblyReader;
+				Instruction instruction = assemblyReader.GetInstructionId(bufferIterator);
+				if (AssemblyReader::IsBreakpoint(instruction)) {
+					bufferIterator = _GetDebugger().GetOriginalCode(frame.Scope).GetConstIterator();
+					bufferIterator.Seek(frame.InstructionOffset);
+					instruction = assemblyReader.GetInstructionId(bufferIterator);
+				}
+				Register mId;
+				if (instruction == Instruction::send || instruction == Instruction::recv)
+					assemblyReader.ChannelAccess(bufferIterator, channelId);
+				else
+					assemblyReader.ChannelMemoryAccess(bufferIterator, channelId, mId);
+				return instruction;
+			}
+
+		/// <summary>
+		/// Executes the channel instructions. Values are only popped once they're sent, so a suspended
+		/// instruction finds the stack as it was when it runs again.
+		/// </summary>
+		inline bool _ExecuteChannelInstruction(
+			Instruction instruction, InstructionAssemblyReader & instructionAssemblyReader
+			) {
+				chanref_t channelId;
+				// Only send_m and recv_m have a register.
+				Register mId = Register::m0;
+				if (instruction == Instruction::send || instruction == Instruction::recv)
+					instructionAssemblyReader.ChannelAccess(channelId);
+				else
+					instructionAssemblyReader.ChannelMemoryAccess(channelId, mId);
+
+				Channel & channel = _GetChannel(channelId);
+				std::int32_t size = static_cast<std::int32_t>(channel.GetElementSize());
+				std::int8_t value[32];
+				switch (instruction) {
+				case Instruction::send:
+					if (!channel.HasElementType())
+						throw RuntimeException("Byte buffers must be sent through objects.");
+					if (_runtimeStack->GetCurrentAddress() - _runtimeStack->GetBaseAddress() < size)
+						throw StackException("Value can't getted from stack. Stack size too small.");
+					if (!channel.TrySendBytes(_runtimeStack->GetCurrentAddress() - size))
+						return _Suspend();
+					_runtimeStack->PopBytes(value, size);
+					return true;
+				case Instruction::recv:
+					if (!channel.HasElementType())
+						throw RuntimeException("Byte buffers must be received through objects.");
+					if (_runtimeStack->GetBaseAddress() + _runtimeStack->GetSize() - _runtimeStack->GetCurrentAddress() < size)
+						throw StackException("Value can't pushed to stack. Stack remaining space too small.");
+					if (!channel.TryReceiveBytes(value))
+						return _Suspend();
+					_runtimeStack->PushBytes(value, size);
+					return true;
+				case Instruction::send_m:
+					if (!channel.TrySendBytes(HeapObject::GetBytes(_registerSet->GetMRegister(_CheckMRegister(mId)), 0, size, false)))
+						return _Suspend();
+					return true;
+				default:
+					if (!channel.TryReceiveBytes(HeapObject::GetBytes(_registerSet->GetMRegister(_CheckMRegister(mId)), 0, size, true)))
+						return _Suspend();
+					return true;
+				}
+			}
+
+		inline IScopeDebugger & _GetDebugger(
+			) const {
+				IScopeDebugger * debugger = _scopeManager->GetDebugger();
+				if (debugger == nullptr)
+					throw RuntimeException("The scope holds breakpoints, but no debugger is attached.");
+				return * debugger;
+			}
+
+		/// <summary>
+		/// Calls the debugger at a breakpoint trap, then runs the original instruction. The frame goes
+		/// on with the version returned by the debugger, which may hold other traps.
+		/// </summary>
+		/// <param name='bufferIterator'>Iterator at the end of the trap.</param>
+		inline bool _ExecuteBreakpoint(
+			DynamicBuffer::ConstIterator & bufferIterator
+			) {
+				IScopeDebugger & debugger = _GetDebugger();
+				const RuntimeScope * version = debugger.OnBreakpoint(* this);
+
+				CallFrame & frame = _frames.back();
+				frame.Version = version;
+				size_t offset = bufferIterator.GetOffset();
+				bufferIterator = version->GetCodeBuffer().GetConstIterator();
+				bufferIterator.Seek(offset);
+
+				DynamicBuffer::ConstIterator originalIterator = debugger.GetOriginalCode(frame.Scope).GetConstIterator();
+				originalIterator.Seek(frame.InstructionOffset);
+				AssemblyReader assemblyReader;
+				Instruction instruction = assemblyReader.GetInstructionId(originalIterator);
+				InstructionAssemblyReader instructionAssemblyReader(assemblyReader, originalIterator);
+				return _ExecuteInstruction(instruction, instructionAssemblyReader, bufferIterator);
+			}
+
+		/// <summary>
+		/// Executes pmap. The elements go to the parallel mapper of the scope manager, or the scope is
+		/// called for each of them by this context if the manager has none.
+		/// </summary>
+		inline void _ExecuteParallelMap(
+			InstructionAssemblyReader & instructionAssemblyReader
+			) {
+				scoperef_t scopeId;
+				Register sourceId, destinationId;
+				instructionAssemblyReader.PMap(scopeId, sourceId, destinationId);
+				std::int32_t maxParallelism = _runtimeStack->Pop<std::int32_t>();
+				std::int32_t count = _runtimeStack->Pop<std::int32_t>();
+				if (count < 0 || maxParallelism < 0)
+					throw RuntimeException("The element count and the parallelism of pmap can't be negative.");
+				if (reinterpret_cast<size_t>(scopeId) >= _scopeManager->GetScopeCount())
+					throw RuntimeException("The scope doesn't exist.");
+
+				RuntimeScope & scope = _scopeManager->GetScope(scopeId);
+				if (!scope.IsLoaded() || !scope.IsVerified())
+					ScopeVerifier(* _scopeManager).Verify(scope);
+				if (!ScopeVerifier::IsMapSignature(scope.GetSignature()))
+					throw RuntimeException("Mapped scopes must take one scalar value and return another.");
+				if (count == 0)
+					return;
+
+				std::int64_t parameterSize = GetValueTypeSize(scope.GetSignature().GetParameters()[0]);
+				std::int64_t resultSize = GetValueTypeSize(scope.GetSignature().GetResults()[0]);
+				const std::int64_t maxSize = std::numeric_limits<std::int32_t>::max();
+				if (count * parameterSize > maxSize || count * resultSize > maxSize)
+					throw RuntimeException("Too many elements to map.");
+				std::int32_t inputSize = static_cast<std::int32_t>(count * parameterSize);
+				std::int32_t outputSize = static_cast<std::int32_t>(count * resultSize);
+
+				IParallelMapper * parallelMapper = _scopeManager->GetParallelMapper();
+				if (parallelMapper != nullptr) {
+					// The context waits for the mapper, so its objects can't move meanwhile.
+					const std::int8_t * input = HeapObject::GetBytes(_registerSet->GetMRegister(_CheckMRegister(sourceId)), 0, inputSize, false);
+					std::int8_t * output = HeapObject::GetBytes(_registerSet->GetMRegister(_CheckMRegister(destinationId)), 0, outputSize, true);
+					parallelMapper->Map(scopeId, scope.GetSignature(), input, output, count, maxParallelism);
+					return;
+				}
+
+				// The scope may collect the heap, so the input is copied before the calls and the results
+				// are stored after them.
+				DynamicBuffer input, output;
+				input.Push(HeapObject::GetBytes(_registerSet->GetMRegister(_CheckMRegister(sourceId)), 0, inputSize, false), inputSize);
+				// The destination is checked before the calls, so they aren't run for nothing.
+				HeapObject::GetBytes(_registerSet->GetMRegister(_CheckMRegister(destinationId)), 0, outputSize, true);
+				output.Resize(outputSize);
+				for (std::int32_t i = 0; i < count; ++i) {
+					_runtimeStack->PushBytes(static_cast<const std::int8_t *>(input.GetPointer()) + i * parameterSize,
+						static_cast<size_t>(parameterSize));
+					_ExecuteScope(scopeId);
+					if (_suspended)
+						throw RuntimeException("Scopes blocked on channels can't be mapped.");
+					_runtimeStack->PopBytes(static_cast<std::int8_t *>(output.GetPointer()) + i * resultSize,
+						static_cast<size_t>(resultSize));
+				}
+				memcpy(HeapObject::GetBytes(_registerSet->GetMRegister(_CheckMRegister(destinationId)), 0, outputSize, true),
+					output.GetPointer(), outputSize);
+			}
+
+		inline void _FinishRun(
+			) {
+				_suspended = false;
+				_frames.clear();
+				_scopeManager->LeaveReader(_scopeReader);
+				if (_heap->OnRunFinished()) {
+					_registerSet->SetMRegister(Register::m0, nullptr);
+					_registerSet->SetMRegister(Register::m1, nullptr);
+					_registerSet->SetMRegister(Register::m2, nullptr);
+					_registerSet->SetMRegister(Register::m3, nullptr);
+				}
+			}
+
+		static inline std::uint64_t _GetElapsedNanoseconds(
+			std::chrono::high_resolution_clock::time_point start
+			) {
+				return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+			}
+
+		/// <summary>
+		/// Returns the kind of the exception being handled.
+		/// </summary>
+		static inline TrapKind _GetTrapKind(
+			) {
+				try {
+					throw;
+				} catch (const StackException &) {
+					return TrapKind::Stack;
+				} catch (const HeapException &) {
+					return TrapKind::Heap;
+				} catch (const VerificationException &) {
+					return TrapKind::Verification;
+				} catch (const RuntimeException &) {
+					return TrapKind::Runtime;
+				} catch (...) {
+					return TrapKind::Other;
+				}
+			}
+
+		/// <summary>
+		/// Starts or resumes the run, and records its latency and its trap, if any.
+		/// </summary>
+		inline void _Execute(
+			bool resume
+			) {
+				EngineMetrics & metrics = _scopeManager->GetMetrics();
+				bool timed = metrics.IsLatencyEnabled();
+				std::chrono::high_resolution_clock::time_point start;
+				if (timed)
+					start = std::chrono::high_resolution_clock::now();
+
+				try {
+					if (resume)
+						_ResumeFrame(0);
+					else
+						_ExecuteScope(_startScope);
+					// The host gets the deferred calls before the run returns, even if it's suspended.
+					_FlushDeferredCalls();
+				} catch (...) {
+					Internal::MetricsShard & shard = metrics.GetShard();
+					shard.AddTrap(_GetTrapKind());
+					if (timed)
+						shard.AddRunLatency(_GetElapsedNanoseconds(start));
+					_FinishRun();
+					// The calls made before the trap are delivered too, unless a callback failed.
+					_FlushDeferredCalls();
+					throw;
+				}
+				if (timed)
+					metrics.GetShard().AddRunLatency(_GetElapsedNanoseconds(start));
+				if (!_suspended)
+					_FinishRun();
+			}
+
+		/// <summary>
+		/// Pops two int32 values and compares the first pushed one to the second one.
+		/// </summary>
+		inline bool _CompareI4(
+			Instruction instruction
+			) {
+				std::int32_t b = _runtimeStack->Pop<std::int32_t>(), a = _runtimeStack->Pop<std::int32_t>();
+				switch (instruction) {
+				case Instruction::cmpeq_i4:
+				case Instruction::jeq_i4:
+					return a == b;
+				case Instruction::cmpne_i4:
+				case Instruction::jne_i4:
+					return a != b;
+				case Instruction::cmplt_i4:
+				case Instruction::jlt_i4:
+					return a < b;
+				case Instruction::cmple_i4:
+				case Instruction::jle_i4:
+					return a <= b;
+				case Instruction::cmpgt_i4:
+				case Instruction::jgt_i4:
+					return a > b;
+				default:
+					return a >= b;
+				}
+			}
+
+		/// <param name='bufferIterator'>Iterator at the end of the branch instruction.</param>
+		static inline void _Branch(
+			DynamicBuffer::ConstIterator & bufferIterator, std::int32_t offset
+			) {
+				std::int64_t target = static_cast<std::int64_t>(bufferIterator.GetOffset()) + offset;
+				if (target < 0)
+					throw RuntimeException("The branch target is out of the scope.");
+				bufferIterator.Seek(static_cast<size_t>(target));
+			}
+
+		/// <param name='bufferIterator'>Iterator at the end of the instruction. Branches move it to
+		/// their target.</param>
+		inline bool _ExecuteInstruction(
+			Instruction instruction, InstructionAssemblyReader & instructionAssemblyReader,
+			DynamicBuffer::ConstIterator & bufferIterator
 			) {
 				switch (instruction) {
 				case Instruction::nop:
@@ -50,6 +778,16 @@ namespace Nova {
 					return true;
 				case Instruction::push_i4r:
 					{
+						Register rId;
+						instructionAssemblyReader.PushI4R(rId);
+						_runtimeStack->Push<std::int32_t>(static_cast<std::int32_t>(_registerSet->GetRRegister(_CheckRRegister(rId))));
+					}
+					return true;
+				case Instruction::set_i4r:
+					{
+						Register rId;
+						instructionAssemblyReader.SetI4R(rId);
+						_registerSet->SetRRegister(_CheckRRegister(rId), _runtimeStack->Pop<std::int32_t>());
 					}
 					return true;
 				case Instruction::call:
@@ -58,13 +796,26 @@ namespace Nova {
 						instructionAssemblyReader.Call(scopeId);
 						_ExecuteScope(scopeId);
 					}
-					return true;
+					return !_suspended;
 				case Instruction::xcall:
 					{
 						scoperef_t scopeId;
 						instructionAssemblyReader.XCall(scopeId);
 						ExternalScope & scope = _scopeManager->GetExternalScope(scopeId);
+						if (scope.IsDeferred()) {
+							_DeferCall(scope);
+							return true;
+						}
+
+						EngineMetrics & metrics = _scopeManager->GetMetrics();
+						if (!metrics.IsLatencyEnabled()) {
+							scope.GetCallbackFunction()(* _runtimeStack);
+							return true;
+						}
+
+						std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
 						scope.GetCallbackFunction()(* _runtimeStack);
+						metrics.GetShard().AddXCallLatency(reinterpret_cast<size_t>(scopeId), _GetElapsedNanoseconds(start));
 					}
 					return true;
 				case Instruction::ret:
@@ -72,6 +823,305 @@ namespace Nova {
 						instructionAssemblyReader.Ret();
 					}
 					return false;
+				case Instruction::alloc:
+					{
+						Register mId;
+						instructionAssemblyReader.Alloc(mId);
+						std::int32_t size = _runtimeStack->Pop<std::int32_t>();
+						if (size < 0)
+							throw HeapException("The object size can't be negative.");
+						_registerSet->SetMRegister(_CheckMRegister(mId), _heap->Allocate(size));
+					}
+					return true;
+				case Instruction::push_rfr:
+					{
+						Register mId;
+						instructionAssemblyReader.PushRfR(mId);
+						_runtimeStack->Push<refaddr_t>(_registerSet->GetMRegister(_CheckMRegister(mId)));
+					}
+					return true;
+				case Instruction::set_rfr:
+					{
+						Register mId;
+						instructionAssemblyReader.SetRfR(mId);
+						_CheckReferenceStore();
+						_registerSet->SetMRegister(_CheckMRegister(mId), _runtimeStack->Pop<refaddr_t>());
+					}
+					return true;
+				case Instruction::ld_i1m:
+					_LoadFromMemory<std::int8_t>(instructionAssemblyReader);
+					return true;
+				case Instruction::ld_i2m:
+					_LoadFromMemory<std::int16_t>(instructionAssemblyReader);
+					return true;
+				case Instruction::ld_i4m:
+					_LoadFromMemory<std::int32_t>(instructionAssemblyReader);
+					return true;
+				case Instruction::ld_i8m:
+					_LoadFromMemory<std::int64_t>(instructionAssemblyReader);
+					return true;
+				case Instruction::ld_fsm:
+					_LoadFromMemory<float>(instructionAssemblyReader);
+					return true;
+				case Instruction::ld_fdm:
+					_LoadFromMemory<double>(instructionAssemblyReader);
+					return true;
+				case Instruction::ld_rfm:
+					_LoadFromMemory<refaddr_t>(instructionAssemblyReader);
+					return true;
+				case Instruction::st_i1m:
+					_StoreToMemory<std::int8_t>(instructionAssemblyReader);
+					return true;
+				case Instruction::st_i2m:
+					_StoreToMemory<std::int16_t>(instructionAssemblyReader);
+					return true;
+				case Instruction::st_i4m:
+					_StoreToMemory<std::int32_t>(instructionAssemblyReader);
+					return true;
+				case Instruction::st_i8m:
+					_StoreToMemory<std::int64_t>(instructionAssemblyReader);
+					return true;
+				case Instruction::st_fsm:
+					_StoreToMemory<float>(instructionAssemblyReader);
+					return true;
+				case Instruction::st_fdm:
+					_StoreToMemory<double>(instructionAssemblyReader);
+					return true;
+				case Instruction::st_rfm:
+					{
+						Register mId;
+						std::int32_t offset;
+						instructionAssemblyReader.MemoryAccess(mId, offset);
+						_CheckReferenceStore();
+						refaddr_t object = _registerSet->GetMRegister(_CheckMRegister(mId));
+						refaddr_t value = _runtimeStack->Pop<refaddr_t>();
+						// Views belong to the run, so objects, which may outlive it, can't hold them.
+						if (value != nullptr && HeapObject::IsHostView(value))
+							throw HeapException("Host views can't be stored in objects.");
+						HeapObject::Store<refaddr_t>(object, offset, value);
+						_heap->WriteBarrier(object, value);
+					}
+					return true;
+				case Instruction::ldx_i1m:
+					_LoadElement<std::int8_t>(instructionAssemblyReader);
+					return true;
+				case Instruction::ldx_i2m:
+					_LoadElement<std::int16_t>(instructionAssemblyReader);
+					return true;
+				case Instruction::ldx_i4m:
+					_LoadElement<std::int32_t>(instructionAssemblyReader);
+					return true;
+				case Instruction::ldx_i8m:
+					_LoadElement<std::int64_t>(instructionAssemblyReader);
+					return true;
+				case Instruction::ldx_fsm:
+					_LoadElement<float>(instructionAssemblyReader);
+					return true;
+				case Instruction::ldx_fdm:
+					_LoadElement<double>(instructionAssemblyReader);
+					return true;
+				case Instruction::stx_i1m:
+					_StoreElement<std::int8_t>(instructionAssemblyReader);
+					return true;
+				case Instruction::stx_i2m:
+					_StoreElement<std::int16_t>(instructionAssemblyReader);
+					return true;
+				case Instruction::stx_i4m:
+					_StoreElement<std::int32_t>(instructionAssemblyReader);
+					return true;
+				case Instruction::stx_i8m:
+					_StoreElement<std::int64_t>(instructionAssemblyReader);
+					return true;
+				case Instruction::stx_fsm:
+					_StoreElement<float>(instructionAssemblyReader);
+					return true;
+				case Instruction::stx_fdm:
+					_StoreElement<double>(instructionAssemblyReader);
+					return true;
+				case Instruction::fill_i1m:
+					_Fill<std::int8_t>(instructionAssemblyReader);
+					return true;
+				case Instruction::fill_i2m:
+					_Fill<std::int16_t>(instructionAssemblyReader);
+					return true;
+				case Instruction::fill_i4m:
+					_Fill<std::int32_t>(instructionAssemblyReader);
+					return true;
+				case Instruction::fill_i8m:
+					_Fill<std::int64_t>(instructionAssemblyReader);
+					return true;
+				case Instruction::fill_fsm:
+					_Fill<float>(instructionAssemblyReader);
+					return true;
+				case Instruction::fill_fdm:
+					_Fill<double>(instructionAssemblyReader);
+					return true;
+				case Instruction::len_m:
+					{
+						Register mId;
+						instructionAssemblyReader.IndexedAccess(mId);
+						_runtimeStack->Push<std::int32_t>(
+							static_cast<std::int32_t>(HeapObject::GetSize(_registerSet->GetMRegister(_CheckMRegister(mId)))));
+					}
+					return true;
+				case Instruction::copy_m:
+					{
+						Register destinationMId, sourceMId;
+						instructionAssemblyReader.CopyM(destinationMId, sourceMId);
+						std::int32_t size = _runtimeStack->Pop<std::int32_t>();
+						std::int32_t sourceOffset = _runtimeStack->Pop<std::int32_t>();
+						std::int32_t destinationOffset = _runtimeStack->Pop<std::int32_t>();
+						HeapObject::Copy(_registerSet->GetMRegister(_CheckMRegister(destinationMId)), destinationOffset,
+							_registerSet->GetMRegister(_CheckMRegister(sourceMId)), sourceOffset, size);
+					}
+					return true;
+				case Instruction::push_vr:
+				case Instruction::set_vr:
+				case Instruction::add_v:
+				case Instruction::sub_v:
+				case Instruction::mul_v:
+				case Instruction::min_v:
+				case Instruction::max_v:
+				case Instruction::cmpeq_v:
+				case Instruction::cmplt_v:
+				case Instruction::blend_v:
+				case Instruction::splat_v:
+				case Instruction::hadd_v:
+				case Instruction::hmin_v:
+				case Instruction::hmax_v:
+				case Instruction::shuffle_v:
+				case Instruction::ldx_vm:
+				case Instruction::stx_vm:
+					_ExecuteVectorInstruction(instruction, instructionAssemblyReader);
+					return true;
+				case Instruction::cmpeq_i4:
+				case Instruction::cmpne_i4:
+				case Instruction::cmplt_i4:
+				case Instruction::cmple_i4:
+				case Instruction::cmpgt_i4:
+				case Instruction::cmpge_i4:
+					{
+						instructionAssemblyReader.Compare();
+						_registerSet->SetCPRegister(_CompareI4(instruction));
+					}
+					return true;
+				case Instruction::jmp:
+					{
+						std::int32_t offset;
+						instructionAssemblyReader.Branch(offset);
+						_Branch(bufferIterator, offset);
+					}
+					return true;
+				case Instruction::jt:
+				case Instruction::jf:
+					{
+						std::int32_t offset;
+						instructionAssemblyReader.Branch(offset);
+						if (_registerSet->GetCPRegister() == (instruction == Instruction::jt))
+							_Branch(bufferIterator, offset);
+					}
+					return true;
+				case Instruction::jeq_i4:
+				case Instruction::jne_i4:
+				case Instruction::jlt_i4:
+				case Instruction::jle_i4:
+				case Instruction::jgt_i4:
+				case Instruction::jge_i4:
+					{
+						std::int32_t offset;
+						instructionAssemblyReader.Branch(offset);
+						bool taken = _CompareI4(instruction);
+						_registerSet->SetCPRegister(taken);
+						if (taken)
+							_Branch(bufferIterator, offset);
+					}
+					return true;
+				case Instruction::djnz_i4r:
+					{
+						Register rId;
+						std::int32_t offset;
+						instructionAssemblyReader.DjnzI4R(rId, offset);
+						std::int32_t value = static_cast<std::int32_t>(_registerSet->GetRRegister(_CheckRRegister(rId))) - 1;
+						_registerSet->SetRRegister(rId, value);
+						if (value != 0)
+							_Branch(bufferIterator, offset);
+					}
+					return true;
+				case Instruction::send:
+				case Instruction::recv:
+				case Instruction::send_m:
+				case Instruction::recv_m:
+					return _ExecuteChannelInstruction(instruction, instructionAssemblyReader);
+				case Instruction::pmap:
+					_ExecuteParallelMap(instructionAssemblyReader);
+					return true;
+				case Instruction::set_spr:
+					{
+						Register spId;
+						instructionAssemblyReader.SetSpR(spId);
+						_registerSet->SetSPRegister(spId, _runtimeStack->GetCurrentAddress());
+					}
+					return true;
+				case Instruction::ld_i1s:
+					_LoadFromFrame<std::int8_t>(instructionAssemblyReader);
+					return true;
+				case Instruction::ld_i2s:
+					_LoadFromFrame<std::int16_t>(instructionAssemblyReader);
+					return true;
+				case Instruction::ld_i4s:
+					_LoadFromFrame<std::int32_t>(instructionAssemblyReader);
+					return true;
+				case Instruction::ld_i8s:
+					_LoadFromFrame<std::int64_t>(instructionAssemblyReader);
+					return true;
+				case Instruction::ld_fss:
+					_LoadFromFrame<float>(instructionAssemblyReader);
+					return true;
+				case Instruction::ld_fds:
+					_LoadFromFrame<double>(instructionAssemblyReader);
+					return true;
+				case Instruction::ld_rfs:
+					_LoadFromFrame<refaddr_t>(instructionAssemblyReader);
+					return true;
+				case Instruction::st_i1s:
+					_StoreToFrame<std::int8_t>(instructionAssemblyReader);
+					return true;
+				case Instruction::st_i2s:
+					_StoreToFrame<std::int16_t>(instructionAssemblyReader);
+					return true;
+				case Instruction::st_i4s:
+					_StoreToFrame<std::int32_t>(instructionAssemblyReader);
+					return true;
+				case Instruction::st_i8s:
+					_StoreToFrame<std::int64_t>(instructionAssemblyReader);
+					return true;
+				case Instruction::st_fss:
+					_StoreToFrame<float>(instructionAssemblyReader);
+					return true;
+				case Instruction::st_fds:
+					_StoreToFrame<double>(instructionAssemblyReader);
+					return true;
+				case Instruction::st_rfs:
+					_StoreToFrame<refaddr_t>(instructionAssemblyReader);
+					return true;
+				case Instruction::dup:
+				case Instruction::swap:
+				case Instruction::pick:
+				case Instruction::drop_n:
+					_ExecuteStackInstruction(instruction, instructionAssemblyReader);
+					return true;
+				case Instruction::ld_k:
+				case Instruction::ldx_k:
+				case Instruction::alloc_k:
+					_ExecuteConstantInstruction(instruction, instructionAssemblyReader);
+					return true;
+				case Instruction::brk4:
+				case Instruction::brk8:
+				case Instruction::brk12:
+				case Instruction::brk16:
+				case Instruction::brk20:
+				case Instruction::brk24:
+					return _ExecuteBreakpoint(bufferIterator);
 				default:
 					throw RuntimeException("Unsupported instruction.");
 				}
@@ -81,39 +1131,318 @@ namespace Nova {
 			scoperef_t scopeId
 			) {
 				RuntimeScope & scope = _scopeManager->GetScope(scopeId);
+				// Verified scopes trust the references in their frame, so they only call verified scopes,
+				// and unverified scopes can't pass them references. The start scope is called by the host.
+				bool verifiedCaller = !_frames.empty() && _frames.back().Version->IsVerified();
+				if (!scope.IsLoaded() || (verifiedCaller && !scope.IsVerified()))
+					ScopeVerifier(* _scopeManager).Verify(scope);
+				if (!_frames.empty() && !verifiedCaller && scope.IsVerified() && scope.GetSignature().HasReferenceParameters())
+					throw RuntimeException("Unverified scopes can't pass references to verified scopes.");
 				DynamicBuffer::ConstIterator bufferIterator = scope.GetCodeBuffer().GetConstIterator();
-					
+
+				CallFrame frame;
+				frame.Scope = scopeId;
+				frame.Version = &scope;
+				frame.InstructionOffset = 0;
+				frame.StackBase = _runtimeStack->GetCurrentAddress();
+				if (scope.IsVerified())
+					frame.StackBase -= scope.GetSignature().GetParametersSize();
+				frame.RestoresSPRegisters = !scope.IsVerified() || scope.SetsFrameRegisters();
+				if (frame.RestoresSPRegisters) {
+					for (int i = 0; i < 6; ++i)
+						frame.SPRegisters[i] = _registerSet->GetSPRegister(static_cast<Register>(static_cast<int>(Register::sp0) + i));
+				}
+
+				_frames.push_back(frame);
+				_ExecuteFrame(_frames.size() - 1, bufferIterator);
+			}
+
+		/// <summary>
+		/// Runs the scope of a frame from the iterator. The frame is removed when the scope returns, and
+		/// kept if the context is suspended.
+		/// </summary>
+		inline void _ExecuteFrame(
+			size_t frameIndex, DynamicBuffer::ConstIterator & bufferIterator
+			) {
 				AssemblyReader assemblyReader;
+				std::uint64_t retired = 0;
 				while (bufferIterator.HasData()) {
+					++retired;
+					_frames[frameIndex].InstructionOffset = bufferIterator.GetOffset();
 					Instruction instruction = assemblyReader.GetInstructionId(bufferIterator);
-					if (!_ExecuteInstruction(instruction, InstructionAssemblyReader(assemblyReader, bufferIterator)))
-						break;
+					InstructionAssemblyReader instructionAssemblyReader(assemblyReader, bufferIterator);
 					assemblyReader.GoNextInstruction(bufferIterator);
+					if (!_ExecuteInstruction(instruction, instructionAssemblyReader, bufferIterator))
+						break;
+				}
+
+				// Verified frames count all the stack they can use, not only what this run used.
+				const CallFrame & frame = _frames[frameIndex];
+				size_t depth = _runtimeStack->GetCurrentAddress() - _runtimeStack->GetBaseAddress();
+				if (frame.Version->IsVerified())
+					depth = std::max(depth, static_cast<size_t>(frame.StackBase - _runtimeStack->GetBaseAddress()) + frame.Version->GetMaxStackUsage());
+				Internal::MetricsShard & shard = _scopeManager->GetMetrics().GetShard();
+				shard.AddInstructions(retired);
+				shard.UpdateStackDepth(depth);
+
+				if (_suspended)
+					return;
+				if (frame.RestoresSPRegisters) {
+					for (int i = 0; i < 6; ++i)
+						_registerSet->SetSPRegister(static_cast<Register>(static_cast<int>(Register::sp0) + i), frame.SPRegisters[i]);
+				}
+				_frames.pop_back();
+			}
+
+		/// <summary>
+		/// Continues a suspended frame. Its callee is resumed first, and the frame goes on after the
+		/// call once the callee returns; the innermost frame runs its instruction again.
+		/// </summary>
+		inline void _ResumeFrame(
+			size_t frameIndex
+			) {
+				DynamicBuffer::ConstIterator bufferIterator = _frames[frameIndex].Version->GetCodeBuffer().GetConstIterator();
+				bufferIterator.Seek(_frames[frameIndex].InstructionOffset);
+				if (frameIndex + 1 < _frames.size()) {
+					_ResumeFrame(frameIndex + 1);
+					if (_suspended)
+						return;
+					AssemblyReader().GoNextInstruction(bufferIterator);
 				}
+				_ExecuteFrame(frameIndex, bufferIterator);
 			}
 
 	public:
+		/// <summary>
+		/// Creates a new context over the specified resources.
+		/// </summary>
+		/// <param name='heap'>Heap for the objects created by the context. If null, the context uses a
+		/// region heap which is released at the end of every run.</param>
+		/// <param name='ownsResources'>If true, the stack, the register set, the scope manager and the
+		/// heap are released with the context. Contexts embedded in a pool share the scope manager and
+		/// keep their stack and registers in the pool block, so they don't own them.</param>
 		inline RuntimeContext(
 			RuntimeFixedStack * runtimeStack,
 			RegisterSet * registerSet,
 			RuntimeScopeManager * scopeManager,
-			scoperef_t startScope
+			scoperef_t startScope,
+			IRuntimeHeap * heap = nullptr,
+			bool ownsResources = true
 			)
 			: _runtimeStack(runtimeStack), _registerSet(registerSet),
-			  _scopeManager(scopeManager), _startScope(startScope)
+			  _scopeManager(scopeManager), _startScope(startScope),
+			  _ownsResources(ownsResources), _suspended(false), _heap(heap != nullptr ? heap : &_regionHeap),
+			  _extension(nullptr)
 			{
+				_heap->SetRootEnumerator(this);
+				_heap->SetMetrics(&_scopeManager->GetMetrics());
+				_scopeManager->RegisterReader(&_scopeReader);
+				_scopeManager->GetMetrics().GetShard().AddContextAllocation();
+			}
+
+		virtual ~RuntimeContext(
+			) {
+				_scopeManager->UnregisterReader(&_scopeReader);
+				_heap->SetRootEnumerator(nullptr);
+				_heap->SetMetrics(nullptr);
+				delete _extension;
+				if (_ownsResources) {
+					delete _runtimeStack;
+					delete _registerSet;
+					delete _scopeManager;
+					if (_heap != &_regionHeap)
+						delete _heap;
+				}
+			}
+
+		/// <summary>
+		/// Clears the stack, the registers and the host views, so the context can be reused to run a
+		/// new scope.
+		/// </summary>
+		/// <param name='startScope'>Scope executed by the next call to Run.</param>
+		inline void Reset(
+			scoperef_t startScope
+			) {
+				if (_suspended)
+					_FinishRun();
+				_runtimeStack->Reset();
+				_registerSet->Reset();
+				ClearHostViews();
+				_startScope = startScope;
+			}
+
+		/// <summary>
+		/// Exposes a buffer of the host to the scripts without copying it. The returned reference can be
+		/// stored in a memory-address register and accessed with the heap and array instructions.
+		/// </summary>
+		/// <param name='data'>Buffer of the host. It must outlive the view.</param>
+		/// <param name='length'>Number of elements in the buffer.</param>
+		/// <param name='elementType'>Type of the elements, checked by the array instructions.</param>
+		inline refaddr_t RegisterHostView(
+			void * data, size_t length, ValueType elementType, HostViewAccess access
+			) {
+				return _GetExtension().HostViews.Register(data, length, elementType, access);
+			}
+
+		/// <summary>
+		/// Exposes a read-only buffer of the host to the scripts without copying it.
+		/// </summary>
+		inline refaddr_t RegisterHostView(
+			const void * data, size_t length, ValueType elementType
+			) {
+				return RegisterHostView(const_cast<void *>(data), length, elementType, HostViewAccess::ReadOnly);
+			}
+
+		/// <summary>
+		/// Removes the host views registered in the context. References to them can't be used anymore.
+		/// </summary>
+		inline void ClearHostViews(
+			) {
+				if (_extension != nullptr)
+					_extension->HostViews.Clear();
 			}
 
-		inline ~RuntimeContext(
+		/// <summary>
+		/// Delivers the calls to deferred external scopes buffered by the context. Runs do it before
+		/// they return; the callbacks of synchronous external scopes can do it too, so the host gets
+		/// the calls made before them first.
+		/// </summary>
+		inline void FlushDeferredCalls(
 			) {
-				delete _runtimeStack;
-				delete _registerSet;
-				delete _scopeManager;
+				_FlushDeferredCalls();
 			}
 
+		/// <summary>
+		/// Returns the number of calls to deferred external scopes not delivered yet.
+		/// </summary>
+		inline size_t GetDeferredCallCount(
+			) const {
+				return _extension != nullptr ? _extension->DeferredCalls.GetCallCount() : 0;
+			}
+
+		/// <summary>
+		/// Executes the start scope. If the heap releases its objects when the run finishes, as the
+		/// region heap does, the memory-address registers are cleared.
+		/// </summary>
+		/// <remarks>
+		/// If a channel instruction finds its channel full or empty, the run stops and the context is
+		/// suspended: the frames, the stack and the heap are kept until the run is resumed or the
+		/// context reset.
+		/// </remarks>
 		inline void Run(
 			) {
-				_ExecuteScope(_startScope);
+				if (_suspended)
+					throw RuntimeException("The context is suspended. It must be resumed or reset.");
+				_scopeManager->EnterReader(_scopeReader);
+				_scopeManager->GetMetrics().GetShard().AddRun();
+				_Execute(false);
+			}
+
+		/// <summary>
+		/// Continues a suspended run from the channel instruction which stopped it. The context is
+		/// suspended again if the channel still can't be used.
+		/// </summary>
+		inline void Resume(
+			) {
+				if (!_suspended)
+					throw RuntimeException("The context isn't suspended.");
+				_suspended = false;
+				_Execute(true);
+			}
+
+		inline bool IsSuspended(
+			) const {
+				return _suspended;
+			}
+
+		/// <summary>
+		/// Returns the channel a suspended context waits for, or null if it isn't suspended.
+		/// </summary>
+		inline Channel * GetWaitChannel(
+			) const {
+				if (!_suspended)
+					return nullptr;
+				chanref_t channelId;
+				_GetWaitInstruction(channelId);
+				return &_scopeManager->GetChannel(channelId);
+			}
+
+		/// <summary>
+		/// Returns true if the context is suspended and its channel has room or values now.
+		/// </summary>
+		inline bool CanResume(
+			) const {
+				if (!_suspended)
+					return false;
+				chanref_t channelId;
+				Instruction instruction = _GetWaitInstruction(channelId);
+				const Channel & channel = _scopeManager->GetChannel(channelId);
+				return instruction == Instruction::send || instruction == Instruction::send_m
+					? channel.CanSend() : channel.CanReceive();
+			}
+
+		/// <summary>
+		/// Visits the memory-address registers and the references in the frames of the active scopes,
+		/// located through the stack maps built by the verifier.
+		/// </summary>
+		inline void EnumerateRoots(
+			IHeapRootVisitor & visitor
+			) {
+				// All the frames are checked before visiting any root, so a failure doesn't leave the
+				// heap partially collected.
+				for (auto & frame : _frames) {
+					const RuntimeScope & scope = * frame.Version;
+					if (!scope.IsVerified())
+						throw HeapException("The heap can't be collected while running scopes without stack maps.");
+					if (scope.GetStackMap().Find(frame.InstructionOffset) == nullptr)
+						throw HeapException("The heap can't be collected outside of a safepoint.");
+				}
+
+				for (int i = static_cast<int>(Register::m0); i <= static_cast<int>(Register::m3); ++i) {
+					refaddr_t value = _registerSet->GetMRegister(static_cast<Register>(i));
+					visitor.VisitRoot(&value);
+					_registerSet->SetMRegister(static_cast<Register>(i), value);
+				}
+
+				for (auto & frame : _frames) {
+					const RuntimeScope & scope = * frame.Version;
+					const ScopeStackMap::Entry * entry = scope.GetStackMap().Find(frame.InstructionOffset);
+					for (auto offset : entry->ReferenceOffsets)
+						visitor.VisitRoot(frame.StackBase + offset);
+				}
+			}
+
+		inline const std::vector<CallFrame> & GetCallFrames(
+			) const {
+				return _frames;
+			}
+
+		inline RuntimeFixedStack & GetRuntimeStack(
+			) {
+				return * _runtimeStack;
+			}
+
+		inline RegisterSet & GetRegisterSet(
+			) {
+				return * _registerSet;
+			}
+
+		/// <summary>
+		/// Returns the metrics of the scope manager, shared by all its contexts.
+		/// </summary>
+		inline EngineMetrics & GetMetrics(
+			) {
+				return _scopeManager->GetMetrics();
+			}
+
+		inline RuntimeScopeManager & GetRuntimeScopeManager(
+			) {
+				return * _scopeManager;
+			}
+
+		inline IRuntimeHeap & GetRuntimeHeap(
+			) {
+				return * _heap;
 			}
 	};
 
@@ -121,13 +1450,14 @@ namespace Nova {
 		RuntimeFixedStack * _runtimeStack;
 		RegisterSet * _registerSet;
 		RuntimeScopeManager * _scopeManager;
+		IRuntimeHeap * _heap;
 		scoperef_t _startScope;
 
 	public:
 		inline RuntimeContextBuilder(
 			)
 			: _runtimeStack(nullptr), _registerSet(nullptr),
-			  _scopeManager(nullptr), _startScope(InvalidScope)
+			  _scopeManager(nullptr), _heap(nullptr), _startScope(InvalidScope)
 			{
 			}
 
@@ -152,6 +1482,13 @@ namespace Nova {
 				return * this;
 			}
 		
+		inline RuntimeContextBuilder & SetRuntimeHeap(
+			IRuntimeHeap * heap
+			) {
+				_heap = heap;
+				return * this;
+			}
+
 		inline RuntimeContextBuilder & SetStartScope(
 			scoperef_t startScope
 			) {
@@ -162,7 +1499,7 @@ namespace Nova {
 		inline RuntimeContext * Build(
 			) {
 				return new RuntimeContext(
-					_runtimeStack, _registerSet, _scopeManager, _startScope);
+					_runtimeStack, _registerSet, _scopeManager, _startScope, _heap);
 			}
 	};
 }
@@ -0,0 +1,634 @@
+//
+// runtime-heap.hpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#ifndef _NOVA_RUNTIME_ENVIRONMENT_RUNTIME_HEAP_HEADER_
+#define _NOVA_RUNTIME_ENVIRONMENT_RUNTIME_HEAP_HEADER_
+
+#include "..\common\exception.hpp"
+#include "..\common\platform.hpp"
+#include "..\common\type-traits.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace Nova {
+
+	INHERIT_EXCEPTION(HeapException, RuntimeException)
+
+	class EngineMetrics;
+
+	namespace Internal {
+		/// <summary>
+		/// Header stored before the data of every object in the heap. References point to the data.
+		/// </summary>
+		/// <remarks>
+		/// The data is padded to 8 bytes and followed by a bitmap with one bit per reference-sized slot,
+		/// set when the slot holds a reference. Collectors use it to find references precisely.
+		/// </remarks>
+		struct HeapObjectHeader {
+			std::uint32_t Size;
+			std::uint32_t Flags;
+		};
+
+		enum HeapObjectFlags {
+			HeapObjectHasReferences = 1,
+			HeapObjectOld = 2,
+			HeapObjectMarked = 4,
+			HeapObjectForwarded = 8,
+			HeapObjectRemembered = 16,
+			HeapObjectHostView = 32
+		};
+
+		/// <summary>
+		/// Description of a host view. Its data isn't stored in the heaps, so it isn't managed by them.
+		/// The generation changes every time the view is cleared.
+		/// </summary>
+		struct HostView {
+			std::int8_t * Data;
+			size_t Size;
+			ValueType ElementType;
+			bool Writable;
+			std::uint32_t Generation;
+		};
+
+		/// <summary>
+		/// Data of the objects referenced by the scripts to use a host view. It's tagged with the
+		/// generation of the view it was created for, so references kept after the view is cleared
+		/// fail instead of reaching the next view stored in its place.
+		/// </summary>
+		struct HostViewReference {
+			HostView * View;
+			std::uint32_t Generation;
+		};
+
+		/// <summary>
+		/// Block of memory used by the heap for bump-pointer allocation. The data follows the header.
+		/// </summary>
+		struct HeapRegion {
+			HeapRegion * Next;
+			size_t Size;
+		};
+
+		/// <summary>
+		/// Per-thread cache of released regions, so heaps in the same thread recycle their memory
+		/// instead of returning it to the system.
+		/// </summary>
+		class HeapRegionCache {
+			struct State {
+				HeapRegion * FreeRegions;
+				size_t FreeCount;
+			};
+
+			static inline State & _GetState(
+				) {
+					static NOVA_THREAD_LOCAL State state;
+					return state;
+				}
+
+		public:
+			/// <summary>
+			/// Size of the regular regions. Bigger objects get a dedicated region.
+			/// </summary>
+			static const size_t RegionSize = 64 * 1024;
+
+			/// <summary>
+			/// Maximum number of regions kept by each thread.
+			/// </summary>
+			static const size_t MaxCachedRegions = 16;
+
+			static inline HeapRegion * Acquire(
+				size_t size
+				) {
+					State & state = _GetState();
+					if (size <= RegionSize && state.FreeRegions != nullptr) {
+						HeapRegion * region = state.FreeRegions;
+						state.FreeRegions = region->Next;
+						--state.FreeCount;
+						region->Next = nullptr;
+						return region;
+					}
+
+					size_t regionSize = size <= RegionSize ? RegionSize : size;
+					HeapRegion * region = reinterpret_cast<HeapRegion *>(
+						AlignedAllocate(sizeof(HeapRegion) + regionSize, CacheLineSize));
+					region->Next = nullptr;
+					region->Size = regionSize;
+					return region;
+				}
+
+			static inline void Release(
+				HeapRegion * region
+				) {
+					State & state = _GetState();
+					if (region->Size != RegionSize || state.FreeCount >= MaxCachedRegions) {
+						AlignedFree(region);
+						return;
+					}
+
+					region->Next = state.FreeRegions;
+					state.FreeRegions = region;
+					++state.FreeCount;
+				}
+		};
+	}
+
+	/// <summary>
+	/// Access to the layout of the objects stored in the heaps of the engine.
+	/// </summary>
+	class HeapObject {
+		static inline size_t _GetPaddedSize(
+			size_t size
+			) {
+				return size == 0 ? 8 : (size + 7) & ~size_t(7);
+			}
+
+		static inline std::uint8_t * _GetReferenceBitmap(
+			Internal::HeapObjectHeader * header
+			) {
+				return reinterpret_cast<std::uint8_t *>(header + 1) + _GetPaddedSize(header->Size);
+			}
+
+		static inline Internal::HostView * _GetHostView(
+			refaddr_t address
+			) {
+				Internal::HostViewReference * reference = reinterpret_cast<Internal::HostViewReference *>(address);
+				if (reference->Generation != reference->View->Generation)
+					throw HeapException("The host view was cleared.");
+				return reference->View;
+			}
+
+		/// <summary>
+		/// Returns the address of a range of the object data, resolving host views to their buffers.
+		/// </summary>
+		static inline std::int8_t * _GetDataAddress(
+			refaddr_t address, std::int64_t offset, std::int64_t size, bool write
+			) {
+				Internal::HeapObjectHeader * header = GetHeader(address);
+				if (header->Flags & Internal::HeapObjectHostView) {
+					Internal::HostView * view = _GetHostView(address);
+					if (offset < 0 || size < 0 || static_cast<std::uint64_t>(offset + size) > view->Size)
+						throw HeapException("The offset is out of the view bounds.");
+					if (write && !view->Writable)
+						throw HeapException("The view is read-only.");
+					return view->Data + offset;
+				}
+
+				if (offset < 0 || size < 0 || static_cast<std::uint64_t>(offset + size) > header->Size)
+					throw HeapException("The offset is out of the object bounds.");
+				return reinterpret_cast<std::int8_t *>(address) + offset;
+			}
+
+		/// <summary>
+		/// Returns the address of a range of elements, checking the element type of host views.
+		/// </summary>
+		static inline std::int8_t * _GetElementAddress(
+			refaddr_t address, std::int32_t index, ValueType type, size_t count, bool write
+			) {
+				Internal::HeapObjectHeader * header = GetHeader(address);
+				if ((header->Flags & Internal::HeapObjectHostView)
+					&& _GetHostView(address)->ElementType != type)
+					throw HeapException("The element type doesn't match the view.");
+
+				std::int64_t size = static_cast<std::int64_t>(GetValueTypeSize(type));
+				return _GetDataAddress(address, index * size, static_cast<std::int64_t>(count) * size, write);
+			}
+
+		static inline bool _IsReferenceSlot(
+			refaddr_t address, std::int32_t offset
+			) {
+				Internal::HeapObjectHeader * header = GetHeader(address);
+				if ((header->Flags & Internal::HeapObjectHasReferences) == 0)
+					return false;
+				size_t slot = offset / sizeof(refaddr_t);
+				return (_GetReferenceBitmap(header)[slot / 8] & (1 << (slot % 8))) != 0;
+			}
+
+		static inline bool _HasReferences(
+			refaddr_t address, std::int32_t offset, std::int32_t size
+			) {
+				if (IsHostView(address) || (GetHeader(address)->Flags & Internal::HeapObjectHasReferences) == 0)
+					return false;
+				for (std::int32_t slot = offset - offset % sizeof(refaddr_t); slot < offset + size; slot += sizeof(refaddr_t)) {
+					if (_IsReferenceSlot(address, slot))
+						return true;
+				}
+				return false;
+			}
+
+		static inline void _UpdateReferenceBitmap(
+			refaddr_t address, std::int64_t offset, std::int64_t size, bool isReference
+			) {
+				Internal::HeapObjectHeader * header = GetHeader(address);
+				if (!isReference && (header->Flags & Internal::HeapObjectHasReferences) == 0)
+					return;
+				if (size == 0)
+					return;
+
+				std::uint8_t * bitmap = _GetReferenceBitmap(header);
+				size_t first = static_cast<size_t>(offset / sizeof(refaddr_t));
+				size_t last = static_cast<size_t>((offset + size - 1) / sizeof(refaddr_t));
+				for (size_t slot = first; slot <= last; ++slot)
+					bitmap[slot / 8] &= ~(1 << (slot % 8));
+
+				if (isReference) {
+					bitmap[first / 8] |= 1 << (first % 8);
+					header->Flags |= Internal::HeapObjectHasReferences;
+				}
+			}
+
+	public:
+		/// <summary>
+		/// Returns the number of bytes used by an object, including its header and reference bitmap.
+		/// </summary>
+		static inline size_t GetAllocationSize(
+			size_t size
+			) {
+				size_t slots = _GetPaddedSize(size) / sizeof(refaddr_t);
+				size_t bitmapSize = ((slots + 7) / 8 + 7) & ~size_t(7);
+				return sizeof(Internal::HeapObjectHeader) + _GetPaddedSize(size) + bitmapSize;
+			}
+
+		/// <summary>
+		/// Initializes an object in the specified memory block, which must have GetAllocationSize bytes.
+		/// </summary>
+		static inline refaddr_t Initialize(
+			void * memory, size_t size, std::uint32_t flags
+			) {
+				Internal::HeapObjectHeader * header = reinterpret_cast<Internal::HeapObjectHeader *>(memory);
+				header->Size = static_cast<std::uint32_t>(size);
+				header->Flags = flags;
+				memset(header + 1, 0, GetAllocationSize(size) - sizeof(Internal::HeapObjectHeader));
+				return reinterpret_cast<refaddr_t>(header + 1);
+			}
+
+		static inline Internal::HeapObjectHeader * GetHeader(
+			refaddr_t address
+			) {
+				if (address == nullptr)
+					throw HeapException("Null reference.");
+				return reinterpret_cast<Internal::HeapObjectHeader *>(address) - 1;
+			}
+
+		/// <summary>
+		/// Returns the size in bytes of the data of an object, or of the buffer of a host view.
+		/// </summary>
+		static inline size_t GetSize(
+			refaddr_t address
+			) {
+				Internal::HeapObjectHeader * header = GetHeader(address);
+				if (header->Flags & Internal::HeapObjectHostView)
+					return _GetHostView(address)->Size;
+				return header->Size;
+			}
+
+		static inline bool IsHostView(
+			refaddr_t address
+			) {
+				return (GetHeader(address)->Flags & Internal::HeapObjectHostView) != 0;
+			}
+
+		/// <summary>
+		/// Calls the function with the address of every slot of the object holding a reference.
+		/// </summary>
+		template <typename _TyFunction>
+		static inline void ForEachReference(
+			refaddr_t address, _TyFunction function
+			) {
+				Internal::HeapObjectHeader * header = GetHeader(address);
+				if ((header->Flags & Internal::HeapObjectHasReferences) == 0)
+					return;
+
+				std::uint8_t * bitmap = _GetReferenceBitmap(header);
+				size_t slots = _GetPaddedSize(header->Size) / sizeof(refaddr_t);
+				for (size_t slot = 0; slot < slots; ++slot) {
+					if (bitmap[slot / 8] & (1 << (slot % 8)))
+						function(reinterpret_cast<refaddr_t *>(address) + slot);
+				}
+			}
+
+		/// <summary>
+		/// Reads a value stored in an object.
+		/// </summary>
+		/// <param name='address'>Reference to the object.</param>
+		/// <param name='offset'>Offset in bytes inside the object data.</param>
+		template <typename _Ty>
+		static inline _Ty Load(
+			refaddr_t address, std::int32_t offset
+			) {
+				static_assert(EngineTypeTraits<_Ty>::Supported == true,
+					"Type used is not supported by the engine");
+
+				const bool isReference = std::is_same<_Ty, refaddr_t>::value;
+				std::int8_t * field = _GetDataAddress(address, offset, sizeof(_Ty), false);
+				if (isReference && (IsHostView(address) || !_IsReferenceSlot(address, offset))) {
+					std::int64_t raw = 0;
+					memcpy(&raw, field, sizeof(_Ty));
+					if (raw != 0)
+						throw HeapException("The field doesn't hold a reference.");
+				}
+
+				_Ty value;
+				memcpy(&value, field, sizeof(_Ty));
+				return value;
+			}
+
+		/// <summary>
+		/// Stores a value in an object. References must be stored at offsets aligned to their size.
+		/// </summary>
+		/// <param name='address'>Reference to the object.</param>
+		/// <param name='offset'>Offset in bytes inside the object data.</param>
+		/// <param name='value'>Value to be stored.</param>
+		template <typename _Ty>
+		static inline void Store(
+			refaddr_t address, std::int32_t offset, const _Ty & value
+			) {
+				static_assert(EngineTypeTraits<_Ty>::Supported == true,
+					"Type used is not supported by the engine");
+
+				const bool isReference = std::is_same<_Ty, refaddr_t>::value;
+				std::int8_t * field = _GetDataAddress(address, offset, sizeof(_Ty), true);
+				if (isReference && IsHostView(address))
+					throw HeapException("References can't be stored in host views.");
+				if (isReference && offset % sizeof(refaddr_t) != 0)
+					throw HeapException("References must be stored at aligned offsets.");
+
+				memcpy(field, &value, sizeof(_Ty));
+				if (!IsHostView(address))
+					_UpdateReferenceBitmap(address, offset, sizeof(_Ty), isReference);
+			}
+
+		/// <summary>
+		/// Reads the element at the specified index, for objects used as arrays of scalar values.
+		/// Host views check that the type matches their element type.
+		/// </summary>
+		template <typename _Ty>
+		static inline _Ty LoadElement(
+			refaddr_t address, std::int32_t index
+			) {
+				_Ty value;
+				memcpy(&value, _GetElementAddress(address, index, EngineTypeTraits<_Ty>::Type, 1, false), sizeof(_Ty));
+				return value;
+			}
+
+		/// <summary>
+		/// Stores the element at the specified index, for objects used as arrays of scalar values.
+		/// </summary>
+		template <typename _Ty>
+		static inline void StoreElement(
+			refaddr_t address, std::int32_t index, const _Ty & value
+			) {
+				memcpy(_GetElementAddress(address, index, EngineTypeTraits<_Ty>::Type, 1, true), &value, sizeof(_Ty));
+				if (!IsHostView(address))
+					_UpdateReferenceBitmap(address, static_cast<std::int64_t>(index) * sizeof(_Ty), sizeof(_Ty), false);
+			}
+
+		/// <summary>
+		/// Reads consecutive elements of the specified type, such as the lanes of a vector.
+		/// </summary>
+		static inline void LoadElements(
+			refaddr_t address, std::int32_t index, ValueType type, size_t count, void * values
+			) {
+				memcpy(values, _GetElementAddress(address, index, type, count, false), count * GetValueTypeSize(type));
+			}
+
+		/// <summary>
+		/// Stores consecutive elements of the specified type, such as the lanes of a vector.
+		/// </summary>
+		static inline void StoreElements(
+			refaddr_t address, std::int32_t index, ValueType type, size_t count, const void * values
+			) {
+				size_t size = count * GetValueTypeSize(type);
+				memcpy(_GetElementAddress(address, index, type, count, true), values, size);
+				if (!IsHostView(address))
+					_UpdateReferenceBitmap(address, static_cast<std::int64_t>(index) * GetValueTypeSize(type), size, false);
+			}
+
+		/// <summary>
+		/// Stores a value in a range of elements.
+		/// </summary>
+		template <typename _Ty>
+		static inline void Fill(
+			refaddr_t address, std::int32_t start, std::int32_t count, const _Ty & value
+			) {
+				if (count < 0)
+					throw HeapException("The count can't be negative.");
+				if (count == 0)
+					return;
+
+				// The range is checked in 64 bits, so start + count can't wrap around.
+				_Ty * elements = reinterpret_cast<_Ty *>(_GetElementAddress(address, start, EngineTypeTraits<_Ty>::Type, count, true));
+				if (sizeof(_Ty) == 1) {
+					memset(elements, * reinterpret_cast<const std::int8_t *>(&value), count);
+				} else if (reinterpret_cast<size_t>(elements) % sizeof(_Ty) == 0) {
+					for (std::int32_t i = 0; i < count; ++i)
+						elements[i] = value;
+				} else {
+					for (std::int32_t i = 0; i < count; ++i)
+						memcpy(reinterpret_cast<std::int8_t *>(elements) + i * sizeof(_Ty), &value, sizeof(_Ty));
+				}
+
+				if (!IsHostView(address))
+					_UpdateReferenceBitmap(address, static_cast<std::int64_t>(start) * static_cast<std::int64_t>(sizeof(_Ty)),
+						static_cast<std::int64_t>(count) * static_cast<std::int64_t>(sizeof(_Ty)), false);
+			}
+
+		/// <summary>
+		/// Copies a range of bytes between objects or views. The ranges may overlap. References can't
+		/// be copied.
+		/// </summary>
+		static inline void Copy(
+			refaddr_t destination, std::int32_t destinationOffset,
+			refaddr_t source, std::int32_t sourceOffset, std::int32_t size
+			) {
+				const std::int8_t * sourceData = _GetDataAddress(source, sourceOffset, size, false);
+				std::int8_t * destinationData = _GetDataAddress(destination, destinationOffset, size, true);
+				if (size == 0)
+					return;
+
+				if (_HasReferences(source, sourceOffset, size))
+					throw HeapException("References can't be copied.");
+
+				memmove(destinationData, sourceData, size);
+				if (!IsHostView(destination))
+					_UpdateReferenceBitmap(destination, destinationOffset, size, false);
+			}
+
+		/// <summary>
+		/// Returns the address of a range of bytes of an object or view, so it can be copied in or out
+		/// without an intermediate buffer. The range can't hold references.
+		/// </summary>
+		static inline std::int8_t * GetBytes(
+			refaddr_t address, std::int32_t offset, std::int32_t size, bool write
+			) {
+				std::int8_t * data = _GetDataAddress(address, offset, size, write);
+				if (_HasReferences(address, offset, size))
+					throw HeapException("The range holds references.");
+				return data;
+			}
+	};
+
+	/// <summary>
+	/// Receives the address of every root slot during a collection. Slots in the stack aren't aligned.
+	/// </summary>
+	class IHeapRootVisitor {
+	public:
+		virtual void VisitRoot(void * slot) = 0;
+	};
+
+	/// <summary>
+	/// Source of the roots of a heap, usually the context that owns it.
+	/// </summary>
+	class IHeapRootEnumerator {
+	public:
+		virtual void EnumerateRoots(IHeapRootVisitor & visitor) = 0;
+	};
+
+	/// <summary>
+	/// Heap used by a context for the objects referenced by the memory-address registers.
+	/// </summary>
+	class IRuntimeHeap {
+	public:
+		virtual ~IRuntimeHeap() {}
+
+		/// <summary>
+		/// Allocates a new zero-filled object. It may collect the heap, so it's a safepoint.
+		/// </summary>
+		virtual refaddr_t Allocate(size_t size) = 0;
+
+		/// <summary>
+		/// Notifies the heap that a reference was stored in an object.
+		/// </summary>
+		virtual void WriteBarrier(refaddr_t object, refaddr_t value) = 0;
+
+		virtual void SetRootEnumerator(IHeapRootEnumerator * enumerator) = 0;
+
+		/// <summary>
+		/// Sets the metrics where the heap records its collections, or null to stop recording them.
+		/// </summary>
+		virtual void SetMetrics(EngineMetrics * metrics) = 0;
+
+		/// <summary>
+		/// Called by the context when a run finishes. Returns true if all the objects were released.
+		/// </summary>
+		virtual bool OnRunFinished() = 0;
+	};
+
+	/// <summary>
+	/// Heap for the objects referenced by the memory-address registers.
+	/// </summary>
+	/// <remarks>
+	/// Objects are allocated by bumping a pointer inside regions taken from a per-thread cache, and
+	/// they are never released one by one; the whole heap is released in bulk by Release, which the
+	/// context calls when a run finishes.
+	/// </remarks>
+	class RuntimeHeap : public IRuntimeHeap {
+		Internal::HeapRegion * _regions;
+		std::int8_t * _current;
+		std::int8_t * _end;
+		size_t _allocatedBytes;
+
+		static inline std::int8_t * _GetRegionData(
+			Internal::HeapRegion * region
+			) {
+				return reinterpret_cast<std::int8_t *>(region + 1);
+			}
+
+		inline void _AddRegion(
+			size_t size
+			) {
+				Internal::HeapRegion * region = Internal::HeapRegionCache::Acquire(size);
+				region->Next = _regions;
+				_regions = region;
+				_current = _GetRegionData(region);
+				_end = _current + region->Size;
+			}
+
+	public:
+		/// <summary>
+		/// Maximum size of a single object.
+		/// </summary>
+		static const size_t MaxObjectSize = 0x7FFFFFF0;
+
+		inline RuntimeHeap(
+			)
+			: _regions(nullptr), _current(nullptr), _end(nullptr), _allocatedBytes(0)
+			{
+			}
+
+		inline ~RuntimeHeap(
+			) {
+				Release();
+			}
+
+		/// <summary>
+		/// Allocates a new zero-filled object.
+		/// </summary>
+		/// <param name='size'>Size in bytes of the object data.</param>
+		inline refaddr_t Allocate(
+			size_t size
+			) {
+				if (size > MaxObjectSize)
+					throw HeapException("The object is too big.");
+
+				size_t totalSize = HeapObject::GetAllocationSize(size);
+				if (static_cast<size_t>(_end - _current) < totalSize)
+					_AddRegion(totalSize);
+
+				void * memory = _current;
+				_current += totalSize;
+				_allocatedBytes += totalSize;
+				return HeapObject::Initialize(memory, size, 0);
+			}
+
+		inline void WriteBarrier(
+			refaddr_t /*object*/, refaddr_t /*value*/
+			) {
+			}
+
+		inline void SetRootEnumerator(
+			IHeapRootEnumerator * /*enumerator*/
+			) {
+			}
+
+		inline void SetMetrics(
+			EngineMetrics * /*metrics*/
+			) {
+			}
+
+		inline bool OnRunFinished(
+			) {
+				Release();
+				return true;
+			}
+
+		/// <summary>
+		/// Releases all the objects of the heap. References to them are invalid after this call.
+		/// </summary>
+		inline void Release(
+			) {
+				while (_regions != nullptr) {
+					Internal::HeapRegion * region = _regions;
+					_regions = region->Next;
+					Internal::HeapRegionCache::Release(region);
+				}
+				_current = _end = nullptr;
+				_allocatedBytes = 0;
+			}
+
+		/// <summary>
+		/// Returns the number of bytes allocated since the last release, including object headers.
+		/// </summary>
+		inline size_t GetAllocatedBytes(
+			) const {
+				return _allocatedBytes;
+			}
+	};
+
+} // namespace Nova
+
+#endif // !_NOVA_RUNTIME_ENVIRONMENT_RUNTIME_HEAP_HEADER_
\ No newline at end of file
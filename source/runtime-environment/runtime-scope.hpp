@@ -10,21 +10,231 @@
 
 #include "common\type-traits.hpp"
 #include "common\dynamic-buffer.hpp"
+#include "common\lz-codec.hpp"
+#include "common\object-arena.hpp"
+#include "common\platform.hpp"
+#include "channel.hpp"
+#include "constant-pool.hpp"
+#include "engine-metrics.hpp"
 
 #include <vector>
 #include <functional>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <mutex>
+#include <utility>
 
 namespace Nova {
 
+	/// <summary>
+	/// Types of the values consumed and produced by a scope on the stack.
+	/// </summary>
+	class ScopeSignature {
+		std::vector<ValueType> _parameters;
+		std::vector<ValueType> _results;
+
+		static inline size_t _GetSize(
+			const std::vector<ValueType> & types
+			) {
+				size_t size = 0;
+				for (auto type : types) size += GetValueTypeSize(type);
+				return size;
+			}
+
+	public:
+		inline ScopeSignature(
+			) {
+			}
+
+		/// <param name='parameters'>Types popped by the scope, from the bottom to the top of the stack.</param>
+		/// <param name='results'>Types left by the scope, from the bottom to the top of the stack.</param>
+		inline ScopeSignature(
+			const std::vector<ValueType> & parameters, const std::vector<ValueType> & results
+			)
+			: _parameters(parameters), _results(results)
+			{
+			}
+
+		inline const std::vector<ValueType> & GetParameters(
+			) const {
+				return _parameters;
+			}
+
+		inline const std::vector<ValueType> & GetResults(
+			) const {
+				return _results;
+			}
+
+		inline size_t GetParametersSize(
+			) const {
+				return _GetSize(_parameters);
+			}
+
+		inline size_t GetResultsSize(
+			) const {
+				return _GetSize(_results);
+			}
+
+		inline bool HasReferenceParameters(
+			) const {
+				return std::find(_parameters.begin(), _parameters.end(), ValueType::rf) != _parameters.end();
+			}
+
+		inline bool operator == (
+			const ScopeSignature & other
+			) const {
+				return _parameters == other._parameters && _results == other._results;
+			}
+	};
+
+	/// <summary>
+	/// Locations of the references stored in the stack frame of a scope at every safepoint, that is,
+	/// every instruction where the heap can be collected while the scope is active.
+	/// </summary>
+	/// <remarks>
+	/// Offsets are relative to the base of the frame, which is the address of the first parameter.
+	/// </remarks>
+	class ScopeStackMap {
+	public:
+		struct Entry {
+			size_t InstructionOffset;
+			std::vector<std::uint32_t> ReferenceOffsets;
+		};
+
+	private:
+		std::vector<Entry> _entries;
+
+		struct _EntryComparer {
+			inline bool operator () (
+				const Entry & entry, size_t instructionOffset
+				) const {
+					return entry.InstructionOffset < instructionOffset;
+				}
+		};
+
+	public:
+		/// <summary>
+		/// Adds the entry for a safepoint. Entries must be added in instruction order.
+		/// </summary>
+		inline void AddEntry(
+			size_t instructionOffset, const std::vector<std::uint32_t> & referenceOffsets
+			) {
+				Entry entry;
+				entry.InstructionOffset = instructionOffset;
+				entry.ReferenceOffsets = referenceOffsets;
+				_entries.push_back(entry);
+			}
+
+		/// <summary>
+		/// Returns the entry for the safepoint at the specified offset, or null if it isn't a safepoint.
+		/// </summary>
+		inline const Entry * Find(
+			size_t instructionOffset
+			) const {
+				std::vector<Entry>::const_iterator it = std::lower_bound(
+					_entries.begin(), _entries.end(), instructionOffset, _EntryComparer());
+				if (it == _entries.end() || it->InstructionOffset != instructionOffset)
+					return nullptr;
+				return &* it;
+			}
+
+		inline const std::vector<Entry> & GetEntries(
+			) const {
+				return _entries;
+			}
+
+		inline void Clear(
+			) {
+				_entries.clear();
+			}
+	};
+
+	/// <summary>
+	/// Location in the code written by the host of every instruction of a scope rewritten by the
+	/// engine, such as a scope with inlined calls. Used to report profiles and traces in terms of the
+	/// original scopes.
+	/// </summary>
+	class ScopeOriginMap {
+	public:
+		struct Entry {
+			size_t InstructionOffset;
+			scoperef_t Scope;
+			size_t OriginalOffset;
+		};
+
+	private:
+		std::vector<Entry> _entries;
+
+		struct _EntryComparer {
+			inline bool operator () (
+				const Entry & entry, size_t instructionOffset
+				) const {
+					return entry.InstructionOffset < instructionOffset;
+				}
+		};
+
+	public:
+		/// <summary>
+		/// Adds the origin of an instruction. Entries must be added in instruction order.
+		/// </summary>
+		inline void AddEntry(
+			size_t instructionOffset, scoperef_t scope, size_t originalOffset
+			) {
+				Entry entry;
+				entry.InstructionOffset = instructionOffset;
+				entry.Scope = scope;
+				entry.OriginalOffset = originalOffset;
+				_entries.push_back(entry);
+			}
+
+		/// <summary>
+		/// Returns the origin of the instruction at the specified offset, or null if the scope code
+		/// wasn't rewritten.
+		/// </summary>
+		inline const Entry * Find(
+			size_t instructionOffset
+			) const {
+				std::vector<Entry>::const_iterator it = std::lower_bound(
+					_entries.begin(), _entries.end(), instructionOffset, _EntryComparer());
+				if (it == _entries.end() || it->InstructionOffset != instructionOffset)
+					return nullptr;
+				return &* it;
+			}
+
+		inline bool IsEmpty(
+			) const {
+				return _entries.empty();
+			}
+
+		inline void Clear(
+			) {
+				_entries.clear();
+			}
+	};
+
 	class RuntimeScope {
 		DynamicBuffer _codeBuffer;
 		scoperef_t _id;
+		ScopeSignature _signature;
+		ScopeStackMap _stackMap;
+		ScopeOriginMap _originMap;
+		size_t _maxStackUsage;
+		bool _hasDeclaredSignature;
+		std::atomic<bool> _verified;
+		bool _setsFrameRegisters;
+
+		std::function<void (DynamicBuffer &)> _codeLoader;
+		std::atomic<bool> _loaded;
+		std::mutex _loadMutex;
 
 	public:
 		inline RuntimeScope(
 			scoperef_t id
 			)
-			: _id(id)
+			: _id(id), _maxStackUsage(0), _hasDeclaredSignature(false), _verified(false), _setsFrameRegisters(false),
+			  _loaded(true)
 			{
 			}
 
@@ -37,31 +247,257 @@ namespace Nova {
 			const DynamicBuffer & buffer
 			) {
 				_codeBuffer = buffer;
+				_originMap.Clear();
+				_verified = false;
+				_codeLoader = nullptr;
+				_loaded.store(true, std::memory_order_release);
 			}
 		
 		inline void SetCodeBuffer(
 			DynamicBuffer && buffer
 			) {
-				_codeBuffer = buffer;
+				_codeBuffer = std::move(buffer);
+				_originMap.Clear();
+				_verified = false;
+				_codeLoader = nullptr;
+				_loaded.store(true, std::memory_order_release);
 			}
 		
 		inline const DynamicBuffer & GetCodeBuffer(
 			) const {
 				return _codeBuffer;
 			}
+
+		/// <summary>
+		/// Makes the scope lazy: its code is left wherever the loader reads it from, compressed or not,
+		/// until the scope is first called or started.
+		/// </summary>
+		/// <param name='codeLoader'>Writes the code of the scope to the buffer. It's called once, from
+		/// the thread loading the scope.</param>
+		inline void SetCodeLoader(
+			const std::function<void (DynamicBuffer &)> & codeLoader
+			) {
+				_codeBuffer = DynamicBuffer();
+				_originMap.Clear();
+				_verified = false;
+				_codeLoader = codeLoader;
+				_loaded.store(false, std::memory_order_release);
+			}
+
+		/// <summary>
+		/// Makes the scope lazy, keeping its code compressed with LzCodec until it's loaded.
+		/// </summary>
+		inline void SetCompressedCode(
+			const DynamicBuffer & compressedCode
+			) {
+				SetCodeLoader([compressedCode] (DynamicBuffer & codeBuffer) {
+					LzCodec::Decompress(compressedCode, codeBuffer);
+				});
+			}
+
+		/// <summary>
+		/// Returns false for a lazy scope whose code wasn't loaded yet. Until then, only the declared
+		/// signature of the scope can be used.
+		/// </summary>
+		inline bool IsLoaded(
+			) const {
+				return _loaded.load(std::memory_order_acquire);
+			}
+
+		/// <summary>
+		/// Loads the code of a lazy scope and passes the scope to the link function, which verifies it.
+		/// Concurrent calls wait for the first one, and the scope is loaded once both functions return, so
+		/// a scope failing to load is tried again the next time.
+		/// </summary>
+		template <typename _Fn>
+		inline void Load(
+			const _Fn & link
+			) {
+				std::lock_guard<std::mutex> lock(_loadMutex);
+				if (_loaded.load(std::memory_order_relaxed))
+					return;
+
+				DynamicBuffer codeBuffer;
+				_codeLoader(codeBuffer);
+				_codeBuffer = std::move(codeBuffer);
+				link(* this);
+
+				_codeLoader = nullptr;
+				_loaded.store(true, std::memory_order_release);
+			}
+
+		/// <summary>
+		/// Moves the code to memory owned by the scope manager, which must hold the same bytes. The
+		/// verification and the origins of the code are kept.
+		/// </summary>
+		inline void RelocateCode(
+			const void * code
+			) {
+				_codeBuffer = DynamicBuffer::CreateView(code, _codeBuffer.GetSize());
+			}
+
+		/// <summary>
+		/// Sets the origin of the instructions of the code, after the engine rewrote it.
+		/// </summary>
+		inline void SetOriginMap(
+			const ScopeOriginMap & originMap
+			) {
+				_originMap = originMap;
+			}
+
+		inline const ScopeOriginMap & GetOriginMap(
+			) const {
+				return _originMap;
+			}
+
+		/// <summary>
+		/// Declares the signature of the scope. Scopes without a declared signature get the one inferred
+		/// by the verifier; recursive scopes must declare it.
+		/// </summary>
+		inline void SetSignature(
+			const ScopeSignature & signature
+			) {
+				_signature = signature;
+				_hasDeclaredSignature = true;
+				_verified = false;
+			}
+
+		inline bool HasDeclaredSignature(
+			) const {
+				return _hasDeclaredSignature;
+			}
+
+		inline const ScopeSignature & GetSignature(
+			) const {
+				return _signature;
+			}
+
+		/// <summary>
+		/// Stores the results of the verification of the scope code. They're published with the
+		/// verified flag, so threads seeing the scope verified also see them.
+		/// </summary>
+		inline void SetVerificationResult(
+			const ScopeSignature & signature, const ScopeStackMap & stackMap, size_t maxStackUsage,
+			bool setsFrameRegisters
+			) {
+				// A declared signature is read without locks by the verification of the callers.
+				if (!_hasDeclaredSignature)
+					_signature = signature;
+				_stackMap = stackMap;
+				_maxStackUsage = maxStackUsage;
+				_setsFrameRegisters = setsFrameRegisters;
+				_verified.store(true, std::memory_order_release);
+			}
+
+		inline bool IsVerified(
+			) const {
+				return _verified.load(std::memory_order_acquire);
+			}
+
+		inline const ScopeStackMap & GetStackMap(
+			) const {
+				return _stackMap;
+			}
+
+		/// <summary>
+		/// Returns the maximum number of bytes used by the frame of the scope, including its parameters.
+		/// </summary>
+		inline size_t GetMaxStackUsage(
+			) const {
+				return _maxStackUsage;
+			}
+
+		/// <summary>
+		/// Returns true if the verified code uses set_spr, so calls to the scope must restore the
+		/// stack-frame registers of the caller.
+		/// </summary>
+		inline bool SetsFrameRegisters(
+			) const {
+				return _setsFrameRegisters;
+			}
 	};
 
 	class RuntimeFixedStack;
 
+	/// <summary>
+	/// Arguments of the deferred calls made to an external scope, in the order the calls were made.
+	/// </summary>
+	/// <remarks>
+	/// Every call is a record with the arguments laid out as they were in the stack, from the first
+	/// parameter to the last one, so the host can process a column of them with a fixed stride. The
+	/// batch is only valid during the callback.
+	/// </remarks>
+	class ExternalCallBatch {
+		scoperef_t _scope;
+		const std::int8_t * _data;
+		size_t _callCount;
+		size_t _recordSize;
+
+	public:
+		inline ExternalCallBatch(
+			scoperef_t scope, const void * data, size_t callCount, size_t recordSize
+			)
+			: _scope(scope), _data(reinterpret_cast<const std::int8_t *>(data)),
+			  _callCount(callCount), _recordSize(recordSize)
+			{
+			}
+
+		inline scoperef_t GetScope(
+			) const {
+				return _scope;
+			}
+
+		inline size_t GetCallCount(
+			) const {
+				return _callCount;
+			}
+
+		/// <summary>
+		/// Returns the size of the arguments of a call, which is the stride between records.
+		/// </summary>
+		inline size_t GetRecordSize(
+			) const {
+				return _recordSize;
+			}
+
+		inline const std::int8_t * GetRecord(
+			size_t call
+			) const {
+				if (call >= _callCount)
+					throw InvalidArgumentException("The call isn't in the batch.");
+				return _data + call * _recordSize;
+			}
+
+		/// <summary>
+		/// Reads an argument of a call.
+		/// </summary>
+		/// <param name='offset'>Offset of the argument in the record, which is the size of the parameters
+		/// before it.</param>
+		template <typename _Ty>
+		inline _Ty GetArgument(
+			size_t call, size_t offset
+			) const {
+				if (offset > _recordSize || sizeof(_Ty) > _recordSize - offset)
+					throw InvalidArgumentException("The argument isn't in the record.");
+				_Ty value;
+				memcpy(&value, GetRecord(call) + offset, sizeof value);
+				return value;
+			}
+	};
+
 	class ExternalScope {
 		std::function<void (RuntimeFixedStack &)> _callbackFunction;
+		std::function<void (const ExternalCallBatch &)> _batchCallbackFunction;
 		scoperef_t _id;
+		ScopeSignature _signature;
+		bool _hasSignature;
+		size_t _maxBatchSize;
 
 	public:
 		inline ExternalScope(
 			scoperef_t id
 			)
-			: _id(id)
+			: _id(id), _hasSignature(false), _maxBatchSize(0)
 			{
 			}
 
@@ -80,48 +516,556 @@ namespace Nova {
 			) const {
 				return _callbackFunction;
 			}
+
+		/// <summary>
+		/// Declares the values the callback pops and pushes. Scopes calling external scopes without a
+		/// signature can't be verified.
+		/// </summary>
+		inline void SetSignature(
+			const ScopeSignature & signature
+			) {
+				if (IsDeferred())
+					throw InvalidArgumentException("The signature of a deferred scope can't change.");
+				_signature = signature;
+				_hasSignature = true;
+			}
+
+		/// <summary>
+		/// Makes the calls to the scope deferred: xcall pops the arguments to a buffer of the context
+		/// and goes on, and the callback receives the calls in batches, when the batch is full, when
+		/// the context flushes its deferred calls, and when a run finishes or is suspended.
+		/// </summary>
+		/// <remarks>
+		/// Only scopes with side effects for the host can be deferred: the signature must be declared
+		/// first and can't have results, nor reference parameters, which wouldn't be valid later.
+		/// Deferred calls are delivered after the synchronous calls made meanwhile.
+		/// </remarks>
+		/// <param name='maxBatchSize'>Number of calls buffered before the batch is delivered.</param>
+		inline void SetBatchCallbackFunction(
+			const std::function<void (const ExternalCallBatch &)> & callback, size_t maxBatchSize = 1024
+			) {
+				if (!_hasSignature || !_signature.GetResults().empty())
+					throw InvalidArgumentException("Deferred scopes must declare a signature without results.");
+				for (auto type : _signature.GetParameters()) {
+					if (type == ValueType::rf)
+						throw InvalidArgumentException("Deferred scopes can't take references.");
+				}
+				if (maxBatchSize == 0)
+					throw InvalidArgumentException("The batches of a deferred scope can't be empty.");
+				_batchCallbackFunction = callback;
+				_maxBatchSize = maxBatchSize;
+			}
+
+		inline const std::function<void (const ExternalCallBatch &)> & GetBatchCallbackFunction(
+			) const {
+				return _batchCallbackFunction;
+			}
+
+		inline bool IsDeferred(
+			) const {
+				return _maxBatchSize != 0;
+			}
+
+		inline size_t GetMaxBatchSize(
+			) const {
+				return _maxBatchSize;
+			}
+
+		inline bool HasSignature(
+			) const {
+				return _hasSignature;
+			}
+
+		inline const ScopeSignature & GetSignature(
+			) const {
+				return _signature;
+			}
+	};
+
+	namespace Internal {
+		/// <summary>
+		/// Epoch announced by a context or an executor while it reads the scopes of a manager, or zero
+		/// when it doesn't.
+		/// </summary>
+		struct ScopeReader {
+			std::atomic<std::uint32_t> Epoch;
+
+			inline ScopeReader(
+				)
+				: Epoch(0)
+				{
+				}
+		};
+	}
+
+	/// <summary>
+	/// Runs a scope for every element of an array on several threads, for the pmap instruction.
+	/// </summary>
+	class IParallelMapper {
+	public:
+		virtual ~IParallelMapper() {}
+
+		/// <summary>
+		/// Calls a scope with one scalar parameter and one scalar result for every element of the input,
+		/// storing the results in the output. Returns when all the elements are done.
+		/// </summary>
+		/// <param name='signature'>Signature of the current version of the scope.</param>
+		/// <param name='maxParallelism'>Maximum number of threads working on the call, including the
+		/// calling one, or zero for no limit.</param>
+		virtual void Map(scoperef_t scopeId, const ScopeSignature & signature, const void * input, void * output,
+			size_t count, size_t maxParallelism) = 0;
 	};
 
+	class RuntimeContext;
+
+	/// <summary>
+	/// Debugger attached to the scopes of a manager, which patches breakpoint traps into their code.
+	/// </summary>
+	class IScopeDebugger {
+	public:
+		virtual ~IScopeDebugger() {}
+
+		/// <summary>
+		/// Called by a context reaching a trap, before the original instruction runs. Returns the
+		/// version of the scope the frame goes on with, which must have the layout of its current one.
+		/// </summary>
+		virtual const RuntimeScope * OnBreakpoint(RuntimeContext & context) = 0;
+
+		/// <summary>
+		/// Returns the code of a patched scope without the traps.
+		/// </summary>
+		virtual const DynamicBuffer & GetOriginalCode(scoperef_t scope) = 0;
+	};
+
+	/// <summary>
+	/// Owner of the scopes of a program.
+	/// </summary>
+	/// <remarks>
+	/// <para>New versions of a scope can be published while contexts run it: running invocations finish
+	/// on the version they started, and new ones get the new version. The versions replaced are
+	/// reclaimed once no reader that could have seen them is still running.</para>
+	/// <para>Readers announce the epoch of the manager when they start and clear it when they finish;
+	/// a version replaced in an epoch is released when every reader is idle or started in a later one.
+	/// Getting a scope only loads a pointer, so the dispatch of calls doesn't take any lock.</para>
+	/// <para>Epochs are odd 32-bit numbers, so zero is never one, and they're compared as serial
+	/// numbers: a run can't last while more than 2^30 versions are published.</para>
+	/// <para>The scopes created by the manager are stored in arenas, and the current versions are
+	/// found through one contiguous table. Scopes must be created before the contexts using the
+	/// manager run, since the table may move when it grows.</para>
+	/// </remarks>
 	class RuntimeScopeManager {
-		std::vector<RuntimeScope *> _scopes;
+		struct _RetiredScope {
+			RuntimeScope * Scope;
+			std::uint32_t Epoch;
+		};
+
+		static const size_t _CodeAlignment = 16;
+
+		ObjectArena<RuntimeScope> _scopeArena;
+		ObjectArena<ExternalScope> _externalScopeArena;
+		std::atomic<RuntimeScope *> * _scopes;
+		size_t _scopeCount;
+		size_t _scopeCapacity;
 		std::vector<ExternalScope *> _externalScopes;
+		std::vector<void *> _codeRegions;
+		std::vector<Channel *> _channels;
+		Internal::ChannelSignal _channelSignal;
+		ConstantPool _constantPool;
+		IParallelMapper * _parallelMapper;
+		IScopeDebugger * _debugger;
+		EngineMetrics _metrics;
+
+		std::atomic<std::uint32_t> _epoch;
+		std::mutex _versionMutex;
+		std::recursive_mutex _verificationMutex;
+		std::vector<Internal::ScopeReader *> _readers;
+		std::vector<_RetiredScope> _retiredScopes;
+
+		static inline bool _HasKnownSignature(
+			const RuntimeScope & scope
+			) {
+				return scope.HasDeclaredSignature() || (scope.IsLoaded() && scope.IsVerified());
+			}
+
+		static inline bool _IsBefore(
+			std::uint32_t epoch, std::uint32_t other
+			) {
+				return static_cast<std::int32_t>(epoch - other) < 0;
+			}
+
+		RuntimeScopeManager(const RuntimeScopeManager &);
+		RuntimeScopeManager & operator = (const RuntimeScopeManager &);
+
+		/// <summary>
+		/// Releases a version, which is either the first one of the scope, stored in the arena, or one
+		/// created by CreateScopeVersion.
+		/// </summary>
+		inline void _ReleaseScope(
+			RuntimeScope * scope
+			) {
+				if (_scopeArena.Owns(scope))
+					_scopeArena.Destroy(scope);
+				else
+					delete scope;
+			}
+
+		inline void _GrowScopeTable(
+			) {
+				size_t capacity = _scopeCapacity != 0 ? _scopeCapacity * 2 : 64;
+				std::atomic<RuntimeScope *> * scopes = new std::atomic<RuntimeScope *>[capacity];
+				for (size_t i = 0; i < _scopeCount; ++i)
+					scopes[i].store(_scopes[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+				delete [] _scopes;
+				_scopes = scopes;
+				_scopeCapacity = capacity;
+			}
+
+		inline size_t _ReclaimScopes(
+			) {
+				std::uint32_t oldestEpoch = 0;
+				for (auto reader : _readers) {
+					std::uint32_t epoch = reader->Epoch.load();
+					if (epoch != 0 && (oldestEpoch == 0 || _IsBefore(epoch, oldestEpoch)))
+						oldestEpoch = epoch;
+				}
+
+				size_t count = 0;
+				for (size_t i = 0; i < _retiredScopes.size(); ) {
+					if (oldestEpoch == 0 || _IsBefore(_retiredScopes[i].Epoch, oldestEpoch)) {
+						_ReleaseScope(_retiredScopes[i].Scope);
+						_retiredScopes[i] = _retiredScopes.back();
+						_retiredScopes.pop_back();
+						++count;
+					} else {
+						++i;
+					}
+				}
+				return count;
+			}
 
 	public:
 		inline RuntimeScopeManager(
-			) {
+			)
+			: _scopes(nullptr), _scopeCount(0), _scopeCapacity(0),
+			  _parallelMapper(nullptr), _debugger(nullptr), _epoch(1)
+			{
 			}
 
 		inline ~RuntimeScopeManager(
 			) {
-				for (auto item : _scopes) delete item;
+				for (size_t i = 0; i < _scopeCount; ++i) _ReleaseScope(_scopes[i].load());
+				for (auto & item : _retiredScopes) _ReleaseScope(item.Scope);
+				delete [] _scopes;
+				for (auto item : _channels) delete item;
+				for (auto item : _codeRegions) AlignedFree(item);
 			}
 
 		inline RuntimeScope & CreateNewScope(
 			) {
-				RuntimeScope * scope = new RuntimeScope(reinterpret_cast<scoperef_t>(_scopes.size()));
-				_scopes.push_back(scope);
+				std::lock_guard<std::mutex> lock(_versionMutex);
+				if (_scopeCount == _scopeCapacity)
+					_GrowScopeTable();
+				RuntimeScope * scope = _scopeArena.Create(reinterpret_cast<scoperef_t>(_scopeCount));
+				_scopes[_scopeCount].store(scope, std::memory_order_release);
+				++_scopeCount;
 				return * scope;
 			}
 		
 		inline ExternalScope & CreateExternalScope(
 			) {
-				ExternalScope * scope = new ExternalScope(reinterpret_cast<scoperef_t>(_externalScopes.size()));
+				ExternalScope * scope = _externalScopeArena.Create(reinterpret_cast<scoperef_t>(_externalScopes.size()));
 				_externalScopes.push_back(scope);
 				return * scope;
 			}
 
+		/// <summary>
+		/// Creates a channel of values of a type, which the scopes of every context can use.
+		/// </summary>
+		inline Channel & CreateChannel(
+			ValueType elementType, size_t capacity, ChannelMode mode = ChannelMode::MultiProducerMultiConsumer
+			) {
+				Channel * channel = new Channel(reinterpret_cast<chanref_t>(_channels.size()), elementType, capacity, mode, &_channelSignal);
+				_channels.push_back(channel);
+				return * channel;
+			}
+
+		/// <summary>
+		/// Creates a channel of byte buffers of a fixed size.
+		/// </summary>
+		inline Channel & CreateChannel(
+			size_t elementSize, size_t capacity, ChannelMode mode = ChannelMode::MultiProducerMultiConsumer
+			) {
+				Channel * channel = new Channel(reinterpret_cast<chanref_t>(_channels.size()), elementSize, capacity, mode, &_channelSignal);
+				_channels.push_back(channel);
+				return * channel;
+			}
+
+		/// <summary>
+		/// Creates a new version of a scope. It's owned by the caller, and not used, until it's published.
+		/// </summary>
+		inline RuntimeScope * CreateScopeVersion(
+			scoperef_t scope
+			) {
+				if (reinterpret_cast<size_t>(scope) >= _scopeCount)
+					throw InvalidArgumentException("The scope doesn't exist.");
+				return new RuntimeScope(scope);
+			}
+
+		/// <summary>
+		/// Replaces the current version of a scope. The callers were verified against its signature, so
+		/// the new version must have the same one if the current one is known: it must be verified or
+		/// declare it.
+		/// </summary>
+		/// <param name='version'>Version created by CreateScopeVersion. The manager takes its ownership.</param>
+		inline void PublishScope(
+			RuntimeScope * version
+			) {
+				std::lock_guard<std::mutex> lock(_versionMutex);
+				std::atomic<RuntimeScope *> & slot = _scopes[reinterpret_cast<size_t>(version->GetId())];
+				RuntimeScope * current = slot.load();
+				if (version == current)
+					throw InvalidArgumentException("The version is already published.");
+				if (_HasKnownSignature(* current)
+					&& (!_HasKnownSignature(* version) || !(version->GetSignature() == current->GetSignature())))
+						throw InvalidArgumentException("The new version of the scope must keep its signature.");
+
+				slot.store(version);
+				_RetiredScope retired;
+				retired.Scope = current;
+				retired.Epoch = _epoch.fetch_add(2);
+				_retiredScopes.push_back(retired);
+				_ReclaimScopes();
+			}
+
+		/// <summary>
+		/// Releases the replaced versions which can't be used anymore. Returns how many were released.
+		/// </summary>
+		inline size_t ReclaimScopes(
+			) {
+				std::lock_guard<std::mutex> lock(_versionMutex);
+				return _ReclaimScopes();
+			}
+
+		/// <summary>
+		/// Returns the number of replaced versions waiting to be released.
+		/// </summary>
+		inline size_t GetRetiredScopeCount(
+			) {
+				std::lock_guard<std::mutex> lock(_versionMutex);
+				return _retiredScopes.size();
+			}
+
+		inline void RegisterReader(
+			Internal::ScopeReader * reader
+			) {
+				std::lock_guard<std::mutex> lock(_versionMutex);
+				_readers.push_back(reader);
+			}
+
+		inline void UnregisterReader(
+			Internal::ScopeReader * reader
+			) {
+				std::lock_guard<std::mutex> lock(_versionMutex);
+				_readers.erase(std::remove(_readers.begin(), _readers.end(), reader), _readers.end());
+			}
+
+		/// <summary>
+		/// Announces that a reader starts using the scopes. The versions it gets stay alive until it
+		/// calls LeaveReader.
+		/// </summary>
+		inline void EnterReader(
+			Internal::ScopeReader & reader
+			) {
+				reader.Epoch.store(_epoch.load());
+				// The scopes must not be read before the epoch is visible to the publishers.
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+			}
+
+		inline void LeaveReader(
+			Internal::ScopeReader & reader
+			) {
+				reader.Epoch.store(0, std::memory_order_release);
+			}
+
+		/// <summary>
+		/// Returns a number which grows every time a new version of a scope is published.
+		/// </summary>
+		inline std::uint32_t GetEpoch(
+			) const {
+				return _epoch.load();
+			}
+
+		inline size_t GetScopeCount(
+			) const {
+				return _scopeCount;
+			}
+
+		/// <summary>
+		/// Copies the code of the current versions of the loaded scopes to one page-aligned region, in
+		/// the order of their ids, so the code of a program is contiguous. Returns the size of the code.
+		/// </summary>
+		/// <remarks>
+		/// The scopes keep their verification and origins, since their code doesn't change. It must be
+		/// called while no context runs. The regions of earlier calls are kept until the manager is
+		/// destroyed, since replaced versions may still use them.
+		/// </remarks>
+		inline size_t PackCode(
+			) {
+				return PackCode(std::vector<scoperef_t>());
+			}
+
+		/// <summary>
+		/// Packs the code of the scopes in the specified order, followed by the other scopes in the order
+		/// of their ids. Calls go through the ids, so they don't change.
+		/// </summary>
+		inline size_t PackCode(
+			const std::vector<scoperef_t> & order
+			) {
+				std::vector<bool> isOrdered(_scopeCount, false);
+				std::vector<scoperef_t> scopes;
+				scopes.reserve(_scopeCount);
+				for (auto scope : order) {
+					size_t index = reinterpret_cast<size_t>(scope);
+					if (index >= _scopeCount)
+						throw InvalidArgumentException("The scope doesn't exist.");
+					if (isOrdered[index])
+						throw InvalidArgumentException("The scope appears twice in the order.");
+					isOrdered[index] = true;
+					scopes.push_back(scope);
+				}
+				for (size_t i = 0; i < _scopeCount; ++i) {
+					if (!isOrdered[i])
+						scopes.push_back(reinterpret_cast<scoperef_t>(i));
+				}
+
+				std::lock_guard<std::mutex> lock(_versionMutex);
+				size_t size = 0;
+				for (auto id : scopes) {
+					const RuntimeScope & scope = * _scopes[reinterpret_cast<size_t>(id)].load();
+					if (scope.IsLoaded())
+						size += (scope.GetCodeBuffer().GetSize() + _CodeAlignment - 1) & ~(_CodeAlignment - 1);
+				}
+				if (size == 0)
+					return 0;
+
+				std::int8_t * region = reinterpret_cast<std::int8_t *>(
+					AlignedAllocate((size + PageSize - 1) & ~(PageSize - 1), PageSize));
+				_codeRegions.push_back(region);
+				size_t offset = 0;
+				for (auto id : scopes) {
+					RuntimeScope & scope = * _scopes[reinterpret_cast<size_t>(id)].load();
+					size_t codeSize = scope.GetCodeBuffer().GetSize();
+					if (!scope.IsLoaded() || codeSize == 0)
+						continue;
+					memcpy(region + offset, scope.GetCodeBuffer().GetPointer(), codeSize);
+					scope.RelocateCode(region + offset);
+					offset += (codeSize + _CodeAlignment - 1) & ~(_CodeAlignment - 1);
+				}
+				return size;
+			}
+
+		inline size_t GetExternalScopeCount(
+			) const {
+				return _externalScopes.size();
+			}
+
+		/// <summary>
+		/// Returns the current version of a scope.
+		/// </summary>
 		inline RuntimeScope & GetScope(
 			scoperef_t scope
 			) {
-				return * _scopes[reinterpret_cast<size_t>(scope)];
+				return * _scopes[reinterpret_cast<size_t>(scope)].load(std::memory_order_acquire);
 			}
 		
 		inline const RuntimeScope & GetScope(
 			scoperef_t scope
 			) const {
-				return * _scopes[reinterpret_cast<size_t>(scope)];
+				return * _scopes[reinterpret_cast<size_t>(scope)].load(std::memory_order_acquire);
 			}
 		
+		inline size_t GetChannelCount(
+			) const {
+				return _channels.size();
+			}
+
+		inline Channel & GetChannel(
+			chanref_t channel
+			) {
+				return * _channels[reinterpret_cast<size_t>(channel)];
+			}
+
+		/// <summary>
+		/// Returns the signal notified by the channels of the manager, used by the schedulers to wait
+		/// for them.
+		/// </summary>
+		inline Internal::ChannelSignal & GetChannelSignal(
+			) {
+				return _channelSignal;
+			}
+
+		/// <summary>
+		/// Returns the constants of the program, which the ld_k, ldx_k and alloc_k instructions of its
+		/// scopes reference.
+		/// </summary>
+		inline ConstantPool & GetConstantPool(
+			) {
+				return _constantPool;
+			}
+
+		inline const ConstantPool & GetConstantPool(
+			) const {
+				return _constantPool;
+			}
+
+		/// <summary>
+		/// Sets the mapper which runs the pmap instructions of the contexts. It isn't owned by the
+		/// manager; without one, the contexts call the scope for every element themselves.
+		/// </summary>
+		inline void SetParallelMapper(
+			IParallelMapper * parallelMapper
+			) {
+				_parallelMapper = parallelMapper;
+			}
+
+		inline IParallelMapper * GetParallelMapper(
+			) const {
+				return _parallelMapper;
+			}
+
+		/// <summary>
+		/// Sets the debugger called by the contexts reaching breakpoint traps. It isn't owned by the
+		/// manager.
+		/// </summary>
+		inline void SetDebugger(
+			IScopeDebugger * debugger
+			) {
+				_debugger = debugger;
+			}
+
+		inline IScopeDebugger * GetDebugger(
+			) const {
+				return _debugger;
+			}
+
+		/// <summary>
+		/// Returns the metrics of the contexts running the scopes of the manager.
+		/// </summary>
+		inline EngineMetrics & GetMetrics(
+			) {
+				return _metrics;
+			}
+
+		/// <summary>
+		/// Returns the mutex held while the scopes of the manager are verified. Verifying a scope
+		/// verifies the callees whose signature isn't known yet, so a single lock for the manager keeps
+		/// threads verifying each other's callees from waiting on each other.
+		/// </summary>
+		inline std::recursive_mutex & GetVerificationMutex(
+			) {
+				return _verificationMutex;
+			}
+
 		inline ExternalScope & GetExternalScope(
 			scoperef_t scope
 			) {
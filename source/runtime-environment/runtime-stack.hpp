@@ -9,6 +9,7 @@
 #define _NOVA_RUNTIME_ENVIRONMENT_RUNTIME_STACK_HEADER_
 
 #include <cstdint>
+#include <cstring>
 
 #include "..\common\exception.hpp"
 #include "..\common\type-traits.hpp"
@@ -41,6 +42,11 @@ namespace Nova {
 		/// </summary>
 		staddr_t _stackEnd;
 
+		/// <summary>
+		/// Indicates if the stack buffer was allocated by the instance and must be released by it.
+		/// </summary>
+		bool _ownsBuffer;
+
 		/// <summary>
 		/// Utility function to validate if the type is supported by the engine.
 		/// </summary>
@@ -71,7 +77,22 @@ namespace Nova {
 		inline RuntimeFixedStack(
 			size_t stackSize
 			)
-			: _stack(new std::int8_t[stackSize]), _stackOffset(_stack), _stackEnd(_stack + stackSize)
+			: _stack(new std::int8_t[stackSize]), _stackOffset(_stack), _stackEnd(_stack + stackSize),
+			  _ownsBuffer(true)
+			{
+			}
+
+		/// <summary>
+		/// Creates a new stack over an external buffer. The buffer isn't released by the stack, so it
+		/// can be embedded in the same allocation as its owner.
+		/// </summary>
+		/// <param name='buffer'>Address of the buffer used as storage.</param>
+		/// <param name='stackSize'>Size of the buffer.</param>
+		inline RuntimeFixedStack(
+			staddr_t buffer, size_t stackSize
+			)
+			: _stack(buffer), _stackOffset(_stack), _stackEnd(_stack + stackSize),
+			  _ownsBuffer(false)
 			{
 			}
 
@@ -80,7 +101,24 @@ namespace Nova {
 		/// </summary>
 		inline ~RuntimeFixedStack(
 			) {
-				delete[] _stack;
+				if (_ownsBuffer)
+					delete[] _stack;
+			}
+
+		/// <summary>
+		/// Removes all the elements from the stack.
+		/// </summary>
+		inline void Reset(
+			) {
+				_stackOffset = _stack;
+			}
+
+		/// <summary>
+		/// Returns the total size of the stack buffer.
+		/// </summary>
+		inline size_t GetSize(
+			) const {
+				return _stackEnd - _stack;
 			}
 
 		/// <summary>
@@ -110,6 +148,14 @@ namespace Nova {
 				* reinterpret_cast<_Ty *>(address) = value;
 			}
 
+		/// <summary>
+		/// Returns the address of the bottom of the stack.
+		/// </summary>
+		inline staddr_t GetBaseAddress(
+			) const {
+				return _stack;
+			}
+
 		/// <summary>
 		/// Returns current offset position of the stack.
 		/// </summary>
@@ -146,6 +192,49 @@ namespace Nova {
 				Set<_Ty>(currentAddress, value);
 			}
 
+		/// <summary>
+		/// Pushes a value whose type is only known at runtime, copying its bytes.
+		/// </summary>
+		/// <param name='value'>Address of the value.</param>
+		/// <param name='size'>Size of the value.</param>
+		inline void PushBytes(
+			const void * value, size_t size
+			) {
+				if (static_cast<size_t>(_stackEnd - _stackOffset) < size)
+					throw StackException("Value can't pushed to stack. Stack remaining space too small.");
+
+				memcpy(_stackOffset, value, size);
+				_stackOffset += size;
+			}
+
+		/// <summary>
+		/// Removes a value whose type is only known at runtime, copying its bytes.
+		/// </summary>
+		/// <param name='value'>Address where the value is copied.</param>
+		/// <param name='size'>Size of the value.</param>
+		inline void PopBytes(
+			void * value, size_t size
+			) {
+				if (static_cast<size_t>(_stackOffset - _stack) < size)
+					throw StackException("Value can't getted from stack. Stack size too small.");
+
+				_stackOffset -= size;
+				memcpy(value, _stackOffset, size);
+			}
+
+		/// <summary>
+		/// Removes values from the top of the stack without reading them.
+		/// </summary>
+		/// <param name='size'>Size of the values.</param>
+		inline void Drop(
+			size_t size
+			) {
+				if (static_cast<size_t>(_stackOffset - _stack) < size)
+					throw StackException("Value can't getted from stack. Stack size too small.");
+
+				_stackOffset -= size;
+			}
+
 		/// <summary>
 		/// Returns the top element of the stack.
 		/// </summary>
@@ -0,0 +1,377 @@
+//
+// scope-debugger.hpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#ifndef _NOVA_RUNTIME_ENVIRONMENT_SCOPE_DEBUGGER_HEADER_
+#define _NOVA_RUNTIME_ENVIRONMENT_SCOPE_DEBUGGER_HEADER_
+
+#include "runtime-context.hpp"
+#include "scope-verifier.hpp"
+#include "assembly.hpp"
+
+#include "..\common\exception.hpp"
+#include "..\common\dynamic-buffer.hpp"
+#include "..\common\type-traits.hpp"
+
+#include <cstdint>
+#include <vector>
+#include <map>
+#include <set>
+#include <mutex>
+#include <functional>
+
+namespace Nova {
+
+	enum class DebugAction {
+		Continue = 0,
+
+		/// <summary>
+		/// Stops the context again before the next instruction of the frame, or the first one of the
+		/// scope it calls.
+		/// </summary>
+		Step
+	};
+
+	/// <summary>
+	/// Instruction where a context stopped.
+	/// </summary>
+	struct BreakpointHit {
+		scoperef_t Scope;
+		size_t InstructionOffset;
+
+		/// <summary>
+		/// Original instruction, which runs once the handler returns.
+		/// </summary>
+		Nova::Instruction Instruction;
+
+		/// <summary>
+		/// True if the context stopped after a step instead of at a breakpoint.
+		/// </summary>
+		bool Step;
+
+		/// <summary>
+		/// Scope and offset where the host wrote the instruction. They're the ones of the hit unless the
+		/// engine rewrote the scope, such as an instruction of an inlined callee.
+		/// </summary>
+		scoperef_t OriginScope;
+		size_t OriginalOffset;
+	};
+
+	/// <summary>
+	/// Debugger which stops the contexts running the scopes of a manager at breakpoints.
+	/// </summary>
+	/// <remarks>
+	/// <para>Breakpoints are set by publishing a copy of the scope code with a trap patched over the
+	/// instruction, whose original is kept by the debugger, so the dispatch of the contexts doesn't
+	/// check anything when no trap is hit. Frames which were already running keep the code they
+	/// started with, so they only stop in the scopes they call.</para>
+	/// <para>The handler is called from the thread of the context, before the instruction runs. It can
+	/// inspect the stack, the registers and the frames of the context, and it may block until the
+	/// user decides how to go on. Stepping stops at the next instruction of the frame, or the first one
+	/// of the scope it calls; stepping past the end of a scope goes on until the next breakpoint.
+	/// Only one context steps at a time.</para>
+	/// <para>Detaching publishes the original code again. The debugger must outlive the frames running
+	/// patched code, and new versions of the scopes can't be published by others while it's attached.</para>
+	/// </remarks>
+	class ScopeDebugger : public IScopeDebugger {
+	public:
+		typedef std::function<DebugAction (RuntimeContext &, const BreakpointHit &)> BreakpointHandler;
+
+	private:
+		struct _PatchedScope {
+			DynamicBuffer Code;
+			std::set<size_t> Breakpoints;
+			std::set<size_t> StepTraps;
+		};
+
+		RuntimeScopeManager & _scopeManager;
+		std::mutex _mutex;
+		std::map<scoperef_t, _PatchedScope *> _scopes;
+		BreakpointHandler _handler;
+		const RuntimeContext * _steppingContext;
+		size_t _hitCount;
+
+		inline _PatchedScope & _GetPatchedScope(
+			scoperef_t scopeId
+			) {
+				std::map<scoperef_t, _PatchedScope *>::iterator it = _scopes.find(scopeId);
+				if (it != _scopes.end())
+					return * it->second;
+
+				if (reinterpret_cast<size_t>(scopeId) >= _scopeManager.GetScopeCount())
+					throw InvalidArgumentException("The scope doesn't exist.");
+				RuntimeScope & scope = _scopeManager.GetScope(scopeId);
+				if (!scope.IsLoaded())
+					ScopeVerifier(_scopeManager).Verify(scope);
+
+				_PatchedScope * patchedScope = new _PatchedScope();
+				patchedScope->Code = scope.GetCodeBuffer();
+				_scopes[scopeId] = patchedScope;
+				return * patchedScope;
+			}
+
+		static inline bool _IsInstructionOffset(
+			const DynamicBuffer & code, size_t offset
+			) {
+				AssemblyReader assemblyReader;
+				DynamicBuffer::ConstIterator bufferIterator = code.GetConstIterator();
+				while (bufferIterator.HasData() && bufferIterator.GetOffset() < offset)
+					assemblyReader.GoNextInstruction(bufferIterator);
+				return bufferIterator.HasData() && bufferIterator.GetOffset() == offset;
+			}
+
+		/// <summary>
+		/// Publishes a copy of the original code with traps over its breakpoints and steps. The copy keeps
+		/// the signature and the verification of the current version, since its layout is the same.
+		/// </summary>
+		inline void _Publish(
+			scoperef_t scopeId, const _PatchedScope & patchedScope
+			) {
+				DynamicBuffer code = patchedScope.Code;
+				AssemblyReader assemblyReader;
+				std::set<size_t> offsets(patchedScope.Breakpoints);
+				offsets.insert(patchedScope.StepTraps.begin(), patchedScope.StepTraps.end());
+				for (auto offset : offsets) {
+					DynamicBuffer::ConstIterator bufferIterator = patchedScope.Code.GetConstIterator();
+					bufferIterator.Seek(offset);
+					Internal::InstructionMemoryStructure::Base trap;
+					trap.Instruction = AssemblyReader::GetBreakpoint(
+						AssemblyReader::GetInstructionSize(assemblyReader.GetInstructionId(bufferIterator)));
+					code.Write(&trap, offset, sizeof trap);
+				}
+
+				const RuntimeScope & current = _scopeManager.GetScope(scopeId);
+				RuntimeScope * version = _scopeManager.CreateScopeVersion(scopeId);
+				version->SetCodeBuffer(std::move(code));
+				if (current.HasDeclaredSignature())
+					version->SetSignature(current.GetSignature());
+				version->SetOriginMap(current.GetOriginMap());
+				if (current.IsVerified())
+					version->SetVerificationResult(current.GetSignature(), current.GetStackMap(), current.GetMaxStackUsage(),
+						current.SetsFrameRegisters());
+				_scopeManager.PublishScope(version);
+			}
+
+		inline void _ClearStepTraps(
+			) {
+				for (auto & item : _scopes) {
+					if (item.second->StepTraps.empty())
+						continue;
+					item.second->StepTraps.clear();
+					_Publish(item.first, * item.second);
+				}
+				_steppingContext = nullptr;
+			}
+
+		/// <summary>
+		/// Sets traps on every instruction which can run after the one of the frame.
+		/// </summary>
+		inline void _SetStepTraps(
+			const RuntimeContext & context, const CallFrame & frame
+			) {
+				const DynamicBuffer & code = _scopes[frame.Scope]->Code;
+				DynamicBuffer::ConstIterator bufferIterator = code.GetConstIterator();
+				bufferIterator.Seek(frame.InstructionOffset);
+				AssemblyReader assemblyReader;
+				Instruction instruction = assemblyReader.GetInstructionId(bufferIterator);
+				size_t end = frame.InstructionOffset + AssemblyReader::GetInstructionSize(instruction);
+
+				std::map<scoperef_t, std::set<size_t>> targets;
+				if (instruction != Instruction::ret && instruction != Instruction::jmp && end < code.GetSize())
+					targets[frame.Scope].insert(end);
+
+				std::int32_t offset = 0;
+				Register registerId;
+				scoperef_t calleeId;
+				if (instruction >= Instruction::jmp && instruction <= Instruction::jge_i4) {
+					assemblyReader.Branch(bufferIterator, offset);
+					targets[frame.Scope].insert(static_cast<size_t>(static_cast<std::int64_t>(end) + offset));
+				} else if (instruction == Instruction::djnz_i4r) {
+					assemblyReader.DjnzI4R(bufferIterator, registerId, offset);
+					targets[frame.Scope].insert(static_cast<size_t>(static_cast<std::int64_t>(end) + offset));
+				} else if (instruction == Instruction::call || instruction == Instruction::pmap) {
+					if (instruction == Instruction::call)
+						assemblyReader.Call(bufferIterator, calleeId);
+					else
+						assemblyReader.PMap(bufferIterator, calleeId, registerId, registerId);
+					if (_GetPatchedScope(calleeId).Code.GetSize() != 0)
+						targets[calleeId].insert(0);
+				}
+
+				for (auto & item : targets) {
+					_PatchedScope & patchedScope = _GetPatchedScope(item.first);
+					for (auto target : item.second) {
+						if (target < patchedScope.Code.GetSize())
+							patchedScope.StepTraps.insert(target);
+					}
+					_Publish(item.first, patchedScope);
+				}
+				_steppingContext = &context;
+			}
+
+	public:
+		/// <summary>
+		/// Attaches the debugger to the scopes of a manager.
+		/// </summary>
+		inline explicit ScopeDebugger(
+			RuntimeScopeManager & scopeManager
+			)
+			: _scopeManager(scopeManager), _steppingContext(nullptr), _hitCount(0)
+			{
+				if (_scopeManager.GetDebugger() != nullptr)
+					throw InvalidArgumentException("The scope manager has a debugger attached already.");
+				_scopeManager.SetDebugger(this);
+			}
+
+		inline ~ScopeDebugger(
+			) {
+				Detach();
+				_scopeManager.SetDebugger(nullptr);
+				for (auto & item : _scopes)
+					delete item.second;
+			}
+
+		/// <summary>
+		/// Sets the function called when a context stops. Without one, contexts go on as if they were
+		/// told to continue.
+		/// </summary>
+		inline void SetHandler(
+			const BreakpointHandler & handler
+			) {
+				std::lock_guard<std::mutex> lock(_mutex);
+				_handler = handler;
+			}
+
+		/// <summary>
+		/// Sets a breakpoint before the instruction at an offset of the scope code.
+		/// </summary>
+		inline void SetBreakpoint(
+			scoperef_t scopeId, size_t instructionOffset
+			) {
+				std::lock_guard<std::mutex> lock(_mutex);
+				_PatchedScope & patchedScope = _GetPatchedScope(scopeId);
+				if (!_IsInstructionOffset(patchedScope.Code, instructionOffset))
+					throw InvalidArgumentException("The offset isn't the start of an instruction.");
+				AssemblyReader assemblyReader;
+				DynamicBuffer::ConstIterator bufferIterator = patchedScope.Code.GetConstIterator();
+				bufferIterator.Seek(instructionOffset);
+				if (AssemblyReader::GetBreakpoint(AssemblyReader::GetInstructionSize(assemblyReader.GetInstructionId(bufferIterator))) == Instruction::nop)
+					throw InvalidArgumentException("The instruction can't hold a breakpoint.");
+
+				if (patchedScope.Breakpoints.insert(instructionOffset).second)
+					_Publish(scopeId, patchedScope);
+			}
+
+		inline void ClearBreakpoint(
+			scoperef_t scopeId, size_t instructionOffset
+			) {
+				std::lock_guard<std::mutex> lock(_mutex);
+				std::map<scoperef_t, _PatchedScope *>::iterator it = _scopes.find(scopeId);
+				if (it != _scopes.end() && it->second->Breakpoints.erase(instructionOffset) != 0)
+					_Publish(scopeId, * it->second);
+			}
+
+		/// <summary>
+		/// Removes every breakpoint and step, publishing the original code of the scopes.
+		/// </summary>
+		inline void Detach(
+			) {
+				std::lock_guard<std::mutex> lock(_mutex);
+				_steppingContext = nullptr;
+				for (auto & item : _scopes) {
+					if (item.second->Breakpoints.empty() && item.second->StepTraps.empty())
+						continue;
+					item.second->Breakpoints.clear();
+					item.second->StepTraps.clear();
+					_Publish(item.first, * item.second);
+				}
+			}
+
+		inline size_t GetBreakpointCount(
+			) {
+				std::lock_guard<std::mutex> lock(_mutex);
+				size_t count = 0;
+				for (auto & item : _scopes)
+					count += item.second->Breakpoints.size();
+				return count;
+			}
+
+		/// <summary>
+		/// Returns the number of times the handler was called.
+		/// </summary>
+		inline size_t GetHitCount(
+			) {
+				std::lock_guard<std::mutex> lock(_mutex);
+				return _hitCount;
+			}
+
+		/// <summary>
+		/// Returns the number of bytes of the stack used by a frame: its parameters and the values it
+		/// pushed, up to the frame it called.
+		/// </summary>
+		static inline size_t GetFrameStackSize(
+			RuntimeContext & context, size_t frameIndex
+			) {
+				const std::vector<CallFrame> & frames = context.GetCallFrames();
+				if (frameIndex >= frames.size())
+					throw InvalidArgumentException("The frame doesn't exist.");
+				staddr_t top = frameIndex + 1 < frames.size()
+					? frames[frameIndex + 1].StackBase : context.GetRuntimeStack().GetCurrentAddress();
+				return static_cast<size_t>(top - frames[frameIndex].StackBase);
+			}
+
+		inline const RuntimeScope * OnBreakpoint(
+			RuntimeContext & context
+			) {
+				const CallFrame & frame = context.GetCallFrames().back();
+				std::unique_lock<std::mutex> lock(_mutex);
+				_PatchedScope & patchedScope = * _scopes[frame.Scope];
+				bool breakpoint = patchedScope.Breakpoints.count(frame.InstructionOffset) != 0;
+				bool step = _steppingContext == &context && patchedScope.StepTraps.count(frame.InstructionOffset) != 0;
+				// Traps left in older versions, or steps of other contexts, don't stop the context.
+				if (!breakpoint && !step)
+					return &_scopeManager.GetScope(frame.Scope);
+				if (_steppingContext == &context)
+					_ClearStepTraps();
+
+				DynamicBuffer::ConstIterator bufferIterator = patchedScope.Code.GetConstIterator();
+				bufferIterator.Seek(frame.InstructionOffset);
+				BreakpointHit hit;
+				hit.Scope = frame.Scope;
+				hit.InstructionOffset = frame.InstructionOffset;
+				hit.Instruction = AssemblyReader().GetInstructionId(bufferIterator);
+				hit.Step = !breakpoint;
+				const ScopeOriginMap::Entry * origin = frame.Version->GetOriginMap().Find(frame.InstructionOffset);
+				hit.OriginScope = origin != nullptr ? origin->Scope : frame.Scope;
+				hit.OriginalOffset = origin != nullptr ? origin->OriginalOffset : frame.InstructionOffset;
+				++_hitCount;
+				BreakpointHandler handler = _handler;
+				lock.unlock();
+
+				DebugAction action = handler ? handler(context, hit) : DebugAction::Continue;
+
+				lock.lock();
+				if (action == DebugAction::Step) {
+					_ClearStepTraps();
+					_SetStepTraps(context, frame);
+				}
+				return &_scopeManager.GetScope(frame.Scope);
+			}
+
+		inline const DynamicBuffer & GetOriginalCode(
+			scoperef_t scopeId
+			) {
+				std::lock_guard<std::mutex> lock(_mutex);
+				std::map<scoperef_t, _PatchedScope *>::const_iterator it = _scopes.find(scopeId);
+				if (it == _scopes.end())
+					throw RuntimeException("The scope wasn't patched by the debugger.");
+				return it->second->Code;
+			}
+	};
+
+} // namespace Nova
+
+#endif // !_NOVA_RUNTIME_ENVIRONMENT_SCOPE_DEBUGGER_HEADER_
\ No newline at end of file
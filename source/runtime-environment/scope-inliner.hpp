@@ -0,0 +1,279 @@
+//
+// scope-inliner.hpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#ifndef _NOVA_RUNTIME_ENVIRONMENT_SCOPE_INLINER_HEADER_
+#define _NOVA_RUNTIME_ENVIRONMENT_SCOPE_INLINER_HEADER_
+
+#include "runtime-scope.hpp"
+#include "scope-verifier.hpp"
+#include "assembly.hpp"
+
+#include "..\common\type-traits.hpp"
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <utility>
+
+namespace Nova {
+
+	/// <summary>
+	/// Replaces the calls to small scopes with the code of the callee, so helpers called from hot code
+	/// don't pay for a frame and a new dispatch loop.
+	/// </summary>
+	/// <remarks>
+	/// <para>A callee runs on the frame of its caller: it takes its parameters from the stack and leaves
+	/// its results there, so its code can be copied in place of the call as is. Only its control flow
+	/// is rewritten: branches are written again against the new offsets, and ret jumps past the
+	/// inlined code.</para>
+	/// <para>Callees are inlined if they're smaller than the callee size limit, or smaller than the
+	/// single call site limit when they appear in a single call instruction of the program. The call
+	/// sites are counted in the code, not in a profile, so a callee called once from a loop counts as
+	/// one. Scopes calling themselves are never inlined, and callees are inlined one level per
+	/// pass.</para>
+	/// <para>Rewritten scopes are verified and published as a new version, so contexts running the
+	/// scope finish with the code they started with. The new version gets an origin map pointing every
+	/// instruction back to the scope it was written in, which the debugger reports with its
+	/// breakpoints.</para>
+	/// </remarks>
+	class ScopeInliner {
+	public:
+		static const size_t DefaultMaxCalleeSize = 64;
+		static const size_t DefaultMaxSingleCallSiteSize = 512;
+		static const size_t DefaultMaxScopeSize = 16 * 1024;
+
+	private:
+		RuntimeScopeManager & _scopeManager;
+		const size_t _maxCalleeSize;
+		const size_t _maxSingleCallSiteSize;
+		const size_t _maxScopeSize;
+		std::vector<size_t> _staticCallSites;
+
+		static inline std::vector<size_t> _GetInstructionOffsets(
+			const DynamicBuffer & code
+			) {
+				std::vector<size_t> offsets;
+				AssemblyReader assemblyReader;
+				DynamicBuffer::ConstIterator bufferIterator = code.GetConstIterator();
+				while (bufferIterator.HasData()) {
+					offsets.push_back(bufferIterator.GetOffset());
+					assemblyReader.GoNextInstruction(bufferIterator);
+				}
+				offsets.push_back(code.GetSize());
+				return offsets;
+			}
+
+		static inline size_t _GetTargetIndex(
+			const std::vector<size_t> & offsets, size_t index, std::int32_t offset
+			) {
+				size_t target = static_cast<size_t>(static_cast<std::int64_t>(offsets[index + 1]) + offset);
+				return static_cast<size_t>(std::lower_bound(offsets.begin(), offsets.end(), target) - offsets.begin());
+			}
+
+		/// <summary>
+		/// Counts the call instructions to every scope in the code of the program.
+		/// </summary>
+		inline void _CountStaticCallSites(
+			) {
+				_staticCallSites.assign(_scopeManager.GetScopeCount(), 0);
+
+				AssemblyReader assemblyReader;
+				for (size_t i = 0; i < _scopeManager.GetScopeCount(); ++i) {
+					const RuntimeScope & scope = _scopeManager.GetScope(reinterpret_cast<scoperef_t>(i));
+					DynamicBuffer::ConstIterator bufferIterator = scope.GetCodeBuffer().GetConstIterator();
+					while (bufferIterator.HasData()) {
+						if (assemblyReader.GetInstructionId(bufferIterator) == Instruction::call) {
+							scoperef_t calleeId;
+							assemblyReader.Call(bufferIterator, calleeId);
+							++_staticCallSites[reinterpret_cast<size_t>(calleeId)];
+						}
+						assemblyReader.GoNextInstruction(bufferIterator);
+					}
+				}
+			}
+
+		inline bool _CallsItself(
+			const RuntimeScope & scope
+			) {
+				AssemblyReader assemblyReader;
+				DynamicBuffer::ConstIterator bufferIterator = scope.GetCodeBuffer().GetConstIterator();
+				while (bufferIterator.HasData()) {
+					if (assemblyReader.GetInstructionId(bufferIterator) == Instruction::call) {
+						scoperef_t calleeId;
+						assemblyReader.Call(bufferIterator, calleeId);
+						if (calleeId == scope.GetId())
+							return true;
+					}
+					assemblyReader.GoNextInstruction(bufferIterator);
+				}
+				return false;
+			}
+
+		inline bool _ShouldInline(
+			const RuntimeScope & caller, const RuntimeScope & callee, size_t outputSize
+			) {
+				if (callee.GetId() == caller.GetId() || !callee.IsVerified())
+					return false;
+				// Calls restore the stack-frame registers, which inlined code wouldn't do.
+				if (callee.SetsFrameRegisters())
+					return false;
+
+				size_t size = callee.GetCodeBuffer().GetSize();
+				size_t index = reinterpret_cast<size_t>(callee.GetId());
+				size_t callSites = index < _staticCallSites.size() ? _staticCallSites[index] : 0;
+				if (size > _maxCalleeSize && !(callSites == 1 && size <= _maxSingleCallSiteSize))
+					return false;
+				if (outputSize + size > _maxScopeSize)
+					return false;
+				return !_CallsItself(callee);
+			}
+
+		/// <summary>
+		/// Adds the origin of an instruction of the scope, following the origin map of the scope if it
+		/// was already rewritten.
+		/// </summary>
+		static inline void _AddOrigin(
+			ScopeOriginMap & originMap, size_t instructionOffset, const RuntimeScope & scope, size_t offset
+			) {
+				const ScopeOriginMap::Entry * origin = scope.GetOriginMap().Find(offset);
+				if (origin != nullptr)
+					originMap.AddEntry(instructionOffset, origin->Scope, origin->OriginalOffset);
+				else
+					originMap.AddEntry(instructionOffset, scope.GetId(), offset);
+			}
+
+		/// <summary>
+		/// Writes the code of a scope to the output.
+		/// </summary>
+		/// <param name='caller'>Scope the code is written for. If it isn't the scope itself, the scope
+		/// is being inlined: its calls are kept and ret jumps to the end of its code.</param>
+		/// <returns>The number of calls inlined.</returns>
+		inline size_t _Write(
+			AssemblyWriter & writer, DynamicBuffer & output, ScopeOriginMap & originMap,
+			const RuntimeScope & caller, const RuntimeScope & scope
+			) {
+				bool inlining = caller.GetId() != scope.GetId();
+				const DynamicBuffer & code = scope.GetCodeBuffer();
+				std::vector<size_t> offsets = _GetInstructionOffsets(code);
+				size_t end = offsets.size() - 1;
+
+				std::vector<label_t> labels;
+				for (size_t i = 0; i <= end; ++i)
+					labels.push_back(writer.CreateLabel());
+
+				size_t inlined = 0;
+				AssemblyReader assemblyReader;
+				DynamicBuffer::ConstIterator bufferIterator = code.GetConstIterator();
+				for (size_t i = 0; i < end; ++i) {
+					writer.BindLabel(output, labels[i]);
+					bufferIterator.Seek(offsets[i]);
+
+					Register registerId;
+					std::int32_t offset;
+					scoperef_t calleeId;
+					Instruction instruction = assemblyReader.GetInstructionId(bufferIterator);
+					if (instruction == Instruction::call && !inlining) {
+						assemblyReader.Call(bufferIterator, calleeId);
+						const RuntimeScope & callee = _scopeManager.GetScope(calleeId);
+						if (_ShouldInline(caller, callee, output.GetSize())) {
+							inlined += 1 + _Write(writer, output, originMap, caller, callee);
+							continue;
+						}
+					}
+
+					if (instruction == Instruction::ret && inlining && i + 1 == end)
+						continue;
+
+					_AddOrigin(originMap, output.GetSize(), scope, offsets[i]);
+					if (instruction == Instruction::ret && inlining) {
+						writer.Jmp(output, labels[end]);
+					} else if (instruction >= Instruction::jmp && instruction <= Instruction::jge_i4) {
+						assemblyReader.Branch(bufferIterator, offset);
+						writer.Branch(output, instruction, labels[_GetTargetIndex(offsets, i, offset)]);
+					} else if (instruction == Instruction::djnz_i4r) {
+						assemblyReader.DjnzI4R(bufferIterator, registerId, offset);
+						writer.DjnzI4R(output, registerId, labels[_GetTargetIndex(offsets, i, offset)]);
+					} else {
+						output.Push(static_cast<const std::int8_t *>(code.GetPointer()) + offsets[i], offsets[i + 1] - offsets[i]);
+					}
+				}
+				writer.BindLabel(output, labels[end]);
+
+				return inlined;
+			}
+
+	public:
+		/// <param name='maxCalleeSize'>Maximum size in bytes of the code of the callees inlined.</param>
+		/// <param name='maxSingleCallSiteSize'>Maximum size in bytes of the code of the callees inlined
+		/// when they're called from a single place.</param>
+		/// <param name='maxScopeSize'>Size in bytes after which a scope doesn't get more calls inlined.</param>
+		inline explicit ScopeInliner(
+			RuntimeScopeManager & scopeManager, size_t maxCalleeSize = DefaultMaxCalleeSize,
+			size_t maxSingleCallSiteSize = DefaultMaxSingleCallSiteSize, size_t maxScopeSize = DefaultMaxScopeSize
+			)
+			: _scopeManager(scopeManager), _maxCalleeSize(maxCalleeSize),
+			_maxSingleCallSiteSize(maxSingleCallSiteSize), _maxScopeSize(maxScopeSize)
+			{
+			}
+
+		/// <summary>
+		/// Inlines the calls of a scope, publishing a new version of it if any was inlined. The scope
+		/// and its callees are verified if they weren't yet.
+		/// </summary>
+		/// <returns>The number of calls inlined.</returns>
+		inline size_t Inline(
+			scoperef_t scopeId
+			) {
+				RuntimeScope & scope = _scopeManager.GetScope(scopeId);
+				if (!scope.IsVerified())
+					ScopeVerifier(_scopeManager).Verify(scope);
+				if (_staticCallSites.size() != _scopeManager.GetScopeCount())
+					_CountStaticCallSites();
+
+				// Most of the code is copied as it is, so the output starts with room for it.
+				DynamicBuffer output;
+				output.Reserve(scope.GetCodeBuffer().GetSize());
+				AssemblyWriter writer;
+				ScopeOriginMap originMap;
+				size_t inlined = _Write(writer, output, originMap, scope, scope);
+				if (inlined == 0)
+					return 0;
+
+				RuntimeScope * version = _scopeManager.CreateScopeVersion(scopeId);
+				try {
+					version->SetCodeBuffer(std::move(output));
+					if (scope.HasDeclaredSignature())
+						version->SetSignature(scope.GetSignature());
+					version->SetOriginMap(originMap);
+					ScopeVerifier(_scopeManager).Verify(* version);
+					_scopeManager.PublishScope(version);
+				} catch (...) {
+					delete version;
+					throw;
+				}
+				return inlined;
+			}
+
+		/// <summary>
+		/// Inlines the calls of all the scopes of the manager.
+		/// </summary>
+		/// <returns>The number of calls inlined.</returns>
+		inline size_t InlineAll(
+			) {
+				ScopeVerifier(_scopeManager).VerifyAll();
+				_CountStaticCallSites();
+
+				size_t inlined = 0;
+				for (size_t i = 0; i < _scopeManager.GetScopeCount(); ++i)
+					inlined += Inline(reinterpret_cast<scoperef_t>(i));
+				return inlined;
+			}
+	};
+
+} // namespace Nova
+
+#endif // !_NOVA_RUNTIME_ENVIRONMENT_SCOPE_INLINER_HEADER_
\ No newline at end of file
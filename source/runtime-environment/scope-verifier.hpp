@@ -0,0 +1,1045 @@
+//
+// scope-verifier.hpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#ifndef _NOVA_RUNTIME_ENVIRONMENT_SCOPE_VERIFIER_HEADER_
+#define _NOVA_RUNTIME_ENVIRONMENT_SCOPE_VERIFIER_HEADER_
+
+#include "runtime-scope.hpp"
+#include "assembly.hpp"
+
+#include "..\common\exception.hpp"
+#include "..\common\type-traits.hpp"
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <mutex>
+
+namespace Nova {
+
+	INHERIT_EXCEPTION(VerificationException, RuntimeException)
+
+	namespace Internal {
+		/// <summary>
+		/// Stack of value types used to simulate the execution of a scope.
+		/// </summary>
+		/// <remarks>
+		/// Offsets are relative to the top of the stack when the scope is entered, so parameters have
+		/// negative offsets until the size of all of them is known. The stack-frame registers set by
+		/// the scope are kept as offsets too.
+		/// </remarks>
+		class VerifierStack {
+			static const int _FrameRegisterCount = 6;
+
+			std::vector<ValueType> _values;
+			std::vector<ValueType> _inferredParameters;
+			std::int32_t _bottomOffset;
+			std::int32_t _size;
+			std::int32_t _maxTop;
+			bool _inferParameters;
+			std::int32_t _frameOffsets[_FrameRegisterCount];
+			unsigned _setFrameRegisters;
+
+		public:
+			inline VerifierStack(
+				)
+				: _bottomOffset(0), _size(0), _maxTop(0), _inferParameters(true), _setFrameRegisters(0)
+				{
+					for (int i = 0; i < _FrameRegisterCount; ++i)
+						_frameOffsets[i] = 0;
+				}
+
+			/// <summary>
+			/// Starts the simulation with the declared parameters on the stack, instead of inferring them.
+			/// </summary>
+			inline void SetParameters(
+				const std::vector<ValueType> & parameters
+				) {
+					_inferParameters = false;
+					for (auto type : parameters) {
+						_bottomOffset -= static_cast<std::int32_t>(GetValueTypeSize(type));
+						Push(type);
+					}
+				}
+
+			inline void Push(
+				ValueType type
+				) {
+					_values.push_back(type);
+					_size += static_cast<std::int32_t>(GetValueTypeSize(type));
+					_maxTop = std::max(_maxTop, _bottomOffset + _size);
+				}
+
+			inline void Pop(
+				ValueType type
+				) {
+					if (_values.empty()) {
+						if (!_inferParameters)
+							throw VerificationException("The scope pops more values than its parameters.");
+						_inferredParameters.push_back(type);
+						_bottomOffset -= static_cast<std::int32_t>(GetValueTypeSize(type));
+						return;
+					}
+
+					if (_values.back() != type)
+						throw VerificationException("The type of the value in the stack doesn't match the instruction.");
+					_size -= static_cast<std::int32_t>(GetValueTypeSize(type));
+					_values.pop_back();
+				}
+
+			/// <summary>
+			/// Removes whole values from the top of the stack, which must have been pushed by the scope or
+			/// declared as its parameters, since their types can't be inferred.
+			/// </summary>
+			inline void Drop(
+				std::int32_t size
+				) {
+					if (size < 0)
+						throw VerificationException("The size dropped can't be negative.");
+					while (size > 0) {
+						if (_values.empty())
+							throw VerificationException("The values dropped must be pushed by the scope or declared as its parameters.");
+						std::int32_t valueSize = static_cast<std::int32_t>(GetValueTypeSize(_values.back()));
+						if (valueSize > size)
+							throw VerificationException("The size dropped must cover whole values.");
+						Pop(_values.back());
+						size -= valueSize;
+					}
+				}
+
+			/// <summary>
+			/// Returns true if a value of the type starts at the offset, below the top of the stack.
+			/// </summary>
+			inline bool HasValue(
+				std::int32_t offset, ValueType type
+				) const {
+					std::int32_t valueOffset = _bottomOffset;
+					for (auto valueType : _values) {
+						if (valueOffset == offset)
+							return valueType == type;
+						if (valueOffset > offset)
+							return false;
+						valueOffset += static_cast<std::int32_t>(GetValueTypeSize(valueType));
+					}
+					return false;
+				}
+
+			inline std::int32_t GetTop(
+				) const {
+					return _bottomOffset + _size;
+				}
+
+			/// <summary>
+			/// Sets a stack-frame register, by index, to the top of the stack.
+			/// </summary>
+			inline void SetFrameRegister(
+				int index
+				) {
+					_frameOffsets[index] = GetTop();
+					_setFrameRegisters |= 1u << index;
+				}
+
+			/// <summary>
+			/// Returns false if the scope didn't set the stack-frame register on this path.
+			/// </summary>
+			inline bool GetFrameRegister(
+				int index, std::int32_t & offset
+				) const {
+					if ((_setFrameRegisters & (1u << index)) == 0)
+						return false;
+					offset = _frameOffsets[index];
+					return true;
+				}
+
+			/// <summary>
+			/// Returns the offsets of the references in the stack, relative to the entry of the scope.
+			/// </summary>
+			inline std::vector<std::int32_t> GetReferenceOffsets(
+				) const {
+					std::vector<std::int32_t> offsets;
+					std::int32_t offset = _bottomOffset;
+					for (auto type : _values) {
+						if (type == ValueType::rf)
+							offsets.push_back(offset);
+						offset += static_cast<std::int32_t>(GetValueTypeSize(type));
+					}
+					return offsets;
+				}
+
+			inline const std::vector<ValueType> & GetValues(
+				) const {
+					return _values;
+				}
+
+			/// <summary>
+			/// Returns the inferred parameters, from the bottom to the top of the stack.
+			/// </summary>
+			inline std::vector<ValueType> GetInferredParameters(
+				) const {
+					return std::vector<ValueType>(_inferredParameters.rbegin(), _inferredParameters.rend());
+				}
+
+			inline std::int32_t GetMaxTop(
+				) const {
+					return _maxTop;
+				}
+
+			/// <summary>
+			/// Returns true if both stacks hold the same values and inferred the same parameters, so the
+			/// code can continue from either of them.
+			/// </summary>
+			inline bool HasSameShape(
+				const VerifierStack & other
+				) const {
+					if (_bottomOffset != other._bottomOffset || _values != other._values
+						|| _inferredParameters != other._inferredParameters || _setFrameRegisters != other._setFrameRegisters)
+						return false;
+					for (int i = 0; i < _FrameRegisterCount; ++i) {
+						if ((_setFrameRegisters & (1u << i)) != 0 && _frameOffsets[i] != other._frameOffsets[i])
+							return false;
+					}
+					return true;
+				}
+		};
+	}
+
+	/// <summary>
+	/// Checks the code of the scopes and builds the information the engine needs to run them precisely:
+	/// the signature of every scope and the stack maps for its safepoints.
+	/// </summary>
+	/// <remarks>
+	/// <para>Safepoints are the instructions that can collect the heap while the scope is active: alloc,
+	/// alloc_k, and call because the callee can allocate. The stack map of a call doesn't include the parameters of
+	/// the callee, which belong to the callee frame.</para>
+	/// <para>The ld_*s and st_*s instructions must use stack-frame registers set by the scope, on every
+	/// path, and reach a value of their type in the stack, so the engine doesn't check them when it runs
+	/// verified scopes.</para>
+	/// </remarks>
+	class ScopeVerifier {
+		RuntimeScopeManager & _scopeManager;
+		std::vector<scoperef_t> _activeScopes;
+
+		struct _PendingEntry {
+			size_t InstructionOffset;
+			std::vector<std::int32_t> ReferenceOffsets;
+		};
+
+		inline void _Pop(
+			Internal::VerifierStack & stack, const std::vector<ValueType> & types
+			) {
+				for (auto it = types.rbegin(); it != types.rend(); ++it)
+					stack.Pop(* it);
+			}
+
+		inline void _Push(
+			Internal::VerifierStack & stack, const std::vector<ValueType> & types
+			) {
+				for (auto type : types)
+					stack.Push(type);
+			}
+
+		static inline void _CheckRRegister(
+			Register registerId
+			) {
+				if (registerId < Register::r0 || registerId > Register::r7)
+					throw VerificationException("The register isn't a general-purpose register.");
+			}
+
+		static inline void _CheckMRegister(
+			Register registerId
+			) {
+				if (registerId < Register::m0 || registerId > Register::m3)
+					throw VerificationException("The register isn't a memory-address register.");
+			}
+
+		/// <summary>
+		/// Checks the memory-address register of a ld_*m or st_*m instruction.
+		/// </summary>
+		static inline void _CheckMemoryAccess(
+			AssemblyReader & assemblyReader, const DynamicBuffer::ConstIterator & bufferIterator
+			) {
+				Register registerId;
+				std::int32_t offset;
+				assemblyReader.MemoryAccess(bufferIterator, registerId, offset);
+				_CheckMRegister(registerId);
+			}
+
+		/// <summary>
+		/// Checks the memory-address register of an array instruction.
+		/// </summary>
+		static inline void _CheckIndexedAccess(
+			AssemblyReader & assemblyReader, const DynamicBuffer::ConstIterator & bufferIterator
+			) {
+				Register registerId;
+				assemblyReader.IndexedAccess(bufferIterator, registerId);
+				_CheckMRegister(registerId);
+			}
+
+		static inline int _GetFrameRegisterIndex(
+			Register registerId
+			) {
+				if (registerId < Register::sp0 || registerId > Register::sp5)
+					throw VerificationException("The register isn't a stack-frame register.");
+				return static_cast<int>(registerId) - static_cast<int>(Register::sp0);
+			}
+
+		/// <summary>
+		/// Checks that a ld_*s or st_*s instruction reaches a value of the type in the stack. Stores
+		/// check it once their value is popped.
+		/// </summary>
+		static inline void _CheckFrameAccess(
+			AssemblyReader & assemblyReader, const DynamicBuffer::ConstIterator & bufferIterator,
+			const Internal::VerifierStack & stack, ValueType type
+			) {
+				Register registerId;
+				std::int32_t offset, frameOffset;
+				assemblyReader.FrameAccess(bufferIterator, registerId, offset);
+				if (!stack.GetFrameRegister(_GetFrameRegisterIndex(registerId), frameOffset))
+					throw VerificationException("The stack-frame register isn't set by the scope.");
+				if (!stack.HasValue(frameOffset + offset, type))
+					throw VerificationException("The stack-frame access doesn't reach a value of its type.");
+			}
+
+		/// <summary>
+		/// Returns true if the instruction can branch, with the offset of its target relative to its end.
+		/// </summary>
+		static inline bool _GetBranchOffset(
+			AssemblyReader & assemblyReader, const DynamicBuffer::ConstIterator & bufferIterator,
+			std::int32_t & offset
+			) {
+				Instruction instruction = assemblyReader.GetInstructionId(bufferIterator);
+				if (instruction >= Instruction::jmp && instruction <= Instruction::jge_i4) {
+					assemblyReader.Branch(bufferIterator, offset);
+					return true;
+				}
+				if (instruction == Instruction::djnz_i4r) {
+					Register registerId;
+					assemblyReader.DjnzI4R(bufferIterator, registerId, offset);
+					return true;
+				}
+				return false;
+			}
+
+		static inline ValueType _CheckVectorType(
+			ValueType type
+			) {
+				if (!IsVectorType(type))
+					throw VerificationException("The instruction requires a vector type.");
+				return type;
+			}
+
+		inline const ScopeSignature & _GetCalleeSignature(
+			scoperef_t scopeId
+			) {
+				if (reinterpret_cast<size_t>(scopeId) >= _scopeManager.GetScopeCount())
+					throw VerificationException("The scope called doesn't exist.");
+
+				RuntimeScope & callee = _scopeManager.GetScope(scopeId);
+				if (callee.HasDeclaredSignature() || (callee.IsLoaded() && callee.IsVerified()))
+					return callee.GetSignature();
+
+				if (std::find(_activeScopes.begin(), _activeScopes.end(), scopeId) != _activeScopes.end())
+					throw VerificationException("Recursive scopes must declare their signature.");
+
+				Verify(callee);
+				return callee.GetSignature();
+			}
+
+		inline const ScopeSignature & _GetExternalSignature(
+			scoperef_t scopeId
+			) {
+				if (reinterpret_cast<size_t>(scopeId) >= _scopeManager.GetExternalScopeCount())
+					throw VerificationException("The external scope called doesn't exist.");
+
+				ExternalScope & callee = _scopeManager.GetExternalScope(scopeId);
+				if (!callee.HasSignature())
+					throw VerificationException("External scopes must declare their signature to be verified.");
+				return callee.GetSignature();
+			}
+
+		inline const Channel & _GetChannel(
+			chanref_t channelId
+			) {
+				if (reinterpret_cast<size_t>(channelId) >= _scopeManager.GetChannelCount())
+					throw VerificationException("The channel doesn't exist.");
+				return _scopeManager.GetChannel(channelId);
+			}
+
+		/// <summary>
+		/// Checks that a constant of the pool exists and is either a value or an array. Returns its type.
+		/// </summary>
+		inline ValueType _GetConstantType(
+			constref_t constant, bool isArray
+			) {
+				const ConstantPool & pool = _scopeManager.GetConstantPool();
+				if (!pool.Contains(constant))
+					throw VerificationException("The constant doesn't exist.");
+				if (pool.IsArray(constant) != isArray)
+					throw VerificationException(isArray ? "The constant isn't an array." : "The constant isn't a value.");
+				return pool.GetType(constant);
+			}
+
+		/// <summary>
+		/// Simulates an instruction. Returns false if the next instruction can't be reached from it.
+		/// </summary>
+		inline bool _VerifyInstruction(
+			AssemblyReader & assemblyReader, const DynamicBuffer::ConstIterator & bufferIterator,
+			Internal::VerifierStack & stack, std::vector<_PendingEntry> & entries
+			) {
+				_PendingEntry entry;
+				entry.InstructionOffset = bufferIterator.GetOffset();
+
+				Register registerId;
+				std::int32_t offset;
+				scoperef_t scopeId;
+				ValueType type;
+				constref_t constant;
+
+				Instruction instruction = assemblyReader.GetInstructionId(bufferIterator);
+				switch (instruction) {
+				case Instruction::nop:
+					break;
+				case Instruction::push_i4c:
+					stack.Push(ValueType::i4);
+					break;
+				case Instruction::push_i4r:
+					assemblyReader.PushI4R(bufferIterator, registerId);
+					_CheckRRegister(registerId);
+					stack.Push(ValueType::i4);
+					break;
+				case Instruction::set_i4r:
+					assemblyReader.SetI4R(bufferIterator, registerId);
+					_CheckRRegister(registerId);
+					stack.Pop(ValueType::i4);
+					break;
+				case Instruction::add_i4:
+					stack.Pop(ValueType::i4);
+					stack.Pop(ValueType::i4);
+					stack.Push(ValueType::i4);
+					break;
+				case Instruction::call:
+					{
+						assemblyReader.Call(bufferIterator, scopeId);
+						const ScopeSignature & signature = _GetCalleeSignature(scopeId);
+						_Pop(stack, signature.GetParameters());
+						entry.ReferenceOffsets = stack.GetReferenceOffsets();
+						entries.push_back(entry);
+						_Push(stack, signature.GetResults());
+					}
+					break;
+				case Instruction::xcall:
+					{
+						assemblyReader.XCall(bufferIterator, scopeId);
+						const ScopeSignature & signature = _GetExternalSignature(scopeId);
+						_Pop(stack, signature.GetParameters());
+						_Push(stack, signature.GetResults());
+					}
+					break;
+				case Instruction::ret:
+					return false;
+				case Instruction::alloc:
+					assemblyReader.Alloc(bufferIterator, registerId);
+					_CheckMRegister(registerId);
+					stack.Pop(ValueType::i4);
+					entry.ReferenceOffsets = stack.GetReferenceOffsets();
+					entries.push_back(entry);
+					break;
+				case Instruction::push_rfr:
+					assemblyReader.PushRfR(bufferIterator, registerId);
+					_CheckMRegister(registerId);
+					stack.Push(ValueType::rf);
+					break;
+				case Instruction::set_rfr:
+					assemblyReader.SetRfR(bufferIterator, registerId);
+					_CheckMRegister(registerId);
+					stack.Pop(ValueType::rf);
+					break;
+				case Instruction::ld_i1m:
+					_CheckMemoryAccess(assemblyReader, bufferIterator);
+					stack.Push(ValueType::i1);
+					break;
+				case Instruction::ld_i2m:
+					_CheckMemoryAccess(assemblyReader, bufferIterator);
+					stack.Push(ValueType::i2);
+					break;
+				case Instruction::ld_i4m:
+					_CheckMemoryAccess(assemblyReader, bufferIterator);
+					stack.Push(ValueType::i4);
+					break;
+				case Instruction::ld_i8m:
+					_CheckMemoryAccess(assemblyReader, bufferIterator);
+					stack.Push(ValueType::i8);
+					break;
+				case Instruction::ld_fsm:
+					_CheckMemoryAccess(assemblyReader, bufferIterator);
+					stack.Push(ValueType::fs);
+					break;
+				case Instruction::ld_fdm:
+					_CheckMemoryAccess(assemblyReader, bufferIterator);
+					stack.Push(ValueType::fd);
+					break;
+				case Instruction::ld_rfm:
+					_CheckMemoryAccess(assemblyReader, bufferIterator);
+					stack.Push(ValueType::rf);
+					break;
+				case Instruction::st_i1m:
+					_CheckMemoryAccess(assemblyReader, bufferIterator);
+					stack.Pop(ValueType::i1);
+					break;
+				case Instruction::st_i2m:
+					_CheckMemoryAccess(assemblyReader, bufferIterator);
+					stack.Pop(ValueType::i2);
+					break;
+				case Instruction::st_i4m:
+					_CheckMemoryAccess(assemblyReader, bufferIterator);
+					stack.Pop(ValueType::i4);
+					break;
+				case Instruction::st_i8m:
+					_CheckMemoryAccess(assemblyReader, bufferIterator);
+					stack.Pop(ValueType::i8);
+					break;
+				case Instruction::st_fsm:
+					_CheckMemoryAccess(assemblyReader, bufferIterator);
+					stack.Pop(ValueType::fs);
+					break;
+				case Instruction::st_fdm:
+					_CheckMemoryAccess(assemblyReader, bufferIterator);
+					stack.Pop(ValueType::fd);
+					break;
+				case Instruction::st_rfm:
+					assemblyReader.MemoryAccess(bufferIterator, registerId, offset);
+					_CheckMRegister(registerId);
+					if (offset % static_cast<std::int32_t>(sizeof(refaddr_t)) != 0)
+						throw VerificationException("References must be stored at aligned offsets.");
+					stack.Pop(ValueType::rf);
+					break;
+				case Instruction::ldx_i1m:
+					_CheckIndexedAccess(assemblyReader, bufferIterator);
+					stack.Pop(ValueType::i4);
+					stack.Push(ValueType::i1);
+					break;
+				case Instruction::ldx_i2m:
+					_CheckIndexedAccess(assemblyReader, bufferIterator);
+					stack.Pop(ValueType::i4);
+					stack.Push(ValueType::i2);
+					break;
+				case Instruction::ldx_i4m:
+					_CheckIndexedAccess(assemblyReader, bufferIterator);
+					stack.Pop(ValueType::i4);
+					stack.Push(ValueType::i4);
+					break;
+				case Instruction::ldx_i8m:
+					_CheckIndexedAccess(assemblyReader, bufferIterator);
+					stack.Pop(ValueType::i4);
+					stack.Push(ValueType::i8);
+					break;
+				case Instruction::ldx_fsm:
+					_CheckIndexedAccess(assemblyReader, bufferIterator);
+					stack.Pop(ValueType::i4);
+					stack.Push(ValueType::fs);
+					break;
+				case Instruction::ldx_fdm:
+					_CheckIndexedAccess(assemblyReader, bufferIterator);
+					stack.Pop(ValueType::i4);
+					stack.Push(ValueType::fd);
+					break;
+				case Instruction::stx_i1m:
+					_CheckIndexedAccess(assemblyReader, bufferIterator);
+					stack.Pop(ValueType::i1);
+					stack.Pop(ValueType::i4);
+					break;
+				case Instruction::stx_i2m:
+					_CheckIndexedAccess(assemblyReader, bufferIterator);
+					stack.Pop(ValueType::i2);
+					stack.Pop(ValueType::i4);
+					break;
+				case Instruction::stx_i4m:
+					_CheckIndexedAccess(assemblyReader, bufferIterator);
+					stack.Pop(ValueType::i4);
+					stack.Pop(ValueType::i4);
+					break;
+				case Instruction::stx_i8m:
+					_CheckIndexedAccess(assemblyReader, bufferIterator);
+					stack.Pop(ValueType::i8);
+					stack.Pop(ValueType::i4);
+					break;
+				case Instruction::stx_fsm:
+					_CheckIndexedAccess(assemblyReader, bufferIterator);
+					stack.Pop(ValueType::fs);
+					stack.Pop(ValueType::i4);
+					break;
+				case Instruction::stx_fdm:
+					_CheckIndexedAccess(assemblyReader, bufferIterator);
+					stack.Pop(ValueType::fd);
+					stack.Pop(ValueType::i4);
+					break;
+				case Instruction::fill_i1m:
+					_CheckIndexedAccess(assemblyReader, bufferIterator);
+					stack.Pop(ValueType::i1);
+					stack.Pop(ValueType::i4);
+					stack.Pop(ValueType::i4);
+					break;
+				case Instruction::fill_i2m:
+					_CheckIndexedAccess(assemblyReader, bufferIterator);
+					stack.Pop(ValueType::i2);
+					stack.Pop(ValueType::i4);
+					stack.Pop(ValueType::i4);
+					break;
+				case Instruction::fill_i4m:
+					_CheckIndexedAccess(assemblyReader, bufferIterator);
+					stack.Pop(ValueType::i4);
+					stack.Pop(ValueType::i4);
+					stack.Pop(ValueType::i4);
+					break;
+				case Instruction::fill_i8m:
+					_CheckIndexedAccess(assemblyReader, bufferIterator);
+					stack.Pop(ValueType::i8);
+					stack.Pop(ValueType::i4);
+					stack.Pop(ValueType::i4);
+					break;
+				case Instruction::fill_fsm:
+					_CheckIndexedAccess(assemblyReader, bufferIterator);
+					stack.Pop(ValueType::fs);
+					stack.Pop(ValueType::i4);
+					stack.Pop(ValueType::i4);
+					break;
+				case Instruction::fill_fdm:
+					_CheckIndexedAccess(assemblyReader, bufferIterator);
+					stack.Pop(ValueType::fd);
+					stack.Pop(ValueType::i4);
+					stack.Pop(ValueType::i4);
+					break;
+				case Instruction::len_m:
+					_CheckIndexedAccess(assemblyReader, bufferIterator);
+					stack.Push(ValueType::i4);
+					break;
+				case Instruction::copy_m:
+					{
+						Register sourceId;
+						assemblyReader.CopyM(bufferIterator, registerId, sourceId);
+						_CheckMRegister(registerId);
+						_CheckMRegister(sourceId);
+					}
+					stack.Pop(ValueType::i4);
+					stack.Pop(ValueType::i4);
+					stack.Pop(ValueType::i4);
+					break;
+				case Instruction::push_vr:
+				case Instruction::set_vr:
+					assemblyReader.VectorRegisterAccess(bufferIterator, type, registerId);
+					_CheckVectorType(type);
+					if (registerId < Register::v0 || registerId > Register::v3)
+						throw VerificationException("The register isn't a vector register.");
+					if (instruction == Instruction::push_vr)
+						stack.Push(type);
+					else
+						stack.Pop(type);
+					break;
+				case Instruction::add_v:
+				case Instruction::sub_v:
+				case Instruction::mul_v:
+				case Instruction::min_v:
+				case Instruction::max_v:
+				case Instruction::cmpeq_v:
+				case Instruction::cmplt_v:
+					assemblyReader.VectorOperation(bufferIterator, type);
+					stack.Pop(_CheckVectorType(type));
+					stack.Pop(type);
+					stack.Push(type);
+					break;
+				case Instruction::blend_v:
+					assemblyReader.VectorOperation(bufferIterator, type);
+					stack.Pop(_CheckVectorType(type));
+					stack.Pop(type);
+					stack.Pop(type);
+					stack.Push(type);
+					break;
+				case Instruction::splat_v:
+					assemblyReader.VectorOperation(bufferIterator, type);
+					stack.Pop(GetVectorLaneType(_CheckVectorType(type)));
+					stack.Push(type);
+					break;
+				case Instruction::hadd_v:
+				case Instruction::hmin_v:
+				case Instruction::hmax_v:
+					assemblyReader.VectorOperation(bufferIterator, type);
+					stack.Pop(_CheckVectorType(type));
+					stack.Push(GetVectorLaneType(type));
+					break;
+				case Instruction::shuffle_v:
+					{
+						std::uint8_t lanes[8];
+						assemblyReader.ShuffleV(bufferIterator, type, lanes);
+						for (size_t i = 0; i < GetVectorLaneCount(_CheckVectorType(type)); ++i) {
+							if (lanes[i] >= GetVectorLaneCount(type))
+								throw VerificationException("The lane doesn't exist in the vector.");
+						}
+						stack.Pop(type);
+						stack.Push(type);
+					}
+					break;
+				case Instruction::ldx_vm:
+					assemblyReader.VectorMemoryAccess(bufferIterator, type, registerId);
+					_CheckMRegister(registerId);
+					stack.Pop(ValueType::i4);
+					stack.Push(_CheckVectorType(type));
+					break;
+				case Instruction::stx_vm:
+					assemblyReader.VectorMemoryAccess(bufferIterator, type, registerId);
+					_CheckMRegister(registerId);
+					stack.Pop(_CheckVectorType(type));
+					stack.Pop(ValueType::i4);
+					break;
+				case Instruction::cmpeq_i4:
+				case Instruction::cmpne_i4:
+				case Instruction::cmplt_i4:
+				case Instruction::cmple_i4:
+				case Instruction::cmpgt_i4:
+				case Instruction::cmpge_i4:
+				case Instruction::jeq_i4:
+				case Instruction::jne_i4:
+				case Instruction::jlt_i4:
+				case Instruction::jle_i4:
+				case Instruction::jgt_i4:
+				case Instruction::jge_i4:
+					stack.Pop(ValueType::i4);
+					stack.Pop(ValueType::i4);
+					break;
+				case Instruction::jmp:
+					return false;
+				case Instruction::jt:
+				case Instruction::jf:
+					break;
+				case Instruction::djnz_i4r:
+					assemblyReader.DjnzI4R(bufferIterator, registerId, offset);
+					_CheckRRegister(registerId);
+					break;
+				case Instruction::send:
+				case Instruction::recv:
+					{
+						chanref_t channelId;
+						assemblyReader.ChannelAccess(bufferIterator, channelId);
+						const Channel & channel = _GetChannel(channelId);
+						if (!channel.HasElementType())
+							throw VerificationException("Byte buffers must be sent and received through objects.");
+
+						// The context can be suspended before the instruction runs.
+						entry.ReferenceOffsets = stack.GetReferenceOffsets();
+						entries.push_back(entry);
+						if (instruction == Instruction::send)
+							stack.Pop(channel.GetElementType());
+						else
+							stack.Push(channel.GetElementType());
+					}
+					break;
+				case Instruction::send_m:
+				case Instruction::recv_m:
+					{
+						chanref_t channelId;
+						assemblyReader.ChannelMemoryAccess(bufferIterator, channelId, registerId);
+						_CheckMRegister(registerId);
+						_GetChannel(channelId);
+						entry.ReferenceOffsets = stack.GetReferenceOffsets();
+						entries.push_back(entry);
+					}
+					break;
+				case Instruction::pmap:
+					{
+						Register destinationId;
+						assemblyReader.PMap(bufferIterator, scopeId, registerId, destinationId);
+						_CheckMRegister(registerId);
+						_CheckMRegister(destinationId);
+						const ScopeSignature & signature = _GetCalleeSignature(scopeId);
+						if (!IsMapSignature(signature))
+							throw VerificationException("Mapped scopes must take one scalar value and return another.");
+
+						stack.Pop(ValueType::i4);
+						stack.Pop(ValueType::i4);
+						// Without a parallel mapper, the scope runs in this context.
+						entry.ReferenceOffsets = stack.GetReferenceOffsets();
+						entries.push_back(entry);
+					}
+					break;
+				case Instruction::set_spr:
+					assemblyReader.SetSpR(bufferIterator, registerId);
+					stack.SetFrameRegister(_GetFrameRegisterIndex(registerId));
+					break;
+				case Instruction::ld_i1s:
+					_CheckFrameAccess(assemblyReader, bufferIterator, stack, ValueType::i1);
+					stack.Push(ValueType::i1);
+					break;
+				case Instruction::ld_i2s:
+					_CheckFrameAccess(assemblyReader, bufferIterator, stack, ValueType::i2);
+					stack.Push(ValueType::i2);
+					break;
+				case Instruction::ld_i4s:
+					_CheckFrameAccess(assemblyReader, bufferIterator, stack, ValueType::i4);
+					stack.Push(ValueType::i4);
+					break;
+				case Instruction::ld_i8s:
+					_CheckFrameAccess(assemblyReader, bufferIterator, stack, ValueType::i8);
+					stack.Push(ValueType::i8);
+					break;
+				case Instruction::ld_fss:
+					_CheckFrameAccess(assemblyReader, bufferIterator, stack, ValueType::fs);
+					stack.Push(ValueType::fs);
+					break;
+				case Instruction::ld_fds:
+					_CheckFrameAccess(assemblyReader, bufferIterator, stack, ValueType::fd);
+					stack.Push(ValueType::fd);
+					break;
+				case Instruction::ld_rfs:
+					_CheckFrameAccess(assemblyReader, bufferIterator, stack, ValueType::rf);
+					stack.Push(ValueType::rf);
+					break;
+				case Instruction::st_i1s:
+					stack.Pop(ValueType::i1);
+					_CheckFrameAccess(assemblyReader, bufferIterator, stack, ValueType::i1);
+					break;
+				case Instruction::st_i2s:
+					stack.Pop(ValueType::i2);
+					_CheckFrameAccess(assemblyReader, bufferIterator, stack, ValueType::i2);
+					break;
+				case Instruction::st_i4s:
+					stack.Pop(ValueType::i4);
+					_CheckFrameAccess(assemblyReader, bufferIterator, stack, ValueType::i4);
+					break;
+				case Instruction::st_i8s:
+					stack.Pop(ValueType::i8);
+					_CheckFrameAccess(assemblyReader, bufferIterator, stack, ValueType::i8);
+					break;
+				case Instruction::st_fss:
+					stack.Pop(ValueType::fs);
+					_CheckFrameAccess(assemblyReader, bufferIterator, stack, ValueType::fs);
+					break;
+				case Instruction::st_fds:
+					stack.Pop(ValueType::fd);
+					_CheckFrameAccess(assemblyReader, bufferIterator, stack, ValueType::fd);
+					break;
+				case Instruction::st_rfs:
+					stack.Pop(ValueType::rf);
+					_CheckFrameAccess(assemblyReader, bufferIterator, stack, ValueType::rf);
+					break;
+				case Instruction::dup:
+					assemblyReader.StackOperation(bufferIterator, type);
+					stack.Pop(type);
+					stack.Push(type);
+					stack.Push(type);
+					break;
+				case Instruction::swap:
+					assemblyReader.StackOperation(bufferIterator, type);
+					stack.Pop(type);
+					stack.Pop(type);
+					stack.Push(type);
+					stack.Push(type);
+					break;
+				case Instruction::pick:
+					assemblyReader.Pick(bufferIterator, type, offset);
+					if (offset < 0 || !stack.HasValue(stack.GetTop() - offset - static_cast<std::int32_t>(GetValueTypeSize(type)), type))
+						throw VerificationException("The value picked isn't in the stack.");
+					stack.Push(type);
+					break;
+				case Instruction::drop_n:
+					assemblyReader.DropN(bufferIterator, offset);
+					stack.Drop(offset);
+					break;
+				case Instruction::ld_k:
+				case Instruction::ldx_k:
+					assemblyReader.ConstantAccess(bufferIterator, type, constant);
+					if (_GetConstantType(constant, instruction == Instruction::ldx_k) != type)
+						throw VerificationException("The type doesn't match the constant.");
+					if (instruction == Instruction::ldx_k)
+						stack.Pop(ValueType::i4);
+					stack.Push(type);
+					break;
+				case Instruction::alloc_k:
+					assemblyReader.AllocK(bufferIterator, registerId, constant);
+					_CheckMRegister(registerId);
+					_GetConstantType(constant, true);
+					entry.ReferenceOffsets = stack.GetReferenceOffsets();
+					entries.push_back(entry);
+					break;
+				default:
+					throw VerificationException("Unsupported instruction.");
+				}
+				return true;
+			}
+
+		inline void _Verify(
+			RuntimeScope & scope
+			) {
+				_activeScopes.push_back(scope.GetId());
+
+				Internal::VerifierStack initialStack;
+				if (scope.HasDeclaredSignature())
+					initialStack.SetParameters(scope.GetSignature().GetParameters());
+
+				// The code is simulated once per instruction, following the branches. Every path
+				// reaching an instruction must have the same stack, so the state of the first one
+				// holds for all of them.
+				const DynamicBuffer & code = scope.GetCodeBuffer();
+				std::vector<size_t> instructionOffsets;
+				std::vector<Internal::VerifierStack> states;
+				std::vector<bool> reached;
+				std::vector<size_t> pending;
+				Internal::VerifierStack exitStack;
+				bool exits = false;
+				std::int32_t maxTop = initialStack.GetMaxTop();
+				bool setsFrameRegisters = false;
+
+				std::vector<_PendingEntry> entries;
+				try {
+					AssemblyReader assemblyReader;
+					DynamicBuffer::ConstIterator bufferIterator = code.GetConstIterator();
+					while (bufferIterator.HasData()) {
+						size_t size = AssemblyReader::GetInstructionSize(assemblyReader.GetInstructionId(bufferIterator));
+						if (size == 0)
+							throw VerificationException("Unsupported instruction.");
+						if (bufferIterator.GetOffset() + size > code.GetSize())
+							throw VerificationException("The code ends in the middle of an instruction.");
+						instructionOffsets.push_back(bufferIterator.GetOffset());
+						if (assemblyReader.GetInstructionId(bufferIterator) == Instruction::set_spr)
+							setsFrameRegisters = true;
+						bufferIterator.Skip(size);
+					}
+					instructionOffsets.push_back(code.GetSize());
+					states.resize(instructionOffsets.size());
+					reached.resize(instructionOffsets.size(), false);
+
+					auto mergeState = [&] (size_t index, const Internal::VerifierStack & stack) {
+						if (index == instructionOffsets.size() - 1) {
+							if (exits && !exitStack.HasSameShape(stack))
+								throw VerificationException("The stack doesn't match in all the exits of the scope.");
+							exitStack = stack;
+							exits = true;
+						} else if (!reached[index]) {
+							states[index] = stack;
+							reached[index] = true;
+							pending.push_back(index);
+						} else if (!states[index].HasSameShape(stack)) {
+							throw VerificationException("The stack doesn't match in all the paths reaching an instruction.");
+						}
+					};
+					mergeState(0, initialStack);
+
+					while (!pending.empty()) {
+						size_t index = pending.back();
+						pending.pop_back();
+
+						Internal::VerifierStack stack = states[index];
+						bufferIterator.Seek(instructionOffsets[index]);
+						bool continues = _VerifyInstruction(assemblyReader, bufferIterator, stack, entries);
+						maxTop = std::max(maxTop, stack.GetMaxTop());
+
+						std::int32_t offset;
+						if (_GetBranchOffset(assemblyReader, bufferIterator, offset)) {
+							std::int64_t target = static_cast<std::int64_t>(instructionOffsets[index + 1]) + offset;
+							auto it = std::lower_bound(instructionOffsets.begin(), instructionOffsets.end(), target);
+							if (target < 0 || it == instructionOffsets.end() || static_cast<std::int64_t>(* it) != target)
+								throw VerificationException("The branch target isn't an instruction of the scope.");
+							mergeState(static_cast<size_t>(it - instructionOffsets.begin()), stack);
+						}
+
+						if (continues)
+							mergeState(index + 1, stack);
+						else if (assemblyReader.GetInstructionId(bufferIterator) == Instruction::ret)
+							mergeState(instructionOffsets.size() - 1, stack);
+					}
+				} catch (...) {
+					_activeScopes.pop_back();
+					throw;
+				}
+				_activeScopes.pop_back();
+
+				if (!exits && !scope.HasDeclaredSignature())
+					throw VerificationException("Scopes that never return must declare their signature.");
+
+				ScopeSignature signature = scope.HasDeclaredSignature()
+					? scope.GetSignature()
+					: ScopeSignature(exitStack.GetInferredParameters(), exitStack.GetValues());
+				if (exits && signature.GetResults() != exitStack.GetValues())
+					throw VerificationException("The scope results don't match its declared signature.");
+
+				std::sort(entries.begin(), entries.end(),
+					[] (const _PendingEntry & a, const _PendingEntry & b) {
+						return a.InstructionOffset < b.InstructionOffset;
+					});
+
+				std::int32_t parametersSize = static_cast<std::int32_t>(signature.GetParametersSize());
+				ScopeStackMap stackMap;
+				for (auto & entry : entries) {
+					std::vector<std::uint32_t> referenceOffsets;
+					for (auto offset : entry.ReferenceOffsets)
+						referenceOffsets.push_back(static_cast<std::uint32_t>(offset + parametersSize));
+					stackMap.AddEntry(entry.InstructionOffset, referenceOffsets);
+				}
+
+				scope.SetVerificationResult(signature, stackMap, maxTop + parametersSize, setsFrameRegisters);
+			}
+
+	public:
+		inline explicit ScopeVerifier(
+			RuntimeScopeManager & scopeManager
+			)
+			: _scopeManager(scopeManager)
+			{
+			}
+
+		/// <summary>
+		/// Verifies a scope and the scopes it calls, and stores the results in them. Lazy scopes are
+		/// loaded first, and verified once by the thread loading them.
+		/// </summary>
+		/// <remarks>
+		/// Threads running or mapping a scope verify it when they first need it, so the verification
+		/// holds the verification mutex of the manager, and a scope another thread verified meanwhile
+		/// isn't verified again while its results are being read.
+		/// </remarks>
+		inline void Verify(
+			RuntimeScope & scope
+			) {
+				std::lock_guard<std::recursive_mutex> lock(_scopeManager.GetVerificationMutex());
+				if (scope.IsLoaded() && scope.IsVerified())
+					return;
+				if (scope.IsLoaded()) {
+					_Verify(scope);
+					return;
+				}
+				scope.Load([this] (RuntimeScope & loadedScope) {
+					_Verify(loadedScope);
+				});
+			}
+
+		/// <summary>
+		/// Returns true if the signature takes one scalar value and returns another, so the scope can
+		/// be used by pmap.
+		/// </summary>
+		static inline bool IsMapSignature(
+			const ScopeSignature & signature
+			) {
+				if (signature.GetParameters().size() != 1 || signature.GetResults().size() != 1)
+					return false;
+				ValueType parameter = signature.GetParameters()[0], result = signature.GetResults()[0];
+				return parameter != ValueType::rf && !IsVectorType(parameter)
+					&& result != ValueType::rf && !IsVectorType(result);
+			}
+
+		/// <summary>
+		/// Verifies all the scopes of the manager that weren't verified yet, loading the lazy ones.
+		/// </summary>
+		inline void VerifyAll(
+			) {
+				for (size_t i = 0; i < _scopeManager.GetScopeCount(); ++i) {
+					RuntimeScope & scope = _scopeManager.GetScope(reinterpret_cast<scoperef_t>(i));
+					if (!scope.IsLoaded() || !scope.IsVerified())
+						Verify(scope);
+				}
+			}
+	};
+
+} // namespace Nova
+
+#endif // !_NOVA_RUNTIME_ENVIRONMENT_SCOPE_VERIFIER_HEADER_
\ No newline at end of file
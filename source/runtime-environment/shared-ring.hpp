@@ -0,0 +1,178 @@
+//
+// shared-ring.hpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#ifndef _NOVA_RUNTIME_ENVIRONMENT_SHARED_RING_HEADER_
+#define _NOVA_RUNTIME_ENVIRONMENT_SHARED_RING_HEADER_
+
+#include "..\common\exception.hpp"
+#include "..\common\dynamic-buffer.hpp"
+#include "..\common\platform.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <new>
+
+namespace Nova {
+
+	namespace Internal {
+		/// <summary>
+		/// Positions of a shared ring, which count the bytes written and read since it was created, so
+		/// they wrap around. Each one is on its own cache line.
+		/// </summary>
+		struct SharedRingHeader {
+			std::atomic<std::uint32_t> WritePosition;
+			std::int8_t Padding0[CacheLineSize - sizeof(std::atomic<std::uint32_t>)];
+			std::atomic<std::uint32_t> ReadPosition;
+			std::int8_t Padding1[CacheLineSize - sizeof(std::atomic<std::uint32_t>)];
+		};
+
+		struct SharedRingRecord {
+			std::uint32_t Size;
+			std::uint32_t Kind;
+		};
+
+		/// <summary>
+		/// Queue of messages of any size in memory shared by two processes, with one writer and one
+		/// reader.
+		/// </summary>
+		/// <remarks>
+		/// <para>Messages are records holding their size and kind, aligned to eight bytes. A record
+		/// never wraps around the end of the ring: if it doesn't fit, the rest of the ring is skipped
+		/// with a padding record. That's why messages can't be larger than half the ring.</para>
+		/// <para>The ring holds offsets only, so each process can map it at a different address. The
+		/// reader doesn't trust the writer: records which would go out of the ring are rejected.</para>
+		/// </remarks>
+		class SharedRing {
+			static const std::uint32_t _PaddingKind = 0xffffffff;
+
+			SharedRingHeader * _header;
+			std::int8_t * _data;
+			std::uint32_t _capacity;
+
+			static inline std::uint32_t _GetRecordSize(
+				size_t size
+				) {
+					return static_cast<std::uint32_t>((sizeof(SharedRingRecord) + size + 7) & ~size_t(7));
+				}
+
+		public:
+			/// <summary>
+			/// Returns the bytes of shared memory used by a ring.
+			/// </summary>
+			static inline size_t GetRequiredSize(
+				size_t capacity
+				) {
+					return sizeof(SharedRingHeader) + capacity;
+				}
+
+			/// <param name='memory'>Shared memory holding the ring, aligned to a cache line.</param>
+			/// <param name='capacity'>Bytes of messages the ring holds: a power of two, and at least
+			/// 64.</param>
+			/// <param name='initialize'>True for the process creating the ring, false for the one
+			/// opening it.</param>
+			inline SharedRing(
+				void * memory, size_t capacity, bool initialize
+				)
+				: _header(reinterpret_cast<SharedRingHeader *>(memory)),
+				  _data(reinterpret_cast<std::int8_t *>(memory) + sizeof(SharedRingHeader)),
+				  _capacity(static_cast<std::uint32_t>(capacity))
+				{
+					if (capacity < 64 || capacity > 0x80000000 || (capacity & (capacity - 1)) != 0)
+						throw InvalidArgumentException("The capacity of a shared ring must be a power of two.");
+					if (initialize) {
+						new (&_header->WritePosition) std::atomic<std::uint32_t>(0);
+						new (&_header->ReadPosition) std::atomic<std::uint32_t>(0);
+					}
+				}
+
+			inline size_t GetMaxMessageSize(
+				) const {
+					return _capacity / 2 - sizeof(SharedRingRecord);
+				}
+
+			/// <summary>
+			/// Writes a message made of two parts, usually a fixed header and a payload. Returns false,
+			/// without blocking, if the ring doesn't have room for it yet.
+			/// </summary>
+			inline bool TryWrite(
+				std::uint32_t kind, const void * header, size_t headerSize, const void * payload, size_t payloadSize
+				) {
+					size_t size = headerSize + payloadSize;
+					if (size > GetMaxMessageSize() || kind == _PaddingKind)
+						throw InvalidArgumentException("The message doesn't fit in the shared ring.");
+
+					std::uint32_t recordSize = _GetRecordSize(size);
+					std::uint32_t write = _header->WritePosition.load(std::memory_order_relaxed);
+					std::uint32_t read = _header->ReadPosition.load(std::memory_order_acquire);
+					std::uint32_t offset = write & (_capacity - 1);
+					std::uint32_t tail = _capacity - offset;
+					if (_capacity - (write - read) < recordSize + (tail < recordSize ? tail : 0))
+						return false;
+
+					if (tail < recordSize) {
+						SharedRingRecord padding = { tail - static_cast<std::uint32_t>(sizeof(SharedRingRecord)), _PaddingKind };
+						memcpy(_data + offset, &padding, sizeof padding);
+						write += tail;
+						offset = 0;
+					}
+
+					SharedRingRecord record = { static_cast<std::uint32_t>(size), kind };
+					std::int8_t * data = _data + offset;
+					memcpy(data, &record, sizeof record);
+					if (headerSize != 0)
+						memcpy(data + sizeof record, header, headerSize);
+					if (payloadSize != 0)
+						memcpy(data + sizeof record + headerSize, payload, payloadSize);
+					_header->WritePosition.store(write + recordSize, std::memory_order_release);
+					return true;
+				}
+
+			inline bool TryWrite(
+				std::uint32_t kind, const void * payload, size_t payloadSize
+				) {
+					return TryWrite(kind, nullptr, 0, payload, payloadSize);
+				}
+
+			/// <summary>
+			/// Copies the oldest message out of the ring. Returns false, without blocking, if the ring
+			/// is empty.
+			/// </summary>
+			inline bool TryRead(
+				std::uint32_t & kind, DynamicBuffer & message
+				) {
+					std::uint32_t read = _header->ReadPosition.load(std::memory_order_relaxed);
+					std::uint32_t write = _header->WritePosition.load(std::memory_order_acquire);
+					if (write - read > _capacity)
+						throw RuntimeException("The shared ring is corrupted.");
+
+					while (read != write) {
+						std::uint32_t offset = read & (_capacity - 1);
+						SharedRingRecord record;
+						memcpy(&record, _data + offset, sizeof record);
+						if (record.Size > _capacity - offset - sizeof record || _GetRecordSize(record.Size) > write - read)
+							throw RuntimeException("The shared ring is corrupted.");
+
+						read += _GetRecordSize(record.Size);
+						if (record.Kind == _PaddingKind)
+							continue;
+
+						kind = record.Kind;
+						message.Clear();
+						message.Push(_data + offset + sizeof record, record.Size);
+						_header->ReadPosition.store(read, std::memory_order_release);
+						return true;
+					}
+					_header->ReadPosition.store(read, std::memory_order_release);
+					return false;
+				}
+		};
+	}
+
+} // namespace Nova
+
+#endif // !_NOVA_RUNTIME_ENVIRONMENT_SHARED_RING_HEADER_
\ No newline at end of file
@@ -0,0 +1,448 @@
+//
+// vector-kernels.hpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#ifndef _NOVA_RUNTIME_ENVIRONMENT_VECTOR_KERNELS_HEADER_
+#define _NOVA_RUNTIME_ENVIRONMENT_VECTOR_KERNELS_HEADER_
+
+#include "..\common\exception.hpp"
+#include "..\common\platform.hpp"
+#include "..\common\type-traits.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace Nova {
+
+	namespace Internal {
+		/// <summary>
+		/// Kernel for a lane-wise operation over two vectors. Vectors don't need to be aligned.
+		/// </summary>
+		typedef void (* VectorBinaryKernel) (void * result, const void * a, const void * b);
+
+		/// <summary>
+		/// Kernel selecting the lanes of b whose mask lane has the sign bit set, and the lanes of a
+		/// for the rest.
+		/// </summary>
+		typedef void (* VectorBlendKernel) (void * result, const void * a, const void * b, const void * mask);
+
+		/// <summary>
+		/// Lane-wise operations. Comparisons set all the bits of the lanes where they are true.
+		/// </summary>
+		enum VectorBinaryOperation {
+			VectorAdd = 0,
+			VectorSubtract,
+			VectorMultiply,
+			VectorMinimum,
+			VectorMaximum,
+			VectorCompareEqual,
+			VectorCompareLess,
+			VectorBinaryOperationCount
+		};
+
+		enum VectorReduceOperation {
+			VectorReduceAdd = 0,
+			VectorReduceMinimum,
+			VectorReduceMaximum
+		};
+
+		static const size_t VectorTypeCount = 6;
+
+		inline size_t GetVectorTypeIndex(
+			ValueType type
+			) {
+				return static_cast<size_t>(type) - static_cast<size_t>(ValueType::v4i4);
+			}
+
+		struct VectorKernelTable {
+			VectorBinaryKernel Binary[VectorBinaryOperationCount][VectorTypeCount];
+			VectorBlendKernel Blend[VectorTypeCount];
+		};
+
+		/// <summary>
+		/// Lane operations of the scalar kernels. Integer lanes wrap around on overflow.
+		/// </summary>
+		class ScalarVectorOperations {
+			template <typename _Ty>
+			static inline _Ty _GetMask(
+				bool value
+				) {
+					_Ty mask;
+					memset(&mask, value ? 0xFF : 0, sizeof mask);
+					return mask;
+				}
+
+		public:
+			template <typename _Ty>
+			static inline bool IsMaskSet(
+				const _Ty & lane
+				) {
+					typename std::conditional<sizeof(_Ty) == 4, std::int32_t, std::int64_t>::type bits;
+					memcpy(&bits, &lane, sizeof bits);
+					return bits < 0;
+				}
+
+			struct Add {
+				template <typename _Ty>
+				static inline _Ty Apply(_Ty a, _Ty b) { return a + b; }
+				static inline std::int32_t Apply(std::int32_t a, std::int32_t b) {
+					return static_cast<std::int32_t>(static_cast<std::uint32_t>(a) + static_cast<std::uint32_t>(b));
+				}
+			};
+
+			struct Subtract {
+				template <typename _Ty>
+				static inline _Ty Apply(_Ty a, _Ty b) { return a - b; }
+				static inline std::int32_t Apply(std::int32_t a, std::int32_t b) {
+					return static_cast<std::int32_t>(static_cast<std::uint32_t>(a) - static_cast<std::uint32_t>(b));
+				}
+			};
+
+			struct Multiply {
+				template <typename _Ty>
+				static inline _Ty Apply(_Ty a, _Ty b) { return a * b; }
+				static inline std::int32_t Apply(std::int32_t a, std::int32_t b) {
+					return static_cast<std::int32_t>(static_cast<std::uint32_t>(a) * static_cast<std::uint32_t>(b));
+				}
+			};
+
+			// Same results as the SIMD instructions: the second operand is returned when the
+			// lanes are unordered.
+			struct Minimum {
+				template <typename _Ty>
+				static inline _Ty Apply(_Ty a, _Ty b) { return a < b ? a : b; }
+			};
+
+			struct Maximum {
+				template <typename _Ty>
+				static inline _Ty Apply(_Ty a, _Ty b) { return a > b ? a : b; }
+			};
+
+			struct CompareEqual {
+				template <typename _Ty>
+				static inline _Ty Apply(_Ty a, _Ty b) { return _GetMask<_Ty>(a == b); }
+			};
+
+			struct CompareLess {
+				template <typename _Ty>
+				static inline _Ty Apply(_Ty a, _Ty b) { return _GetMask<_Ty>(a < b); }
+			};
+
+			template <typename _Ty, size_t _Count, typename _Operation>
+			static void Binary(
+				void * result, const void * a, const void * b
+				) {
+					_Ty x[_Count], y[_Count];
+					memcpy(x, a, sizeof x);
+					memcpy(y, b, sizeof y);
+					for (size_t i = 0; i < _Count; ++i)
+						x[i] = _Operation::Apply(x[i], y[i]);
+					memcpy(result, x, sizeof x);
+				}
+
+			template <typename _Ty, size_t _Count>
+			static void Blend(
+				void * result, const void * a, const void * b, const void * mask
+				) {
+					_Ty x[_Count], y[_Count], m[_Count];
+					memcpy(x, a, sizeof x);
+					memcpy(y, b, sizeof y);
+					memcpy(m, mask, sizeof m);
+					for (size_t i = 0; i < _Count; ++i) {
+						if (IsMaskSet(m[i]))
+							x[i] = y[i];
+					}
+					memcpy(result, x, sizeof x);
+				}
+
+			template <typename _Ty, size_t _Count>
+			static void Fill(
+				VectorKernelTable & table, ValueType type
+				) {
+					size_t index = GetVectorTypeIndex(type);
+					table.Binary[VectorAdd][index] = Binary<_Ty, _Count, Add>;
+					table.Binary[VectorSubtract][index] = Binary<_Ty, _Count, Subtract>;
+					table.Binary[VectorMultiply][index] = Binary<_Ty, _Count, Multiply>;
+					table.Binary[VectorMinimum][index] = Binary<_Ty, _Count, Minimum>;
+					table.Binary[VectorMaximum][index] = Binary<_Ty, _Count, Maximum>;
+					table.Binary[VectorCompareEqual][index] = Binary<_Ty, _Count, CompareEqual>;
+					table.Binary[VectorCompareLess][index] = Binary<_Ty, _Count, CompareLess>;
+					table.Blend[index] = Blend<_Ty, _Count>;
+				}
+
+			template <typename _Ty, size_t _Count>
+			static void Reduce(
+				VectorReduceOperation operation, const void * a, void * result
+				) {
+					_Ty x[_Count];
+					memcpy(x, a, sizeof x);
+					_Ty value = x[0];
+					for (size_t i = 1; i < _Count; ++i) {
+						switch (operation) {
+						case VectorReduceAdd: value = Add::Apply(value, x[i]); break;
+						case VectorReduceMinimum: value = Minimum::Apply(value, x[i]); break;
+						default: value = Maximum::Apply(value, x[i]); break;
+						}
+					}
+					memcpy(result, &value, sizeof value);
+				}
+		};
+
+#if defined(NOVA_X86)
+		/// <summary>
+		/// Kernels using SSE and AVX instructions. Each one requires the instruction set named in its target.
+		/// </summary>
+		class SimdVectorOperations {
+#define NOVA_VECTOR_KERNEL(name, target, type, load, store, operation) \
+			target static void name(void * result, const void * a, const void * b) { \
+				store(reinterpret_cast<type *>(result), operation( \
+					load(reinterpret_cast<const type *>(a)), load(reinterpret_cast<const type *>(b)))); \
+			}
+#define NOVA_VECTOR_BLEND_KERNEL(name, target, type, load, store, blend) \
+			target static void name(void * result, const void * a, const void * b, const void * mask) { \
+				store(reinterpret_cast<type *>(result), blend(load(reinterpret_cast<const type *>(a)), \
+					load(reinterpret_cast<const type *>(b)), load(reinterpret_cast<const type *>(mask)))); \
+			}
+
+			// Operations without a single intrinsic. Integer lanes are blended as floats, which also
+			// select by the sign bit of every lane.
+			NOVA_TARGET_SSE41 static inline __m128i _BlendV4I4(__m128i a, __m128i b, __m128i mask) {
+				return _mm_castps_si128(_mm_blendv_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _mm_castsi128_ps(mask)));
+			}
+			NOVA_TARGET_AVX2 static inline __m256i _CompareLessV8I4(__m256i a, __m256i b) {
+				return _mm256_cmpgt_epi32(b, a);
+			}
+			NOVA_TARGET_AVX static inline __m256i _BlendV8I4(__m256i a, __m256i b, __m256i mask) {
+				return _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(a), _mm256_castsi256_ps(b), _mm256_castsi256_ps(mask)));
+			}
+			NOVA_TARGET_AVX static inline __m256 _CompareEqualV8Fs(__m256 a, __m256 b) {
+				return _mm256_cmp_ps(a, b, _CMP_EQ_OQ);
+			}
+			NOVA_TARGET_AVX static inline __m256 _CompareLessV8Fs(__m256 a, __m256 b) {
+				return _mm256_cmp_ps(a, b, _CMP_LT_OQ);
+			}
+			NOVA_TARGET_AVX static inline __m256d _CompareEqualV4Fd(__m256d a, __m256d b) {
+				return _mm256_cmp_pd(a, b, _CMP_EQ_OQ);
+			}
+			NOVA_TARGET_AVX static inline __m256d _CompareLessV4Fd(__m256d a, __m256d b) {
+				return _mm256_cmp_pd(a, b, _CMP_LT_OQ);
+			}
+
+		public:
+			NOVA_VECTOR_KERNEL(AddV4I4, NOVA_TARGET_SSE2, __m128i, _mm_loadu_si128, _mm_storeu_si128, _mm_add_epi32)
+			NOVA_VECTOR_KERNEL(SubtractV4I4, NOVA_TARGET_SSE2, __m128i, _mm_loadu_si128, _mm_storeu_si128, _mm_sub_epi32)
+			NOVA_VECTOR_KERNEL(MultiplyV4I4, NOVA_TARGET_SSE41, __m128i, _mm_loadu_si128, _mm_storeu_si128, _mm_mullo_epi32)
+			NOVA_VECTOR_KERNEL(MinimumV4I4, NOVA_TARGET_SSE41, __m128i, _mm_loadu_si128, _mm_storeu_si128, _mm_min_epi32)
+			NOVA_VECTOR_KERNEL(MaximumV4I4, NOVA_TARGET_SSE41, __m128i, _mm_loadu_si128, _mm_storeu_si128, _mm_max_epi32)
+			NOVA_VECTOR_KERNEL(CompareEqualV4I4, NOVA_TARGET_SSE2, __m128i, _mm_loadu_si128, _mm_storeu_si128, _mm_cmpeq_epi32)
+			NOVA_VECTOR_KERNEL(CompareLessV4I4, NOVA_TARGET_SSE2, __m128i, _mm_loadu_si128, _mm_storeu_si128, _mm_cmplt_epi32)
+			NOVA_VECTOR_BLEND_KERNEL(BlendV4I4, NOVA_TARGET_SSE41, __m128i, _mm_loadu_si128, _mm_storeu_si128, _BlendV4I4)
+
+			NOVA_VECTOR_KERNEL(AddV4Fs, NOVA_TARGET_SSE2, float, _mm_loadu_ps, _mm_storeu_ps, _mm_add_ps)
+			NOVA_VECTOR_KERNEL(SubtractV4Fs, NOVA_TARGET_SSE2, float, _mm_loadu_ps, _mm_storeu_ps, _mm_sub_ps)
+			NOVA_VECTOR_KERNEL(MultiplyV4Fs, NOVA_TARGET_SSE2, float, _mm_loadu_ps, _mm_storeu_ps, _mm_mul_ps)
+			NOVA_VECTOR_KERNEL(MinimumV4Fs, NOVA_TARGET_SSE2, float, _mm_loadu_ps, _mm_storeu_ps, _mm_min_ps)
+			NOVA_VECTOR_KERNEL(MaximumV4Fs, NOVA_TARGET_SSE2, float, _mm_loadu_ps, _mm_storeu_ps, _mm_max_ps)
+			NOVA_VECTOR_KERNEL(CompareEqualV4Fs, NOVA_TARGET_SSE2, float, _mm_loadu_ps, _mm_storeu_ps, _mm_cmpeq_ps)
+			NOVA_VECTOR_KERNEL(CompareLessV4Fs, NOVA_TARGET_SSE2, float, _mm_loadu_ps, _mm_storeu_ps, _mm_cmplt_ps)
+			NOVA_VECTOR_BLEND_KERNEL(BlendV4Fs, NOVA_TARGET_SSE41, float, _mm_loadu_ps, _mm_storeu_ps, _mm_blendv_ps)
+
+			NOVA_VECTOR_KERNEL(AddV2Fd, NOVA_TARGET_SSE2, double, _mm_loadu_pd, _mm_storeu_pd, _mm_add_pd)
+			NOVA_VECTOR_KERNEL(SubtractV2Fd, NOVA_TARGET_SSE2, double, _mm_loadu_pd, _mm_storeu_pd, _mm_sub_pd)
+			NOVA_VECTOR_KERNEL(MultiplyV2Fd, NOVA_TARGET_SSE2, double, _mm_loadu_pd, _mm_storeu_pd, _mm_mul_pd)
+			NOVA_VECTOR_KERNEL(MinimumV2Fd, NOVA_TARGET_SSE2, double, _mm_loadu_pd, _mm_storeu_pd, _mm_min_pd)
+			NOVA_VECTOR_KERNEL(MaximumV2Fd, NOVA_TARGET_SSE2, double, _mm_loadu_pd, _mm_storeu_pd, _mm_max_pd)
+			NOVA_VECTOR_KERNEL(CompareEqualV2Fd, NOVA_TARGET_SSE2, double, _mm_loadu_pd, _mm_storeu_pd, _mm_cmpeq_pd)
+			NOVA_VECTOR_KERNEL(CompareLessV2Fd, NOVA_TARGET_SSE2, double, _mm_loadu_pd, _mm_storeu_pd, _mm_cmplt_pd)
+			NOVA_VECTOR_BLEND_KERNEL(BlendV2Fd, NOVA_TARGET_SSE41, double, _mm_loadu_pd, _mm_storeu_pd, _mm_blendv_pd)
+
+			NOVA_VECTOR_KERNEL(AddV8I4, NOVA_TARGET_AVX2, __m256i, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_add_epi32)
+			NOVA_VECTOR_KERNEL(SubtractV8I4, NOVA_TARGET_AVX2, __m256i, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_sub_epi32)
+			NOVA_VECTOR_KERNEL(MultiplyV8I4, NOVA_TARGET_AVX2, __m256i, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_mullo_epi32)
+			NOVA_VECTOR_KERNEL(MinimumV8I4, NOVA_TARGET_AVX2, __m256i, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_min_epi32)
+			NOVA_VECTOR_KERNEL(MaximumV8I4, NOVA_TARGET_AVX2, __m256i, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_max_epi32)
+			NOVA_VECTOR_KERNEL(CompareEqualV8I4, NOVA_TARGET_AVX2, __m256i, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_cmpeq_epi32)
+			NOVA_VECTOR_KERNEL(CompareLessV8I4, NOVA_TARGET_AVX2, __m256i, _mm256_loadu_si256, _mm256_storeu_si256, _CompareLessV8I4)
+			NOVA_VECTOR_BLEND_KERNEL(BlendV8I4, NOVA_TARGET_AVX, __m256i, _mm256_loadu_si256, _mm256_storeu_si256, _BlendV8I4)
+
+			NOVA_VECTOR_KERNEL(AddV8Fs, NOVA_TARGET_AVX, float, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_add_ps)
+			NOVA_VECTOR_KERNEL(SubtractV8Fs, NOVA_TARGET_AVX, float, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_sub_ps)
+			NOVA_VECTOR_KERNEL(MultiplyV8Fs, NOVA_TARGET_AVX, float, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_mul_ps)
+			NOVA_VECTOR_KERNEL(MinimumV8Fs, NOVA_TARGET_AVX, float, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_min_ps)
+			NOVA_VECTOR_KERNEL(MaximumV8Fs, NOVA_TARGET_AVX, float, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_max_ps)
+			NOVA_VECTOR_KERNEL(CompareEqualV8Fs, NOVA_TARGET_AVX, float, _mm256_loadu_ps, _mm256_storeu_ps, _CompareEqualV8Fs)
+			NOVA_VECTOR_KERNEL(CompareLessV8Fs, NOVA_TARGET_AVX, float, _mm256_loadu_ps, _mm256_storeu_ps, _CompareLessV8Fs)
+			NOVA_VECTOR_BLEND_KERNEL(BlendV8Fs, NOVA_TARGET_AVX, float, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_blendv_ps)
+
+			NOVA_VECTOR_KERNEL(AddV4Fd, NOVA_TARGET_AVX, double, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_add_pd)
+			NOVA_VECTOR_KERNEL(SubtractV4Fd, NOVA_TARGET_AVX, double, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_sub_pd)
+			NOVA_VECTOR_KERNEL(MultiplyV4Fd, NOVA_TARGET_AVX, double, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_mul_pd)
+			NOVA_VECTOR_KERNEL(MinimumV4Fd, NOVA_TARGET_AVX, double, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_min_pd)
+			NOVA_VECTOR_KERNEL(MaximumV4Fd, NOVA_TARGET_AVX, double, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_max_pd)
+			NOVA_VECTOR_KERNEL(CompareEqualV4Fd, NOVA_TARGET_AVX, double, _mm256_loadu_pd, _mm256_storeu_pd, _CompareEqualV4Fd)
+			NOVA_VECTOR_KERNEL(CompareLessV4Fd, NOVA_TARGET_AVX, double, _mm256_loadu_pd, _mm256_storeu_pd, _CompareLessV4Fd)
+			NOVA_VECTOR_BLEND_KERNEL(BlendV4Fd, NOVA_TARGET_AVX, double, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_blendv_pd)
+
+#undef NOVA_VECTOR_KERNEL
+#undef NOVA_VECTOR_BLEND_KERNEL
+
+			/// <summary>
+			/// Replaces the scalar kernels of a table with the ones supported by the processor.
+			/// </summary>
+			static void Fill(
+				VectorKernelTable & table, const CpuFeatures & features
+				) {
+					size_t v4i4 = GetVectorTypeIndex(ValueType::v4i4), v8i4 = GetVectorTypeIndex(ValueType::v8i4);
+					size_t v4fs = GetVectorTypeIndex(ValueType::v4fs), v8fs = GetVectorTypeIndex(ValueType::v8fs);
+					size_t v2fd = GetVectorTypeIndex(ValueType::v2fd), v4fd = GetVectorTypeIndex(ValueType::v4fd);
+
+					if (features.Sse2) {
+						table.Binary[VectorAdd][v4i4] = AddV4I4;
+						table.Binary[VectorSubtract][v4i4] = SubtractV4I4;
+						table.Binary[VectorCompareEqual][v4i4] = CompareEqualV4I4;
+						table.Binary[VectorCompareLess][v4i4] = CompareLessV4I4;
+
+						table.Binary[VectorAdd][v4fs] = AddV4Fs;
+						table.Binary[VectorSubtract][v4fs] = SubtractV4Fs;
+						table.Binary[VectorMultiply][v4fs] = MultiplyV4Fs;
+						table.Binary[VectorMinimum][v4fs] = MinimumV4Fs;
+						table.Binary[VectorMaximum][v4fs] = MaximumV4Fs;
+						table.Binary[VectorCompareEqual][v4fs] = CompareEqualV4Fs;
+						table.Binary[VectorCompareLess][v4fs] = CompareLessV4Fs;
+
+						table.Binary[VectorAdd][v2fd] = AddV2Fd;
+						table.Binary[VectorSubtract][v2fd] = SubtractV2Fd;
+						table.Binary[VectorMultiply][v2fd] = MultiplyV2Fd;
+						table.Binary[VectorMinimum][v2fd] = MinimumV2Fd;
+						table.Binary[VectorMaximum][v2fd] = MaximumV2Fd;
+						table.Binary[VectorCompareEqual][v2fd] = CompareEqualV2Fd;
+						table.Binary[VectorCompareLess][v2fd] = CompareLessV2Fd;
+					}
+
+					if (features.Sse41) {
+						table.Binary[VectorMultiply][v4i4] = MultiplyV4I4;
+						table.Binary[VectorMinimum][v4i4] = MinimumV4I4;
+						table.Binary[VectorMaximum][v4i4] = MaximumV4I4;
+						table.Blend[v4i4] = BlendV4I4;
+						table.Blend[v4fs] = BlendV4Fs;
+						table.Blend[v2fd] = BlendV2Fd;
+					}
+
+					if (features.Avx) {
+						table.Binary[VectorAdd][v8fs] = AddV8Fs;
+						table.Binary[VectorSubtract][v8fs] = SubtractV8Fs;
+						table.Binary[VectorMultiply][v8fs] = MultiplyV8Fs;
+						table.Binary[VectorMinimum][v8fs] = MinimumV8Fs;
+						table.Binary[VectorMaximum][v8fs] = MaximumV8Fs;
+						table.Binary[VectorCompareEqual][v8fs] = CompareEqualV8Fs;
+						table.Binary[VectorCompareLess][v8fs] = CompareLessV8Fs;
+						table.Blend[v8fs] = BlendV8Fs;
+
+						table.Binary[VectorAdd][v4fd] = AddV4Fd;
+						table.Binary[VectorSubtract][v4fd] = SubtractV4Fd;
+						table.Binary[VectorMultiply][v4fd] = MultiplyV4Fd;
+						table.Binary[VectorMinimum][v4fd] = MinimumV4Fd;
+						table.Binary[VectorMaximum][v4fd] = MaximumV4Fd;
+						table.Binary[VectorCompareEqual][v4fd] = CompareEqualV4Fd;
+						table.Binary[VectorCompareLess][v4fd] = CompareLessV4Fd;
+						table.Blend[v4fd] = BlendV4Fd;
+
+						table.Blend[v8i4] = BlendV8I4;
+					}
+
+					if (features.Avx2) {
+						table.Binary[VectorAdd][v8i4] = AddV8I4;
+						table.Binary[VectorSubtract][v8i4] = SubtractV8I4;
+						table.Binary[VectorMultiply][v8i4] = MultiplyV8I4;
+						table.Binary[VectorMinimum][v8i4] = MinimumV8I4;
+						table.Binary[VectorMaximum][v8i4] = MaximumV8I4;
+						table.Binary[VectorCompareEqual][v8i4] = CompareEqualV8I4;
+						table.Binary[VectorCompareLess][v8i4] = CompareLessV8I4;
+					}
+				}
+		};
+#endif
+
+		/// <summary>
+		/// Creates the table of vector kernels.
+		/// </summary>
+		/// <param name='useSimd'>If false, all the kernels are the portable scalar ones.</param>
+		inline VectorKernelTable CreateVectorKernelTable(
+			bool useSimd
+			) {
+				VectorKernelTable table;
+				ScalarVectorOperations::Fill<std::int32_t, 4>(table, ValueType::v4i4);
+				ScalarVectorOperations::Fill<std::int32_t, 8>(table, ValueType::v8i4);
+				ScalarVectorOperations::Fill<float, 4>(table, ValueType::v4fs);
+				ScalarVectorOperations::Fill<float, 8>(table, ValueType::v8fs);
+				ScalarVectorOperations::Fill<double, 2>(table, ValueType::v2fd);
+				ScalarVectorOperations::Fill<double, 4>(table, ValueType::v4fd);
+#if defined(NOVA_X86)
+				if (useSimd)
+					SimdVectorOperations::Fill(table, GetCpuFeatures());
+#endif
+				return table;
+			}
+
+		/// <summary>
+		/// Returns the kernels for the processor running the engine.
+		/// </summary>
+		inline const VectorKernelTable & GetVectorKernels(
+			) {
+				static const VectorKernelTable table = CreateVectorKernelTable(true);
+				return table;
+			}
+
+		/// <summary>
+		/// Returns the sum, the minimum or the maximum of the lanes of a vector.
+		/// </summary>
+		inline void ReduceVector(
+			ValueType type, VectorReduceOperation operation, const void * a, void * result
+			) {
+				switch (type) {
+				case ValueType::v4i4: ScalarVectorOperations::Reduce<std::int32_t, 4>(operation, a, result); break;
+				case ValueType::v8i4: ScalarVectorOperations::Reduce<std::int32_t, 8>(operation, a, result); break;
+				case ValueType::v4fs: ScalarVectorOperations::Reduce<float, 4>(operation, a, result); break;
+				case ValueType::v8fs: ScalarVectorOperations::Reduce<float, 8>(operation, a, result); break;
+				case ValueType::v2fd: ScalarVectorOperations::Reduce<double, 2>(operation, a, result); break;
+				case ValueType::v4fd: ScalarVectorOperations::Reduce<double, 4>(operation, a, result); break;
+				default: throw InvalidArgumentException("The type isn't a vector type.");
+				}
+			}
+
+		/// <summary>
+		/// Builds a vector with all its lanes set to the same value.
+		/// </summary>
+		inline void SplatVector(
+			ValueType type, const void * lane, void * result
+			) {
+				size_t laneSize = GetValueTypeSize(GetVectorLaneType(type));
+				size_t laneCount = GetVectorLaneCount(type);
+				for (size_t i = 0; i < laneCount; ++i)
+					memcpy(reinterpret_cast<std::int8_t *>(result) + i * laneSize, lane, laneSize);
+			}
+
+		/// <summary>
+		/// Builds a vector taking every lane from the specified lane of another one.
+		/// </summary>
+		inline void ShuffleVector(
+			ValueType type, const void * a, const std::uint8_t * lanes, void * result
+			) {
+				size_t laneSize = GetValueTypeSize(GetVectorLaneType(type));
+				size_t laneCount = GetVectorLaneCount(type);
+				for (size_t i = 0; i < laneCount; ++i) {
+					if (lanes[i] >= laneCount)
+						throw InvalidArgumentException("The lane doesn't exist in the vector.");
+					memcpy(reinterpret_cast<std::int8_t *>(result) + i * laneSize,
+						reinterpret_cast<const std::int8_t *>(a) + lanes[i] * laneSize, laneSize);
+				}
+			}
+	}
+
+} // namespace Nova
+
+#endif // !_NOVA_RUNTIME_ENVIRONMENT_VECTOR_KERNELS_HEADER_
\ No newline at end of file
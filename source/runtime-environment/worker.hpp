@@ -0,0 +1,572 @@
+//
+// worker.hpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#ifndef _NOVA_RUNTIME_ENVIRONMENT_WORKER_HEADER_
+#define _NOVA_RUNTIME_ENVIRONMENT_WORKER_HEADER_
+
+#include "runtime-context.hpp"
+#include "shared-ring.hpp"
+
+#include "..\common\exception.hpp"
+#include "..\common\dynamic-buffer.hpp"
+#include "..\common\platform.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <exception>
+
+namespace Nova {
+
+	INHERIT_EXCEPTION(WorkerException, RuntimeException)
+
+	namespace Internal {
+		enum class WorkerMessage : std::uint32_t {
+			// Host to worker.
+			Run = 1,
+			CallResults,
+			CallError,
+			Stop,
+			// Worker to host.
+			Results,
+			Error,
+			Call,
+			Batch
+		};
+
+		/// <summary>
+		/// Header of the region shared by a host and a worker. The sizes are written by the host before
+		/// the magic number, which tells the worker the region is ready.
+		/// </summary>
+		struct WorkerRegionHeader {
+			std::atomic<std::uint32_t> Magic;
+			std::uint32_t RingCapacity;
+			std::uint32_t InputSize;
+			std::uint32_t OutputSize;
+		};
+
+		struct WorkerScopeMessage {
+			std::uint64_t Scope;
+		};
+
+		struct WorkerBatchMessage {
+			std::uint64_t Scope;
+			std::uint64_t CallCount;
+		};
+
+		/// <summary>
+		/// Offsets of the parts of the region shared by a host and a worker: the header, the request
+		/// ring, the response ring, the input area and the output area, each aligned to a cache line.
+		/// </summary>
+		struct WorkerRegionLayout {
+			size_t RingCapacity;
+			size_t InputSize;
+			size_t OutputSize;
+			size_t RequestRingOffset;
+			size_t ResponseRingOffset;
+			size_t InputOffset;
+			size_t OutputOffset;
+			size_t Size;
+
+			static const std::uint32_t Magic = 0x4b524f57;
+
+			static inline size_t _Align(
+				size_t offset
+				) {
+					return (offset + CacheLineSize - 1) & ~(CacheLineSize - 1);
+				}
+
+			inline WorkerRegionLayout(
+				size_t ringCapacity, size_t inputSize, size_t outputSize
+				)
+				: RingCapacity(ringCapacity), InputSize(inputSize), OutputSize(outputSize)
+				{
+					RequestRingOffset = _Align(sizeof(WorkerRegionHeader));
+					ResponseRingOffset = _Align(RequestRingOffset + SharedRing::GetRequiredSize(ringCapacity));
+					InputOffset = _Align(ResponseRingOffset + SharedRing::GetRequiredSize(ringCapacity));
+					OutputOffset = _Align(InputOffset + inputSize);
+					Size = OutputOffset + outputSize;
+				}
+		};
+
+		/// <summary>
+		/// Waits for the other side of a shared ring: it spins first, so a busy peer answers at once,
+		/// then yields, and finally sleeps, so an idle side doesn't take a core.
+		/// </summary>
+		class WorkerBackoff {
+			unsigned _count;
+
+		public:
+			inline WorkerBackoff(
+				)
+				: _count(0)
+				{
+				}
+
+			inline void Wait(
+				) {
+					if (_count < 64) {
+						++_count;
+					} else if (_count < 1024) {
+						++_count;
+						std::this_thread::yield();
+					} else {
+						std::this_thread::sleep_for(std::chrono::microseconds(100));
+					}
+				}
+		};
+	}
+
+	/// <summary>
+	/// Runs scopes in a worker process for a host, through rings in shared memory.
+	/// </summary>
+	/// <remarks>
+	/// <para>The worker has its own scope manager, with the program loaded once, and its own context.
+	/// The external scopes of the program are served by the host: the worker replaces their callbacks
+	/// with ones sending the arguments to the host and waiting for the results. Deferred external
+	/// scopes send their batches without waiting.</para>
+	/// <para>Every run starts with the input area of the region as a read-only view in m0 and the
+	/// output area as a writable view in m1, whose elements are i1 values, so large data isn't copied
+	/// through the rings. The arguments of the host are pushed to the stack, and the stack is sent
+	/// back once the run finishes.</para>
+	/// </remarks>
+	class Worker {
+		RuntimeContext & _context;
+		Internal::WorkerRegionLayout _layout;
+		std::int8_t * _region;
+		Internal::SharedRing _requests;
+		Internal::SharedRing _responses;
+		DynamicBuffer _message;
+		bool _stopped;
+
+		Worker(const Worker &);
+		Worker & operator = (const Worker &);
+
+		/// <summary>
+		/// Reads the layout the host wrote in the header of the region.
+		/// </summary>
+		static inline Internal::WorkerRegionLayout _ReadLayout(
+			void * region, size_t regionSize
+			) {
+				Internal::WorkerRegionHeader & header = * reinterpret_cast<Internal::WorkerRegionHeader *>(region);
+				if (regionSize < sizeof header || header.Magic.load(std::memory_order_acquire) != Internal::WorkerRegionLayout::Magic)
+					throw InvalidArgumentException("The region wasn't created by a worker host.");
+				Internal::WorkerRegionLayout layout(header.RingCapacity, header.InputSize, header.OutputSize);
+				if (layout.Size > regionSize)
+					throw InvalidArgumentException("The region is smaller than its layout.");
+				return layout;
+			}
+
+		inline void _Send(
+			Internal::WorkerMessage kind, const void * header, size_t headerSize, const void * payload, size_t payloadSize
+			) {
+				Internal::WorkerBackoff backoff;
+				while (!_responses.TryWrite(static_cast<std::uint32_t>(kind), header, headerSize, payload, payloadSize))
+					backoff.Wait();
+			}
+
+		inline Internal::WorkerMessage _Receive(
+			) {
+				Internal::WorkerBackoff backoff;
+				std::uint32_t kind;
+				while (!_requests.TryRead(kind, _message))
+					backoff.Wait();
+				return static_cast<Internal::WorkerMessage>(kind);
+			}
+
+		/// <summary>
+		/// Sends the arguments of a call to the host and pushes the results it sends back.
+		/// </summary>
+		inline void _ProxyCall(
+			const ExternalScope & scope, RuntimeFixedStack & stack
+			) {
+				const ScopeSignature & signature = scope.GetSignature();
+				size_t size = signature.GetParametersSize();
+				if (static_cast<size_t>(stack.GetCurrentAddress() - stack.GetBaseAddress()) < size)
+					throw StackException("Value can't getted from stack. Stack size too small.");
+
+				Internal::WorkerScopeMessage header = { reinterpret_cast<size_t>(scope.GetId()) };
+				_Send(Internal::WorkerMessage::Call, &header, sizeof header, stack.GetCurrentAddress() - size, size);
+				stack.Drop(size);
+
+				switch (_Receive()) {
+				case Internal::WorkerMessage::CallResults:
+					if (_message.GetSize() != signature.GetResultsSize())
+						throw RuntimeException("The results of the host don't match the external scope.");
+					stack.PushBytes(_message.GetPointer(), _message.GetSize());
+					return;
+				case Internal::WorkerMessage::CallError:
+					throw RuntimeException(std::string(reinterpret_cast<const char *>(_message.GetPointer()), _message.GetSize()));
+				case Internal::WorkerMessage::Stop:
+					_stopped = true;
+					throw RuntimeException("The worker was stopped.");
+				default:
+					throw RuntimeException("The host sent an unexpected message.");
+				}
+			}
+
+		/// <summary>
+		/// Sends a batch of deferred calls to the host, split in messages which fit in the ring.
+		/// </summary>
+		inline void _ProxyBatch(
+			const ExternalCallBatch & batch
+			) {
+				size_t maxCallCount = batch.GetRecordSize() != 0
+					? (_responses.GetMaxMessageSize() - sizeof(Internal::WorkerBatchMessage)) / batch.GetRecordSize()
+					: batch.GetCallCount();
+				if (maxCallCount == 0)
+					throw RuntimeException("The arguments of the call don't fit in the ring.");
+				for (size_t first = 0; first < batch.GetCallCount(); first += maxCallCount) {
+					size_t callCount = batch.GetCallCount() - first < maxCallCount ? batch.GetCallCount() - first : maxCallCount;
+					Internal::WorkerBatchMessage header = { reinterpret_cast<size_t>(batch.GetScope()), callCount };
+					_Send(Internal::WorkerMessage::Batch, &header, sizeof header,
+						batch.GetRecord(first), callCount * batch.GetRecordSize());
+				}
+			}
+
+		inline void _Run(
+			) {
+				Internal::WorkerScopeMessage header;
+				if (_message.GetSize() < sizeof header)
+					throw RuntimeException("The request is truncated.");
+				memcpy(&header, _message.GetPointer(), sizeof header);
+				RuntimeScopeManager & scopeManager = _context.GetRuntimeScopeManager();
+				if (header.Scope >= scopeManager.GetScopeCount())
+					throw RuntimeException("The scope doesn't exist.");
+
+				scoperef_t scope = reinterpret_cast<scoperef_t>(static_cast<size_t>(header.Scope));
+				_context.Reset(scope);
+				RegisterSet & registerSet = _context.GetRegisterSet();
+				const std::int8_t * input = _region + _layout.InputOffset;
+				registerSet.SetMRegister(Register::m0, _context.RegisterHostView(input, _layout.InputSize, ValueType::i1));
+				registerSet.SetMRegister(Register::m1, _context.RegisterHostView(_region + _layout.OutputOffset,
+					_layout.OutputSize, ValueType::i1, HostViewAccess::ReadWrite));
+				RuntimeFixedStack & stack = _context.GetRuntimeStack();
+				stack.PushBytes(static_cast<const std::int8_t *>(_message.GetPointer()) + sizeof header, _message.GetSize() - sizeof header);
+
+				_context.Run();
+				if (_context.IsSuspended()) {
+					_context.Reset(scope);
+					throw RuntimeException("Scopes run by workers can't wait for channels.");
+				}
+				_Send(Internal::WorkerMessage::Results, nullptr, 0,
+					stack.GetBaseAddress(), stack.GetCurrentAddress() - stack.GetBaseAddress());
+			}
+
+	public:
+		/// <summary>
+		/// Opens the region created by a WorkerHost, and routes the external scopes of the scope
+		/// manager of the context to the host. Every external scope must declare its signature.
+		/// </summary>
+		/// <param name='region'>Region shared with the host, mapped by this process.</param>
+		inline Worker(
+			void * region, size_t regionSize, RuntimeContext & context
+			)
+			: _context(context), _layout(_ReadLayout(region, regionSize)), _region(reinterpret_cast<std::int8_t *>(region)),
+			  _requests(_region + _layout.RequestRingOffset, _layout.RingCapacity, false),
+			  _responses(_region + _layout.ResponseRingOffset, _layout.RingCapacity, false),
+			  _stopped(false)
+			{
+				RuntimeScopeManager & scopeManager = context.GetRuntimeScopeManager();
+				for (size_t i = 0; i < scopeManager.GetExternalScopeCount(); ++i) {
+					ExternalScope & scope = scopeManager.GetExternalScope(reinterpret_cast<scoperef_t>(i));
+					if (!scope.HasSignature())
+						throw InvalidArgumentException("External scopes must declare their signature to be called from a worker.");
+					if (scope.IsDeferred()) {
+						scope.SetBatchCallbackFunction(
+							[this] (const ExternalCallBatch & batch) { _ProxyBatch(batch); },
+							scope.GetMaxBatchSize());
+					} else {
+						scope.SetCallbackFunction(
+							[this, &scope] (RuntimeFixedStack & stack) { _ProxyCall(scope, stack); });
+					}
+				}
+			}
+
+		/// <summary>
+		/// Runs the requests of the host until it stops the worker. A run which fails is reported to
+		/// the host, and the worker goes on.
+		/// </summary>
+		inline void Serve(
+			) {
+				while (!_stopped) {
+					Internal::WorkerMessage kind = _Receive();
+					if (kind == Internal::WorkerMessage::Stop)
+						break;
+
+					try {
+						if (kind != Internal::WorkerMessage::Run)
+							throw RuntimeException("The host sent an unexpected message.");
+						_Run();
+					} catch (const Exception & e) {
+						std::string message = e.GetMessage();
+						_Send(Internal::WorkerMessage::Error, nullptr, 0, message.data(), message.size());
+					}
+				}
+				_stopped = true;
+			}
+	};
+
+	/// <summary>
+	/// Host side of a worker: it creates the region shared with the worker process, sends it the runs
+	/// and serves the external scopes the worker calls.
+	/// </summary>
+	/// <remarks>
+	/// <para>The external scopes of the scope manager of the host must be the ones of the program
+	/// loaded by the worker, in the same order, and declare their signatures. Their callbacks run on
+	/// the thread calling Run, while it waits for the worker.</para>
+	/// <para>The worker isn't trusted: its messages are checked, and a timeout stops waiting for a
+	/// worker which crashed or hangs. After a timeout, the worker must be restarted with a new
+	/// region.</para>
+	/// </remarks>
+	class WorkerHost {
+		RuntimeScopeManager & _scopeManager;
+		Internal::WorkerRegionLayout _layout;
+		std::int8_t * _region;
+		Internal::SharedRing _requests;
+		Internal::SharedRing _responses;
+		DynamicBuffer _message;
+		RuntimeFixedStack _callStack;
+		std::chrono::milliseconds _timeout;
+
+		WorkerHost(const WorkerHost &);
+		WorkerHost & operator = (const WorkerHost &);
+
+		inline void _Wait(
+			Internal::WorkerBackoff & backoff, std::chrono::steady_clock::time_point start
+			) {
+				if (_timeout.count() != 0 && std::chrono::steady_clock::now() - start > _timeout)
+					throw WorkerException("The worker didn't respond in time.");
+				backoff.Wait();
+			}
+
+		inline void _Send(
+			Internal::WorkerMessage kind, const void * header, size_t headerSize, const void * payload, size_t payloadSize
+			) {
+				Internal::WorkerBackoff backoff;
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				while (!_requests.TryWrite(static_cast<std::uint32_t>(kind), header, headerSize, payload, payloadSize))
+					_Wait(backoff, start);
+			}
+
+		inline void _SendError(
+			const std::string & message
+			) {
+				_Send(Internal::WorkerMessage::CallError, nullptr, 0, message.data(), message.size());
+			}
+
+		inline ExternalScope * _GetExternalScope(
+			std::uint64_t scope
+			) {
+				if (scope >= _scopeManager.GetExternalScopeCount())
+					return nullptr;
+				return &_scopeManager.GetExternalScope(reinterpret_cast<scoperef_t>(static_cast<size_t>(scope)));
+			}
+
+		/// <summary>
+		/// Runs the callback of an external scope for the worker. Errors of the host are kept to be
+		/// thrown once the run finishes, and the worker gets a message.
+		/// </summary>
+		inline void _ServeCall(
+			std::exception_ptr & error
+			) {
+				Internal::WorkerScopeMessage header;
+				if (_message.GetSize() < sizeof header) {
+					_SendError("The call is truncated.");
+					return;
+				}
+				memcpy(&header, _message.GetPointer(), sizeof header);
+				ExternalScope * scope = _GetExternalScope(header.Scope);
+				size_t size = _message.GetSize() - sizeof header;
+				if (scope == nullptr || !scope->HasSignature() || scope->GetSignature().GetParametersSize() != size) {
+					_SendError("The external scope doesn't match the one of the host.");
+					return;
+				}
+
+				try {
+					_callStack.Reset();
+					_callStack.PushBytes(static_cast<const std::int8_t *>(_message.GetPointer()) + sizeof header, size);
+					scope->GetCallbackFunction()(_callStack);
+				} catch (...) {
+					error = std::current_exception();
+					_SendError("The external scope failed in the host.");
+					return;
+				}
+				_Send(Internal::WorkerMessage::CallResults, nullptr, 0,
+					_callStack.GetBaseAddress(), _callStack.GetCurrentAddress() - _callStack.GetBaseAddress());
+			}
+
+		inline void _ServeBatch(
+			std::exception_ptr & error
+			) {
+				Internal::WorkerBatchMessage header;
+				ExternalScope * scope = nullptr;
+				size_t size = 0;
+				if (_message.GetSize() >= sizeof header) {
+					memcpy(&header, _message.GetPointer(), sizeof header);
+					scope = _GetExternalScope(header.Scope);
+					size = _message.GetSize() - sizeof header;
+				}
+				// The worker doesn't wait for batches, so errors are only reported once the run finishes.
+				// The call count comes from the worker, so it's checked by dividing, which can't overflow.
+				size_t parametersSize = scope != nullptr ? scope->GetSignature().GetParametersSize() : 0;
+				if (scope == nullptr || !scope->IsDeferred() || header.CallCount == 0
+					|| (parametersSize != 0
+						? size % parametersSize != 0 || header.CallCount != size / parametersSize
+						: size != 0)) {
+					if (!error)
+						error = std::make_exception_ptr(WorkerException("The batch doesn't match a deferred external scope of the host."));
+					return;
+				}
+
+				try {
+					ExternalCallBatch batch(scope->GetId(), static_cast<const std::int8_t *>(_message.GetPointer()) + sizeof header,
+						static_cast<size_t>(header.CallCount), size / static_cast<size_t>(header.CallCount));
+					scope->GetBatchCallbackFunction()(batch);
+				} catch (...) {
+					if (!error)
+						error = std::current_exception();
+				}
+			}
+
+	public:
+		/// <summary>
+		/// Returns the size of the region shared with a worker.
+		/// </summary>
+		static inline size_t GetRegionSize(
+			size_t ringCapacity, size_t inputSize, size_t outputSize
+			) {
+				return Internal::WorkerRegionLayout(ringCapacity, inputSize, outputSize).Size;
+			}
+
+		/// <summary>
+		/// Lays out a region for a worker, which can open it once the constructor returns.
+		/// </summary>
+		/// <param name='region'>Shared memory aligned to a cache line, of at least GetRegionSize bytes.</param>
+		/// <param name='ringCapacity'>Bytes of each ring, a power of two. Arguments and results must fit
+		/// in half of it.</param>
+		/// <param name='inputSize'>Bytes of the area the worker sees in m0.</param>
+		/// <param name='outputSize'>Bytes of the area the worker sees in m1.</param>
+		inline WorkerHost(
+			void * region, size_t regionSize, RuntimeScopeManager & scopeManager,
+			size_t ringCapacity, size_t inputSize, size_t outputSize
+			)
+			: _scopeManager(scopeManager), _layout(ringCapacity, inputSize, outputSize),
+			  _region(reinterpret_cast<std::int8_t *>(region)),
+			  _requests(_region + _layout.RequestRingOffset, ringCapacity, true),
+			  _responses(_region + _layout.ResponseRingOffset, ringCapacity, true),
+			  _callStack(ringCapacity / 2), _timeout(0)
+			{
+				if (_layout.Size > regionSize)
+					throw InvalidArgumentException("The region is too small for the worker.");
+				if (inputSize > 0x7fffffff || outputSize > 0x7fffffff)
+					throw InvalidArgumentException("The areas of a worker are too big.");
+
+				Internal::WorkerRegionHeader & header = * reinterpret_cast<Internal::WorkerRegionHeader *>(region);
+				header.RingCapacity = static_cast<std::uint32_t>(ringCapacity);
+				header.InputSize = static_cast<std::uint32_t>(inputSize);
+				header.OutputSize = static_cast<std::uint32_t>(outputSize);
+				new (&header.Magic) std::atomic<std::uint32_t>(0);
+				header.Magic.store(Internal::WorkerRegionLayout::Magic, std::memory_order_release);
+			}
+
+		/// <summary>
+		/// Sets how long Run and Stop wait for the worker, or zero to wait forever, which is the default.
+		/// </summary>
+		inline void SetTimeout(
+			std::chrono::milliseconds timeout
+			) {
+				_timeout = timeout;
+			}
+
+		/// <summary>
+		/// Returns the area read by the scopes of the worker through m0.
+		/// </summary>
+		inline std::int8_t * GetInput(
+			) {
+				return _region + _layout.InputOffset;
+			}
+
+		inline size_t GetInputSize(
+			) const {
+				return _layout.InputSize;
+			}
+
+		/// <summary>
+		/// Returns the area written by the scopes of the worker through m1.
+		/// </summary>
+		inline const std::int8_t * GetOutput(
+			) const {
+				return _region + _layout.OutputOffset;
+			}
+
+		inline size_t GetOutputSize(
+			) const {
+				return _layout.OutputSize;
+			}
+
+		/// <summary>
+		/// Runs a scope in the worker, and serves the external scopes it calls until it finishes.
+		/// </summary>
+		/// <param name='arguments'>Bytes pushed to the stack of the worker before the run.</param>
+		/// <param name='results'>Receives the stack of the worker once the run finishes.</param>
+		inline void Run(
+			scoperef_t scope, const void * arguments, size_t size, DynamicBuffer & results
+			) {
+				Internal::WorkerScopeMessage header = { reinterpret_cast<size_t>(scope) };
+				_Send(Internal::WorkerMessage::Run, &header, sizeof header, arguments, size);
+
+				std::exception_ptr error;
+				Internal::WorkerBackoff backoff;
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				for (;;) {
+					std::uint32_t kind;
+					if (!_responses.TryRead(kind, _message)) {
+						_Wait(backoff, start);
+						continue;
+					}
+
+					switch (static_cast<Internal::WorkerMessage>(kind)) {
+					case Internal::WorkerMessage::Call:
+						_ServeCall(error);
+						break;
+					case Internal::WorkerMessage::Batch:
+						_ServeBatch(error);
+						break;
+					case Internal::WorkerMessage::Results:
+						if (error)
+							std::rethrow_exception(error);
+						results = std::move(_message);
+						return;
+					case Internal::WorkerMessage::Error:
+						// The host errors which made the run fail are more precise than the worker's.
+						if (error)
+							std::rethrow_exception(error);
+						throw WorkerException(std::string(reinterpret_cast<const char *>(_message.GetPointer()), _message.GetSize()));
+					default:
+						throw WorkerException("The worker sent an unexpected message.");
+					}
+					backoff = Internal::WorkerBackoff();
+					start = std::chrono::steady_clock::now();
+				}
+			}
+
+		/// <summary>
+		/// Asks the worker to return from Serve once it finishes the current run.
+		/// </summary>
+		inline void Stop(
+			) {
+				_Send(Internal::WorkerMessage::Stop, nullptr, 0, nullptr, 0);
+			}
+	};
+
+} // namespace Nova
+
+#endif // !_NOVA_RUNTIME_ENVIRONMENT_WORKER_HEADER_
\ No newline at end of file
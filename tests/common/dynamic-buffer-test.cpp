@@ -0,0 +1,126 @@
+//
+// dynamic-buffer-test.cpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#include "common\dynamic-buffer.hpp"
+
+#include <n-test\test-unit.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+using namespace Nova;
+using namespace std;
+
+namespace {
+	DynamicBuffer CreateBuffer(
+		size_t size
+		) {
+			DynamicBuffer buffer;
+			for (size_t i = 0; i < size; ++i) {
+				int8_t value = static_cast<int8_t>(i);
+				buffer.Push(&value, 1);
+			}
+			return buffer;
+		}
+
+	bool HoldsSequence(
+		const DynamicBuffer & buffer, size_t size
+		) {
+			if (buffer.GetSize() != size)
+				return false;
+			const int8_t * data = static_cast<const int8_t *>(buffer.GetPointer());
+			for (size_t i = 0; i < size; ++i) {
+				if (data[i] != static_cast<int8_t>(i))
+					return false;
+			}
+			return true;
+		}
+}
+
+TEST_UNIT("common\\dynamic-buffer")
+	TEST_METHOD("move", testContext) {
+		// Large buffers hand their storage over, small ones copy the bytes kept inside the object.
+		DynamicBuffer large = CreateBuffer(1000);
+		const void * storage = static_cast<const DynamicBuffer &>(large).GetPointer();
+		DynamicBuffer moved(move(large));
+		testContext.Accept(static_cast<const DynamicBuffer &>(moved).GetPointer() == storage);
+		testContext.Accept(HoldsSequence(moved, 1000) && large.GetSize() == 0);
+
+		DynamicBuffer small = CreateBuffer(10);
+		DynamicBuffer assigned = CreateBuffer(500);
+		assigned = move(small);
+		testContext.Accept(HoldsSequence(assigned, 10) && small.GetSize() == 0);
+		testContext.Accept(assigned.GetCapacity() == DynamicBuffer::InlineCapacity);
+
+		DynamicBuffer copy(moved);
+		testContext.Accept(HoldsSequence(copy, 1000) && copy.GetPointer() != moved.GetPointer());
+
+		// Pushing the data of the buffer itself survives the storage moving.
+		DynamicBuffer repeated = CreateBuffer(DynamicBuffer::InlineCapacity);
+		repeated.Push(repeated.GetPointer(), repeated.GetSize());
+		testContext.Accept(repeated.GetSize() == 2 * DynamicBuffer::InlineCapacity
+			&& memcmp(repeated.GetPointer(), static_cast<int8_t *>(repeated.GetPointer()) + DynamicBuffer::InlineCapacity, DynamicBuffer::InlineCapacity) == 0);
+	}
+
+	TEST_METHOD("view", testContext) {
+		DynamicBuffer owner = CreateBuffer(100);
+		DynamicBuffer view = DynamicBuffer::CreateView(owner.GetPointer(), owner.GetSize());
+		const DynamicBuffer & constView = view;
+		testContext.Accept(view.IsView() && view.GetCapacity() == 0 && constView.GetPointer() == owner.GetPointer());
+
+		DynamicBuffer movedView(move(view));
+		testContext.Accept(movedView.IsView() && HoldsSequence(movedView, 100));
+
+		DynamicBuffer copy(movedView);
+		testContext.Accept(!copy.IsView() && HoldsSequence(copy, 100));
+
+		// Changing a view copies the data, leaving the memory it viewed as it was.
+		int8_t value = 77;
+		movedView.Write(&value, 0, 1);
+		testContext.Accept(!movedView.IsView() && movedView.Load<int8_t>(0) == 77);
+		testContext.Accept(HoldsSequence(owner, 100));
+	}
+
+	TEST_METHOD("capacity", testContext) {
+		DynamicBuffer buffer;
+		testContext.Accept(buffer.GetSize() == 0 && buffer.GetCapacity() == DynamicBuffer::InlineCapacity);
+		testContext.Accept(buffer.GetPointer() != nullptr);
+
+		buffer.Reserve(4096);
+		const void * storage = buffer.GetPointer();
+		testContext.Accept(buffer.GetCapacity() >= 4096);
+		for (int i = 0; i < 1024; ++i)
+			buffer.Push(&i, sizeof i);
+		testContext.Accept(buffer.GetPointer() == storage && buffer.GetSize() == 4096);
+
+		// Cleared buffers keep their storage for the next use.
+		buffer.Clear();
+		testContext.Accept(buffer.GetSize() == 0 && buffer.GetCapacity() >= 4096 && buffer.GetPointer() == storage);
+		buffer.Resize(16);
+		testContext.Accept(buffer.Load<int64_t>(8) == 0);
+	}
+
+	TEST_METHOD("load", testContext) {
+		DynamicBuffer buffer;
+		int8_t padding = 1;
+		int32_t value = 0x12345678;
+		buffer.Push(&padding, 1).Push(&value, sizeof value);
+		testContext.Accept(buffer.Load<int32_t>(1) == 0x12345678);
+
+		DynamicBuffer::ConstIterator iterator = buffer.GetConstIterator();
+		iterator.Skip(1);
+		testContext.Accept(iterator.Load<int32_t>() == 0x12345678 && iterator.GetOffset() == 1);
+
+		try {
+			buffer.Load<int32_t>(2);
+			testContext.Fail();
+		} catch (const RuntimeException &) {
+			testContext.Accept();
+		}
+	}
+END_TEST_UNIT
\ No newline at end of file
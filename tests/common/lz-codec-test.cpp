@@ -0,0 +1,137 @@
+//
+// lz-codec-test.cpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#include "common\lz-codec.hpp"
+#include "runtime-environment\runtime-context.hpp"
+
+#include <n-test\test-unit.hpp>
+
+#include <cstdint>
+#include <cstring>
+
+using namespace Nova;
+using namespace std;
+
+namespace {
+	bool RoundTrips(
+		const DynamicBuffer & data
+		) {
+			DynamicBuffer compressed, decompressed;
+			LzCodec::Compress(data, compressed);
+			LzCodec::Decompress(compressed, decompressed);
+			return decompressed.GetSize() == data.GetSize()
+				&& (data.GetSize() == 0 || memcmp(decompressed.GetPointer(), data.GetPointer(), data.GetSize()) == 0);
+		}
+}
+
+TEST_UNIT("common\\lz-codec")
+	TEST_METHOD("round-trip", testContext) {
+		testContext.Accept(RoundTrips(DynamicBuffer()));
+
+		DynamicBuffer small;
+		small.Push("abc", 3);
+		testContext.Accept(RoundTrips(small));
+
+		// Noise, runs longer than the length nibbles and repeated blocks far apart.
+		DynamicBuffer mixed;
+		uint32_t seed = 12345;
+		for (int i = 0; i < 5000; ++i) {
+			seed = seed * 1103515245 + 12345;
+			uint8_t byte = static_cast<uint8_t>(seed >> 16);
+			mixed.Push(&byte, 1);
+		}
+		vector<uint8_t> run(1000, 7);
+		mixed.Push(run.data(), run.size());
+		mixed.Push(mixed.GetPointer(), 3000);
+		testContext.Accept(RoundTrips(mixed));
+	}
+
+	TEST_METHOD("bytecode", testContext) {
+		DynamicBuffer code;
+		AssemblyWriter writer;
+		for (int i = 0; i < 200; ++i)
+			writer
+				.PushI4C(code, i)
+				.AddI4(code)
+				.SetI4R(code, Register::r1);
+
+		DynamicBuffer compressed;
+		LzCodec::Compress(code, compressed);
+		testContext.Accept(compressed.GetSize() * 3 < code.GetSize());
+		testContext.Accept(LzCodec::GetDecompressedSize(compressed.GetPointer(), compressed.GetSize()) == code.GetSize());
+		testContext.Accept(RoundTrips(code));
+	}
+
+	TEST_METHOD("corrupted", testContext) {
+		DynamicBuffer data;
+		for (int i = 0; i < 100; ++i)
+			data.Push("0123456789", 10);
+		DynamicBuffer compressed;
+		LzCodec::Compress(data, compressed);
+
+		// Every truncation and every single byte change is rejected or decoded within the buffers.
+		for (size_t size = 0; size < compressed.GetSize(); ++size) {
+			DynamicBuffer truncated, output;
+			truncated.Push(compressed.GetPointer(), size);
+			try {
+				LzCodec::Decompress(truncated, output);
+				testContext.Fail();
+			} catch (const RuntimeException &) {
+				testContext.Accept();
+			}
+		}
+		for (size_t offset = 4; offset < compressed.GetSize(); ++offset) {
+			DynamicBuffer changed(compressed), output;
+			static_cast<uint8_t *>(changed.GetPointer())[offset] ^= 0xA5;
+			try {
+				LzCodec::Decompress(changed, output);
+			} catch (const RuntimeException &) {
+			}
+		}
+		testContext.Accept();
+
+		// A size the data can't decompress to is rejected before the output is allocated.
+		uint32_t header = 0xFFFFFFFFu;
+		DynamicBuffer oversized, output;
+		oversized.Push(&header, sizeof (header));
+		oversized.Push(static_cast<const int8_t *>(compressed.GetPointer()) + sizeof (header), compressed.GetSize() - sizeof (header));
+		try {
+			LzCodec::Decompress(oversized, output);
+			testContext.Fail();
+		} catch (const RuntimeException &) {
+			testContext.Accept(output.GetSize() == 0);
+		}
+	}
+
+	TEST_METHOD("lazy-scope", testContext) {
+		RuntimeScopeManager * scopeManager = new RuntimeScopeManager();
+		RuntimeScope & scope = scopeManager->CreateNewScope();
+
+		DynamicBuffer code, compressed;
+		AssemblyWriter writer;
+		writer.PushI4C(code, 0);
+		for (int i = 0; i < 100; ++i)
+			writer
+				.PushI4C(code, 2)
+				.AddI4(code);
+		LzCodec::Compress(code, compressed);
+		scope.SetCompressedCode(compressed);
+		testContext.Accept(!scope.IsLoaded());
+
+		RuntimeContext * context = RuntimeContextBuilder()
+			.SetRegisterSet(new RegisterSet())
+			.SetRuntimeStack(new RuntimeFixedStack(64))
+			.SetRuntimeScopeManager(scopeManager)
+			.SetStartScope(scope.GetId())
+			.Build();
+		context->Run();
+		testContext.Accept(scope.IsLoaded() && scope.GetCodeBuffer().GetSize() == code.GetSize());
+		testContext.Accept(context->GetRuntimeStack().Pop<int32_t>() == 200);
+
+		delete context;
+	}
+END_TEST_UNIT
\ No newline at end of file
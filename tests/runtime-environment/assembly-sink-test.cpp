@@ -0,0 +1,131 @@
+//
+// assembly-sink-test.cpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#include "runtime-environment\assembly-sink.hpp"
+
+#include <n-test\test-unit.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <sstream>
+#include <vector>
+
+using namespace Nova;
+using namespace std;
+
+namespace {
+	/// <summary>
+	/// Writes a loop counting r0 down from every value, with a forward branch out of each one.
+	/// </summary>
+	template <typename _Output>
+	void WriteLoops(
+		BasicAssemblyWriter<_Output> & writer, _Output & output, int count
+		) {
+			for (int i = 0; i < count; ++i) {
+				label_t loop = writer.CreateLabel();
+				label_t end = writer.CreateLabel();
+				writer
+					.PushI4C(output, i)
+					.SetI4R(output, Register::r0)
+					.Jmp(output, end)
+					.BindLabel(output, loop)
+					.Nop(output)
+					.BindLabel(output, end)
+					.DjnzI4R(output, Register::r0, loop);
+			}
+		}
+
+	bool Matches(
+		const DynamicBuffer & expected, const void * data, size_t size
+		) {
+			return expected.GetSize() == size && memcmp(expected.GetPointer(), data, size) == 0;
+		}
+}
+
+TEST_UNIT("runtime-environment\\assembly-sink")
+	TEST_METHOD("buffer", testContext) {
+		DynamicBuffer expected;
+		AssemblyWriter writer;
+		WriteLoops(writer, expected, 100);
+
+		DynamicBuffer buffer;
+		BufferAssemblySink sink(buffer);
+		AssemblySinkWriter sinkWriter;
+		WriteLoops<IAssemblySink>(sinkWriter, sink, 100);
+		testContext.Accept(!sinkWriter.HasUnresolvedLabels());
+		testContext.Accept(Matches(expected, buffer.GetPointer(), buffer.GetSize()));
+	}
+
+	TEST_METHOD("fixed", testContext) {
+		DynamicBuffer expected;
+		AssemblyWriter writer;
+		WriteLoops(writer, expected, 10);
+
+		vector<int8_t> memory(expected.GetSize());
+		FixedAssemblySink sink(&memory[0], memory.size());
+		AssemblySinkWriter sinkWriter;
+		WriteLoops<IAssemblySink>(sinkWriter, sink, 10);
+		testContext.Accept(Matches(expected, &memory[0], sink.GetSize()));
+
+		// The buffer never grows.
+		try {
+			sinkWriter.Nop(sink);
+			testContext.Fail();
+		} catch (const RuntimeException &) {
+			testContext.Accept();
+		}
+		testContext.Accept(sink.GetSize() == memory.size());
+	}
+
+	TEST_METHOD("stream", testContext) {
+		DynamicBuffer expected;
+		AssemblyWriter writer;
+		for (int i = 0; i < 100; ++i)
+			WriteLoops(writer, expected, 100);
+
+		ostringstream stream(ios::binary);
+		StreamAssemblySink sink(stream, 256, 1024);
+		AssemblySinkWriter sinkWriter;
+		size_t maxBufferedSize = 0;
+		for (int i = 0; i < 100; ++i) {
+			WriteLoops<IAssemblySink>(sinkWriter, sink, 100);
+			maxBufferedSize = max(maxBufferedSize, sink.GetBufferedSize());
+		}
+		testContext.Accept(maxBufferedSize < 256 + 1024 + 24 && sink.GetSize() == expected.GetSize());
+		sink.Flush();
+		string data = stream.str();
+		testContext.Accept(sink.GetBufferedSize() == 0 && Matches(expected, data.data(), data.size()));
+	}
+
+	TEST_METHOD("window", testContext) {
+		ostringstream stream(ios::binary);
+		StreamAssemblySink sink(stream, 64, 64);
+		AssemblySinkWriter writer;
+
+		// A label bound further than the window can't fix up its branches.
+		label_t end = writer.CreateLabel();
+		writer.Jmp(sink, end);
+		for (int i = 0; i < 64; ++i)
+			writer.Nop(sink);
+		try {
+			writer.BindLabel(sink, end);
+			testContext.Fail();
+		} catch (const InvalidArgumentException &) {
+			testContext.Accept();
+		}
+
+		// Labels bound before the branches are always fine, since their offset is known.
+		label_t start = writer.CreateLabel();
+		writer.BindLabel(sink, start);
+		for (int i = 0; i < 64; ++i)
+			writer.Nop(sink);
+		writer.Jmp(sink, start);
+		sink.Flush();
+		testContext.Accept(stream.str().size() == sink.GetSize());
+	}
+END_TEST_UNIT
\ No newline at end of file
@@ -0,0 +1,90 @@
+//
+// batch-executor-test.cpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#include "runtime-environment\batch-executor.hpp"
+
+#include <n-test\test-unit.hpp>
+
+#include <cstdint>
+
+using namespace Nova;
+using namespace std;
+
+TEST_UNIT("runtime-environment\\batch-executor")
+	TEST_METHOD("vector", testContext) {
+		RuntimeScopeManager scopeManager;
+		RuntimeScope & mainScope = scopeManager.CreateNewScope();
+		RuntimeScope & addScope = scopeManager.CreateNewScope();
+		ExternalScope & squareScope = scopeManager.CreateExternalScope();
+		squareScope.SetSignature(ScopeSignature(vector<ValueType>(1, ValueType::i4), vector<ValueType>(1, ValueType::i4)));
+		squareScope.SetCallbackFunction(
+			[] (RuntimeFixedStack & stack) {
+				int32_t value = stack.Pop<int32_t>();
+				stack.Push<int32_t>(value * value);
+			});
+
+		DynamicBuffer addCode;
+		AssemblyWriter().AddI4(addCode);
+		addScope.SetCodeBuffer(move(addCode));
+
+		// square(a + b) + 1
+		DynamicBuffer mainCode;
+		AssemblyWriter()
+			.Call(mainCode, addScope.GetId())
+			.XCall(mainCode, squareScope.GetId())
+			.PushI4C(mainCode, 1)
+			.AddI4(mainCode)
+			.Ret(mainCode);
+		mainScope.SetCodeBuffer(move(mainCode));
+
+		const size_t rowCount = 1000;
+		vector<int32_t> a(rowCount), b(rowCount), results(rowCount);
+		for (size_t i = 0; i < rowCount; ++i) {
+			a[i] = static_cast<int32_t>(i);
+			b[i] = 3;
+		}
+
+		BatchExecutor executor(scopeManager, 64);
+		const void * inputs[] = { &a[0], &b[0] };
+		void * outputs[] = { &results[0] };
+		executor.Run(mainScope.GetId(), rowCount, inputs, outputs);
+
+		testContext.Accept(executor.IsVectorizable(mainScope.GetId()));
+		bool matches = true;
+		for (size_t i = 0; i < rowCount; ++i)
+			matches = matches && results[i] == (a[i] + 3) * (a[i] + 3) + 1;
+		testContext.Accept(matches);
+	}
+
+	TEST_METHOD("row-fallback", testContext) {
+		RuntimeScopeManager scopeManager;
+		RuntimeScope & scope = scopeManager.CreateNewScope();
+
+		DynamicBuffer code;
+		AssemblyWriter()
+			.PushI4C(code, 8)
+			.Alloc(code, Register::m0)
+			.StI4M(code, Register::m0, 4)
+			.LdI4M(code, Register::m0, 4)
+			.PushI4C(code, 10)
+			.AddI4(code);
+		scope.SetCodeBuffer(move(code));
+
+		const size_t rowCount = 100;
+		vector<int32_t> values(rowCount), results(rowCount);
+		for (size_t i = 0; i < rowCount; ++i)
+			values[i] = static_cast<int32_t>(i * 2);
+
+		BatchExecutor executor(scopeManager, 16);
+		const void * inputs[] = { &values[0] };
+		void * outputs[] = { &results[0] };
+		executor.Run(scope.GetId(), rowCount, inputs, outputs);
+
+		testContext.Accept(!executor.IsVectorizable(scope.GetId()));
+		testContext.Accept(results[0] == 10 && results[99] == 208);
+	}
+END_TEST_UNIT
\ No newline at end of file
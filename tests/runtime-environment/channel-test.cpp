@@ -0,0 +1,261 @@
+//
+// channel-test.cpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#include "runtime-environment\channel.hpp"
+#include "runtime-environment\context-scheduler.hpp"
+#include "runtime-environment\runtime-context.hpp"
+#include "runtime-environment\scope-verifier.hpp"
+
+#include <n-test\test-unit.hpp>
+
+#include <cstdint>
+#include <atomic>
+#include <thread>
+
+using namespace Nova;
+using namespace std;
+
+namespace {
+	/// <summary>
+	/// Receives values from a channel until it gets a zero, sending twice every value and then the
+	/// zero to the other channel.
+	/// </summary>
+	void WriteDoubler(
+		DynamicBuffer & code, chanref_t input, chanref_t output
+		) {
+			AssemblyWriter writer;
+			label_t loop = writer.CreateLabel(), end = writer.CreateLabel();
+			writer
+				.BindLabel(code, loop)
+				.Recv(code, input)
+				.SetI4R(code, Register::r0)
+				.PushI4R(code, Register::r0)
+				.PushI4C(code, 0)
+				.JeqI4(code, end)
+				.PushI4R(code, Register::r0)
+				.PushI4R(code, Register::r0)
+				.AddI4(code)
+				.Send(code, output)
+				.Jmp(code, loop)
+				.BindLabel(code, end)
+				.PushI4C(code, 0)
+				.Send(code, output);
+		}
+}
+
+TEST_UNIT("runtime-environment\\channel")
+	TEST_METHOD("queue", testContext) {
+		RuntimeScopeManager scopeManager;
+		Channel & channel = scopeManager.CreateChannel(ValueType::i4, 3, ChannelMode::SingleProducerSingleConsumer);
+		testContext.Accept(channel.GetCapacity() == 4 && channel.GetElementSize() == 4);
+		testContext.Accept(&scopeManager.GetChannel(channel.GetId()) == &channel);
+
+		int32_t value = 0;
+		testContext.Accept(!channel.CanReceive() && !channel.TryReceive(value));
+		for (int32_t i = 1; i <= 4; ++i)
+			testContext.Accept(channel.TrySend(i));
+		testContext.Accept(!channel.CanSend() && !channel.TrySend(int32_t(5)));
+		testContext.Accept(channel.GetSize() == 4);
+
+		// The positions wrap around the cells.
+		for (int32_t i = 1; i <= 10; ++i) {
+			testContext.Accept(channel.TryReceive(value) && value == i);
+			testContext.Accept(channel.TrySend(i + 4));
+		}
+
+		try {
+			channel.TrySend(int64_t(1));
+			testContext.Fail();
+		} catch (const InvalidArgumentException &) {
+			testContext.Accept();
+		}
+		try {
+			scopeManager.CreateChannel(ValueType::rf, 4);
+			testContext.Fail();
+		} catch (const InvalidArgumentException &) {
+			testContext.Accept();
+		}
+	}
+
+	TEST_METHOD("concurrent", testContext) {
+		RuntimeScopeManager scopeManager;
+		Channel & channel = scopeManager.CreateChannel(ValueType::i8, 64);
+
+		const int threadCount = 4;
+		const int64_t valueCount = 20000;
+		atomic<int64_t> sum(0);
+		atomic<int64_t> received(0);
+		vector<thread> threads;
+		for (int i = 0; i < threadCount; ++i) {
+			threads.push_back(thread([&] {
+				for (int64_t value = 1; value <= valueCount; ++value) {
+					while (!channel.TrySend(value))
+						this_thread::yield();
+				}
+			}));
+			threads.push_back(thread([&] {
+				int64_t value;
+				while (received.load() < threadCount * valueCount) {
+					if (channel.TryReceive(value)) {
+						sum += value;
+						++received;
+					} else {
+						this_thread::yield();
+					}
+				}
+			}));
+		}
+		for (auto & item : threads)
+			item.join();
+
+		testContext.Accept(received == threadCount * valueCount);
+		testContext.Accept(sum == threadCount * valueCount * (valueCount + 1) / 2);
+		testContext.Accept(channel.GetSize() == 0);
+	}
+
+	TEST_METHOD("suspension", testContext) {
+		RuntimeScopeManager scopeManager;
+		RuntimeScope & mainScope = scopeManager.CreateNewScope();
+		RuntimeScope & receiveScope = scopeManager.CreateNewScope();
+		Channel & values = scopeManager.CreateChannel(ValueType::i4, 2);
+		Channel & buffers = scopeManager.CreateChannel(8, 2);
+
+		// The suspension happens in a callee, and then through an object.
+		DynamicBuffer receiveCode;
+		AssemblyWriter()
+			.Recv(receiveCode, values.GetId())
+			.PushI4C(receiveCode, 1)
+			.AddI4(receiveCode);
+		receiveScope.SetCodeBuffer(move(receiveCode));
+
+		DynamicBuffer mainCode;
+		AssemblyWriter()
+			.Call(mainCode, receiveScope.GetId())
+			.PushI4C(mainCode, 8)
+			.Alloc(mainCode, Register::m0)
+			.RecvM(mainCode, buffers.GetId(), Register::m0)
+			.LdI4M(mainCode, Register::m0, 4)
+			.AddI4(mainCode);
+		mainScope.SetCodeBuffer(move(mainCode));
+		ScopeVerifier(scopeManager).Verify(mainScope);
+		testContext.Accept(mainScope.GetStackMap().GetEntries().size() == 3);
+
+		RuntimeFixedStack stack(64);
+		RegisterSet registerSet;
+		registerSet.Reset();
+		RuntimeContext context(&stack, &registerSet, &scopeManager, mainScope.GetId(), nullptr, false);
+		context.Run();
+		testContext.Accept(context.IsSuspended() && context.GetWaitChannel() == &values);
+		testContext.Accept(context.GetCallFrames().size() == 2 && !context.CanResume());
+
+		testContext.Accept(values.TrySend(int32_t(41)));
+		testContext.Accept(context.CanResume());
+		context.Resume();
+		testContext.Accept(context.IsSuspended() && context.GetWaitChannel() == &buffers);
+		testContext.Accept(context.GetCallFrames().size() == 1);
+
+		int32_t buffer[] = { 0, 100 };
+		testContext.Accept(buffers.TrySendBytes(buffer));
+		context.Resume();
+		testContext.Accept(!context.IsSuspended() && context.GetCallFrames().empty());
+		testContext.Accept(stack.Pop<int32_t>() == 142);
+
+		// Reset abandons a suspended run.
+		context.Reset(mainScope.GetId());
+		context.Run();
+		testContext.Accept(context.IsSuspended());
+		context.Reset(mainScope.GetId());
+		testContext.Accept(!context.IsSuspended() && context.GetCallFrames().empty());
+	}
+
+	TEST_METHOD("pipeline", testContext) {
+		RuntimeScopeManager scopeManager;
+		Channel & input = scopeManager.CreateChannel(ValueType::i4, 4, ChannelMode::SingleProducerSingleConsumer);
+		Channel & output = scopeManager.CreateChannel(ValueType::i4, 4, ChannelMode::SingleProducerSingleConsumer);
+		RuntimeScope & producerScope = scopeManager.CreateNewScope();
+		RuntimeScope & doublerScope = scopeManager.CreateNewScope();
+		RuntimeScope & consumerScope = scopeManager.CreateNewScope();
+
+		// Sends 1000, 999, ..., 1 and a zero.
+		const int32_t valueCount = 1000;
+		DynamicBuffer producerCode;
+		AssemblyWriter producerWriter;
+		label_t producerLoop = producerWriter.CreateLabel();
+		producerWriter
+			.PushI4C(producerCode, valueCount)
+			.SetI4R(producerCode, Register::r0)
+			.BindLabel(producerCode, producerLoop)
+			.PushI4R(producerCode, Register::r0)
+			.Send(producerCode, input.GetId())
+			.DjnzI4R(producerCode, Register::r0, producerLoop)
+			.PushI4C(producerCode, 0)
+			.Send(producerCode, input.GetId());
+		producerScope.SetCodeBuffer(move(producerCode));
+
+		DynamicBuffer doublerCode;
+		WriteDoubler(doublerCode, input.GetId(), output.GetId());
+		doublerScope.SetCodeBuffer(move(doublerCode));
+
+		// Adds the values until it gets the zero.
+		DynamicBuffer consumerCode;
+		AssemblyWriter consumerWriter;
+		label_t consumerLoop = consumerWriter.CreateLabel(), consumerEnd = consumerWriter.CreateLabel();
+		consumerWriter
+			.PushI4C(consumerCode, 0)
+			.SetI4R(consumerCode, Register::r1)
+			.BindLabel(consumerCode, consumerLoop)
+			.Recv(consumerCode, output.GetId())
+			.SetI4R(consumerCode, Register::r0)
+			.PushI4R(consumerCode, Register::r0)
+			.PushI4C(consumerCode, 0)
+			.JeqI4(consumerCode, consumerEnd)
+			.PushI4R(consumerCode, Register::r0)
+			.PushI4R(consumerCode, Register::r1)
+			.AddI4(consumerCode)
+			.SetI4R(consumerCode, Register::r1)
+			.Jmp(consumerCode, consumerLoop)
+			.BindLabel(consumerCode, consumerEnd)
+			.PushI4R(consumerCode, Register::r1);
+		consumerScope.SetCodeBuffer(move(consumerCode));
+
+		RuntimeScope * scopes[] = { &producerScope, &doublerScope, &consumerScope };
+		vector<RuntimeFixedStack *> stacks;
+		vector<RegisterSet *> registerSets;
+		vector<RuntimeContext *> contexts;
+		ContextScheduler scheduler(scopeManager, 2);
+		for (size_t i = 0; i < 3; ++i) {
+			ScopeVerifier(scopeManager).Verify(* scopes[i]);
+			stacks.push_back(new RuntimeFixedStack(64));
+			registerSets.push_back(new RegisterSet());
+			registerSets.back()->Reset();
+			contexts.push_back(new RuntimeContext(stacks[i], registerSets[i], &scopeManager, scopes[i]->GetId(), nullptr, false));
+			scheduler.Add(* contexts[i]);
+		}
+		scheduler.Run();
+
+		testContext.Accept(stacks[2]->Pop<int32_t>() == valueCount * (valueCount + 1));
+		testContext.Accept(scheduler.GetSuspensionCount() > 0);
+		for (size_t i = 0; i < 3; ++i)
+			testContext.Accept(!contexts[i]->IsSuspended());
+
+		// Nobody sends to the doubler anymore.
+		contexts[1]->Reset(doublerScope.GetId());
+		scheduler.Add(* contexts[1]);
+		try {
+			scheduler.Run();
+			testContext.Fail();
+		} catch (const SchedulerException &) {
+			testContext.Accept(contexts[1]->IsSuspended());
+		}
+
+		for (size_t i = 0; i < 3; ++i) {
+			delete contexts[i];
+			delete registerSets[i];
+			delete stacks[i];
+		}
+	}
+END_TEST_UNIT
\ No newline at end of file
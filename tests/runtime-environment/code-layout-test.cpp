@@ -0,0 +1,132 @@
+//
+// code-layout-test.cpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#include "runtime-environment\code-layout.hpp"
+#include "runtime-environment\runtime-context.hpp"
+#include "runtime-environment\assembly.hpp"
+
+#include <n-test\test-unit.hpp>
+
+#include <cstdint>
+#include <vector>
+
+using namespace Nova;
+using namespace std;
+
+namespace {
+	scoperef_t ToScope(
+		size_t index
+		) {
+			return reinterpret_cast<scoperef_t>(index);
+		}
+
+	const int8_t * GetCode(
+		RuntimeScope & scope
+		) {
+			return static_cast<const int8_t *>(scope.GetCodeBuffer().GetPointer());
+		}
+}
+
+TEST_UNIT("runtime-environment\\code-layout")
+	TEST_METHOD("order", testContext) {
+		// main calls hot, which calls helper; cold is never called and big runs on its own.
+		ScopeProfile profile;
+		profile.AddCalls(ToScope(0), 1);
+		profile.AddCalls(ToScope(0), ToScope(3), 100);
+		profile.AddCalls(ToScope(3), ToScope(2), 50);
+		testContext.Accept(profile.GetCallCount(ToScope(3)) == 100 && profile.GetCallCount(ToScope(1)) == 0);
+		testContext.Accept(profile.GetEdges().size() == 2);
+
+		vector<scoperef_t> order = CodeLayout::GetOrder(profile, 5);
+		testContext.Accept(order.size() == 3 && order[0] == ToScope(0) && order[1] == ToScope(3) && order[2] == ToScope(2));
+
+		// The chain called the most goes first.
+		profile.AddCalls(ToScope(4), 500);
+		order = CodeLayout::GetOrder(profile, 5);
+		testContext.Accept(order.size() == 4 && order[0] == ToScope(4) && order[1] == ToScope(0)
+			&& order[2] == ToScope(3) && order[3] == ToScope(2));
+	}
+
+	TEST_METHOD("pack", testContext) {
+		RuntimeScopeManager * scopeManager = new RuntimeScopeManager();
+		RuntimeScope & mainScope = scopeManager->CreateNewScope();
+		RuntimeScope & coldScope = scopeManager->CreateNewScope();
+		RuntimeScope & helperScope = scopeManager->CreateNewScope();
+		RuntimeScope & hotScope = scopeManager->CreateNewScope();
+
+		DynamicBuffer helperCode;
+		AssemblyWriter()
+			.PushI4C(helperCode, 4)
+			.AddI4(helperCode)
+			.Ret(helperCode);
+		helperScope.SetCodeBuffer(helperCode);
+
+		DynamicBuffer hotCode;
+		AssemblyWriter()
+			.PushI4C(hotCode, 1)
+			.AddI4(hotCode)
+			.Call(hotCode, helperScope.GetId())
+			.Ret(hotCode);
+		hotScope.SetCodeBuffer(hotCode);
+
+		DynamicBuffer coldCode;
+		AssemblyWriter()
+			.Ret(coldCode);
+		coldScope.SetCodeBuffer(coldCode);
+
+		DynamicBuffer mainCode;
+		AssemblyWriter()
+			.PushI4C(mainCode, 3)
+			.Call(mainCode, hotScope.GetId());
+		mainScope.SetCodeBuffer(mainCode);
+
+		ScopeProfile profile;
+		profile.AddCalls(mainScope.GetId(), 1);
+		profile.AddCalls(mainScope.GetId(), hotScope.GetId(), 1);
+		profile.AddCalls(hotScope.GetId(), helperScope.GetId(), 1);
+		CodeLayout::Apply(* scopeManager, profile);
+
+		// The hot scopes follow their callers, and the cold one goes last.
+		testContext.Accept(GetCode(mainScope) < GetCode(hotScope) && GetCode(hotScope) < GetCode(helperScope)
+			&& GetCode(helperScope) < GetCode(coldScope));
+		testContext.Accept(memcmp(GetCode(hotScope), hotCode.GetPointer(), hotCode.GetSize()) == 0);
+
+		RuntimeContext * context = RuntimeContextBuilder()
+			.SetRegisterSet(new RegisterSet())
+			.SetRuntimeStack(new RuntimeFixedStack(64))
+			.SetRuntimeScopeManager(scopeManager)
+			.SetStartScope(mainScope.GetId())
+			.Build();
+		context->Run();
+		testContext.Accept(context->GetRuntimeStack().Pop<int32_t>() == 8);
+		delete context;
+	}
+
+	TEST_METHOD("errors", testContext) {
+		RuntimeScopeManager scopeManager;
+		scopeManager.CreateNewScope();
+		scopeManager.CreateNewScope();
+
+		ScopeProfile profile;
+		profile.AddCalls(ToScope(0), ToScope(2), 10);
+		try {
+			CodeLayout::Apply(scopeManager, profile);
+			testContext.Fail();
+		} catch (InvalidArgumentException &) {
+		}
+
+		vector<scoperef_t> order;
+		order.push_back(ToScope(1));
+		order.push_back(ToScope(1));
+		try {
+			scopeManager.PackCode(order);
+			testContext.Fail();
+		} catch (InvalidArgumentException &) {
+		}
+		testContext.Accept();
+	}
+END_TEST_UNIT
\ No newline at end of file
@@ -0,0 +1,188 @@
+//
+// constant-pool-test.cpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#include "runtime-environment\constant-pool.hpp"
+#include "runtime-environment\runtime-context.hpp"
+#include "runtime-environment\scope-verifier.hpp"
+
+#include <n-test\test-unit.hpp>
+
+#include <cstdint>
+#include <string>
+
+using namespace Nova;
+using namespace std;
+
+namespace {
+	RuntimeContext * CreateContext(
+		RuntimeScopeManager * scopeManager, RuntimeScope & scope
+		) {
+			return RuntimeContextBuilder()
+				.SetRegisterSet(new RegisterSet())
+				.SetRuntimeStack(new RuntimeFixedStack(128))
+				.SetRuntimeScopeManager(scopeManager)
+				.SetStartScope(scope.GetId())
+				.Build();
+		}
+}
+
+TEST_UNIT("runtime-environment\\constant-pool")
+	TEST_METHOD("pool", testContext) {
+		ConstantPool pool;
+		constref_t wide = pool.AddValue<int64_t>(0x123456789abcLL);
+		constref_t half = pool.AddValue(0.5);
+		int32_t table[] = { 1, 2, 4, 8 };
+		constref_t powers = pool.AddArray(table, 4);
+		constref_t name = pool.AddString("nova");
+
+		// Equal constants are stored once, but the type is part of the constant.
+		testContext.Accept(pool.AddValue<int64_t>(0x123456789abcLL) == wide && pool.AddString("nova") == name);
+		testContext.Accept(pool.AddValue<int32_t>(1) != powers && pool.GetCount() == 5);
+
+		testContext.Accept(pool.GetValue<int64_t>(wide) == 0x123456789abcLL && pool.GetValue<double>(half) == 0.5);
+		testContext.Accept(pool.IsArray(powers) && pool.GetType(powers) == ValueType::i4 && pool.GetLength(powers) == 4);
+		testContext.Accept(pool.GetSize(name) == 4 && memcmp(pool.GetData(name), "nova", 4) == 0);
+		testContext.Accept(reinterpret_cast<size_t>(pool.GetData(powers)) % 32 == reinterpret_cast<size_t>(pool.GetData(wide)) % 32);
+
+		try {
+			pool.AddValue<refaddr_t>(nullptr);
+			testContext.Fail();
+		} catch (const InvalidArgumentException &) {
+		}
+		try {
+			pool.GetValue<int32_t>(wide);
+			testContext.Fail();
+		} catch (const InvalidArgumentException &) {
+			testContext.Accept();
+		}
+	}
+
+	TEST_METHOD("image", testContext) {
+		ConstantPool pool;
+		constref_t wide = pool.AddValue<int64_t>(-7);
+		constref_t name = pool.AddString("constant");
+		DynamicBuffer image;
+		pool.Save(image);
+
+		// The loaded pool reads the data from the image.
+		ConstantPool loaded;
+		loaded.Load(image.GetPointer(), image.GetSize());
+		testContext.Accept(loaded.IsMapped() && loaded.GetCount() == 2);
+		testContext.Accept(loaded.GetValue<int64_t>(wide) == -7 && loaded.GetData(name) > image.GetPointer()
+			&& memcmp(loaded.GetData(name), "constant", 8) == 0);
+
+		// Adding constants copies the data out of the image, and finds the ones already loaded.
+		testContext.Accept(loaded.AddString("constant") == name && loaded.IsMapped());
+		constref_t other = loaded.AddString("other");
+		testContext.Accept(!loaded.IsMapped() && loaded.GetCount() == 3 && memcmp(loaded.GetData(other), "other", 5) == 0);
+
+		try {
+			loaded.Load(image.GetPointer(), 8);
+			testContext.Fail();
+		} catch (const InvalidArgumentException &) {
+		}
+		DynamicBuffer corrupted = image;
+		memset(corrupted.GetPointer(), 0, 4);
+		try {
+			loaded.Load(corrupted.GetPointer(), corrupted.GetSize());
+			testContext.Fail();
+		} catch (const InvalidArgumentException &) {
+			testContext.Accept(loaded.GetCount() == 3);
+		}
+	}
+
+	TEST_METHOD("instructions", testContext) {
+		RuntimeScopeManager * scopeManager = new RuntimeScopeManager();
+		RuntimeScope & scope = scopeManager->CreateNewScope();
+		ConstantPool & pool = scopeManager->GetConstantPool();
+		constref_t wide = pool.AddValue<int64_t>(1LL << 40);
+		v2fd_t lanes = { { 1.5, 2.5 } };
+		constref_t sums = pool.AddValue(lanes);
+		int32_t table[] = { 1, 2, 4, 8 };
+		constref_t powers = pool.AddArray(table, 4);
+		constref_t name = pool.AddString("nova");
+
+		DynamicBuffer code;
+		AssemblyWriter writer;
+		writer
+			.LdK(code, ValueType::i8, wide)
+			.LdK(code, ValueType::v2fd, sums)
+			.HAddV(code, ValueType::v2fd)
+			.PushI4C(code, 3)
+			.LdxK(code, ValueType::i4, powers);
+		size_t allocOffset = code.GetSize();
+		writer
+			.AllocK(code, Register::m0, name)
+			.LenM(code, Register::m0)
+			.AddI4(code)
+			.LdI1M(code, Register::m0, 1);
+		scope.SetCodeBuffer(move(code));
+
+		ScopeVerifier(* scopeManager).Verify(scope);
+		vector<ValueType> results;
+		results.push_back(ValueType::i8);
+		results.push_back(ValueType::fd);
+		results.push_back(ValueType::i4);
+		results.push_back(ValueType::i1);
+		testContext.Accept(scope.GetSignature().GetResults() == results);
+		testContext.Accept(scope.GetStackMap().Find(allocOffset) != nullptr);
+
+		RuntimeContext * context = CreateContext(scopeManager, scope);
+		context->Run();
+		RuntimeFixedStack & stack = context->GetRuntimeStack();
+		testContext.Accept(stack.Pop<int8_t>() == 'o' && stack.Pop<int32_t>() == 12);
+		testContext.Accept(stack.Pop<double>() == 4.0 && stack.Pop<int64_t>() == 1LL << 40);
+
+		delete context;
+	}
+
+	TEST_METHOD("errors", testContext) {
+		RuntimeScopeManager * scopeManager = new RuntimeScopeManager();
+		RuntimeScope & typeScope = scopeManager->CreateNewScope();
+		RuntimeScope & indexScope = scopeManager->CreateNewScope();
+		int32_t table[] = { 1, 2 };
+		constref_t pair = scopeManager->GetConstantPool().AddArray(table, 2);
+
+		DynamicBuffer typeCode;
+		AssemblyWriter()
+			.LdK(typeCode, ValueType::i4, pair);
+		typeScope.SetCodeBuffer(move(typeCode));
+		try {
+			ScopeVerifier(* scopeManager).Verify(typeScope);
+			testContext.Fail();
+		} catch (const VerificationException &) {
+			testContext.Accept();
+		}
+
+		// Indices are checked when they're used, by verified scopes too.
+		DynamicBuffer indexCode;
+		AssemblyWriter()
+			.PushI4C(indexCode, 2)
+			.LdxK(indexCode, ValueType::i4, pair);
+		indexScope.SetCodeBuffer(move(indexCode));
+		ScopeVerifier(* scopeManager).Verify(indexScope);
+
+		RuntimeContext * context = CreateContext(scopeManager, indexScope);
+		try {
+			context->Run();
+			testContext.Fail();
+		} catch (const RuntimeException &) {
+			testContext.Accept();
+		}
+
+		// Scopes which weren't verified check the constants when they run.
+		context->Reset(typeScope.GetId());
+		try {
+			context->Run();
+			testContext.Fail();
+		} catch (const RuntimeException &) {
+			testContext.Accept();
+		}
+
+		delete context;
+	}
+END_TEST_UNIT
\ No newline at end of file
@@ -0,0 +1,175 @@
+//
+// context-snapshot-test.cpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#include "runtime-environment\context-snapshot.hpp"
+#include "runtime-environment\generational-heap.hpp"
+
+#include <n-test\test-unit.hpp>
+
+#include <cstdint>
+
+using namespace Nova;
+using namespace std;
+
+TEST_UNIT("runtime-environment\\context-snapshot")
+	TEST_METHOD("stack-and-registers", testContext) {
+		RuntimeScopeManager scopeManager;
+		RuntimeScope & initScope = scopeManager.CreateNewScope();
+		RuntimeScope & requestScope = scopeManager.CreateNewScope();
+
+		int initCount = 0;
+		ExternalScope & setupScope = scopeManager.CreateExternalScope();
+		setupScope.SetCallbackFunction(
+			[&initCount] (RuntimeFixedStack & stack) {
+				++initCount;
+				stack.Push(int32_t(100));
+			});
+
+		DynamicBuffer initCode;
+		AssemblyWriter()
+			.XCall(initCode, setupScope.GetId())
+			.PushI4C(initCode, 7)
+			.SetI4R(initCode, Register::r2);
+		initScope.SetCodeBuffer(move(initCode));
+
+		DynamicBuffer requestCode;
+		AssemblyWriter()
+			.PushI4R(requestCode, Register::r2)
+			.AddI4(requestCode);
+		requestScope.SetCodeBuffer(move(requestCode));
+
+		RuntimeFixedStack initStack(64);
+		RegisterSet initRegisters;
+		initRegisters.Reset();
+		initRegisters.SetSPRegister(Register::sp1, initStack.GetBaseAddress() + 4);
+		RuntimeContext initContext(&initStack, &initRegisters, &scopeManager, initScope.GetId(), nullptr, false);
+		initContext.Run();
+		ContextSnapshot snapshot(initContext);
+		testContext.Accept(snapshot.GetDataSize() == 4 && snapshot.GetObjectCount() == 0);
+
+		for (int i = 0; i < 3; ++i) {
+			RuntimeFixedStack stack(64);
+			RegisterSet registerSet;
+			RuntimeContext context(&stack, &registerSet, &scopeManager, InvalidScope, nullptr, false);
+			snapshot.Restore(context, requestScope.GetId());
+			testContext.Accept(registerSet.GetSPRegister(Register::sp1) == stack.GetBaseAddress() + 4);
+
+			context.Run();
+			testContext.Accept(stack.Pop<int32_t>() == 107);
+			testContext.Accept(stack.GetCurrentAddress() == stack.GetBaseAddress());
+		}
+		testContext.Accept(initCount == 1);
+	}
+
+	TEST_METHOD("heap", testContext) {
+		RuntimeScopeManager scopeManager;
+		RuntimeScope & scope = scopeManager.CreateNewScope();
+
+		// A table of 64 rows, each with its index and a reference back to the table.
+		GenerationalHeap initHeap(4096);
+		RuntimeFixedStack initStack(64);
+		RegisterSet initRegisters;
+		initRegisters.Reset();
+		RuntimeContext initContext(&initStack, &initRegisters, &scopeManager, scope.GetId(), &initHeap, false);
+
+		const int32_t rowCount = 64;
+		refaddr_t table = initHeap.Allocate(rowCount * sizeof (refaddr_t));
+		initRegisters.SetMRegister(Register::m0, table);
+		initRegisters.SetMRegister(Register::m2, table);
+		for (int32_t i = 0; i < rowCount; ++i) {
+			refaddr_t row = initHeap.Allocate(64);
+			HeapObject::Store<int32_t>(row, 0, i * 3);
+			table = initRegisters.GetMRegister(Register::m0);
+			HeapObject::Store<refaddr_t>(row, 8, table);
+			HeapObject::Store<refaddr_t>(table, i * sizeof (refaddr_t), row);
+			initHeap.WriteBarrier(table, row);
+		}
+
+		ContextSnapshot snapshot(initContext);
+		testContext.Accept(snapshot.GetObjectCount() == rowCount + 1);
+
+		// The nursery fills up while the objects are restored, so they are moved.
+		GenerationalHeap heap(1024);
+		RuntimeFixedStack stack(64);
+		RegisterSet registerSet;
+		RuntimeContext context(&stack, &registerSet, &scopeManager, InvalidScope, &heap, false);
+		snapshot.Restore(context, scope.GetId());
+		testContext.Accept(heap.GetStatistics().MinorCollections > 0);
+
+		refaddr_t restoredTable = registerSet.GetMRegister(Register::m0);
+		testContext.Accept(registerSet.GetMRegister(Register::m2) == restoredTable);
+		testContext.Accept(registerSet.GetMRegister(Register::m1) == nullptr);
+		bool rowsMatch = true;
+		for (int32_t i = 0; i < rowCount; ++i) {
+			refaddr_t row = HeapObject::Load<refaddr_t>(restoredTable, i * sizeof (refaddr_t));
+			rowsMatch = rowsMatch && HeapObject::Load<int32_t>(row, 0) == i * 3
+				&& HeapObject::Load<refaddr_t>(row, 8) == restoredTable;
+		}
+		testContext.Accept(rowsMatch);
+	}
+
+	TEST_METHOD("errors", testContext) {
+		RuntimeScopeManager scopeManager;
+		RuntimeScope & scope = scopeManager.CreateNewScope();
+		RuntimeFixedStack stack(64);
+		RegisterSet registerSet;
+		registerSet.Reset();
+		RuntimeContext context(&stack, &registerSet, &scopeManager, scope.GetId(), nullptr, false);
+
+		int32_t hostData[4] = { 0 };
+		registerSet.SetMRegister(Register::m0, context.RegisterHostView(hostData, 4, ValueType::i4, HostViewAccess::ReadWrite));
+		try {
+			ContextSnapshot snapshot(context);
+			testContext.Fail();
+		} catch (const SnapshotException &) {
+			testContext.Accept();
+		}
+
+		// Snapshots can't be taken from a callback, in the middle of a run.
+		ExternalScope & captureScope = scopeManager.CreateExternalScope();
+		bool thrown = false;
+		captureScope.SetCallbackFunction(
+			[&] (RuntimeFixedStack &) {
+				try {
+					ContextSnapshot snapshot(context);
+				} catch (const SnapshotException &) {
+					thrown = true;
+				}
+			});
+		DynamicBuffer code;
+		AssemblyWriter().XCall(code, captureScope.GetId());
+		scope.SetCodeBuffer(move(code));
+		context.Reset(scope.GetId());
+		context.Run();
+		testContext.Accept(thrown);
+
+		// The stack of the context must fit the one of the snapshot.
+		stack.Push(int64_t(1));
+		stack.Push(int64_t(2));
+		ContextSnapshot snapshot(context);
+		RuntimeFixedStack smallStack(8);
+		RuntimeContext smallContext(&smallStack, &registerSet, &scopeManager, scope.GetId(), nullptr, false);
+		try {
+			snapshot.Restore(smallContext, scope.GetId());
+			testContext.Fail();
+		} catch (const StackException &) {
+			testContext.Accept();
+		}
+
+		// References left in the stack would point to the heap of this context.
+		context.Reset(scope.GetId());
+		refaddr_t object = context.GetRuntimeHeap().Allocate(8);
+		registerSet.SetMRegister(Register::m1, object);
+		stack.Push(object);
+		try {
+			ContextSnapshot snapshot(context);
+			testContext.Fail();
+		} catch (const SnapshotException &) {
+			testContext.Accept();
+		}
+	}
+END_TEST_UNIT
\ No newline at end of file
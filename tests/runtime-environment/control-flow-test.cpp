@@ -0,0 +1,247 @@
+//
+// control-flow-test.cpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#include "runtime-environment\runtime-context.hpp"
+#include "runtime-environment\scope-verifier.hpp"
+
+#include <n-test\test-unit.hpp>
+
+#include <cstdint>
+
+using namespace Nova;
+using namespace std;
+
+namespace {
+	RuntimeContext * CreateContext(
+		RuntimeScopeManager * scopeManager, RuntimeScope & scope
+		) {
+			return RuntimeContextBuilder()
+				.SetRegisterSet(new RegisterSet())
+				.SetRuntimeStack(new RuntimeFixedStack(64))
+				.SetRuntimeScopeManager(scopeManager)
+				.SetStartScope(scope.GetId())
+				.Build();
+		}
+}
+
+TEST_UNIT("runtime-environment\\control-flow")
+	TEST_METHOD("loop", testContext) {
+		RuntimeScopeManager * scopeManager = new RuntimeScopeManager();
+		RuntimeScope & scope = scopeManager->CreateNewScope();
+
+		// Sums 10 + 9 + ... + 1.
+		DynamicBuffer code;
+		AssemblyWriter writer;
+		label_t loop = writer.CreateLabel();
+		writer
+			.PushI4C(code, 10)
+			.SetI4R(code, Register::r0)
+			.PushI4C(code, 0)
+			.BindLabel(code, loop)
+			.PushI4R(code, Register::r0)
+			.AddI4(code)
+			.DjnzI4R(code, Register::r0, loop);
+		testContext.Accept(!writer.HasUnresolvedLabels());
+		scope.SetCodeBuffer(move(code));
+
+		ScopeVerifier(* scopeManager).Verify(scope);
+		testContext.Accept(scope.GetSignature().GetParameters().empty());
+		testContext.Accept(scope.GetSignature().GetResults() == vector<ValueType>(1, ValueType::i4));
+
+		RuntimeContext * context = CreateContext(scopeManager, scope);
+		context->Run();
+		testContext.Accept(context->GetRuntimeStack().Pop<int32_t>() == 55);
+		testContext.Accept(context->GetRegisterSet().GetRRegister(Register::r0) == 0);
+
+		delete context;
+	}
+
+	TEST_METHOD("registers", testContext) {
+		RuntimeScopeManager * scopeManager = new RuntimeScopeManager();
+		RuntimeScope & pushScope = scopeManager->CreateNewScope();
+		RuntimeScope & setScope = scopeManager->CreateNewScope();
+		RuntimeScope & loopScope = scopeManager->CreateNewScope();
+
+		// The scopes aren't verified, so the registers are checked when they run.
+		DynamicBuffer pushCode;
+		AssemblyWriter().PushI4R(pushCode, Register(4000));
+		pushScope.SetCodeBuffer(move(pushCode));
+
+		DynamicBuffer setCode;
+		AssemblyWriter()
+			.PushI4C(setCode, 1)
+			.SetI4R(setCode, Register::m0);
+		setScope.SetCodeBuffer(move(setCode));
+
+		DynamicBuffer loopCode;
+		AssemblyWriter loopWriter;
+		label_t loop = loopWriter.CreateLabel();
+		loopWriter
+			.BindLabel(loopCode, loop)
+			.DjnzI4R(loopCode, Register(-1), loop);
+		loopScope.SetCodeBuffer(move(loopCode));
+
+		RuntimeContext * context = CreateContext(scopeManager, pushScope);
+		RuntimeScope * scopes[] = { &pushScope, &setScope, &loopScope };
+		for (auto scope : scopes) {
+			context->Reset(scope->GetId());
+			try {
+				context->Run();
+				testContext.Fail();
+			} catch (const RuntimeException &) {
+				testContext.Accept();
+			}
+		}
+
+		delete context;
+	}
+
+	TEST_METHOD("branches", testContext) {
+		RuntimeScopeManager * scopeManager = new RuntimeScopeManager();
+		RuntimeScope & mainScope = scopeManager->CreateNewScope();
+		RuntimeScope & clampScope = scopeManager->CreateNewScope();
+
+		// Clamps the parameter to [0, 100], with a fused branch for the upper bound and a comparison
+		// for the lower one. Both labels are used before they're bound.
+		DynamicBuffer clampCode;
+		AssemblyWriter writer;
+		label_t positive = writer.CreateLabel(), end = writer.CreateLabel();
+		writer
+			.SetI4R(clampCode, Register::r1)
+			.PushI4R(clampCode, Register::r1)
+			.PushI4C(clampCode, 0)
+			.CmpGeI4(clampCode)
+			.Jt(clampCode, positive)
+			.PushI4C(clampCode, 0)
+			.Jmp(clampCode, end)
+			.BindLabel(clampCode, positive)
+			.PushI4R(clampCode, Register::r1)
+			.PushI4C(clampCode, 100)
+			.PushI4R(clampCode, Register::r1)
+			.JgtI4(clampCode, end)
+			.SetI4R(clampCode, Register::r2)
+			.PushI4C(clampCode, 100)
+			.BindLabel(clampCode, end)
+			.Ret(clampCode);
+		clampScope.SetSignature(ScopeSignature(vector<ValueType>(1, ValueType::i4), vector<ValueType>(1, ValueType::i4)));
+		clampScope.SetCodeBuffer(move(clampCode));
+
+		DynamicBuffer mainCode;
+		AssemblyWriter()
+			.PushI4C(mainCode, 150)
+			.Call(mainCode, clampScope.GetId())
+			.PushI4C(mainCode, -5)
+			.Call(mainCode, clampScope.GetId())
+			.PushI4C(mainCode, 42)
+			.Call(mainCode, clampScope.GetId());
+		mainScope.SetCodeBuffer(move(mainCode));
+
+		ScopeVerifier(* scopeManager).Verify(mainScope);
+		testContext.Accept(mainScope.GetSignature().GetResults() == vector<ValueType>(3, ValueType::i4));
+
+		RuntimeContext * context = CreateContext(scopeManager, mainScope);
+		context->Run();
+		testContext.Accept(context->GetRuntimeStack().Pop<int32_t>() == 42);
+		testContext.Accept(context->GetRuntimeStack().Pop<int32_t>() == 0);
+		testContext.Accept(context->GetRuntimeStack().Pop<int32_t>() == 100);
+
+		delete context;
+	}
+
+	TEST_METHOD("verification", testContext) {
+		RuntimeScopeManager scopeManager;
+		RuntimeScope & joinScope = scopeManager.CreateNewScope();
+		RuntimeScope & targetScope = scopeManager.CreateNewScope();
+		RuntimeScope & endlessScope = scopeManager.CreateNewScope();
+
+		// The taken branch leaves an empty stack, and the other path an i4.
+		DynamicBuffer joinCode;
+		AssemblyWriter joinWriter;
+		label_t join = joinWriter.CreateLabel();
+		joinWriter
+			.PushI4C(joinCode, 1)
+			.PushI4C(joinCode, 2)
+			.JeqI4(joinCode, join)
+			.PushI4C(joinCode, 3)
+			.BindLabel(joinCode, join)
+			.Nop(joinCode);
+		joinScope.SetCodeBuffer(move(joinCode));
+
+		// Targets the middle of the push_i4c.
+		DynamicBuffer targetCode;
+		AssemblyWriter()
+			.PushI4C(targetCode, 1)
+			.Jmp(targetCode, -2);
+		targetScope.SetCodeBuffer(move(targetCode));
+
+		DynamicBuffer endlessCode;
+		AssemblyWriter endlessWriter;
+		label_t loop = endlessWriter.CreateLabel();
+		endlessWriter
+			.BindLabel(endlessCode, loop)
+			.Jmp(endlessCode, loop);
+		endlessScope.SetCodeBuffer(move(endlessCode));
+
+		RuntimeScope * scopes[] = { &joinScope, &targetScope, &endlessScope };
+		for (auto scope : scopes) {
+			try {
+				ScopeVerifier(scopeManager).Verify(* scope);
+				testContext.Fail();
+			} catch (const VerificationException &) {
+				testContext.Accept();
+			}
+		}
+
+		endlessScope.SetSignature(ScopeSignature());
+		ScopeVerifier(scopeManager).Verify(endlessScope);
+		testContext.Accept(endlessScope.IsVerified());
+	}
+
+	TEST_METHOD("labels", testContext) {
+		DynamicBuffer code, otherCode;
+		AssemblyWriter writer;
+		label_t back = writer.CreateLabel(), forward = writer.CreateLabel();
+
+		writer
+			.BindLabel(code, back)
+			.Nop(code)
+			.Jmp(code, back)
+			.Jf(code, forward);
+		testContext.Accept(writer.HasUnresolvedLabels());
+		writer
+			.Nop(code)
+			.BindLabel(code, forward);
+		testContext.Accept(!writer.HasUnresolvedLabels());
+
+		AssemblyReader reader;
+		DynamicBuffer::ConstIterator iterator = code.GetConstIterator();
+		int32_t offset;
+		reader.GoNextInstruction(iterator);
+		reader.Branch(iterator, offset);
+		reader.GoNextInstruction(iterator);
+		testContext.Accept(offset == -static_cast<int32_t>(iterator.GetOffset()));
+		reader.Branch(iterator, offset);
+		reader.GoNextInstruction(iterator);
+		reader.GoNextInstruction(iterator);
+		testContext.Accept(offset == static_cast<int32_t>(AssemblyReader::GetInstructionSize(Instruction::nop)));
+		testContext.Accept(!iterator.HasData());
+
+		try {
+			writer.BindLabel(code, back);
+			testContext.Fail();
+		} catch (const InvalidArgumentException &) {
+			testContext.Accept();
+		}
+
+		try {
+			writer.Jmp(otherCode, back);
+			testContext.Fail();
+		} catch (const InvalidArgumentException &) {
+			testContext.Accept();
+		}
+	}
+END_TEST_UNIT
\ No newline at end of file
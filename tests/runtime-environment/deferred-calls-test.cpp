@@ -0,0 +1,200 @@
+//
+// deferred-calls-test.cpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#include "runtime-environment\runtime-context.hpp"
+#include "runtime-environment\scope-verifier.hpp"
+
+#include <n-test\test-unit.hpp>
+
+#include <cstdint>
+#include <vector>
+
+using namespace Nova;
+using namespace std;
+
+namespace {
+	RuntimeContext * CreateContext(
+		RuntimeScopeManager * scopeManager, RuntimeScope & scope
+		) {
+			return RuntimeContextBuilder()
+				.SetRegisterSet(new RegisterSet())
+				.SetRuntimeStack(new RuntimeFixedStack(128))
+				.SetRuntimeScopeManager(scopeManager)
+				.SetStartScope(scope.GetId())
+				.Build();
+		}
+
+	ScopeSignature CreateSignature(
+		ValueType first, ValueType second
+		) {
+			vector<ValueType> parameters;
+			parameters.push_back(first);
+			parameters.push_back(second);
+			return ScopeSignature(parameters, vector<ValueType>());
+		}
+}
+
+TEST_UNIT("runtime-environment\\deferred-calls")
+	TEST_METHOD("batches", testContext) {
+		RuntimeScopeManager * scopeManager = new RuntimeScopeManager();
+		RuntimeScope & scope = scopeManager->CreateNewScope();
+		ExternalScope & rowScope = scopeManager->CreateExternalScope();
+		ExternalScope & logScope = scopeManager->CreateExternalScope();
+		rowScope.SetSignature(CreateSignature(ValueType::i4, ValueType::fd));
+		logScope.SetSignature(CreateSignature(ValueType::i4, ValueType::i4));
+
+		vector<int32_t> keys;
+		vector<double> values;
+		size_t rowBatches = 0, logCalls = 0;
+		rowScope.SetBatchCallbackFunction(
+			[&] (const ExternalCallBatch & batch) {
+				++rowBatches;
+				for (size_t i = 0; i < batch.GetCallCount(); ++i) {
+					keys.push_back(batch.GetArgument<int32_t>(i, 0));
+					values.push_back(batch.GetArgument<double>(i, sizeof(int32_t)));
+				}
+			});
+		logScope.SetBatchCallbackFunction(
+			[&] (const ExternalCallBatch & batch) {
+				logCalls += batch.GetCallCount();
+			});
+
+		DynamicBuffer code;
+		ConstantPool & pool = scopeManager->GetConstantPool();
+		AssemblyWriter writer;
+		for (int32_t i = 0; i < 3; ++i) {
+			writer
+				.PushI4C(code, i)
+				.LdK(code, ValueType::fd, pool.AddValue(i * 0.5))
+				.XCall(code, rowScope.GetId())
+				.PushI4C(code, i)
+				.PushI4C(code, -i)
+				.XCall(code, logScope.GetId());
+		}
+		writer.PushI4C(code, 7);
+		scope.SetCodeBuffer(move(code));
+		ScopeVerifier(* scopeManager).Verify(scope);
+
+		// The calls are delivered in one batch per scope, once the run finishes.
+		RuntimeContext * context = CreateContext(scopeManager, scope);
+		context->Run();
+		testContext.Accept(rowBatches == 1 && logCalls == 3 && context->GetDeferredCallCount() == 0);
+		testContext.Accept(keys.size() == 3 && keys[0] == 0 && keys[2] == 2 && values[1] == 0.5 && values[2] == 1.0);
+		testContext.Accept(context->GetRuntimeStack().Pop<int32_t>() == 7);
+
+		context->Reset(scope.GetId());
+		context->Run();
+		testContext.Accept(rowBatches == 2 && logCalls == 6 && keys.size() == 6);
+
+		delete context;
+	}
+
+	TEST_METHOD("flush", testContext) {
+		RuntimeScopeManager * scopeManager = new RuntimeScopeManager();
+		RuntimeScope & scope = scopeManager->CreateNewScope();
+		ExternalScope & deferredScope = scopeManager->CreateExternalScope();
+		ExternalScope & syncScope = scopeManager->CreateExternalScope();
+		deferredScope.SetSignature(CreateSignature(ValueType::i4, ValueType::i4));
+
+		vector<size_t> batchSizes;
+		deferredScope.SetBatchCallbackFunction(
+			[&batchSizes] (const ExternalCallBatch & batch) {
+				batchSizes.push_back(batch.GetCallCount());
+			}, 2);
+
+		RuntimeContext * context = nullptr;
+		size_t pendingCalls = 0;
+		syncScope.SetCallbackFunction(
+			[&] (RuntimeFixedStack &) {
+				pendingCalls = context->GetDeferredCallCount();
+				context->FlushDeferredCalls();
+			});
+
+		DynamicBuffer code;
+		AssemblyWriter writer;
+		for (int32_t i = 0; i < 3; ++i) {
+			writer
+				.PushI4C(code, i)
+				.PushI4C(code, i)
+				.XCall(code, deferredScope.GetId());
+		}
+		writer.XCall(code, syncScope.GetId());
+		for (int32_t i = 0; i < 2; ++i) {
+			writer
+				.PushI4C(code, i)
+				.PushI4C(code, i)
+				.XCall(code, deferredScope.GetId());
+		}
+		scope.SetCodeBuffer(move(code));
+
+		// Full batches are delivered right away, and the synchronous call delivers the one left.
+		context = CreateContext(scopeManager, scope);
+		context->Run();
+		testContext.Accept(pendingCalls == 1 && batchSizes.size() == 3);
+		testContext.Accept(batchSizes[0] == 2 && batchSizes[1] == 1 && batchSizes[2] == 2);
+		testContext.Accept(context->GetRuntimeStack().GetCurrentAddress() == context->GetRuntimeStack().GetBaseAddress());
+
+		delete context;
+	}
+
+	TEST_METHOD("errors", testContext) {
+		RuntimeScopeManager * scopeManager = new RuntimeScopeManager();
+		RuntimeScope & scope = scopeManager->CreateNewScope();
+		ExternalScope & deferredScope = scopeManager->CreateExternalScope();
+		size_t calls = 0;
+		auto callback = [&calls] (const ExternalCallBatch & batch) { calls += batch.GetCallCount(); };
+
+		// Only scopes with a signature without results or references can be deferred.
+		try {
+			deferredScope.SetBatchCallbackFunction(callback);
+			testContext.Fail();
+		} catch (const InvalidArgumentException &) {
+		}
+		vector<ValueType> types(1, ValueType::i4);
+		deferredScope.SetSignature(ScopeSignature(types, types));
+		try {
+			deferredScope.SetBatchCallbackFunction(callback);
+			testContext.Fail();
+		} catch (const InvalidArgumentException &) {
+		}
+		deferredScope.SetSignature(CreateSignature(ValueType::i4, ValueType::rf));
+		try {
+			deferredScope.SetBatchCallbackFunction(callback);
+			testContext.Fail();
+		} catch (const InvalidArgumentException &) {
+			testContext.Accept(!deferredScope.IsDeferred());
+		}
+
+		deferredScope.SetSignature(CreateSignature(ValueType::i4, ValueType::i4));
+		deferredScope.SetBatchCallbackFunction(callback);
+		try {
+			deferredScope.SetSignature(ScopeSignature());
+			testContext.Fail();
+		} catch (const InvalidArgumentException &) {
+		}
+
+		// The calls made before a trap are still delivered.
+		DynamicBuffer code;
+		AssemblyWriter()
+			.PushI4C(code, 1)
+			.PushI4C(code, 2)
+			.XCall(code, deferredScope.GetId())
+			.PushI4C(code, 3)
+			.XCall(code, deferredScope.GetId());
+		scope.SetCodeBuffer(move(code));
+
+		RuntimeContext * context = CreateContext(scopeManager, scope);
+		try {
+			context->Run();
+			testContext.Fail();
+		} catch (const StackException &) {
+			testContext.Accept(calls == 1 && context->GetDeferredCallCount() == 0);
+		}
+
+		delete context;
+	}
+END_TEST_UNIT
\ No newline at end of file
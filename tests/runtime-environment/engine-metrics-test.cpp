@@ -0,0 +1,192 @@
+//
+// engine-metrics-test.cpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#include "runtime-environment\engine-metrics.hpp"
+#include "runtime-environment\runtime-context.hpp"
+#include "runtime-environment\scope-verifier.hpp"
+
+#include <n-test\test-unit.hpp>
+
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+using namespace Nova;
+using namespace std;
+
+namespace {
+	RuntimeContext * CreateContext(
+		RuntimeScopeManager * scopeManager, RuntimeScope & scope
+		) {
+			return RuntimeContextBuilder()
+				.SetRegisterSet(new RegisterSet())
+				.SetRuntimeStack(new RuntimeFixedStack(64))
+				.SetRuntimeScopeManager(scopeManager)
+				.SetStartScope(scope.GetId())
+				.Build();
+		}
+}
+
+TEST_UNIT("runtime-environment\\engine-metrics")
+	TEST_METHOD("counters", testContext) {
+		RuntimeScopeManager * scopeManager = new RuntimeScopeManager();
+		RuntimeScope & mainScope = scopeManager->CreateNewScope();
+		RuntimeScope & addScope = scopeManager->CreateNewScope();
+		RuntimeScope & underflowScope = scopeManager->CreateNewScope();
+
+		DynamicBuffer addCode;
+		AssemblyWriter().AddI4(addCode);
+		addScope.SetCodeBuffer(move(addCode));
+
+		DynamicBuffer mainCode;
+		AssemblyWriter()
+			.PushI4C(mainCode, 1)
+			.PushI4C(mainCode, 2)
+			.PushI4C(mainCode, 3)
+			.Call(mainCode, addScope.GetId())
+			.Call(mainCode, addScope.GetId())
+			.Ret(mainCode);
+		mainScope.SetCodeBuffer(move(mainCode));
+		ScopeVerifier(* scopeManager).Verify(mainScope);
+
+		DynamicBuffer underflowCode;
+		AssemblyWriter().AddI4(underflowCode);
+		underflowScope.SetCodeBuffer(move(underflowCode));
+
+		RuntimeContext * context = CreateContext(scopeManager, mainScope);
+		for (int i = 0; i < 3; ++i) {
+			context->Reset(mainScope.GetId());
+			context->Run();
+		}
+		context->Reset(underflowScope.GetId());
+		try {
+			context->Run();
+			testContext.Fail();
+		} catch (const StackException &) {
+			testContext.Accept();
+		}
+
+		// Six instructions in the main scope and one in every call.
+		MetricsSnapshot snapshot = context->GetMetrics().Scrape();
+		testContext.Accept(snapshot.Runs == 4 && snapshot.InstructionsRetired == 3 * 8);
+		testContext.Accept(snapshot.GetTrapCount(TrapKind::Stack) == 1 && snapshot.GetTrapCount(TrapKind::Runtime) == 0);
+		testContext.Accept(snapshot.MaxStackDepth == 12 && snapshot.ContextAllocations == 1);
+		testContext.Accept(snapshot.RunLatency.GetCount() == 4);
+
+		delete context;
+	}
+
+	TEST_METHOD("histograms", testContext) {
+		bool roundTrips = true;
+		uint64_t values[] = { 0, 1, 15, 16, 17, 100, 1000, 123456789, 0xFFFFFFFFFFFFull };
+		for (auto value : values) {
+			size_t index = HistogramSnapshot::GetBucketIndex(value);
+			uint64_t limit = HistogramSnapshot::GetBucketLimit(index);
+			roundTrips = roundTrips && index < HistogramSnapshot::BucketCount && limit >= value
+				&& limit - value <= value / HistogramSnapshot::SubBucketCount;
+		}
+		testContext.Accept(roundTrips);
+
+		HistogramSnapshot histogram;
+		for (uint64_t value = 1; value <= 1000; ++value) {
+			histogram.Add(HistogramSnapshot::GetBucketIndex(value), 1);
+			histogram.AddTotals(1, value, value);
+		}
+		uint64_t median = histogram.GetValueAtPercentile(50);
+		testContext.Accept(median >= 500 && median <= 500 + 500 / 16 && histogram.GetValueAtPercentile(100) == 1000);
+		testContext.Accept(histogram.GetMean() == 500 && histogram.GetMax() == 1000);
+
+		RuntimeScopeManager * scopeManager = new RuntimeScopeManager();
+		RuntimeScope & scope = scopeManager->CreateNewScope();
+		scopeManager->CreateExternalScope().SetCallbackFunction([] (RuntimeFixedStack &) { });
+		ExternalScope & countScope = scopeManager->CreateExternalScope();
+		countScope.SetCallbackFunction([] (RuntimeFixedStack &) { });
+
+		DynamicBuffer code;
+		AssemblyWriter()
+			.XCall(code, countScope.GetId())
+			.XCall(code, countScope.GetId());
+		scope.SetCodeBuffer(move(code));
+
+		RuntimeContext * context = CreateContext(scopeManager, scope);
+		context->Run();
+		scopeManager->GetMetrics().SetLatencyEnabled(false);
+		context->Run();
+
+		MetricsSnapshot snapshot = scopeManager->GetMetrics().Scrape();
+		testContext.Accept(snapshot.XCallLatency.size() >= 2 && snapshot.XCallLatency[0].GetCount() == 0);
+		testContext.Accept(snapshot.XCallLatency[1].GetCount() == 2 && snapshot.RunLatency.GetCount() == 1);
+		testContext.Accept(snapshot.Runs == 2 && snapshot.InstructionsRetired == 4);
+
+		delete context;
+	}
+
+	TEST_METHOD("managers", testContext) {
+		// A thread switching between more managers than it caches keeps one shard in each.
+		const size_t metricsCount = 10;
+		EngineMetrics metrics[metricsCount];
+		Internal::MetricsShard * shards[metricsCount];
+		for (size_t i = 0; i < metricsCount; ++i)
+			shards[i] = &metrics[i].GetShard();
+
+		bool stable = true;
+		for (int round = 0; round < 3; ++round) {
+			for (size_t i = 0; i < metricsCount; ++i)
+				stable = stable && &metrics[i].GetShard() == shards[i] && metrics[i].GetShardCount() == 1;
+			for (size_t i = 0; i < 2; ++i)
+				stable = stable && &metrics[i].GetShard() == shards[i];
+		}
+		testContext.Accept(stable);
+	}
+
+	TEST_METHOD("threads", testContext) {
+		RuntimeScopeManager scopeManager;
+		RuntimeScope & scope = scopeManager.CreateNewScope();
+
+		DynamicBuffer code;
+		AssemblyWriter()
+			.PushI4C(code, 1)
+			.PushI4C(code, 2)
+			.AddI4(code);
+		scope.SetCodeBuffer(move(code));
+		ScopeVerifier(scopeManager).Verify(scope);
+
+		// Scraping while the workers run doesn't stop them, and sees growing counters.
+		const size_t threadCount = 4, runCount = 2000;
+		atomic<size_t> finished(0);
+		vector<thread> threads;
+		for (size_t i = 0; i < threadCount; ++i) {
+			threads.push_back(thread([&] {
+				RuntimeFixedStack stack(64);
+				RegisterSet registerSet;
+				registerSet.Reset();
+				RuntimeContext context(&stack, &registerSet, &scopeManager, scope.GetId(), nullptr, false);
+				for (size_t j = 0; j < runCount; ++j) {
+					context.Reset(scope.GetId());
+					context.Run();
+				}
+				++finished;
+			}));
+		}
+
+		bool monotonic = true;
+		uint64_t lastRuns = 0;
+		while (finished.load() < threadCount) {
+			uint64_t runs = scopeManager.GetMetrics().Scrape().Runs;
+			monotonic = monotonic && runs >= lastRuns;
+			lastRuns = runs;
+		}
+		for (auto & thread : threads)
+			thread.join();
+		testContext.Accept(monotonic);
+
+		MetricsSnapshot snapshot = scopeManager.GetMetrics().Scrape();
+		testContext.Accept(snapshot.Runs == threadCount * runCount && snapshot.InstructionsRetired == threadCount * runCount * 3);
+		testContext.Accept(snapshot.ContextAllocations == threadCount && scopeManager.GetMetrics().GetShardCount() >= threadCount);
+	}
+END_TEST_UNIT
\ No newline at end of file
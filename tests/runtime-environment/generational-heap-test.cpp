@@ -0,0 +1,158 @@
+//
+// generational-heap-test.cpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#include "runtime-environment\generational-heap.hpp"
+#include "runtime-environment\runtime-context.hpp"
+#include "runtime-environment\scope-verifier.hpp"
+
+#include <n-test\test-unit.hpp>
+
+#include <cstdint>
+
+using namespace Nova;
+using namespace std;
+
+TEST_UNIT("runtime-environment\\generational-heap")
+	TEST_METHOD("roots", testContext) {
+		vector<int32_t> values;
+
+		RuntimeScopeManager * scopeManager = new RuntimeScopeManager();
+		RuntimeScope & scope = scopeManager->CreateNewScope();
+		ExternalScope & printScope = scopeManager->CreateExternalScope();
+		printScope.SetSignature(ScopeSignature(vector<ValueType>(1, ValueType::i4), vector<ValueType>()));
+		printScope.SetCallbackFunction(
+			[&values] (RuntimeFixedStack & stack) {
+				values.push_back(stack.Pop<int32_t>());
+			});
+
+		DynamicBuffer code;
+		AssemblyWriter writer;
+		writer
+			.PushI4C(code, 8)
+			.Alloc(code, Register::m0)
+			.PushI4C(code, 1234)
+			.StI4M(code, Register::m0, 0)
+			.PushI4C(code, 16)
+			.Alloc(code, Register::m1)
+			.PushRfR(code, Register::m0)
+			.StRfM(code, Register::m1, 0)
+			.PushRfR(code, Register::m1);
+		for (int i = 0; i < 60; ++i) {
+			writer
+				.PushI4C(code, 200)
+				.Alloc(code, i % 2 == 0 ? Register::m1 : Register::m2);
+		}
+		writer
+			.SetRfR(code, Register::m3)
+			.LdRfM(code, Register::m3, 0)
+			.SetRfR(code, Register::m2)
+			.LdI4M(code, Register::m2, 0)
+			.XCall(code, printScope.GetId());
+		scope.SetCodeBuffer(move(code));
+		ScopeVerifier(* scopeManager).VerifyAll();
+
+		GenerationalHeap * heap = new GenerationalHeap(4096);
+		RuntimeContext * context = RuntimeContextBuilder()
+			.SetRegisterSet(new RegisterSet())
+			.SetRuntimeStack(new RuntimeFixedStack(64))
+			.SetRuntimeScopeManager(scopeManager)
+			.SetRuntimeHeap(heap)
+			.SetStartScope(scope.GetId())
+			.Build();
+
+		context->Run();
+
+		testContext.Accept(values.size() == 1 && values[0] == 1234);
+		testContext.Accept(heap->GetStatistics().MinorCollections > 0);
+
+		refaddr_t object = context->GetRegisterSet().GetMRegister(Register::m0);
+		testContext.Accept(HeapObject::Load<int32_t>(object, 0) == 1234);
+
+		heap->Collect(true);
+		object = context->GetRegisterSet().GetMRegister(Register::m0);
+		testContext.Accept(HeapObject::Load<int32_t>(object, 0) == 1234);
+		testContext.Accept(heap->GetNurseryUsage() == 0);
+		testContext.Accept(heap->GetStatistics().MajorCollections == 1);
+
+		// The pauses reach the metrics of the scope manager too.
+		MetricsSnapshot metrics = context->GetMetrics().Scrape();
+		testContext.Accept(metrics.MinorCollections == heap->GetStatistics().MinorCollections - 1);
+		testContext.Accept(metrics.MajorCollections == 1);
+		testContext.Accept(metrics.CollectionPause.GetCount() == metrics.MinorCollections + 1);
+
+		delete context;
+	}
+
+	TEST_METHOD("remembered-set", testContext) {
+		GenerationalHeap heap(4096);
+
+		refaddr_t parent = heap.Allocate(8);
+		heap.AddRoot(&parent);
+		heap.Collect(false);
+		testContext.Accept(heap.GetNurseryUsage() == 0 && heap.GetOldGenerationSize() > 0);
+
+		refaddr_t child = heap.Allocate(8);
+		HeapObject::Store<int32_t>(child, 0, 77);
+		HeapObject::Store<refaddr_t>(parent, 0, child);
+		heap.WriteBarrier(parent, child);
+		heap.Collect(false);
+
+		child = HeapObject::Load<refaddr_t>(parent, 0);
+		testContext.Accept(HeapObject::Load<int32_t>(child, 0) == 77);
+		testContext.Accept(heap.GetNurseryUsage() == 0);
+	}
+
+	TEST_METHOD("old-generation", testContext) {
+		GenerationalHeap heap(4096, 0);
+
+		refaddr_t live = heap.Allocate(4000);
+		HeapObject::Store<int32_t>(live, 3996, 9);
+		heap.AddRoot(&live);
+
+		for (int i = 0; i < 10; ++i)
+			heap.Allocate(4000);
+		heap.Collect(true);
+
+		testContext.Accept(heap.GetOldGenerationSize() == HeapObject::GetAllocationSize(4000));
+		testContext.Accept(HeapObject::Load<int32_t>(live, 3996) == 9);
+
+		heap.RemoveRoot(&live);
+		heap.Collect(true);
+		testContext.Accept(heap.GetOldGenerationSize() == 0);
+	}
+
+	TEST_METHOD("unverified", testContext) {
+		RuntimeScopeManager * scopeManager = new RuntimeScopeManager();
+		RuntimeScope & scope = scopeManager->CreateNewScope();
+
+		DynamicBuffer code;
+		AssemblyWriter writer;
+		for (int i = 0; i < 40; ++i) {
+			writer
+				.PushI4C(code, 200)
+				.Alloc(code, Register::m0);
+		}
+		scope.SetCodeBuffer(move(code));
+
+		RuntimeContext * context = RuntimeContextBuilder()
+			.SetRegisterSet(new RegisterSet())
+			.SetRuntimeStack(new RuntimeFixedStack(64))
+			.SetRuntimeScopeManager(scopeManager)
+			.SetRuntimeHeap(new GenerationalHeap(4096))
+			.SetStartScope(scope.GetId())
+			.Build();
+
+		try {
+			context->Run();
+			testContext.Fail();
+		} catch (const HeapException &) {
+			testContext.Accept();
+		}
+
+		delete context;
+	}
+END_TEST_UNIT
\ No newline at end of file
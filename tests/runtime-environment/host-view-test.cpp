@@ -0,0 +1,242 @@
+//
+// host-view-test.cpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#include "runtime-environment\runtime-context.hpp"
+#include "runtime-environment\scope-verifier.hpp"
+#include "runtime-environment\generational-heap.hpp"
+
+#include <n-test\test-unit.hpp>
+
+#include <cstdint>
+#include <limits>
+
+using namespace Nova;
+using namespace std;
+
+namespace {
+	RuntimeContext * CreateContext(
+		RuntimeScopeManager * scopeManager, RuntimeScope & scope
+		) {
+			return RuntimeContextBuilder()
+				.SetRegisterSet(new RegisterSet())
+				.SetRuntimeStack(new RuntimeFixedStack(64))
+				.SetRuntimeScopeManager(scopeManager)
+				.SetStartScope(scope.GetId())
+				.Build();
+		}
+}
+
+TEST_UNIT("runtime-environment\\host-view")
+	TEST_METHOD("zero-copy", testContext) {
+		int32_t input[4] = { 1, 2, 3, 4 };
+		int32_t output[4] = { 0, 0, 0, 0 };
+
+		RuntimeScopeManager * scopeManager = new RuntimeScopeManager();
+		RuntimeScope & scope = scopeManager->CreateNewScope();
+
+		// output[i] = input[i] + input[3 - i], unrolled.
+		DynamicBuffer code;
+		AssemblyWriter writer;
+		for (int i = 0; i < 4; ++i) {
+			writer
+				.PushI4C(code, i)
+				.PushI4C(code, i)
+				.LdxI4M(code, Register::m0)
+				.PushI4C(code, 3 - i)
+				.LdxI4M(code, Register::m0)
+				.AddI4(code)
+				.StxI4M(code, Register::m1);
+		}
+		writer.LenM(code, Register::m0);
+		scope.SetCodeBuffer(move(code));
+		ScopeVerifier(* scopeManager).Verify(scope);
+
+		RuntimeContext * context = CreateContext(scopeManager, scope);
+		refaddr_t m0 = context->RegisterHostView(static_cast<const void *>(input), 4, ValueType::i4);
+		refaddr_t m1 = context->RegisterHostView(output, 4, ValueType::i4, HostViewAccess::ReadWrite);
+		context->GetRegisterSet().SetMRegister(Register::m0, m0);
+		context->GetRegisterSet().SetMRegister(Register::m1, m1);
+		context->Run();
+
+		testContext.Accept(output[0] == 5 && output[1] == 5 && output[2] == 5 && output[3] == 5);
+		testContext.Accept(context->GetRuntimeStack().Pop<int32_t>() == 16);
+
+		// The region heap clears the registers after every run, but the views are kept.
+		input[0] = 10;
+		output[0] = 0;
+		context->GetRegisterSet().SetMRegister(Register::m0, m0);
+		context->GetRegisterSet().SetMRegister(Register::m1, m1);
+		context->Run();
+		testContext.Accept(output[0] == 14 && output[3] == 14);
+
+		delete context;
+	}
+
+	TEST_METHOD("fill-copy", testContext) {
+		int32_t source[8] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+		int32_t destination[8] = { 0 };
+
+		RuntimeScopeManager * scopeManager = new RuntimeScopeManager();
+		RuntimeScope & scope = scopeManager->CreateNewScope();
+
+		DynamicBuffer code;
+		AssemblyWriter()
+			.PushI4C(code, 0)
+			.PushI4C(code, 8)
+			.PushI4C(code, -1)
+			.FillI4M(code, Register::m1)
+			.PushI4C(code, 4)
+			.PushI4C(code, 8)
+			.PushI4C(code, 16)
+			.CopyM(code, Register::m1, Register::m0);
+		scope.SetCodeBuffer(move(code));
+		ScopeVerifier(* scopeManager).Verify(scope);
+
+		RuntimeContext * context = CreateContext(scopeManager, scope);
+		context->GetRegisterSet().SetMRegister(Register::m0,
+			context->RegisterHostView(static_cast<const void *>(source), 8, ValueType::i4));
+		context->GetRegisterSet().SetMRegister(Register::m1,
+			context->RegisterHostView(destination, 8, ValueType::i4, HostViewAccess::ReadWrite));
+		context->Run();
+
+		testContext.Accept(destination[0] == -1 && destination[5] == -1 && destination[7] == -1);
+		testContext.Accept(destination[1] == 2 && destination[4] == 5);
+
+		delete context;
+	}
+
+	TEST_METHOD("errors", testContext) {
+		int32_t values[2] = { 1, 2 };
+
+		RuntimeScopeManager * scopeManager = new RuntimeScopeManager();
+		RuntimeScope & outOfBoundsScope = scopeManager->CreateNewScope();
+		RuntimeScope & readOnlyScope = scopeManager->CreateNewScope();
+		RuntimeScope & typeScope = scopeManager->CreateNewScope();
+
+		DynamicBuffer outOfBoundsCode;
+		AssemblyWriter()
+			.PushI4C(outOfBoundsCode, 2)
+			.LdxI4M(outOfBoundsCode, Register::m0);
+		outOfBoundsScope.SetCodeBuffer(move(outOfBoundsCode));
+
+		DynamicBuffer readOnlyCode;
+		AssemblyWriter()
+			.PushI4C(readOnlyCode, 7)
+			.StI4M(readOnlyCode, Register::m0, 0);
+		readOnlyScope.SetCodeBuffer(move(readOnlyCode));
+
+		DynamicBuffer typeCode;
+		AssemblyWriter()
+			.PushI4C(typeCode, 0)
+			.LdxFsM(typeCode, Register::m0);
+		typeScope.SetCodeBuffer(move(typeCode));
+
+		RuntimeContext * context = CreateContext(scopeManager, outOfBoundsScope);
+		refaddr_t view = nullptr;
+
+		scoperef_t scopes[] = { outOfBoundsScope.GetId(), readOnlyScope.GetId(), typeScope.GetId() };
+		for (auto scopeId : scopes) {
+			context->Reset(scopeId);
+			view = context->RegisterHostView(static_cast<const void *>(values), 2, ValueType::i4);
+			context->GetRegisterSet().SetMRegister(Register::m0, view);
+			try {
+				context->Run();
+				testContext.Fail();
+			} catch (const HeapException &) {
+				testContext.Accept();
+			}
+		}
+		testContext.Accept(values[0] == 1 && values[1] == 2);
+
+		context->ClearHostViews();
+		try {
+			HeapObject::Load<int32_t>(view, 0);
+			testContext.Fail();
+		} catch (const HeapException &) {
+			testContext.Accept();
+		}
+
+		delete context;
+	}
+
+	TEST_METHOD("lifetime", testContext) {
+		int32_t first[2] = { 1, 2 };
+		int32_t second[2] = { 3, 4 };
+
+		RuntimeScopeManager * scopeManager = new RuntimeScopeManager();
+		RuntimeScope & storeScope = scopeManager->CreateNewScope();
+		RuntimeScope & fillScope = scopeManager->CreateNewScope();
+
+		DynamicBuffer storeCode;
+		AssemblyWriter()
+			.PushI4C(storeCode, 8)
+			.Alloc(storeCode, Register::m1)
+			.PushRfR(storeCode, Register::m0)
+			.StRfM(storeCode, Register::m1, 0);
+		storeScope.SetCodeBuffer(move(storeCode));
+
+		DynamicBuffer fillCode;
+		AssemblyWriter()
+			.PushI4C(fillCode, numeric_limits<int32_t>::max())
+			.PushI4C(fillCode, 2)
+			.PushI4C(fillCode, 0)
+			.FillI4M(fillCode, Register::m0);
+		fillScope.SetCodeBuffer(move(fillCode));
+		ScopeVerifier(* scopeManager).VerifyAll();
+
+		GenerationalHeap * heap = new GenerationalHeap(4096);
+		RuntimeContext * context = RuntimeContextBuilder()
+			.SetRegisterSet(new RegisterSet())
+			.SetRuntimeStack(new RuntimeFixedStack(64))
+			.SetRuntimeScopeManager(scopeManager)
+			.SetRuntimeHeap(heap)
+			.SetStartScope(storeScope.GetId())
+			.Build();
+
+		// A reference kept after the views are cleared doesn't reach the view reusing their storage.
+		context->Reset(storeScope.GetId());
+		refaddr_t stale = context->RegisterHostView(first, 2, ValueType::i4, HostViewAccess::ReadWrite);
+		context->ClearHostViews();
+		refaddr_t view = context->RegisterHostView(second, 2, ValueType::i4, HostViewAccess::ReadWrite);
+		testContext.Accept(view != stale && HeapObject::Load<int32_t>(view, 0) == 3);
+		try {
+			HeapObject::Load<int32_t>(stale, 0);
+			testContext.Fail();
+		} catch (const HeapException &) {
+			testContext.Accept();
+		}
+
+		// Objects can outlive the views, so they can't hold them.
+		context->GetRegisterSet().SetMRegister(Register::m0, view);
+		try {
+			context->Run();
+			testContext.Fail();
+		} catch (const HeapException &) {
+			testContext.Accept();
+		}
+
+		// The end of the filled range is out of the view, even if it doesn't fit in 32 bits.
+		context->Reset(fillScope.GetId());
+		view = context->RegisterHostView(second, 2, ValueType::i4, HostViewAccess::ReadWrite);
+		context->GetRegisterSet().SetMRegister(Register::m0, view);
+		try {
+			context->Run();
+			testContext.Fail();
+		} catch (const HeapException &) {
+			testContext.Accept();
+		}
+		testContext.Accept(second[0] == 3 && second[1] == 4);
+
+		// Collections don't mark the views.
+		context->GetRegisterSet().SetMRegister(Register::m0, view);
+		heap->Collect(true);
+		testContext.Accept(HeapObject::GetHeader(view)->Flags == Internal::HeapObjectHostView);
+		testContext.Accept(context->GetRegisterSet().GetMRegister(Register::m0) == view);
+
+		delete context;
+	}
+END_TEST_UNIT
\ No newline at end of file
@@ -0,0 +1,186 @@
+//
+// ir-lowering-test.cpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#include "runtime-environment\ir-lowering.hpp"
+#include "runtime-environment\ir-optimizer.hpp"
+#include "runtime-environment\runtime-context.hpp"
+#include "runtime-environment\scope-verifier.hpp"
+
+#include <n-test\test-unit.hpp>
+
+#include <cstdint>
+
+using namespace Nova;
+using namespace std;
+
+namespace {
+	int32_t Run(
+		RuntimeScopeManager * scopeManager, RuntimeScope & scope
+		) {
+			ScopeVerifier(* scopeManager).Verify(scope);
+			RuntimeContext * context = RuntimeContextBuilder()
+				.SetRegisterSet(new RegisterSet())
+				.SetRuntimeStack(new RuntimeFixedStack(64))
+				.SetRuntimeScopeManager(scopeManager)
+				.SetStartScope(scope.GetId())
+				.Build();
+			context->Run();
+			int32_t result = context->GetRuntimeStack().Pop<int32_t>();
+			delete context;
+			return result;
+		}
+
+	size_t CountInstructions(
+		const RuntimeScope & scope, Instruction instruction
+		) {
+			size_t count = 0;
+			AssemblyReader reader;
+			DynamicBuffer::ConstIterator iterator = scope.GetCodeBuffer().GetConstIterator();
+			for (; iterator.HasData(); reader.GoNextInstruction(iterator)) {
+				if (reader.GetInstructionId(iterator) == instruction)
+					++count;
+			}
+			return count;
+		}
+}
+
+TEST_UNIT("runtime-environment\\ir-lowering")
+	TEST_METHOD("constants", testContext) {
+		RuntimeScopeManager * scopeManager = new RuntimeScopeManager();
+		RuntimeScope & scope = scopeManager->CreateNewScope();
+
+		IrFunction function(0);
+		irblock_t thenBlock = function.CreateBlock(0), elseBlock = function.CreateBlock(0);
+		irvalue_t five = function.Add(function.Constant(2), function.Constant(3));
+		function.Branch(IrCondition::Greater, five, function.Constant(4), thenBlock, elseBlock);
+		function.SetInsertBlock(thenBlock);
+		function.Return(vector<irvalue_t>(1, function.Add(five, function.Constant(0))));
+		function.SetInsertBlock(elseBlock);
+		function.Return(vector<irvalue_t>(1, function.Constant(-1)));
+
+		IrOptimizer::Optimize(function);
+		testContext.Accept(function.GetBlock(elseBlock).Removed);
+
+		IrLowering(* scopeManager).Lower(function, scope);
+		testContext.Accept(CountInstructions(scope, Instruction::add_i4) == 0);
+		testContext.Accept(CountInstructions(scope, Instruction::jgt_i4) == 0);
+		testContext.Accept(Run(scopeManager, scope) == 5);
+	}
+
+	TEST_METHOD("loop", testContext) {
+		RuntimeScopeManager * scopeManager = new RuntimeScopeManager();
+		RuntimeScope & mainScope = scopeManager->CreateNewScope();
+		RuntimeScope & sumScope = scopeManager->CreateNewScope();
+
+		// sum(n) = n + (n - 1) + ... + 1, with the counter and the sum as loop parameters.
+		IrFunction function(1);
+		irblock_t loop = function.CreateBlock(2), body = function.CreateBlock(0), exit = function.CreateBlock(0);
+		irvalue_t arguments[] = { function.GetParameter(function.GetEntryBlock(), 0), function.Constant(0) };
+		function.Jump(loop, vector<irvalue_t>(arguments, arguments + 2));
+
+		irvalue_t counter = function.GetParameter(loop, 0), sum = function.GetParameter(loop, 1);
+		function.SetInsertBlock(loop);
+		function.Branch(IrCondition::Greater, counter, function.Constant(0), body, exit);
+
+		function.SetInsertBlock(body);
+		irvalue_t nextArguments[] = { function.Add(counter, function.Constant(-1)), function.Add(sum, counter) };
+		function.Jump(loop, vector<irvalue_t>(nextArguments, nextArguments + 2));
+
+		function.SetInsertBlock(exit);
+		function.Return(vector<irvalue_t>(1, sum));
+
+		IrOptimizer::Optimize(function);
+		IrLowering(* scopeManager).Lower(function, sumScope);
+
+		DynamicBuffer mainCode;
+		AssemblyWriter()
+			.PushI4C(mainCode, 10)
+			.Call(mainCode, sumScope.GetId());
+		mainScope.SetCodeBuffer(move(mainCode));
+
+		ScopeVerifier(* scopeManager).Verify(sumScope);
+		testContext.Accept(sumScope.GetSignature().GetParameters() == vector<ValueType>(1, ValueType::i4));
+		testContext.Accept(sumScope.GetSignature().GetResults() == vector<ValueType>(1, ValueType::i4));
+		testContext.Accept(Run(scopeManager, mainScope) == 55);
+	}
+
+	TEST_METHOD("common-subexpressions", testContext) {
+		RuntimeScopeManager * scopeManager = new RuntimeScopeManager();
+		RuntimeScope & mainScope = scopeManager->CreateNewScope();
+		RuntimeScope & scope = scopeManager->CreateNewScope();
+
+		IrFunction function(1);
+		irvalue_t x = function.GetParameter(function.GetEntryBlock(), 0);
+		irvalue_t a = function.Add(x, function.Constant(1));
+		irvalue_t b = function.Add(function.Constant(1), x);
+		function.Add(x, function.Constant(100));
+		function.Return(vector<irvalue_t>(1, function.Add(a, b)));
+
+		IrOptimizer::Optimize(function);
+		IrLowering(* scopeManager).Lower(function, scope);
+		testContext.Accept(CountInstructions(scope, Instruction::add_i4) == 2);
+
+		DynamicBuffer mainCode;
+		AssemblyWriter()
+			.PushI4C(mainCode, 4)
+			.Call(mainCode, scope.GetId());
+		mainScope.SetCodeBuffer(move(mainCode));
+		testContext.Accept(Run(scopeManager, mainScope) == 10);
+	}
+
+	TEST_METHOD("registers", testContext) {
+		RuntimeScopeManager * scopeManager = new RuntimeScopeManager();
+		RuntimeScope & mainScope = scopeManager->CreateNewScope();
+		RuntimeScope & scope = scopeManager->CreateNewScope();
+		RuntimeScope & clobberScope = scopeManager->CreateNewScope();
+
+		// Writes r0 and r1 behind the back of its callers.
+		DynamicBuffer clobberCode;
+		AssemblyWriter()
+			.PushI4C(clobberCode, 1000)
+			.SetI4R(clobberCode, Register::r0)
+			.PushI4C(clobberCode, 1000)
+			.SetI4R(clobberCode, Register::r1);
+		clobberScope.SetCodeBuffer(move(clobberCode));
+
+		// The parameters are kept in registers across the calls.
+		IrFunction function(4);
+		irvalue_t sum = function.Constant(0);
+		for (size_t i = 0; i < 4; ++i) {
+			function.Call(clobberScope.GetId(), vector<irvalue_t>(), false);
+			sum = function.Add(sum, function.GetParameter(function.GetEntryBlock(), i));
+		}
+		function.Return(vector<irvalue_t>(1, sum));
+
+		IrOptimizer::Optimize(function);
+		IrLowering(* scopeManager).Lower(function, scope);
+
+		// Nine values live at once don't fit in the registers.
+		IrFunction big(9);
+		irvalue_t total = big.GetParameter(big.GetEntryBlock(), 0);
+		for (size_t i = 1; i < 9; ++i)
+			total = big.Add(total, big.GetParameter(big.GetEntryBlock(), i));
+		big.Return(vector<irvalue_t>(1, total));
+		try {
+			DynamicBuffer bigCode;
+			IrLowering(* scopeManager).Lower(big, bigCode);
+			testContext.Fail();
+		} catch (const IrException &) {
+			testContext.Accept();
+		}
+
+		DynamicBuffer mainCode;
+		AssemblyWriter()
+			.PushI4C(mainCode, 1)
+			.PushI4C(mainCode, 2)
+			.PushI4C(mainCode, 3)
+			.PushI4C(mainCode, 4)
+			.Call(mainCode, scope.GetId());
+		mainScope.SetCodeBuffer(move(mainCode));
+		testContext.Accept(Run(scopeManager, mainScope) == 10);
+	}
+END_TEST_UNIT
\ No newline at end of file
@@ -0,0 +1,273 @@
+//
+// parallel-map-test.cpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#include "runtime-environment\parallel-mapper.hpp"
+#include "runtime-environment\runtime-context.hpp"
+#include "runtime-environment\scope-verifier.hpp"
+
+#include <n-test\test-unit.hpp>
+
+#include <cstdint>
+#include <vector>
+#include <set>
+#include <mutex>
+#include <thread>
+
+using namespace Nova;
+using namespace std;
+
+namespace {
+	RuntimeContext * CreateContext(
+		RuntimeScopeManager * scopeManager, RuntimeScope & scope
+		) {
+			return RuntimeContextBuilder()
+				.SetRegisterSet(new RegisterSet())
+				.SetRuntimeStack(new RuntimeFixedStack(256))
+				.SetRuntimeScopeManager(scopeManager)
+				.SetStartScope(scope.GetId())
+				.Build();
+		}
+
+	/// <summary>
+	/// Writes a scope mapping the callee over the view in m0, storing the results in the view in m1.
+	/// </summary>
+	void WriteMap(
+		RuntimeScope & scope, scoperef_t callee, int32_t count, int32_t maxParallelism
+		) {
+			DynamicBuffer code;
+			AssemblyWriter()
+				.PushI4C(code, count)
+				.PushI4C(code, maxParallelism)
+				.PMap(code, callee, Register::m0, Register::m1);
+			scope.SetCodeBuffer(move(code));
+		}
+
+	void RunMap(
+		RuntimeContext & context, const vector<int32_t> & input, vector<int32_t> & output
+		) {
+			context.ClearHostViews();
+			RegisterSet & registerSet = context.GetRegisterSet();
+			registerSet.SetMRegister(Register::m0, context.RegisterHostView(static_cast<const void *>(&input[0]), input.size(), ValueType::i4));
+			registerSet.SetMRegister(Register::m1, context.RegisterHostView(&output[0], output.size(), ValueType::i4, HostViewAccess::ReadWrite));
+			context.Run();
+		}
+
+	bool MatchesSquares(
+		const vector<int32_t> & input, const vector<int32_t> & output
+		) {
+			for (size_t i = 0; i < input.size(); ++i) {
+				if (output[i] != input[i] * input[i] + 1)
+					return false;
+			}
+			return true;
+		}
+}
+
+TEST_UNIT("runtime-environment\\parallel-map")
+	TEST_METHOD("serial", testContext) {
+		RuntimeScopeManager * scopeManager = new RuntimeScopeManager();
+		RuntimeScope & mainScope = scopeManager->CreateNewScope();
+		RuntimeScope & squareScope = scopeManager->CreateNewScope();
+
+		// Without a mapper, the callee runs in the context, so it can use its heap.
+		DynamicBuffer squareCode;
+		AssemblyWriter()
+			.SetI4R(squareCode, Register::r0)
+			.PushI4C(squareCode, 4)
+			.Alloc(squareCode, Register::m2)
+			.PushI4R(squareCode, Register::r0)
+			.StI4M(squareCode, Register::m2, 0)
+			.LdI4M(squareCode, Register::m2, 0)
+			.PushI4C(squareCode, 1)
+			.AddI4(squareCode);
+		squareScope.SetCodeBuffer(move(squareCode));
+		WriteMap(mainScope, squareScope.GetId(), 100, 4);
+		ScopeVerifier(* scopeManager).Verify(mainScope);
+
+		vector<int32_t> input(100), output(100, 0);
+		for (size_t i = 0; i < input.size(); ++i)
+			input[i] = static_cast<int32_t>(i);
+		RuntimeContext * context = CreateContext(scopeManager, mainScope);
+		RunMap(* context, input, output);
+		testContext.Accept(output[0] == 1 && output[50] == 51 && output[99] == 100);
+		testContext.Accept(context->GetRuntimeStack().GetCurrentAddress() == context->GetRuntimeStack().GetBaseAddress());
+
+		delete context;
+	}
+
+	TEST_METHOD("parallel", testContext) {
+		RuntimeScopeManager * scopeManager = new RuntimeScopeManager();
+		RuntimeScope & mainScope = scopeManager->CreateNewScope();
+		RuntimeScope & limitedScope = scopeManager->CreateNewScope();
+		RuntimeScope & mapScope = scopeManager->CreateNewScope();
+		ExternalScope & squareScope = scopeManager->CreateExternalScope();
+
+		mutex threadsMutex;
+		set<thread::id> threads;
+		squareScope.SetSignature(ScopeSignature(vector<ValueType>(1, ValueType::i4), vector<ValueType>(1, ValueType::i4)));
+		squareScope.SetCallbackFunction(
+			[&] (RuntimeFixedStack & stack) {
+				int32_t value = stack.Pop<int32_t>();
+				stack.Push<int32_t>(value * value);
+				lock_guard<mutex> lock(threadsMutex);
+				threads.insert(this_thread::get_id());
+			});
+
+		DynamicBuffer mapCode;
+		AssemblyWriter()
+			.XCall(mapCode, squareScope.GetId())
+			.PushI4C(mapCode, 1)
+			.AddI4(mapCode);
+		mapScope.SetCodeBuffer(move(mapCode));
+		WriteMap(mainScope, mapScope.GetId(), 10000, 0);
+		WriteMap(limitedScope, mapScope.GetId(), 10000, 2);
+
+		vector<int32_t> input(10000), output(10000, 0);
+		for (size_t i = 0; i < input.size(); ++i)
+			input[i] = static_cast<int32_t>(i % 1000);
+
+		RuntimeContext * context = CreateContext(scopeManager, mainScope);
+		{
+			ParallelMapper mapper(* scopeManager, 3, 64);
+			scopeManager->SetParallelMapper(&mapper);
+			RunMap(* context, input, output);
+			testContext.Accept(MatchesSquares(input, output));
+
+			// The cap counts the calling thread.
+			threads.clear();
+			output.assign(output.size(), 0);
+			context->Reset(limitedScope.GetId());
+			RunMap(* context, input, output);
+			testContext.Accept(MatchesSquares(input, output));
+			testContext.Accept(threads.size() >= 1 && threads.size() <= 2);
+			scopeManager->SetParallelMapper(nullptr);
+		}
+		delete context;
+	}
+
+	TEST_METHOD("errors", testContext) {
+		RuntimeScopeManager * scopeManager = new RuntimeScopeManager();
+		RuntimeScope & pairScope = scopeManager->CreateNewScope();
+		RuntimeScope & badMapScope = scopeManager->CreateNewScope();
+		RuntimeScope & mainScope = scopeManager->CreateNewScope();
+		RuntimeScope & mapScope = scopeManager->CreateNewScope();
+		ExternalScope & checkScope = scopeManager->CreateExternalScope();
+
+		DynamicBuffer pairCode;
+		AssemblyWriter().AddI4(pairCode);
+		pairScope.SetCodeBuffer(move(pairCode));
+		WriteMap(badMapScope, pairScope.GetId(), 10, 0);
+		try {
+			ScopeVerifier(* scopeManager).Verify(badMapScope);
+			testContext.Fail();
+		} catch (const VerificationException &) {
+			testContext.Accept();
+		}
+
+		checkScope.SetSignature(ScopeSignature(vector<ValueType>(1, ValueType::i4), vector<ValueType>(1, ValueType::i4)));
+		checkScope.SetCallbackFunction(
+			[] (RuntimeFixedStack & stack) {
+				int32_t value = stack.Pop<int32_t>();
+				if (value == 777)
+					throw RuntimeException("Invalid value.");
+				stack.Push<int32_t>(value);
+			});
+		DynamicBuffer mapCode;
+		AssemblyWriter().XCall(mapCode, checkScope.GetId());
+		mapScope.SetCodeBuffer(move(mapCode));
+		WriteMap(mainScope, mapScope.GetId(), 1000, 0);
+
+		vector<int32_t> input(1000), output(1000, 0);
+		for (size_t i = 0; i < input.size(); ++i)
+			input[i] = static_cast<int32_t>(i);
+
+		// An error in any chunk is thrown by the instruction.
+		RuntimeContext * context = CreateContext(scopeManager, mainScope);
+		{
+			ParallelMapper mapper(* scopeManager, 2, 16);
+			scopeManager->SetParallelMapper(&mapper);
+			try {
+				RunMap(* context, input, output);
+				testContext.Fail();
+			} catch (const RuntimeException &) {
+				testContext.Accept();
+			}
+
+			input[777] = 0;
+			context->Reset(mainScope.GetId());
+			RunMap(* context, input, output);
+			testContext.Accept(output[776] == 776 && output[777] == 0 && output[999] == 999);
+
+			// The destination must hold every result.
+			vector<int32_t> shortOutput(999, 0);
+			context->Reset(mainScope.GetId());
+			try {
+				RunMap(* context, input, shortOutput);
+				testContext.Fail();
+			} catch (const RuntimeException &) {
+				testContext.Accept();
+			}
+			scopeManager->SetParallelMapper(nullptr);
+		}
+		delete context;
+	}
+
+	TEST_METHOD("concurrent", testContext) {
+		RuntimeScopeManager * scopeManager = new RuntimeScopeManager();
+		RuntimeScope & outerScope = scopeManager->CreateNewScope();
+		RuntimeScope & mapScope = scopeManager->CreateNewScope();
+		ExternalScope & squareScope = scopeManager->CreateExternalScope();
+
+		squareScope.SetSignature(ScopeSignature(vector<ValueType>(1, ValueType::i4), vector<ValueType>(1, ValueType::i4)));
+		squareScope.SetCallbackFunction(
+			[] (RuntimeFixedStack & stack) {
+				int32_t value = stack.Pop<int32_t>();
+				stack.Push<int32_t>(value * value);
+			});
+		DynamicBuffer mapCode;
+		AssemblyWriter()
+			.XCall(mapCode, squareScope.GetId())
+			.PushI4C(mapCode, 1)
+			.AddI4(mapCode);
+		mapScope.SetCodeBuffer(move(mapCode));
+		WriteMap(outerScope, mapScope.GetId(), 5000, 2);
+		ScopeVerifier(* scopeManager).Verify(outerScope);
+
+		// Several contexts share the workers, each one limited to two threads.
+		const size_t contextCount = 4;
+		vector<RuntimeContext *> contexts;
+		vector<vector<int32_t>> inputs(contextCount, vector<int32_t>(5000)), outputs(contextCount, vector<int32_t>(5000, 0));
+		for (size_t i = 0; i < contextCount; ++i) {
+			contexts.push_back(new RuntimeContext(new RuntimeFixedStack(256), new RegisterSet(), scopeManager,
+				outerScope.GetId(), nullptr, false));
+			for (size_t j = 0; j < inputs[i].size(); ++j)
+				inputs[i][j] = static_cast<int32_t>((i * 7 + j) % 1000);
+		}
+
+		bool matches = true;
+		{
+			ParallelMapper mapper(* scopeManager, 3, 128);
+			scopeManager->SetParallelMapper(&mapper);
+			vector<thread> threads;
+			for (size_t i = 0; i < contextCount; ++i)
+				threads.push_back(thread([&, i] { RunMap(* contexts[i], inputs[i], outputs[i]); }));
+			for (auto & thread : threads)
+				thread.join();
+			scopeManager->SetParallelMapper(nullptr);
+		}
+		for (size_t i = 0; i < contextCount; ++i)
+			matches = matches && MatchesSquares(inputs[i], outputs[i]);
+		testContext.Accept(matches);
+
+		for (auto context : contexts) {
+			delete &context->GetRuntimeStack();
+			delete &context->GetRegisterSet();
+			delete context;
+		}
+		delete scopeManager;
+	}
+END_TEST_UNIT
\ No newline at end of file
@@ -0,0 +1,71 @@
+//
+// runtime-context-pool-test.cpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#include "runtime-environment\runtime-context-pool.hpp"
+
+#include <n-test\test-unit.hpp>
+
+#include <cstdint>
+
+using namespace Nova;
+using namespace std;
+
+TEST_UNIT("runtime-environment\\runtime-context-pool")
+	TEST_METHOD("reuse", testContext) {
+		DynamicBuffer codeBuffer;
+
+		vector<int> values;
+
+		RuntimeScopeManager scopeManager;
+		RuntimeScope & scope = scopeManager.CreateNewScope();
+		ExternalScope & printScope = scopeManager.CreateExternalScope();
+		printScope.SetCallbackFunction(
+			[&values] (RuntimeFixedStack & stack) {
+				values.push_back(stack.Pop<std::int32_t>());
+			});
+
+		AssemblyWriter()
+			.PushI4C(codeBuffer, int32_t(7))
+			.PushI4C(codeBuffer, int32_t(3))
+			.AddI4(codeBuffer)
+			.XCall(codeBuffer, printScope.GetId());
+		scope.SetCodeBuffer(move(codeBuffer));
+
+		RuntimeContextPool pool(&scopeManager);
+		testContext.Accept(pool.GetContextFootprint() < 1024);
+
+		RuntimeContext * first = pool.Acquire(scope.GetId());
+		staddr_t stackBase = first->GetRuntimeStack().GetCurrentAddress();
+		first->GetRuntimeStack().Push(int32_t(100));
+		first->GetRegisterSet().SetRRegister(Register::r3, 42);
+		first->Run();
+		pool.Release(first);
+
+		RuntimeContext * second = pool.Acquire(scope.GetId());
+		testContext.Accept(first == second);
+		testContext.Accept(pool.GetAllocatedCount() == 1);
+		testContext.Accept(second->GetRuntimeStack().GetCurrentAddress() == stackBase);
+		testContext.Accept(second->GetRegisterSet().GetRRegister(Register::r3) == 0);
+		second->Run();
+		pool.Release(second);
+
+		testContext.Accept(values.size() == 2 && values[0] == 10 && values[1] == 10);
+	}
+
+	TEST_METHOD("reserve", testContext) {
+		RuntimeScopeManager scopeManager;
+		RuntimeContextPool pool(&scopeManager, 4096);
+		pool.Reserve(4);
+		testContext.Accept(pool.GetAvailableCount() == 4);
+
+		RuntimeContext * context = pool.Acquire(InvalidScope);
+		testContext.Accept(pool.GetAvailableCount() == 3 && pool.GetAllocatedCount() == 4);
+		testContext.Accept(context->GetRuntimeStack().GetSize() == 4096);
+		testContext.Accept(reinterpret_cast<size_t>(context) % CacheLineSize == 0);
+		pool.Release(context);
+	}
+END_TEST_UNIT
\ No newline at end of file
@@ -0,0 +1,169 @@
+//
+// runtime-heap-test.cpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#include "runtime-environment\runtime-heap.hpp"
+#include "runtime-environment\runtime-context.hpp"
+
+#include <n-test\test-unit.hpp>
+
+#include <cstdint>
+
+using namespace Nova;
+using namespace std;
+
+TEST_UNIT("runtime-environment\\runtime-heap")
+	TEST_METHOD("basic", testContext) {
+		RuntimeHeap heap;
+
+		refaddr_t object = heap.Allocate(24);
+		testContext.Accept(HeapObject::GetSize(object) == 24);
+		testContext.Accept(HeapObject::Load<int64_t>(object, 16) == 0);
+
+		HeapObject::Store<int32_t>(object, 0, 42);
+		HeapObject::Store<double>(object, 8, 2.5);
+		HeapObject::Store<int8_t>(object, 23, -1);
+		testContext.Accept(HeapObject::Load<int32_t>(object, 0) == 42);
+		testContext.Accept(HeapObject::Load<double>(object, 8) == 2.5);
+		testContext.Accept(HeapObject::Load<int8_t>(object, 23) == -1);
+
+		refaddr_t other = heap.Allocate(8);
+		HeapObject::Store<refaddr_t>(other, 0, object);
+		testContext.Accept(HeapObject::Load<refaddr_t>(other, 0) == object);
+		testContext.Accept(HeapObject::Load<int32_t>(object, 0) == 42);
+
+		heap.Release();
+		testContext.Accept(heap.GetAllocatedBytes() == 0);
+	}
+
+	TEST_METHOD("limits", testContext) {
+		RuntimeHeap heap;
+		refaddr_t object = heap.Allocate(8);
+
+		try {
+			HeapObject::Load<int64_t>(object, 4);
+			testContext.Fail();
+		} catch (const HeapException &) {
+			testContext.Accept();
+		}
+
+		try {
+			HeapObject::Store<int32_t>(object, -4, 1);
+			testContext.Fail();
+		} catch (const HeapException &) {
+			testContext.Accept();
+		}
+
+		try {
+			HeapObject::Load<int32_t>(nullptr, 0);
+			testContext.Fail();
+		} catch (const HeapException &) {
+			testContext.Accept();
+		}
+
+		refaddr_t big = heap.Allocate(256 * 1024);
+		HeapObject::Store<int32_t>(big, 256 * 1024 - 4, 7);
+		testContext.Accept(HeapObject::Load<int32_t>(big, 256 * 1024 - 4) == 7);
+	}
+
+	TEST_METHOD("instructions", testContext) {
+		DynamicBuffer codeBuffer;
+
+		vector<int64_t> values;
+
+		RuntimeScopeManager * runtimeScopeManager = new RuntimeScopeManager();
+		RuntimeScope & scope = runtimeScopeManager->CreateNewScope();
+		ExternalScope & printScope = runtimeScopeManager->CreateExternalScope();
+		printScope.SetCallbackFunction(
+			[&values] (RuntimeFixedStack & stack) {
+				values.push_back(stack.Pop<std::int64_t>());
+			});
+		printScope.SetSignature(ScopeSignature(vector<ValueType>(1, ValueType::i8), vector<ValueType>()));
+
+		AssemblyWriter()
+			.PushI4C(codeBuffer, int32_t(16))
+			.Alloc(codeBuffer, Register::m0)
+			.PushI4C(codeBuffer, int32_t(8))
+			.Alloc(codeBuffer, Register::m1)
+			.PushI4C(codeBuffer, int32_t(20))
+			.StI4M(codeBuffer, Register::m0, 4)
+			.PushRfR(codeBuffer, Register::m0)
+			.StRfM(codeBuffer, Register::m1, 0)
+			.LdRfM(codeBuffer, Register::m1, 0)
+			.SetRfR(codeBuffer, Register::m2)
+			.LdI4M(codeBuffer, Register::m2, 4)
+			.PushI4C(codeBuffer, int32_t(22))
+			.AddI4(codeBuffer)
+			.StI4M(codeBuffer, Register::m2, 0)
+			.LdI8M(codeBuffer, Register::m0, 0)
+			.XCall(codeBuffer, printScope.GetId());
+		scope.SetCodeBuffer(move(codeBuffer));
+		// Scopes must be verified to move references from the stack to registers and objects.
+		ScopeVerifier(* runtimeScopeManager).Verify(scope);
+
+		RuntimeContext * runtimeContext = RuntimeContextBuilder()
+			.SetRegisterSet(new RegisterSet())
+			.SetRuntimeStack(new RuntimeFixedStack(64))
+			.SetRuntimeScopeManager(runtimeScopeManager)
+			.SetStartScope(scope.GetId())
+			.Build();
+
+		runtimeContext->Run();
+
+		testContext.Accept(values.size() == 1 && values[0] == ((int64_t(20) << 32) | 42));
+		testContext.Accept(runtimeContext->GetRegisterSet().GetMRegister(Register::m0) == nullptr);
+		testContext.Accept(static_cast<RuntimeHeap &>(runtimeContext->GetRuntimeHeap()).GetAllocatedBytes() == 0);
+
+		delete runtimeContext;
+	}
+
+	TEST_METHOD("unverified", testContext) {
+		RuntimeScopeManager * runtimeScopeManager = new RuntimeScopeManager();
+		RuntimeScope & allocScope = runtimeScopeManager->CreateNewScope();
+		RuntimeScope & lengthScope = runtimeScopeManager->CreateNewScope();
+		RuntimeScope & forgeScope = runtimeScopeManager->CreateNewScope();
+
+		DynamicBuffer allocCode;
+		AssemblyWriter()
+			.PushI4C(allocCode, int32_t(8))
+			.Alloc(allocCode, Register::r0);
+		allocScope.SetCodeBuffer(move(allocCode));
+
+		DynamicBuffer lengthCode;
+		AssemblyWriter()
+			.LenM(lengthCode, Register(4000));
+		lengthScope.SetCodeBuffer(move(lengthCode));
+
+		// An unverified scope can't build a reference out of two int32 values.
+		DynamicBuffer forgeCode;
+		AssemblyWriter()
+			.PushI4C(forgeCode, int32_t(0x1000))
+			.PushI4C(forgeCode, int32_t(0))
+			.SetRfR(forgeCode, Register::m0)
+			.LdI4M(forgeCode, Register::m0, 0);
+		forgeScope.SetCodeBuffer(move(forgeCode));
+
+		RuntimeContext * runtimeContext = RuntimeContextBuilder()
+			.SetRegisterSet(new RegisterSet())
+			.SetRuntimeStack(new RuntimeFixedStack(64))
+			.SetRuntimeScopeManager(runtimeScopeManager)
+			.SetStartScope(allocScope.GetId())
+			.Build();
+
+		scoperef_t scopes[] = { allocScope.GetId(), lengthScope.GetId(), forgeScope.GetId() };
+		for (auto scope : scopes) {
+			runtimeContext->Reset(scope);
+			try {
+				runtimeContext->Run();
+				testContext.Fail();
+			} catch (const RuntimeException &) {
+				testContext.Accept();
+			}
+		}
+
+		delete runtimeContext;
+	}
+END_TEST_UNIT
\ No newline at end of file
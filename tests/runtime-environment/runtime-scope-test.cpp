@@ -6,13 +6,263 @@
 //
 
 #include "runtime-environment\runtime-scope.hpp"
+#include "runtime-environment\runtime-context.hpp"
+#include "runtime-environment\scope-verifier.hpp"
 
 #include <n-test\test-unit.hpp>
 
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <memory>
+
 using namespace Nova;
 using namespace std;
 
+namespace {
+	/// <summary>
+	/// Makes a scope lazy, loading a copy of the code and counting the loads.
+	/// </summary>
+	void SetLazyCode(
+		RuntimeScope & scope, const DynamicBuffer & code, atomic<int> & loadCount
+		) {
+			scope.SetCodeLoader(
+				[code, &loadCount] (DynamicBuffer & codeBuffer) {
+					++loadCount;
+					codeBuffer = code;
+				});
+		}
+}
+
 TEST_UNIT("runtime-environment\\runtime-scope")
 	TEST_METHOD("basic", testContext) {
 	}
-END_TEST_UNIT
+
+	TEST_METHOD("lazy-loading", testContext) {
+		RuntimeScopeManager * scopeManager = new RuntimeScopeManager();
+		RuntimeScope & mainScope = scopeManager->CreateNewScope();
+		RuntimeScope & addScope = scopeManager->CreateNewScope();
+		atomic<int> loadCount(0);
+
+		DynamicBuffer addCode;
+		AssemblyWriter()
+			.PushI4C(addCode, 1)
+			.AddI4(addCode);
+		SetLazyCode(addScope, addCode, loadCount);
+
+		// Scopes nobody calls are never loaded.
+		DynamicBuffer unusedCode;
+		AssemblyWriter().AddI4(unusedCode);
+		for (int i = 0; i < 100; ++i)
+			SetLazyCode(scopeManager->CreateNewScope(), unusedCode, loadCount);
+
+		DynamicBuffer mainCode;
+		AssemblyWriter()
+			.PushI4C(mainCode, 1)
+			.Call(mainCode, addScope.GetId())
+			.Call(mainCode, addScope.GetId());
+		SetLazyCode(mainScope, mainCode, loadCount);
+		testContext.Accept(!mainScope.IsLoaded() && mainScope.GetCodeBuffer().GetSize() == 0);
+
+		RuntimeContext * context = RuntimeContextBuilder()
+			.SetRegisterSet(new RegisterSet())
+			.SetRuntimeStack(new RuntimeFixedStack(64))
+			.SetRuntimeScopeManager(scopeManager)
+			.SetStartScope(mainScope.GetId())
+			.Build();
+		context->Run();
+		testContext.Accept(context->GetRuntimeStack().Pop<int32_t>() == 3);
+		testContext.Accept(loadCount == 2);
+		testContext.Accept(mainScope.IsLoaded() && mainScope.IsVerified());
+		testContext.Accept(addScope.IsLoaded() && addScope.IsVerified());
+
+		context->Reset(mainScope.GetId());
+		context->Run();
+		testContext.Accept(loadCount == 2);
+
+		delete context;
+	}
+
+	TEST_METHOD("failed-loading", testContext) {
+		RuntimeScopeManager scopeManager;
+		RuntimeScope & scope = scopeManager.CreateNewScope();
+		atomic<int> loadCount(0);
+
+		// Pops a value from an empty stack.
+		DynamicBuffer invalidCode;
+		AssemblyWriter().AddI4(invalidCode);
+		scope.SetSignature(ScopeSignature(vector<ValueType>(), vector<ValueType>(1, ValueType::i4)));
+		SetLazyCode(scope, invalidCode, loadCount);
+
+		RuntimeFixedStack stack(64);
+		RegisterSet registerSet;
+		RuntimeContext context(&stack, &registerSet, &scopeManager, scope.GetId(), nullptr, false);
+		for (int i = 0; i < 2; ++i) {
+			try {
+				context.Run();
+				testContext.Fail();
+			} catch (const VerificationException &) {
+				testContext.Accept(!scope.IsLoaded());
+			}
+		}
+		testContext.Accept(loadCount == 2);
+	}
+
+	TEST_METHOD("concurrent-loading", testContext) {
+		RuntimeScopeManager scopeManager;
+		RuntimeScope & mainScope = scopeManager.CreateNewScope();
+		RuntimeScope & addScope = scopeManager.CreateNewScope();
+		atomic<int> loadCount(0);
+
+		DynamicBuffer addCode;
+		AssemblyWriter writer;
+		for (int i = 0; i < 256; ++i)
+			writer
+				.PushI4C(addCode, 1)
+				.AddI4(addCode);
+		SetLazyCode(addScope, addCode, loadCount);
+
+		DynamicBuffer mainCode;
+		AssemblyWriter()
+			.PushI4C(mainCode, 0)
+			.Call(mainCode, addScope.GetId());
+		mainScope.SetCodeBuffer(move(mainCode));
+
+		const int threadCount = 8;
+		atomic<int> results(0);
+		vector<thread> threads;
+		for (int i = 0; i < threadCount; ++i) {
+			threads.push_back(thread([&] {
+				RuntimeFixedStack stack(64);
+				RegisterSet registerSet;
+				RuntimeContext context(&stack, &registerSet, &scopeManager, mainScope.GetId(), nullptr, false);
+				context.Run();
+				if (stack.Pop<int32_t>() == 256)
+					++results;
+			}));
+		}
+		for (auto & item : threads)
+			item.join();
+
+		testContext.Accept(results == threadCount);
+		testContext.Accept(loadCount == 1);
+	}
+
+	TEST_METHOD("concurrent-verification", testContext) {
+		RuntimeScopeManager scopeManager;
+		RuntimeScope & addScope = scopeManager.CreateNewScope();
+		atomic<int> loadCount(0);
+
+		DynamicBuffer addCode;
+		AssemblyWriter()
+			.PushI4C(addCode, 1)
+			.AddI4(addCode);
+		SetLazyCode(addScope, addCode, loadCount);
+
+		// Every caller verifies the lazy callee, each one from its own thread.
+		const int threadCount = 8;
+		vector<scoperef_t> callers;
+		for (int i = 0; i < threadCount; ++i) {
+			RuntimeScope & scope = scopeManager.CreateNewScope();
+			DynamicBuffer code;
+			AssemblyWriter()
+				.PushI4C(code, i)
+				.Call(code, addScope.GetId());
+			scope.SetCodeBuffer(move(code));
+			callers.push_back(scope.GetId());
+		}
+
+		atomic<int> results(0);
+		vector<thread> threads;
+		for (int i = 0; i < threadCount; ++i) {
+			threads.push_back(thread([&, i] {
+				ScopeVerifier(scopeManager).Verify(scopeManager.GetScope(callers[i]));
+				const RuntimeScope & callee = scopeManager.GetScope(addScope.GetId());
+				if (callee.IsVerified() && callee.GetSignature().GetParameters() == vector<ValueType>(1, ValueType::i4))
+					++results;
+			}));
+		}
+		for (auto & item : threads)
+			item.join();
+
+		testContext.Accept(results == threadCount);
+		testContext.Accept(loadCount == 1);
+	}
+
+	TEST_METHOD("arena", testContext) {
+		RuntimeScopeManager * scopeManager = new RuntimeScopeManager();
+		RuntimeScope & firstScope = scopeManager->CreateNewScope();
+		for (int i = 0; i < 200; ++i)
+			scopeManager->CreateNewScope();
+
+		// Scopes don't move when the manager grows.
+		bool matches = &scopeManager->GetScope(firstScope.GetId()) == &firstScope;
+		for (size_t i = 0; i < scopeManager->GetScopeCount(); ++i)
+			matches = matches && scopeManager->GetScope(reinterpret_cast<scoperef_t>(i)).GetId() == reinterpret_cast<scoperef_t>(i);
+		testContext.Accept(matches && scopeManager->GetScopeCount() == 201);
+
+		// Replaced versions and external scopes are released with the manager.
+		RuntimeScope * version = scopeManager->CreateScopeVersion(firstScope.GetId());
+		scopeManager->PublishScope(version);
+		testContext.Accept(&scopeManager->GetScope(version->GetId()) == version);
+
+		shared_ptr<int> token = make_shared<int>(0);
+		for (int i = 0; i < 10; ++i) {
+			ExternalScope & externalScope = scopeManager->CreateExternalScope();
+			externalScope.SetCallbackFunction([token] (RuntimeFixedStack &) { });
+		}
+		testContext.Accept(token.use_count() == 11 && scopeManager->GetExternalScopeCount() == 10);
+		delete scopeManager;
+		testContext.Accept(token.use_count() == 1);
+	}
+
+	TEST_METHOD("packed-code", testContext) {
+		RuntimeScopeManager * scopeManager = new RuntimeScopeManager();
+		RuntimeScope & mainScope = scopeManager->CreateNewScope();
+		RuntimeScope & addScope = scopeManager->CreateNewScope();
+		RuntimeScope & lazyScope = scopeManager->CreateNewScope();
+		atomic<int> loadCount(0);
+
+		DynamicBuffer addCode;
+		AssemblyWriter()
+			.PushI4C(addCode, 1)
+			.AddI4(addCode)
+			.Ret(addCode);
+		addScope.SetCodeBuffer(addCode);
+		SetLazyCode(lazyScope, addCode, loadCount);
+
+		DynamicBuffer mainCode;
+		AssemblyWriter()
+			.PushI4C(mainCode, 1)
+			.Call(mainCode, addScope.GetId())
+			.Call(mainCode, addScope.GetId());
+		mainScope.SetCodeBuffer(mainCode);
+		ScopeVerifier(* scopeManager).Verify(mainScope);
+
+		// The code of the loaded scopes follows their ids, and lazy scopes aren't loaded.
+		testContext.Accept(scopeManager->PackCode() == 64);
+		const int8_t * mainPtr = static_cast<const int8_t *>(mainScope.GetCodeBuffer().GetPointer());
+		const int8_t * addPtr = static_cast<const int8_t *>(addScope.GetCodeBuffer().GetPointer());
+		testContext.Accept(mainScope.GetCodeBuffer().IsView() && addScope.GetCodeBuffer().IsView());
+		testContext.Accept(reinterpret_cast<size_t>(mainPtr) % PageSize == 0 && addPtr == mainPtr + 48);
+		testContext.Accept(memcmp(mainPtr, mainCode.GetPointer(), mainCode.GetSize()) == 0
+			&& memcmp(addPtr, addCode.GetPointer(), addCode.GetSize()) == 0);
+		testContext.Accept(mainScope.IsVerified() && addScope.IsVerified() && !lazyScope.IsLoaded() && loadCount == 0);
+
+		RuntimeContext * context = RuntimeContextBuilder()
+			.SetRegisterSet(new RegisterSet())
+			.SetRuntimeStack(new RuntimeFixedStack(64))
+			.SetRuntimeScopeManager(scopeManager)
+			.SetStartScope(mainScope.GetId())
+			.Build();
+		context->Run();
+		testContext.Accept(context->GetRuntimeStack().Pop<int32_t>() == 3);
+
+		// Changing packed code copies it out of the region.
+		DynamicBuffer copy = mainScope.GetCodeBuffer();
+		testContext.Accept(!copy.IsView() && copy.GetSize() == mainCode.GetSize());
+		mainScope.SetCodeBuffer(addCode);
+		testContext.Accept(!mainScope.GetCodeBuffer().IsView());
+		delete context;
+	}
+END_TEST_UNIT
\ No newline at end of file
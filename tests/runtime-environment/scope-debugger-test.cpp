@@ -0,0 +1,233 @@
+//
+// scope-debugger-test.cpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#include "runtime-environment\scope-debugger.hpp"
+#include "runtime-environment\runtime-context.hpp"
+#include "runtime-environment\scope-verifier.hpp"
+
+#include <n-test\test-unit.hpp>
+
+#include <cstdint>
+#include <vector>
+
+using namespace Nova;
+using namespace std;
+
+namespace {
+	RuntimeContext * CreateContext(
+		RuntimeScopeManager * scopeManager, RuntimeScope & scope
+		) {
+			RegisterSet * registerSet = new RegisterSet();
+			registerSet->Reset();
+			return RuntimeContextBuilder()
+				.SetRegisterSet(registerSet)
+				.SetRuntimeStack(new RuntimeFixedStack(256))
+				.SetRuntimeScopeManager(scopeManager)
+				.SetStartScope(scope.GetId())
+				.Build();
+		}
+
+	size_t GetSize(
+		Instruction instruction
+		) {
+			return AssemblyReader::GetInstructionSize(instruction);
+		}
+
+	struct Stop {
+		scoperef_t Scope;
+		size_t InstructionOffset;
+	};
+}
+
+TEST_UNIT("runtime-environment\\scope-debugger")
+	TEST_METHOD("breakpoint", testContext) {
+		RuntimeScopeManager * scopeManager = new RuntimeScopeManager();
+		RuntimeScope & mainScope = scopeManager->CreateNewScope();
+
+		DynamicBuffer code;
+		AssemblyWriter()
+			.SetI4R(code, Register::r1)
+			.PushI4C(code, 40)
+			.PushI4C(code, 2)
+			.AddI4(code)
+			.PushI4R(code, Register::r1)
+			.AddI4(code);
+		mainScope.SetCodeBuffer(move(code));
+		ScopeVerifier(* scopeManager).Verify(mainScope);
+		DynamicBuffer original = mainScope.GetCodeBuffer();
+		size_t addOffset = GetSize(Instruction::set_i4r) + 2 * GetSize(Instruction::push_i4c);
+
+		// Setting a breakpoint publishes a new version of the scope, so it's used through its id.
+		scoperef_t mainId = mainScope.GetId();
+
+		RuntimeContext * context = CreateContext(scopeManager, mainScope);
+		{
+			ScopeDebugger debugger(* scopeManager);
+			size_t stackSize = 0;
+			int32_t top = 0, r1 = 0;
+			Instruction instruction = Instruction::nop;
+			debugger.SetHandler(
+				[&] (RuntimeContext & stoppedContext, const BreakpointHit & hit) -> DebugAction {
+					instruction = hit.Instruction;
+					stackSize = ScopeDebugger::GetFrameStackSize(stoppedContext, 0);
+					top = * reinterpret_cast<int32_t *>(stoppedContext.GetRuntimeStack().GetCurrentAddress() - sizeof (int32_t));
+					r1 = static_cast<int32_t>(stoppedContext.GetRegisterSet().GetRRegister(Register::r1));
+					return DebugAction::Continue;
+				});
+			debugger.SetBreakpoint(mainId, addOffset);
+			testContext.Accept(debugger.GetBreakpointCount() == 1);
+			testContext.Accept(scopeManager->GetScope(mainId).IsVerified());
+
+			// The parameter went to r1, and the add hasn't run yet.
+			context->GetRuntimeStack().Push<int32_t>(100);
+			context->Run();
+			testContext.Accept(debugger.GetHitCount() == 1);
+			testContext.Accept(instruction == Instruction::add_i4 && stackSize == 8 && top == 2 && r1 == 100);
+			testContext.Accept(context->GetRuntimeStack().Pop<int32_t>() == 142);
+
+			debugger.Detach();
+			const DynamicBuffer & restored = scopeManager->GetScope(mainId).GetCodeBuffer();
+			testContext.Accept(restored.GetSize() == original.GetSize()
+				&& memcmp(restored.GetPointer(), original.GetPointer(), original.GetSize()) == 0);
+
+			context->Reset(mainId);
+			context->GetRuntimeStack().Push<int32_t>(1);
+			context->Run();
+			testContext.Accept(debugger.GetHitCount() == 1);
+			testContext.Accept(context->GetRuntimeStack().Pop<int32_t>() == 43);
+		}
+		testContext.Accept(scopeManager->GetDebugger() == nullptr);
+		delete context;
+	}
+
+	TEST_METHOD("step", testContext) {
+		RuntimeScopeManager * scopeManager = new RuntimeScopeManager();
+		RuntimeScope & mainScope = scopeManager->CreateNewScope();
+		RuntimeScope & addScope = scopeManager->CreateNewScope();
+		RuntimeScope & jumpScope = scopeManager->CreateNewScope();
+
+		DynamicBuffer addCode;
+		AssemblyWriter()
+			.AddI4(addCode)
+			.Ret(addCode);
+		addScope.SetCodeBuffer(move(addCode));
+
+		DynamicBuffer mainCode;
+		AssemblyWriter()
+			.PushI4C(mainCode, 1)
+			.PushI4C(mainCode, 2)
+			.Call(mainCode, addScope.GetId())
+			.PushI4C(mainCode, 3)
+			.AddI4(mainCode)
+			.Ret(mainCode);
+		mainScope.SetCodeBuffer(move(mainCode));
+
+		DynamicBuffer jumpCode;
+		AssemblyWriter()
+			.Jmp(jumpCode, static_cast<int32_t>(GetSize(Instruction::push_i4c)))
+			.PushI4C(jumpCode, 1)
+			.PushI4C(jumpCode, 2);
+		jumpScope.SetCodeBuffer(move(jumpCode));
+		scoperef_t mainId = mainScope.GetId(), addId = addScope.GetId(), jumpId = jumpScope.GetId();
+
+		RuntimeContext * context = CreateContext(scopeManager, mainScope);
+		{
+			ScopeDebugger debugger(* scopeManager);
+			vector<Stop> stops;
+			size_t stepLimit = 4;
+			debugger.SetHandler(
+				[&] (RuntimeContext &, const BreakpointHit & hit) -> DebugAction {
+					Stop stop = { hit.Scope, hit.InstructionOffset };
+					stops.push_back(stop);
+					return stops.size() < stepLimit ? DebugAction::Step : DebugAction::Continue;
+				});
+
+			// Stepping over a call stops at the first instruction of the callee.
+			debugger.SetBreakpoint(mainId, 0);
+			context->Run();
+			testContext.Accept(context->GetRuntimeStack().Pop<int32_t>() == 6);
+			size_t callOffset = 2 * GetSize(Instruction::push_i4c);
+			testContext.Accept(stops.size() == 4
+				&& stops[0].Scope == mainId && stops[0].InstructionOffset == 0
+				&& stops[1].Scope == mainId && stops[1].InstructionOffset == GetSize(Instruction::push_i4c)
+				&& stops[2].Scope == mainId && stops[2].InstructionOffset == callOffset
+				&& stops[3].Scope == addId && stops[3].InstructionOffset == 0);
+
+			// Stepping over a jump stops at its target.
+			debugger.Detach();
+			stops.clear();
+			stepLimit = 2;
+			debugger.SetBreakpoint(jumpId, 0);
+			context->Reset(jumpId);
+			context->Run();
+			testContext.Accept(stops.size() == 2
+				&& stops[1].Scope == jumpId
+				&& stops[1].InstructionOffset == GetSize(Instruction::jmp) + GetSize(Instruction::push_i4c));
+			testContext.Accept(context->GetRuntimeStack().Pop<int32_t>() == 2);
+		}
+		delete context;
+	}
+
+	TEST_METHOD("errors", testContext) {
+		RuntimeScopeManager * scopeManager = new RuntimeScopeManager();
+		RuntimeScope & mainScope = scopeManager->CreateNewScope();
+		RuntimeScope & patchedScope = scopeManager->CreateNewScope();
+
+		DynamicBuffer code;
+		AssemblyWriter()
+			.PushI4C(code, 1)
+			.PushI4C(code, 2)
+			.AddI4(code);
+		mainScope.SetCodeBuffer(code);
+		ScopeVerifier(* scopeManager).Verify(mainScope);
+
+		{
+			ScopeDebugger debugger(* scopeManager);
+			try {
+				debugger.SetBreakpoint(mainScope.GetId(), 4);
+				testContext.Fail();
+			} catch (const InvalidArgumentException &) {
+				testContext.Accept();
+			}
+			try {
+				debugger.SetBreakpoint(mainScope.GetId(), code.GetSize());
+				testContext.Fail();
+			} catch (const InvalidArgumentException &) {
+				testContext.Accept();
+			}
+			try {
+				ScopeDebugger other(* scopeManager);
+				testContext.Fail();
+			} catch (const InvalidArgumentException &) {
+				testContext.Accept();
+			}
+		}
+
+		// Traps are never valid code by themselves.
+		DynamicBuffer patchedCode(code);
+		Internal::InstructionMemoryStructure::Base trap;
+		trap.Instruction = AssemblyReader::GetBreakpoint(GetSize(Instruction::push_i4c));
+		patchedCode.Write(&trap, 0, sizeof trap);
+		patchedScope.SetCodeBuffer(patchedCode);
+		try {
+			ScopeVerifier(* scopeManager).Verify(patchedScope);
+			testContext.Fail();
+		} catch (const VerificationException &) {
+			testContext.Accept();
+		}
+
+		RuntimeContext * context = CreateContext(scopeManager, patchedScope);
+		try {
+			context->Run();
+			testContext.Fail();
+		} catch (const RuntimeException &) {
+			testContext.Accept();
+		}
+		testContext.Accept(AssemblyReader::GetBreakpoint(6) == Instruction::nop);
+		delete context;
+	}
+END_TEST_UNIT
\ No newline at end of file
@@ -0,0 +1,195 @@
+//
+// scope-inliner-test.cpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#include "runtime-environment\scope-inliner.hpp"
+#include "runtime-environment\runtime-context.hpp"
+#include "runtime-environment\scope-debugger.hpp"
+
+#include <n-test\test-unit.hpp>
+
+#include <cstdint>
+
+using namespace Nova;
+using namespace std;
+
+namespace {
+	RuntimeContext * CreateContext(
+		RuntimeScopeManager * scopeManager, scoperef_t scope
+		) {
+			return RuntimeContextBuilder()
+				.SetRegisterSet(new RegisterSet())
+				.SetRuntimeStack(new RuntimeFixedStack(64))
+				.SetRuntimeScopeManager(scopeManager)
+				.SetStartScope(scope)
+				.Build();
+		}
+
+	bool HasCalls(
+		const RuntimeScope & scope
+		) {
+			AssemblyReader reader;
+			DynamicBuffer::ConstIterator iterator = scope.GetCodeBuffer().GetConstIterator();
+			for (; iterator.HasData(); reader.GoNextInstruction(iterator)) {
+				if (reader.GetInstructionId(iterator) == Instruction::call)
+					return true;
+			}
+			return false;
+		}
+}
+
+TEST_UNIT("runtime-environment\\scope-inliner")
+	TEST_METHOD("loop", testContext) {
+		RuntimeScopeManager * scopeManager = new RuntimeScopeManager();
+		RuntimeScope & mainScope = scopeManager->CreateNewScope();
+		RuntimeScope & addScope = scopeManager->CreateNewScope();
+
+		DynamicBuffer addCode;
+		AssemblyWriter()
+			.PushI4C(addCode, 3)
+			.AddI4(addCode)
+			.Ret(addCode);
+		addScope.SetCodeBuffer(move(addCode));
+
+		DynamicBuffer mainCode;
+		AssemblyWriter writer;
+		label_t loop = writer.CreateLabel();
+		writer
+			.PushI4C(mainCode, 4)
+			.SetI4R(mainCode, Register::r0)
+			.PushI4C(mainCode, 0)
+			.BindLabel(mainCode, loop)
+			.Call(mainCode, addScope.GetId())
+			.DjnzI4R(mainCode, Register::r0, loop);
+		mainScope.SetCodeBuffer(move(mainCode));
+
+		// The rewritten code is published as a new version, so the scope is used through its id.
+		scoperef_t mainId = mainScope.GetId(), addId = addScope.GetId();
+		testContext.Accept(ScopeInliner(* scopeManager).InlineAll() == 1);
+		const RuntimeScope & inlinedScope = scopeManager->GetScope(mainId);
+		testContext.Accept(inlinedScope.IsVerified() && !HasCalls(inlinedScope));
+		testContext.Accept(inlinedScope.GetSignature().GetResults() == vector<ValueType>(1, ValueType::i4));
+
+		// The push_i4c of the callee follows the one of the loop.
+		size_t offset = AssemblyReader::GetInstructionSize(Instruction::push_i4c) * 2
+			+ AssemblyReader::GetInstructionSize(Instruction::set_i4r);
+		const ScopeOriginMap::Entry * origin = inlinedScope.GetOriginMap().Find(offset);
+		testContext.Accept(origin != nullptr && origin->Scope == addId && origin->OriginalOffset == 0);
+		origin = inlinedScope.GetOriginMap().Find(0);
+		testContext.Accept(origin != nullptr && origin->Scope == mainId && origin->OriginalOffset == 0);
+
+		RuntimeContext * context = CreateContext(scopeManager, mainId);
+		{
+			// Breakpoints in the inlined code report where the instruction came from.
+			ScopeDebugger debugger(* scopeManager);
+			vector<BreakpointHit> hits;
+			debugger.SetHandler(
+				[&] (RuntimeContext &, const BreakpointHit & hit) -> DebugAction {
+					hits.push_back(hit);
+					return DebugAction::Continue;
+				});
+			debugger.SetBreakpoint(mainId, offset);
+			debugger.SetBreakpoint(mainId, 0);
+			context->Run();
+			testContext.Accept(context->GetRuntimeStack().Pop<int32_t>() == 12);
+			testContext.Accept(hits.size() == 5);
+			testContext.Accept(hits[0].OriginScope == mainId && hits[0].OriginalOffset == 0);
+			testContext.Accept(hits[1].Scope == mainId && hits[1].InstructionOffset == offset);
+			testContext.Accept(hits[1].OriginScope == addId && hits[1].OriginalOffset == 0);
+		}
+
+		delete context;
+	}
+
+	TEST_METHOD("early-return", testContext) {
+		RuntimeScopeManager * scopeManager = new RuntimeScopeManager();
+		RuntimeScope & mainScope = scopeManager->CreateNewScope();
+		RuntimeScope & positiveScope = scopeManager->CreateNewScope();
+
+		// Returns the parameter, or zero if it's negative.
+		DynamicBuffer positiveCode;
+		AssemblyWriter writer;
+		label_t keep = writer.CreateLabel();
+		writer
+			.SetI4R(positiveCode, Register::r1)
+			.PushI4R(positiveCode, Register::r1)
+			.PushI4C(positiveCode, 0)
+			.JgeI4(positiveCode, keep)
+			.PushI4C(positiveCode, 0)
+			.Ret(positiveCode)
+			.BindLabel(positiveCode, keep)
+			.PushI4R(positiveCode, Register::r1);
+		positiveScope.SetCodeBuffer(move(positiveCode));
+
+		DynamicBuffer mainCode;
+		AssemblyWriter()
+			.PushI4C(mainCode, -7)
+			.Call(mainCode, positiveScope.GetId())
+			.PushI4C(mainCode, 9)
+			.Call(mainCode, positiveScope.GetId())
+			.AddI4(mainCode);
+		mainScope.SetCodeBuffer(move(mainCode));
+
+		scoperef_t mainId = mainScope.GetId();
+		testContext.Accept(ScopeInliner(* scopeManager).Inline(mainId) == 2);
+		testContext.Accept(!HasCalls(scopeManager->GetScope(mainId)));
+
+		RuntimeContext * context = CreateContext(scopeManager, mainId);
+		context->Run();
+		testContext.Accept(context->GetRuntimeStack().Pop<int32_t>() == 9);
+
+		delete context;
+	}
+
+	TEST_METHOD("heuristics", testContext) {
+		RuntimeScopeManager scopeManager;
+		RuntimeScope & mainScope = scopeManager.CreateNewScope();
+		RuntimeScope & bigScope = scopeManager.CreateNewScope();
+		RuntimeScope & onceScope = scopeManager.CreateNewScope();
+		RuntimeScope & recursiveScope = scopeManager.CreateNewScope();
+
+		DynamicBuffer bigCode;
+		AssemblyWriter bigWriter;
+		for (int i = 0; i < 8; ++i)
+			bigWriter.Nop(bigCode);
+		bigScope.SetCodeBuffer(move(bigCode));
+
+		DynamicBuffer onceCode;
+		AssemblyWriter onceWriter;
+		for (int i = 0; i < 8; ++i)
+			onceWriter.Nop(onceCode);
+		onceScope.SetCodeBuffer(move(onceCode));
+
+		DynamicBuffer recursiveCode;
+		AssemblyWriter()
+			.Ret(recursiveCode)
+			.Call(recursiveCode, recursiveScope.GetId());
+		recursiveScope.SetCodeBuffer(move(recursiveCode));
+
+		DynamicBuffer mainCode;
+		AssemblyWriter()
+			.Call(mainCode, bigScope.GetId())
+			.Call(mainCode, bigScope.GetId())
+			.Call(mainCode, onceScope.GetId())
+			.Call(mainCode, recursiveScope.GetId());
+		mainScope.SetCodeBuffer(move(mainCode));
+
+		// Callees up to 8 bytes, or 64 if they're called once.
+		scoperef_t mainId = mainScope.GetId();
+		ScopeInliner inliner(scopeManager, 8, 64);
+		testContext.Accept(inliner.Inline(mainId) == 1);
+
+		size_t calls = 0;
+		AssemblyReader reader;
+		DynamicBuffer::ConstIterator iterator = scopeManager.GetScope(mainId).GetCodeBuffer().GetConstIterator();
+		for (; iterator.HasData(); reader.GoNextInstruction(iterator)) {
+			if (reader.GetInstructionId(iterator) == Instruction::call)
+				++calls;
+		}
+		testContext.Accept(calls == 3);
+		testContext.Accept(inliner.Inline(mainId) == 0);
+	}
+END_TEST_UNIT
\ No newline at end of file
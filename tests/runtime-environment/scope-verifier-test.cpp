@@ -0,0 +1,175 @@
+//
+// scope-verifier-test.cpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#include "runtime-environment\scope-verifier.hpp"
+
+#include <n-test\test-unit.hpp>
+
+#include <cstdint>
+
+using namespace Nova;
+using namespace std;
+
+TEST_UNIT("runtime-environment\\scope-verifier")
+	TEST_METHOD("signature", testContext) {
+		RuntimeScopeManager scopeManager;
+		RuntimeScope & mainScope = scopeManager.CreateNewScope();
+		RuntimeScope & addScope = scopeManager.CreateNewScope();
+		ExternalScope & printScope = scopeManager.CreateExternalScope();
+		printScope.SetSignature(ScopeSignature(vector<ValueType>(1, ValueType::i4), vector<ValueType>()));
+
+		DynamicBuffer addCode;
+		AssemblyWriter().AddI4(addCode);
+		addScope.SetCodeBuffer(move(addCode));
+
+		DynamicBuffer mainCode;
+		AssemblyWriter()
+			.PushI4C(mainCode, 1)
+			.PushI4C(mainCode, 2)
+			.Call(mainCode, addScope.GetId())
+			.XCall(mainCode, printScope.GetId())
+			.Ret(mainCode);
+		mainScope.SetCodeBuffer(move(mainCode));
+
+		ScopeVerifier(scopeManager).Verify(mainScope);
+
+		testContext.Accept(mainScope.IsVerified() && addScope.IsVerified());
+		testContext.Accept(addScope.GetSignature().GetParameters() == vector<ValueType>(2, ValueType::i4));
+		testContext.Accept(addScope.GetSignature().GetResults() == vector<ValueType>(1, ValueType::i4));
+		testContext.Accept(mainScope.GetSignature().GetParameters().empty());
+		testContext.Accept(mainScope.GetSignature().GetResults().empty());
+		testContext.Accept(mainScope.GetMaxStackUsage() == 8);
+		testContext.Accept(addScope.GetMaxStackUsage() == 8);
+	}
+
+	TEST_METHOD("stack-maps", testContext) {
+		RuntimeScopeManager scopeManager;
+		RuntimeScope & scope = scopeManager.CreateNewScope();
+
+		DynamicBuffer code;
+		AssemblyWriter writer;
+		writer
+			.PushRfR(code, Register::m0)
+			.PushI4C(code, 16);
+		size_t firstAlloc = code.GetSize();
+		writer
+			.Alloc(code, Register::m1)
+			.PushI4C(code, 5)
+			.PushRfR(code, Register::m1)
+			.PushI4C(code, 8);
+		size_t secondAlloc = code.GetSize();
+		writer
+			.Alloc(code, Register::m2)
+			.SetRfR(code, Register::m3);
+		scope.SetCodeBuffer(move(code));
+
+		ScopeVerifier(scopeManager).Verify(scope);
+
+		const ScopeStackMap::Entry * entry = scope.GetStackMap().Find(firstAlloc);
+		testContext.Accept(entry != nullptr && entry->ReferenceOffsets == vector<uint32_t>(1, 0));
+
+		entry = scope.GetStackMap().Find(secondAlloc);
+		vector<uint32_t> expected;
+		expected.push_back(0);
+		expected.push_back(sizeof(refaddr_t) + 4);
+		testContext.Accept(entry != nullptr && entry->ReferenceOffsets == expected);
+		testContext.Accept(scope.GetStackMap().Find(0) == nullptr);
+
+		vector<ValueType> results;
+		results.push_back(ValueType::rf);
+		results.push_back(ValueType::i4);
+		testContext.Accept(scope.GetSignature().GetResults() == results);
+	}
+
+	TEST_METHOD("errors", testContext) {
+		RuntimeScopeManager scopeManager;
+		RuntimeScope & mismatchScope = scopeManager.CreateNewScope();
+		RuntimeScope & externalScope = scopeManager.CreateNewScope();
+		RuntimeScope & recursiveScope = scopeManager.CreateNewScope();
+		ExternalScope & printScope = scopeManager.CreateExternalScope();
+
+		DynamicBuffer mismatchCode;
+		AssemblyWriter()
+			.PushI4C(mismatchCode, 1)
+			.SetRfR(mismatchCode, Register::m0);
+		mismatchScope.SetCodeBuffer(move(mismatchCode));
+
+		DynamicBuffer externalCode;
+		AssemblyWriter()
+			.PushI4C(externalCode, 1)
+			.XCall(externalCode, printScope.GetId());
+		externalScope.SetCodeBuffer(move(externalCode));
+
+		DynamicBuffer recursiveCode;
+		AssemblyWriter()
+			.Call(recursiveCode, recursiveScope.GetId());
+		recursiveScope.SetCodeBuffer(move(recursiveCode));
+
+		ScopeVerifier verifier(scopeManager);
+		try {
+			verifier.Verify(mismatchScope);
+			testContext.Fail();
+		} catch (const VerificationException &) {
+			testContext.Accept();
+		}
+
+		try {
+			verifier.Verify(externalScope);
+			testContext.Fail();
+		} catch (const VerificationException &) {
+			testContext.Accept();
+		}
+
+		try {
+			verifier.Verify(recursiveScope);
+			testContext.Fail();
+		} catch (const VerificationException &) {
+			testContext.Accept();
+		}
+
+		recursiveScope.SetSignature(ScopeSignature());
+		verifier.Verify(recursiveScope);
+		testContext.Accept(recursiveScope.IsVerified());
+	}
+
+	TEST_METHOD("registers", testContext) {
+		RuntimeScopeManager scopeManager;
+		RuntimeScope & allocScope = scopeManager.CreateNewScope();
+		RuntimeScope & loadScope = scopeManager.CreateNewScope();
+		RuntimeScope & copyScope = scopeManager.CreateNewScope();
+
+		DynamicBuffer allocCode;
+		AssemblyWriter()
+			.PushI4C(allocCode, 8)
+			.Alloc(allocCode, Register::r0);
+		allocScope.SetCodeBuffer(move(allocCode));
+
+		DynamicBuffer loadCode;
+		AssemblyWriter()
+			.LdI4M(loadCode, Register::sp0, 0);
+		loadScope.SetCodeBuffer(move(loadCode));
+
+		DynamicBuffer copyCode;
+		AssemblyWriter()
+			.PushI4C(copyCode, 0)
+			.PushI4C(copyCode, 0)
+			.PushI4C(copyCode, 4)
+			.CopyM(copyCode, Register::m0, Register::v0);
+		copyScope.SetCodeBuffer(move(copyCode));
+
+		ScopeVerifier verifier(scopeManager);
+		RuntimeScope * scopes[] = { &allocScope, &loadScope, &copyScope };
+		for (auto scope : scopes) {
+			try {
+				verifier.Verify(* scope);
+				testContext.Fail();
+			} catch (const VerificationException &) {
+				testContext.Accept();
+			}
+		}
+	}
+END_TEST_UNIT
\ No newline at end of file
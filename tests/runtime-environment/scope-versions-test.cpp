@@ -0,0 +1,194 @@
+//
+// scope-versions-test.cpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#include "runtime-environment\runtime-scope.hpp"
+#include "runtime-environment\runtime-context.hpp"
+#include "runtime-environment\batch-executor.hpp"
+
+#include <n-test\test-unit.hpp>
+
+#include <cstdint>
+#include <atomic>
+#include <thread>
+
+using namespace Nova;
+using namespace std;
+
+namespace {
+	/// <summary>
+	/// Creates a version of a scope returning a constant.
+	/// </summary>
+	RuntimeScope * CreateConstantVersion(
+		RuntimeScopeManager & scopeManager, scoperef_t scopeId, int32_t value
+		) {
+			RuntimeScope * version = scopeManager.CreateScopeVersion(scopeId);
+			DynamicBuffer code;
+			AssemblyWriter().PushI4C(code, value);
+			version->SetCodeBuffer(move(code));
+			version->SetSignature(ScopeSignature(vector<ValueType>(), vector<ValueType>(1, ValueType::i4)));
+			return version;
+		}
+
+	int32_t Run(
+		RuntimeContext & context, scoperef_t scopeId
+		) {
+			context.Reset(scopeId);
+			context.Run();
+			return context.GetRuntimeStack().Pop<int32_t>();
+		}
+}
+
+TEST_UNIT("runtime-environment\\scope-versions")
+	TEST_METHOD("publish", testContext) {
+		RuntimeScopeManager scopeManager;
+		RuntimeScope & mainScope = scopeManager.CreateNewScope();
+		scoperef_t valueId = scopeManager.CreateNewScope().GetId();
+		scopeManager.PublishScope(CreateConstantVersion(scopeManager, valueId, 1));
+
+		DynamicBuffer mainCode;
+		AssemblyWriter().Call(mainCode, valueId);
+		mainScope.SetCodeBuffer(move(mainCode));
+
+		RuntimeFixedStack stack(64);
+		RegisterSet registerSet;
+		RuntimeContext context(&stack, &registerSet, &scopeManager, mainScope.GetId(), nullptr, false);
+		testContext.Accept(Run(context, mainScope.GetId()) == 1);
+
+		uint32_t epoch = scopeManager.GetEpoch();
+		scopeManager.PublishScope(CreateConstantVersion(scopeManager, valueId, 2));
+		testContext.Accept(scopeManager.GetEpoch() != epoch);
+		testContext.Accept(Run(context, mainScope.GetId()) == 2);
+		// Nothing was running, so the old versions are already released.
+		testContext.Accept(scopeManager.GetRetiredScopeCount() == 0);
+
+		BatchExecutor executor(scopeManager, 16);
+		vector<int32_t> results(40);
+		void * outputs[] = { &results[0] };
+		scopeManager.PublishScope(CreateConstantVersion(scopeManager, valueId, 3));
+		executor.Run(mainScope.GetId(), results.size(), nullptr, outputs);
+		testContext.Accept(results[0] == 3 && results[39] == 3);
+	}
+
+	TEST_METHOD("signature", testContext) {
+		RuntimeScopeManager scopeManager;
+		scoperef_t valueId = scopeManager.CreateNewScope().GetId();
+		scopeManager.PublishScope(CreateConstantVersion(scopeManager, valueId, 1));
+
+		RuntimeScope * version = scopeManager.CreateScopeVersion(valueId);
+		DynamicBuffer code;
+		AssemblyWriter()
+			.PushI4C(code, 1)
+			.PushI4C(code, 2);
+		version->SetCodeBuffer(move(code));
+		try {
+			// The signature isn't known without verifying the version.
+			scopeManager.PublishScope(version);
+			testContext.Fail();
+		} catch (const InvalidArgumentException &) {
+			testContext.Accept();
+		}
+
+		vector<ValueType> results(2, ValueType::i4);
+		version->SetSignature(ScopeSignature(vector<ValueType>(), results));
+		try {
+			scopeManager.PublishScope(version);
+			testContext.Fail();
+		} catch (const InvalidArgumentException &) {
+			testContext.Accept(&scopeManager.GetScope(valueId) != version);
+		}
+		delete version;
+
+		try {
+			scopeManager.CreateScopeVersion(reinterpret_cast<scoperef_t>(5));
+			testContext.Fail();
+		} catch (const InvalidArgumentException &) {
+			testContext.Accept();
+		}
+	}
+
+	TEST_METHOD("running-version", testContext) {
+		RuntimeScopeManager scopeManager;
+		RuntimeScope & mainScope = scopeManager.CreateNewScope();
+		scoperef_t valueId = scopeManager.CreateNewScope().GetId();
+		ExternalScope & publishScope = scopeManager.CreateExternalScope();
+		publishScope.SetSignature(ScopeSignature(vector<ValueType>(), vector<ValueType>()));
+
+		// The version 1 publishes the version 2 in the middle of its execution.
+		size_t retiredCount = 0;
+		publishScope.SetCallbackFunction(
+			[&] (RuntimeFixedStack &) {
+				scopeManager.PublishScope(CreateConstantVersion(scopeManager, valueId, 2));
+				retiredCount = scopeManager.GetRetiredScopeCount();
+			});
+		RuntimeScope * version = scopeManager.CreateScopeVersion(valueId);
+		DynamicBuffer code;
+		AssemblyWriter()
+			.XCall(code, publishScope.GetId())
+			.PushI4C(code, 1);
+		version->SetCodeBuffer(move(code));
+		version->SetSignature(ScopeSignature(vector<ValueType>(), vector<ValueType>(1, ValueType::i4)));
+		scopeManager.PublishScope(version);
+
+		DynamicBuffer mainCode;
+		AssemblyWriter().Call(mainCode, valueId);
+		mainScope.SetCodeBuffer(move(mainCode));
+
+		RuntimeFixedStack stack(64);
+		RegisterSet registerSet;
+		RuntimeContext context(&stack, &registerSet, &scopeManager, mainScope.GetId(), nullptr, false);
+		testContext.Accept(Run(context, mainScope.GetId()) == 1);
+		testContext.Accept(retiredCount == 1);
+		testContext.Accept(scopeManager.GetRetiredScopeCount() == 1);
+
+		testContext.Accept(scopeManager.ReclaimScopes() == 1);
+		testContext.Accept(scopeManager.GetRetiredScopeCount() == 0);
+		testContext.Accept(Run(context, mainScope.GetId()) == 2);
+	}
+
+	TEST_METHOD("concurrent", testContext) {
+		RuntimeScopeManager scopeManager;
+		RuntimeScope & mainScope = scopeManager.CreateNewScope();
+		scoperef_t valueId = scopeManager.CreateNewScope().GetId();
+		scopeManager.PublishScope(CreateConstantVersion(scopeManager, valueId, 0));
+
+		DynamicBuffer mainCode;
+		AssemblyWriter writer;
+		for (int i = 0; i < 16; ++i)
+			writer.Call(mainCode, valueId);
+		for (int i = 0; i < 15; ++i)
+			writer.AddI4(mainCode);
+		mainScope.SetCodeBuffer(move(mainCode));
+
+		const int threadCount = 4;
+		const int32_t versionCount = 200;
+		atomic<bool> stopped(false);
+		atomic<int> failures(0);
+		vector<thread> threads;
+		for (int i = 0; i < threadCount; ++i) {
+			threads.push_back(thread([&] {
+				RuntimeFixedStack stack(256);
+				RegisterSet registerSet;
+				RuntimeContext context(&stack, &registerSet, &scopeManager, mainScope.GetId(), nullptr, false);
+				while (!stopped) {
+					// Every call gets a version published so far.
+					int32_t result = Run(context, mainScope.GetId());
+					if (result < 0 || result > 16 * versionCount)
+						++failures;
+				}
+			}));
+		}
+		for (int32_t i = 1; i <= versionCount; ++i)
+			scopeManager.PublishScope(CreateConstantVersion(scopeManager, valueId, i));
+		stopped = true;
+		for (auto & item : threads)
+			item.join();
+
+		testContext.Accept(failures == 0);
+		scopeManager.ReclaimScopes();
+		testContext.Accept(scopeManager.GetRetiredScopeCount() == 0);
+	}
+END_TEST_UNIT
\ No newline at end of file
@@ -0,0 +1,194 @@
+//
+// stack-frame-test.cpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#include "runtime-environment\runtime-context.hpp"
+#include "runtime-environment\scope-verifier.hpp"
+
+#include <n-test\test-unit.hpp>
+
+#include <cstdint>
+
+using namespace Nova;
+using namespace std;
+
+namespace {
+	RuntimeContext * CreateContext(
+		RuntimeScopeManager * scopeManager, RuntimeScope & scope
+		) {
+			return RuntimeContextBuilder()
+				.SetRegisterSet(new RegisterSet())
+				.SetRuntimeStack(new RuntimeFixedStack(64))
+				.SetRuntimeScopeManager(scopeManager)
+				.SetStartScope(scope.GetId())
+				.Build();
+		}
+
+	bool FailsVerification(
+		RuntimeScopeManager & scopeManager, const DynamicBuffer & code
+		) {
+			RuntimeScope & scope = scopeManager.CreateNewScope();
+			scope.SetCodeBuffer(code);
+			try {
+				ScopeVerifier(scopeManager).Verify(scope);
+			} catch (const VerificationException &) {
+				return true;
+			}
+			return false;
+		}
+}
+
+TEST_UNIT("runtime-environment\\stack-frame")
+	TEST_METHOD("locals", testContext) {
+		RuntimeScopeManager * scopeManager = new RuntimeScopeManager();
+		RuntimeScope & mainScope = scopeManager->CreateNewScope();
+		RuntimeScope & helperScope = scopeManager->CreateNewScope();
+
+		// The helper sets sp0 to its own frame, and the call gives the one of main back.
+		DynamicBuffer helperCode;
+		AssemblyWriter()
+			.PushI4C(helperCode, 100)
+			.SetSpR(helperCode, Register::sp0)
+			.LdI4S(helperCode, Register::sp0, -4)
+			.DropN(helperCode, 8);
+		helperScope.SetCodeBuffer(move(helperCode));
+
+		// Two locals, a and b, below sp0: a = 5, b = 7, a = a + b.
+		DynamicBuffer mainCode;
+		AssemblyWriter()
+			.PushI4C(mainCode, 0)
+			.PushI4C(mainCode, 0)
+			.SetSpR(mainCode, Register::sp0)
+			.PushI4C(mainCode, 5)
+			.StI4S(mainCode, Register::sp0, -8)
+			.PushI4C(mainCode, 7)
+			.StI4S(mainCode, Register::sp0, -4)
+			.Call(mainCode, helperScope.GetId())
+			.LdI4S(mainCode, Register::sp0, -8)
+			.LdI4S(mainCode, Register::sp0, -4)
+			.AddI4(mainCode)
+			.StI4S(mainCode, Register::sp0, -8)
+			.DropN(mainCode, 4);
+		mainScope.SetCodeBuffer(move(mainCode));
+
+		ScopeVerifier(* scopeManager).Verify(mainScope);
+		testContext.Accept(mainScope.SetsFrameRegisters() && helperScope.SetsFrameRegisters());
+		testContext.Accept(mainScope.GetSignature().GetResults() == vector<ValueType>(1, ValueType::i4));
+		testContext.Accept(helperScope.GetSignature().GetResults().empty());
+
+		// The register set by the host is given back too.
+		RuntimeContext * context = CreateContext(scopeManager, mainScope);
+		context->GetRegisterSet().SetSPRegister(Register::sp0, nullptr);
+		context->Run();
+		testContext.Accept(context->GetRuntimeStack().Pop<int32_t>() == 12);
+		testContext.Accept(context->GetRegisterSet().GetSPRegister(Register::sp0) == nullptr);
+
+		delete context;
+	}
+
+	TEST_METHOD("stack-operations", testContext) {
+		RuntimeScopeManager * scopeManager = new RuntimeScopeManager();
+		RuntimeScope & verifiedScope = scopeManager->CreateNewScope();
+		RuntimeScope & uncheckedScope = scopeManager->CreateNewScope();
+
+		DynamicBuffer code;
+		AssemblyWriter()
+			.PushI4C(code, 10)
+			.PushI4C(code, 1)
+			.Swap(code, ValueType::i4)
+			.Dup(code, ValueType::i4)
+			.AddI4(code)
+			.PushI4C(code, 3)
+			.Pick(code, ValueType::i4, 8)
+			.AddI4(code)
+			.AddI4(code)
+			.Swap(code, ValueType::i4)
+			.DropN(code, 4);
+		verifiedScope.SetCodeBuffer(code);
+		uncheckedScope.SetCodeBuffer(code);
+
+		ScopeVerifier(* scopeManager).Verify(verifiedScope);
+		testContext.Accept(!verifiedScope.SetsFrameRegisters());
+		testContext.Accept(verifiedScope.GetSignature().GetResults() == vector<ValueType>(1, ValueType::i4));
+
+		// Scopes which weren't verified get the same results, checking every access.
+		RuntimeContext * context = CreateContext(scopeManager, verifiedScope);
+		context->Run();
+		testContext.Accept(context->GetRuntimeStack().Pop<int32_t>() == 24);
+		context->Reset(uncheckedScope.GetId());
+		context->Run();
+		testContext.Accept(!uncheckedScope.IsVerified() && context->GetRuntimeStack().Pop<int32_t>() == 24);
+
+		delete context;
+	}
+
+	TEST_METHOD("verification", testContext) {
+		RuntimeScopeManager scopeManager;
+
+		// sp0 isn't set by the scope.
+		DynamicBuffer unsetCode;
+		AssemblyWriter()
+			.PushI4C(unsetCode, 1)
+			.LdI4S(unsetCode, Register::sp0, -4);
+		testContext.Accept(FailsVerification(scopeManager, unsetCode));
+
+		DynamicBuffer typeCode;
+		AssemblyWriter()
+			.PushI4C(typeCode, 1)
+			.SetSpR(typeCode, Register::sp1)
+			.LdI8S(typeCode, Register::sp1, -4);
+		testContext.Accept(FailsVerification(scopeManager, typeCode));
+
+		// The offset is above the top of the stack.
+		DynamicBuffer boundsCode;
+		AssemblyWriter()
+			.PushI4C(boundsCode, 1)
+			.SetSpR(boundsCode, Register::sp0)
+			.PushI4C(boundsCode, 2)
+			.StI4S(boundsCode, Register::sp0, 0);
+		testContext.Accept(FailsVerification(scopeManager, boundsCode));
+
+		DynamicBuffer registerCode;
+		AssemblyWriter()
+			.SetSpR(registerCode, Register::r0);
+		testContext.Accept(FailsVerification(scopeManager, registerCode));
+
+		DynamicBuffer dropCode;
+		AssemblyWriter()
+			.PushI4C(dropCode, 1)
+			.DropN(dropCode, 2);
+		testContext.Accept(FailsVerification(scopeManager, dropCode));
+
+		DynamicBuffer pickCode;
+		AssemblyWriter()
+			.PushI4C(pickCode, 1)
+			.Pick(pickCode, ValueType::i4, 4);
+		testContext.Accept(FailsVerification(scopeManager, pickCode));
+	}
+
+	TEST_METHOD("checked-access", testContext) {
+		RuntimeScopeManager * scopeManager = new RuntimeScopeManager();
+		RuntimeScope & scope = scopeManager->CreateNewScope();
+
+		// Without verification, the access out of the stack is caught when it runs.
+		DynamicBuffer code;
+		AssemblyWriter()
+			.PushI4C(code, 1)
+			.SetSpR(code, Register::sp0)
+			.LdI4S(code, Register::sp0, 0);
+		scope.SetCodeBuffer(move(code));
+
+		RuntimeContext * context = CreateContext(scopeManager, scope);
+		try {
+			context->Run();
+			testContext.Fail();
+		} catch (const RuntimeException &) {
+			testContext.Accept();
+		}
+
+		delete context;
+	}
+END_TEST_UNIT
\ No newline at end of file
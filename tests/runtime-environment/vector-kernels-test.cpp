@@ -0,0 +1,158 @@
+//
+// vector-kernels-test.cpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#include "runtime-environment\vector-kernels.hpp"
+#include "runtime-environment\runtime-context.hpp"
+#include "runtime-environment\scope-verifier.hpp"
+
+#include <n-test\test-unit.hpp>
+
+#include <cstdint>
+#include <cstring>
+
+using namespace Nova;
+using namespace std;
+
+TEST_UNIT("runtime-environment\\vector-kernels")
+	TEST_METHOD("simd-matches-scalar", testContext) {
+		const Internal::VectorKernelTable & simd = Internal::GetVectorKernels();
+		Internal::VectorKernelTable scalar = Internal::CreateVectorKernelTable(false);
+
+		int32_t integers[2][8] = {
+			{ 1, -7, 2147483647, 5, -100, 0, 42, 9 },
+			{ 1, 3, 1, -5, 100, -2147483647, 41, 10 }
+		};
+		float floats[2][8] = {
+			{ 1.5f, -2.0f, 3.0f, 0.0f, 8.25f, -1.0f, 7.0f, 2.0f },
+			{ 1.5f, 4.0f, -3.0f, 0.5f, 8.0f, -1.5f, 7.0f, 3.0f }
+		};
+		double doubles[2][4] = {
+			{ 1.5, -2.0, 3.0, 0.25 },
+			{ 2.5, -2.0, -3.0, 0.5 }
+		};
+
+		bool matches = true;
+		for (size_t type = 0; type < Internal::VectorTypeCount; ++type) {
+			ValueType valueType = static_cast<ValueType>(static_cast<size_t>(ValueType::v4i4) + type);
+			const void * a, * b;
+			switch (GetVectorLaneType(valueType)) {
+			case ValueType::i4: a = integers[0]; b = integers[1]; break;
+			case ValueType::fs: a = floats[0]; b = floats[1]; break;
+			default: a = doubles[0]; b = doubles[1]; break;
+			}
+
+			int8_t expected[32], actual[32];
+			size_t size = GetValueTypeSize(valueType);
+			for (size_t operation = 0; operation < Internal::VectorBinaryOperationCount; ++operation) {
+				scalar.Binary[operation][type](expected, a, b);
+				simd.Binary[operation][type](actual, a, b);
+				matches = matches && memcmp(expected, actual, size) == 0;
+			}
+
+			int8_t mask[32];
+			scalar.Binary[Internal::VectorCompareLess][type](mask, a, b);
+			scalar.Blend[type](expected, a, b, mask);
+			simd.Blend[type](actual, a, b, mask);
+			matches = matches && memcmp(expected, actual, size) == 0;
+		}
+		testContext.Accept(matches);
+
+		v4i4_t sum;
+		scalar.Binary[Internal::VectorAdd][Internal::GetVectorTypeIndex(ValueType::v4i4)](&sum, integers[0], integers[1]);
+		testContext.Accept(sum.Lanes[0] == 2 && sum.Lanes[1] == -4 && sum.Lanes[2] == INT32_MIN && sum.Lanes[3] == 0);
+	}
+
+	TEST_METHOD("instructions", testContext) {
+		float weights[8] = { 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f, 8.0f };
+		float features[8] = { 0.5f, 0.5f, 0.5f, 0.5f, 1.0f, 1.0f, -1.0f, 1.0f };
+		float clamped[4] = { 0.0f };
+
+		RuntimeScopeManager * scopeManager = new RuntimeScopeManager();
+		RuntimeScope & scope = scopeManager->CreateNewScope();
+
+		// Dot product of two views, plus max(features[4..7], 0) stored back in a third view.
+		const uint8_t reverse[] = { 3, 2, 1, 0 };
+		DynamicBuffer code;
+		AssemblyWriter()
+			.PushI4C(code, 0)
+			.LdxVM(code, ValueType::v8fs, Register::m0)
+			.PushI4C(code, 0)
+			.LdxVM(code, ValueType::v8fs, Register::m1)
+			.MulV(code, ValueType::v8fs)
+			.HAddV(code, ValueType::v8fs)
+			.PushI4C(code, 0)
+			.PushI4C(code, 4)
+			.LdxVM(code, ValueType::v4fs, Register::m1)
+			.SetVR(code, ValueType::v4fs, Register::v2)
+			.PushI4C(code, 0)
+			.Alloc(code, Register::m3)
+			.PushVR(code, ValueType::v4fs, Register::v2)
+			.PushVR(code, ValueType::v4fs, Register::v2)
+			.PushVR(code, ValueType::v4fs, Register::v2)
+			.SubV(code, ValueType::v4fs)
+			.MaxV(code, ValueType::v4fs)
+			.ShuffleV(code, ValueType::v4fs, reverse)
+			.SetVR(code, ValueType::v4fs, Register::v3)
+			.PushVR(code, ValueType::v4fs, Register::v3)
+			.StxVM(code, ValueType::v4fs, Register::m2);
+		scope.SetCodeBuffer(move(code));
+		ScopeVerifier(* scopeManager).Verify(scope);
+
+		RuntimeContext * context = RuntimeContextBuilder()
+			.SetRegisterSet(new RegisterSet())
+			.SetRuntimeStack(new RuntimeFixedStack(256))
+			.SetRuntimeScopeManager(scopeManager)
+			.SetStartScope(scope.GetId())
+			.Build();
+		context->Reset(scope.GetId());
+		context->GetRegisterSet().SetMRegister(Register::m0, context->RegisterHostView(static_cast<const void *>(weights), 8, ValueType::fs));
+		context->GetRegisterSet().SetMRegister(Register::m1, context->RegisterHostView(static_cast<const void *>(features), 8, ValueType::fs));
+		context->GetRegisterSet().SetMRegister(Register::m2, context->RegisterHostView(clamped, 4, ValueType::fs, HostViewAccess::ReadWrite));
+		context->Run();
+
+		testContext.Accept(context->GetRuntimeStack().Pop<float>() == 0.5f * 10.0f + 5.0f + 6.0f - 7.0f + 8.0f);
+		testContext.Accept(clamped[0] == 1.0f && clamped[1] == 0.0f && clamped[2] == 1.0f && clamped[3] == 1.0f);
+		testContext.Accept(context->GetRegisterSet().GetVRegister<v4fs_t>(Register::v3).Lanes[1] == 0.0f);
+
+		delete context;
+	}
+
+	TEST_METHOD("verification", testContext) {
+		RuntimeScopeManager scopeManager;
+		RuntimeScope & scalarScope = scopeManager.CreateNewScope();
+		RuntimeScope & mismatchScope = scopeManager.CreateNewScope();
+
+		DynamicBuffer scalarCode;
+		AssemblyWriter()
+			.PushI4C(scalarCode, 1)
+			.PushI4C(scalarCode, 1)
+			.AddV(scalarCode, ValueType::i4);
+		scalarScope.SetCodeBuffer(move(scalarCode));
+
+		DynamicBuffer mismatchCode;
+		AssemblyWriter()
+			.PushI4C(mismatchCode, 1)
+			.SplatV(mismatchCode, ValueType::v4i4)
+			.HAddV(mismatchCode, ValueType::v8i4);
+		mismatchScope.SetCodeBuffer(move(mismatchCode));
+
+		ScopeVerifier verifier(scopeManager);
+		try {
+			verifier.Verify(scalarScope);
+			testContext.Fail();
+		} catch (const VerificationException &) {
+			testContext.Accept();
+		}
+
+		try {
+			verifier.Verify(mismatchScope);
+			testContext.Fail();
+		} catch (const VerificationException &) {
+			testContext.Accept();
+		}
+	}
+END_TEST_UNIT
\ No newline at end of file
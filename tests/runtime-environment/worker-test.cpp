@@ -0,0 +1,259 @@
+//
+// worker-test.cpp
+//
+// Copyright (c) 2013 Luis Garcia.
+// This source file is subject to terms of the MIT License. (See accompanying file LICENSE)
+//
+
+#include "runtime-environment\worker.hpp"
+#include "common\shared-memory.hpp"
+
+#include <n-test\test-unit.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <thread>
+#include <limits>
+
+using namespace Nova;
+using namespace std;
+
+namespace {
+	string GetRegionName(
+		const void * owner
+		) {
+			return "n-engine-worker-" + to_string(static_cast<unsigned long long>(reinterpret_cast<size_t>(owner)));
+		}
+
+	ScopeSignature CreateSignature(
+		size_t parameterCount, size_t resultCount
+		) {
+			return ScopeSignature(vector<ValueType>(parameterCount, ValueType::i4), vector<ValueType>(resultCount, ValueType::i4));
+		}
+
+	/// <summary>
+	/// Declares the external scopes shared by the host and the worker program: scale, which returns
+	/// its parameter times ten, and log, which is deferred.
+	/// </summary>
+	void DeclareExternalScopes(
+		RuntimeScopeManager & scopeManager
+		) {
+			scopeManager.CreateExternalScope().SetSignature(CreateSignature(1, 1));
+			ExternalScope & logScope = scopeManager.CreateExternalScope();
+			logScope.SetSignature(CreateSignature(2, 0));
+			logScope.SetBatchCallbackFunction([] (const ExternalCallBatch &) {});
+		}
+
+	/// <summary>
+	/// Runs the worker program until the host stops it, as a worker process would.
+	/// </summary>
+	void RunWorker(
+		const string & regionName
+		) {
+			RuntimeScopeManager * scopeManager = new RuntimeScopeManager();
+			DeclareExternalScopes(* scopeManager);
+			scoperef_t scaleScope = scopeManager->GetExternalScope(reinterpret_cast<scoperef_t>(0)).GetId();
+			scoperef_t logScope = scopeManager->GetExternalScope(reinterpret_cast<scoperef_t>(1)).GetId();
+
+			// The first scope scales its parameter, adds the int32 at the start of the input and writes
+			// the sum to the output. The second one traps.
+			RuntimeScope & scope = scopeManager->CreateNewScope();
+			DynamicBuffer code;
+			AssemblyWriter()
+				.XCall(code, scaleScope)
+				.LdI4M(code, Register::m0, 0)
+				.AddI4(code)
+				.Dup(code, ValueType::i4)
+				.StI4M(code, Register::m1, 0)
+				.PushI4C(code, 1)
+				.PushI4C(code, 2)
+				.XCall(code, logScope);
+			scope.SetCodeBuffer(move(code));
+
+			RuntimeScope & trapScope = scopeManager->CreateNewScope();
+			DynamicBuffer trapCode;
+			AssemblyWriter()
+				.AddI4(trapCode);
+			trapScope.SetCodeBuffer(move(trapCode));
+
+			SharedMemory region(regionName);
+			RuntimeContext * context = RuntimeContextBuilder()
+				.SetRegisterSet(new RegisterSet())
+				.SetRuntimeStack(new RuntimeFixedStack(128))
+				.SetRuntimeScopeManager(scopeManager)
+				.SetStartScope(scope.GetId())
+				.Build();
+			Worker worker(region.GetPointer(), region.GetSize(), * context);
+			worker.Serve();
+			delete context;
+		}
+}
+
+TEST_UNIT("runtime-environment\\worker")
+	TEST_METHOD("ring", testContext) {
+		vector<int64_t> memory(Internal::SharedRing::GetRequiredSize(64) / sizeof(int64_t));
+		Internal::SharedRing writer(&memory[0], 64, true);
+		Internal::SharedRing reader(&memory[0], 64, false);
+		int32_t values[] = { 1, 2, 3, 4, 5, 6 };
+		uint32_t kind;
+		DynamicBuffer message;
+
+		// A record of 24 bytes takes 32 bytes of the ring, so a third message doesn't fit yet.
+		testContext.Accept(writer.GetMaxMessageSize() == 24 && !reader.TryRead(kind, message));
+		testContext.Accept(writer.TryWrite(1, values, 24) && writer.TryWrite(2, values, 4) && !writer.TryWrite(3, values, 24));
+		testContext.Accept(reader.TryRead(kind, message) && kind == 1 && message.GetSize() == 24);
+
+		// The next record doesn't fit before the end of the ring, so it starts over at the beginning.
+		testContext.Accept(writer.TryWrite(3, values, 8, values + 2, 16));
+		testContext.Accept(reader.TryRead(kind, message) && kind == 2 && message.GetSize() == 4);
+		testContext.Accept(reader.TryRead(kind, message) && kind == 3 && memcmp(message.GetPointer(), values, 24) == 0);
+		testContext.Accept(!reader.TryRead(kind, message));
+
+		try {
+			writer.TryWrite(5, values, 25);
+			testContext.Fail();
+		} catch (const InvalidArgumentException &) {
+			testContext.Accept();
+		}
+	}
+
+	TEST_METHOD("runs", testContext) {
+		RuntimeScopeManager hostScopeManager;
+		DeclareExternalScopes(hostScopeManager);
+		hostScopeManager.GetExternalScope(reinterpret_cast<scoperef_t>(0)).SetCallbackFunction(
+			[] (RuntimeFixedStack & stack) {
+				stack.Push<int32_t>(stack.Pop<int32_t>() * 10);
+			});
+		vector<int32_t> logs;
+		hostScopeManager.GetExternalScope(reinterpret_cast<scoperef_t>(1)).SetBatchCallbackFunction(
+			[&logs] (const ExternalCallBatch & batch) {
+				for (size_t i = 0; i < batch.GetCallCount(); ++i)
+					logs.push_back(batch.GetArgument<int32_t>(i, 0) + batch.GetArgument<int32_t>(i, sizeof(int32_t)));
+			});
+
+		size_t regionSize = WorkerHost::GetRegionSize(1024, 64, 64);
+		SharedMemory region(GetRegionName(&hostScopeManager), regionSize);
+		WorkerHost host(region.GetPointer(), region.GetSize(), hostScopeManager, 1024, 64, 64);
+		thread worker(RunWorker, region.GetName());
+
+		// The worker reads the input and writes the output in place, and calls the host back.
+		int32_t input = 5, argument = 3;
+		memcpy(host.GetInput(), &input, sizeof input);
+		DynamicBuffer results;
+		host.Run(reinterpret_cast<scoperef_t>(0), &argument, sizeof argument, results);
+		testContext.Accept(results.GetSize() == sizeof(int32_t) && results.Load<int32_t>(0) == 35);
+		testContext.Accept(memcmp(host.GetOutput(), results.GetPointer(), sizeof(int32_t)) == 0 && logs.size() == 1 && logs[0] == 3);
+
+		// The program stays loaded in the worker between runs.
+		argument = 4;
+		host.Run(reinterpret_cast<scoperef_t>(0), &argument, sizeof argument, results);
+		testContext.Accept(results.Load<int32_t>(0) == 45 && logs.size() == 2);
+
+		host.Stop();
+		worker.join();
+	}
+
+	TEST_METHOD("errors", testContext) {
+		RuntimeScopeManager hostScopeManager;
+		DeclareExternalScopes(hostScopeManager);
+		hostScopeManager.GetExternalScope(reinterpret_cast<scoperef_t>(0)).SetCallbackFunction(
+			[] (RuntimeFixedStack & stack) {
+				if (stack.Pop<int32_t>() < 0)
+					throw InvalidArgumentException("The value can't be negative.");
+				stack.Push<int32_t>(0);
+			});
+
+		size_t regionSize = WorkerHost::GetRegionSize(1024, 64, 64);
+		SharedMemory region(GetRegionName(&hostScopeManager), regionSize);
+		RuntimeContext * context = RuntimeContextBuilder()
+			.SetRegisterSet(new RegisterSet())
+			.SetRuntimeStack(new RuntimeFixedStack(128))
+			.SetRuntimeScopeManager(new RuntimeScopeManager())
+			.Build();
+		try {
+			Worker(region.GetPointer(), region.GetSize(), * context);
+			testContext.Fail();
+		} catch (const InvalidArgumentException &) {
+		}
+		delete context;
+
+		WorkerHost host(region.GetPointer(), region.GetSize(), hostScopeManager, 1024, 64, 64);
+		thread worker(RunWorker, region.GetName());
+		DynamicBuffer results;
+		try {
+			host.Run(reinterpret_cast<scoperef_t>(1), nullptr, 0, results);
+			testContext.Fail();
+		} catch (const WorkerException &) {
+		}
+
+		// Errors of the host are thrown as they were, and the worker goes on.
+		int32_t argument = -1;
+		try {
+			host.Run(reinterpret_cast<scoperef_t>(0), &argument, sizeof argument, results);
+			testContext.Fail();
+		} catch (const InvalidArgumentException & e) {
+			testContext.Accept(e.GetMessage() == "The value can't be negative.");
+		}
+		argument = 1;
+		host.Run(reinterpret_cast<scoperef_t>(0), &argument, sizeof argument, results);
+		testContext.Accept(results.GetSize() == sizeof(int32_t));
+		host.Stop();
+		worker.join();
+
+		// Without a worker, the host gives up after the timeout.
+		host.SetTimeout(chrono::milliseconds(20));
+		try {
+			host.Run(reinterpret_cast<scoperef_t>(0), &argument, sizeof argument, results);
+			testContext.Fail();
+		} catch (const WorkerException &) {
+			testContext.Accept();
+		}
+	}
+	TEST_METHOD("batches", testContext) {
+		RuntimeScopeManager hostScopeManager;
+		DeclareExternalScopes(hostScopeManager);
+		size_t callCount = 0;
+		hostScopeManager.GetExternalScope(reinterpret_cast<scoperef_t>(1)).SetBatchCallbackFunction(
+			[&callCount] (const ExternalCallBatch & batch) {
+				callCount += batch.GetCallCount();
+			});
+
+		size_t regionSize = WorkerHost::GetRegionSize(1024, 64, 64);
+		SharedMemory region(GetRegionName(&hostScopeManager), regionSize);
+		WorkerHost host(region.GetPointer(), region.GetSize(), hostScopeManager, 1024, 64, 64);
+
+		// The worker sends a batch of log calls whose count times the size of the parameters wraps
+		// around to the size of the arguments sent.
+		thread worker([&region] {
+			Internal::WorkerRegionLayout layout(1024, 64, 64);
+			int8_t * memory = static_cast<int8_t *>(region.GetPointer());
+			Internal::SharedRing requests(memory + layout.RequestRingOffset, 1024, false);
+			Internal::SharedRing responses(memory + layout.ResponseRingOffset, 1024, false);
+			uint32_t kind;
+			DynamicBuffer message;
+			while (!requests.TryRead(kind, message))
+				this_thread::yield();
+
+			Internal::WorkerBatchMessage header;
+			header.Scope = 1;
+			header.CallCount = numeric_limits<uint64_t>::max() / 8 + 2;
+			int32_t arguments[2] = { 1, 2 };
+			while (!responses.TryWrite(static_cast<uint32_t>(Internal::WorkerMessage::Batch), &header, sizeof header,
+				arguments, sizeof arguments))
+					this_thread::yield();
+			while (!responses.TryWrite(static_cast<uint32_t>(Internal::WorkerMessage::Results), nullptr, 0, nullptr, 0))
+				this_thread::yield();
+		});
+
+		DynamicBuffer results;
+		try {
+			host.Run(reinterpret_cast<scoperef_t>(0), nullptr, 0, results);
+			testContext.Fail();
+		} catch (const WorkerException &) {
+			testContext.Accept();
+		}
+		worker.join();
+		testContext.Accept(callCount == 0);
+	}
+END_TEST_UNIT
\ No newline at end of file